@@ -3,11 +3,21 @@
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Pipeline features, ids match the bits of renderer_pipeline_feature
+layout(constant_id = 0) const bool TEXTURED = false;
+layout(constant_id = 1) const bool ALPHA_TEST = false;
+
 layout(location = 0) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    //outColor = texture(texSampler, fragTexCoord);
-    outColor = vec4(fragTexCoord, 0.0, 1.0);
+    vec4 color = TEXTURED ?
+        texture(texSampler, fragTexCoord) :
+        vec4(fragTexCoord, 0.0, 1.0);
+
+    if (ALPHA_TEST && color.a < 0.5)
+        discard;
+
+    outColor = color;
 }
@@ -0,0 +1,391 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "util.h"
+
+#define ARCHIVE_MIN_MATCH 4
+#define ARCHIVE_HASH_BITS 16
+#define ARCHIVE_MAX_OFFSET 65535
+
+// The LZ4 block format ends every block with at least five literals and
+// starts no match within the last twelve bytes
+#define ARCHIVE_LAST_LITERALS 5
+#define ARCHIVE_MATCH_LIMIT 12
+
+bool archive_open(struct archive* archive, const char* path)
+{
+    memset(archive, 0, sizeof(*archive));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 ||
+        file_stat.st_size < (off_t)sizeof(struct archive_header)) {
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    // Level loads read most of the archive front to back, let the kernel
+    // start reading ahead right away
+    madvise(base, file_stat.st_size, MADV_SEQUENTIAL);
+    madvise(base, file_stat.st_size, MADV_WILLNEED);
+
+    archive->base = base;
+    archive->size = file_stat.st_size;
+    archive->header = base;
+
+    const struct archive_header* header = archive->header;
+    uint64_t toc_size = (uint64_t)header->entry_count *
+        sizeof(struct archive_entry);
+
+    if (header->magic != ARCHIVE_MAGIC ||
+        header->version != ARCHIVE_VERSION ||
+        header->toc_offset > archive->size ||
+        toc_size > archive->size - header->toc_offset ||
+        header->names_offset > archive->size ||
+        header->names_size > archive->size - header->names_offset) {
+        archive_close(archive);
+        return false;
+    }
+
+    archive->entries = (const struct archive_entry*)
+        (archive->base + header->toc_offset);
+    archive->names = (const char*)(archive->base + header->names_offset);
+
+    return true;
+}
+
+void archive_close(struct archive* archive)
+{
+    if (archive->base)
+        munmap((void*)archive->base, archive->size);
+
+    memset(archive, 0, sizeof(*archive));
+}
+
+const struct archive_entry* archive_find(
+        struct archive* archive,
+        const char* path)
+{
+    uint64_t hash = util_hash(path, strlen(path), UTIL_FNV1A_SEED);
+
+    // Lower bound on the sorted hashes, then check names for collisions
+    uint32_t low = 0;
+    uint32_t high = archive->header->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (archive->entries[middle].path_hash < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for (; low<archive->header->entry_count; low++) {
+        const struct archive_entry* entry = &archive->entries[low];
+        if (entry->path_hash != hash)
+            break;
+
+        if (entry->name_offset < archive->header->names_size &&
+            strncmp(
+                archive->names + entry->name_offset,
+                path,
+                archive->header->names_size - entry->name_offset
+            ) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+bool archive_read(
+        struct archive* archive,
+        const struct archive_entry* entry,
+        struct archive_data* data)
+{
+    memset(data, 0, sizeof(*data));
+
+    if (entry->offset > archive->size ||
+        entry->stored_size > archive->size - entry->offset) {
+        return false;
+    }
+
+    const uint8_t* stored = archive->base + entry->offset;
+
+    // Stored entries are handed out straight from the mapping
+    if (entry->compression == ARCHIVE_COMPRESSION_NONE) {
+        data->data = stored;
+        data->size = entry->stored_size;
+        return true;
+    }
+
+    if (entry->compression != ARCHIVE_COMPRESSION_LZ4)
+        return false;
+
+    uint8_t* decompressed = malloc(entry->size > 0 ? entry->size : 1);
+    assert(decompressed);
+
+    if (!archive_decompress(stored, entry->stored_size, decompressed, entry->size)) {
+        free(decompressed);
+        return false;
+    }
+
+    data->data = decompressed;
+    data->size = entry->size;
+    data->allocation = decompressed;
+
+    return true;
+}
+
+bool archive_read_asset(
+        struct archive* archive,
+        const char* path,
+        struct archive_data* data)
+{
+    if (archive && archive->base) {
+        const struct archive_entry* entry = archive_find(archive, path);
+        if (entry)
+            return archive_read(archive, entry, data);
+    }
+
+    memset(data, 0, sizeof(*data));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Nothing to map, but still a successful read
+    if (file_stat.st_size == 0) {
+        close(fd);
+        data->data = (const uint8_t*)"";
+        return true;
+    }
+
+    void* mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    // Loose assets are consumed whole, front to back
+    madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+    madvise(mapping, file_stat.st_size, MADV_WILLNEED);
+
+    data->data = mapping;
+    data->size = file_stat.st_size;
+    data->mapping = mapping;
+    data->mapping_size = file_stat.st_size;
+
+    return true;
+}
+
+void archive_data_free(struct archive_data* data)
+{
+    free(data->allocation);
+    if (data->mapping)
+        munmap(data->mapping, data->mapping_size);
+    memset(data, 0, sizeof(*data));
+}
+
+size_t archive_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+static uint32_t archive_read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+
+    return value;
+}
+
+static uint32_t archive_hash_sequence(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - ARCHIVE_HASH_BITS);
+}
+
+// Lengths of 15 and over spill into extra bytes of 255 plus a remainder
+static uint8_t* archive_write_length(uint8_t* op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+
+    return op;
+}
+
+size_t archive_compress(
+        const uint8_t* src,
+        size_t src_size,
+        uint8_t* dst,
+        size_t dst_capacity)
+{
+    assert(dst_capacity >= archive_compress_bound(src_size));
+    (void)dst_capacity;
+
+    uint32_t* table = calloc(1 << ARCHIVE_HASH_BITS, sizeof(uint32_t));
+    assert(table);
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + src_size;
+    uint8_t* op = dst;
+
+    // Greedy parse, positions are stored plus one so zero means empty
+    if (src_size > ARCHIVE_MATCH_LIMIT) {
+        const uint8_t* match_limit = end - ARCHIVE_MATCH_LIMIT;
+        const uint8_t* extend_limit = end - ARCHIVE_LAST_LITERALS;
+
+        while (ip < match_limit) {
+            uint32_t sequence = archive_read32(ip);
+            uint32_t hash = archive_hash_sequence(sequence);
+            uint32_t candidate = table[hash];
+            table[hash] = (uint32_t)(ip - src) + 1;
+
+            const uint8_t* ref = src + candidate - 1;
+            if (candidate == 0 ||
+                ip - ref > ARCHIVE_MAX_OFFSET ||
+                archive_read32(ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t* match_end = ip + ARCHIVE_MIN_MATCH;
+            ref += ARCHIVE_MIN_MATCH;
+            while (match_end < extend_limit && *match_end == *ref) {
+                match_end++;
+                ref++;
+            }
+
+            size_t literal_length = ip - anchor;
+            size_t match_length = match_end - ip - ARCHIVE_MIN_MATCH;
+            uint16_t offset = (uint16_t)(match_end - ref);
+
+            uint8_t* token = op++;
+            *token = (uint8_t)(
+                (literal_length >= 15 ? 15 : literal_length) << 4 |
+                (match_length >= 15 ? 15 : match_length)
+            );
+
+            if (literal_length >= 15)
+                op = archive_write_length(op, literal_length - 15);
+            memcpy(op, anchor, literal_length);
+            op += literal_length;
+
+            *op++ = offset & 0xff;
+            *op++ = offset >> 8;
+
+            if (match_length >= 15)
+                op = archive_write_length(op, match_length - 15);
+
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+
+    // Trailing literals, a sequence without a match
+    size_t literal_length = end - anchor;
+    *op++ = (uint8_t)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15)
+        op = archive_write_length(op, literal_length - 15);
+    memcpy(op, anchor, literal_length);
+    op += literal_length;
+
+    free(table);
+
+    return op - dst;
+}
+
+bool archive_decompress(
+        const uint8_t* src,
+        size_t src_size,
+        uint8_t* dst,
+        size_t dst_size)
+{
+    const uint8_t* ip = src;
+    const uint8_t* src_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* dst_end = dst + dst_size;
+
+    while (ip < src_end) {
+        uint8_t token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= src_end)
+                    return false;
+                extra = *ip++;
+                literal_length += extra;
+            } while (extra == 255);
+        }
+
+        if (literal_length > (size_t)(src_end - ip) ||
+            literal_length > (size_t)(dst_end - op)) {
+            return false;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence has no match
+        if (ip == src_end)
+            break;
+
+        if (src_end - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        size_t match_length = (token & 15) + ARCHIVE_MIN_MATCH;
+        if ((token & 15) == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= src_end)
+                    return false;
+                extra = *ip++;
+                match_length += extra;
+            } while (extra == 255);
+        }
+
+        if (offset == 0 ||
+            offset > (size_t)(op - dst) ||
+            match_length > (size_t)(dst_end - op)) {
+            return false;
+        }
+
+        // Byte by byte, matches may overlap their own output
+        const uint8_t* ref = op - offset;
+        size_t i;
+        for (i=0; i<match_length; i++)
+            op[i] = ref[i];
+        op += match_length;
+    }
+
+    return op == dst_end;
+}
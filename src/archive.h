@@ -0,0 +1,106 @@
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// "CPAK" little endian. The file is the header, entry data aligned to
+// ARCHIVE_ALIGNMENT, then the table of contents sorted by path hash and
+// finally the NUL terminated paths
+#define ARCHIVE_MAGIC 0x4b415043
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_ALIGNMENT 64
+
+enum archive_compression
+{
+    ARCHIVE_COMPRESSION_NONE,
+    ARCHIVE_COMPRESSION_LZ4
+};
+
+struct archive_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+    uint64_t toc_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct archive_entry
+{
+    uint64_t path_hash;
+    uint64_t offset;
+    uint64_t stored_size;
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t compression;
+};
+
+// Memory mapped archive, entries point straight into the mapping
+struct archive
+{
+    const uint8_t* base;
+    size_t size;
+    const struct archive_header* header;
+    const struct archive_entry* entries;
+    const char* names;
+};
+
+// Asset bytes, either inside the archive's mapping, a loose file's own
+// mapping or a decompressed allocation
+struct archive_data
+{
+    const uint8_t* data;
+    uint64_t size;
+    void* allocation;
+    void* mapping;
+    size_t mapping_size;
+};
+
+bool archive_open(struct archive* archive, const char* path);
+
+void archive_close(struct archive* archive);
+
+const struct archive_entry* archive_find(
+    struct archive* archive,
+    const char* path
+);
+
+bool archive_read(
+    struct archive* archive,
+    const struct archive_entry* entry,
+    struct archive_data* data
+);
+
+// Reads path from the archive, or maps a loose file when the archive is
+// NULL or doesn't contain it
+bool archive_read_asset(
+    struct archive* archive,
+    const char* path,
+    struct archive_data* data
+);
+
+void archive_data_free(struct archive_data* data);
+
+size_t archive_compress_bound(size_t size);
+
+// LZ4 block format, returns the compressed size
+size_t archive_compress(
+    const uint8_t* src,
+    size_t src_size,
+    uint8_t* dst,
+    size_t dst_capacity
+);
+
+// Returns false on malformed input or if the output isn't exactly dst_size
+bool archive_decompress(
+    const uint8_t* src,
+    size_t src_size,
+    uint8_t* dst,
+    size_t dst_size
+);
+
+#endif
@@ -0,0 +1,280 @@
+#include <string.h>
+#include <math.h>
+
+#include "bcn.h"
+
+static uint16_t bcn_pack_565(const float* color)
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+
+    r = r < 0 ? 0 : (r > 31 ? 31 : r);
+    g = g < 0 ? 0 : (g > 63 ? 63 : g);
+    b = b < 0 ? 0 : (b > 31 ? 31 : b);
+
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void bcn_unpack_565(uint16_t packed, int* color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the nearest of the four palette entries for every texel
+static uint32_t bcn_bc1_indices(
+        const uint8_t* rgba,
+        uint16_t c0,
+        uint16_t c1)
+{
+    int palette[4][3];
+    bcn_unpack_565(c0, palette[0]);
+    bcn_unpack_565(c1, palette[1]);
+
+    int j;
+    for (j=0; j<3; j++) {
+        palette[2][j] = (2*palette[0][j] + palette[1][j]) / 3;
+        palette[3][j] = (palette[0][j] + 2*palette[1][j]) / 3;
+    }
+
+    uint32_t indices = 0;
+    int i, k;
+    for (i=0; i<16; i++) {
+        const uint8_t* texel = &rgba[i*4];
+        int best = 0;
+        int best_distance = 1 << 30;
+        for (k=0; k<4; k++) {
+            int dr = texel[0] - palette[k][0];
+            int dg = texel[1] - palette[k][1];
+            int db = texel[2] - palette[k][2];
+            int distance = dr*dr + dg*dg + db*db;
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = k;
+            }
+        }
+        indices |= (uint32_t)best << (i*2);
+    }
+
+    return indices;
+}
+
+// Least squares endpoints for a fixed index assignment, returns 0 when the
+// system is singular and the previous endpoints should be kept
+static int bcn_bc1_refit(
+        const uint8_t* rgba,
+        uint32_t indices,
+        float* end0,
+        float* end1)
+{
+    static const float weights[4] = {1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f};
+
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f};
+    float bx[3] = {0.0f, 0.0f, 0.0f};
+
+    int i, j;
+    for (i=0; i<16; i++) {
+        float a = weights[(indices >> (i*2)) & 3];
+        float b = 1.0f - a;
+        aa += a*a;
+        bb += b*b;
+        ab += a*b;
+        for (j=0; j<3; j++) {
+            ax[j] += a * rgba[i*4 + j];
+            bx[j] += b * rgba[i*4 + j];
+        }
+    }
+
+    float determinant = aa*bb - ab*ab;
+    if (fabsf(determinant) < 1e-6f)
+        return 0;
+
+    for (j=0; j<3; j++) {
+        end0[j] = (ax[j]*bb - bx[j]*ab) / determinant;
+        end1[j] = (bx[j]*aa - ax[j]*ab) / determinant;
+    }
+
+    return 1;
+}
+
+static void bcn_write_bc1(
+        uint8_t* block,
+        uint16_t c0,
+        uint16_t c1,
+        uint32_t indices)
+{
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+    block[4] = indices & 0xff;
+    block[5] = (indices >> 8) & 0xff;
+    block[6] = (indices >> 16) & 0xff;
+    block[7] = indices >> 24;
+}
+
+// Packs endpoints so c0 > c1, which selects the four colour mode, and
+// remaps the indices if the endpoints had to be swapped
+static void bcn_bc1_finish(
+        const uint8_t* rgba,
+        const float* end0,
+        const float* end1,
+        uint16_t* c0,
+        uint16_t* c1,
+        uint32_t* indices)
+{
+    *c0 = bcn_pack_565(end0);
+    *c1 = bcn_pack_565(end1);
+    if (*c0 < *c1) {
+        uint16_t swap = *c0;
+        *c0 = *c1;
+        *c1 = swap;
+    }
+
+    // Both endpoints collapsed to one colour, every texel uses the first
+    if (*c0 == *c1) {
+        *indices = 0;
+        return;
+    }
+
+    *indices = bcn_bc1_indices(rgba, *c0, *c1);
+}
+
+void bcn_encode_bc1(const uint8_t* rgba, uint8_t* block)
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    int i, j, k;
+    for (i=0; i<16; i++) {
+        for (j=0; j<3; j++)
+            mean[j] += rgba[i*4 + j] / 16.0f;
+    }
+
+    float covariance[3][3];
+    memset(covariance, 0, sizeof(covariance));
+    for (i=0; i<16; i++) {
+        float d[3];
+        for (j=0; j<3; j++)
+            d[j] = rgba[i*4 + j] - mean[j];
+        for (j=0; j<3; j++) {
+            for (k=0; k<3; k++)
+                covariance[j][k] += d[j] * d[k];
+        }
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (i=0; i<8; i++) {
+        float next[3];
+        for (j=0; j<3; j++) {
+            next[j] = covariance[j][0]*axis[0] +
+                covariance[j][1]*axis[1] +
+                covariance[j][2]*axis[2];
+        }
+        float length = sqrtf(next[0]*next[0] + next[1]*next[1] + next[2]*next[2]);
+        if (length < 1e-6f)
+            break;
+        for (j=0; j<3; j++)
+            axis[j] = next[j] / length;
+    }
+
+    float min_t = 1e30f, max_t = -1e30f;
+    for (i=0; i<16; i++) {
+        float t = 0.0f;
+        for (j=0; j<3; j++)
+            t += (rgba[i*4 + j] - mean[j]) * axis[j];
+        if (t < min_t) min_t = t;
+        if (t > max_t) max_t = t;
+    }
+
+    // Pull the endpoints in slightly, the extremes are rarely optimal
+    float inset = (max_t - min_t) / 16.0f;
+    float end0[3], end1[3];
+    for (j=0; j<3; j++) {
+        end0[j] = mean[j] + (max_t - inset) * axis[j];
+        end1[j] = mean[j] + (min_t + inset) * axis[j];
+    }
+
+    uint16_t c0, c1;
+    uint32_t indices;
+    bcn_bc1_finish(rgba, end0, end1, &c0, &c1, &indices);
+
+    // One refinement pass against the chosen indices
+    if (c0 != c1 && bcn_bc1_refit(rgba, indices, end0, end1)) {
+        uint16_t refit_c0, refit_c1;
+        uint32_t refit_indices;
+        bcn_bc1_finish(rgba, end0, end1, &refit_c0, &refit_c1, &refit_indices);
+        if (refit_c0 != refit_c1) {
+            c0 = refit_c0;
+            c1 = refit_c1;
+            indices = refit_indices;
+        }
+    }
+
+    bcn_write_bc1(block, c0, c1, indices);
+}
+
+// Single channel block used for BC3 alpha, BC4 and both halves of BC5
+static void bcn_encode_channel(
+        const uint8_t* rgba,
+        int channel,
+        uint8_t* block)
+{
+    int min = 255, max = 0;
+    int i;
+    for (i=0; i<16; i++) {
+        int value = rgba[i*4 + channel];
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    // a0 > a1 selects eight interpolated values, a flat block keeps a0 == a1
+    // and only ever uses index 0
+    block[0] = (uint8_t)max;
+    block[1] = (uint8_t)min;
+
+    uint64_t indices = 0;
+    if (max > min) {
+        for (i=0; i<16; i++) {
+            int value = rgba[i*4 + channel];
+            int step = ((max - value) * 7 + (max - min) / 2) / (max - min);
+
+            // Steps run from a0 to a1, indices 0 and 1 are the endpoints
+            uint64_t index;
+            if (step == 0)
+                index = 0;
+            else if (step == 7)
+                index = 1;
+            else
+                index = step + 1;
+
+            indices |= index << (i*3);
+        }
+    }
+
+    for (i=0; i<6; i++)
+        block[2 + i] = (uint8_t)(indices >> (i*8));
+}
+
+void bcn_encode_bc3(const uint8_t* rgba, uint8_t* block)
+{
+    bcn_encode_channel(rgba, 3, block);
+    bcn_encode_bc1(rgba, block + 8);
+}
+
+void bcn_encode_bc4(const uint8_t* rgba, uint8_t* block)
+{
+    bcn_encode_channel(rgba, 0, block);
+}
+
+void bcn_encode_bc5(const uint8_t* rgba, uint8_t* block)
+{
+    bcn_encode_channel(rgba, 0, block);
+    bcn_encode_channel(rgba, 1, block + 8);
+}
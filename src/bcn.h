@@ -0,0 +1,18 @@
+#ifndef BCN_H_
+#define BCN_H_
+
+#include <stdint.h>
+
+// Bytes per 4x4 block
+#define BCN_BC1_BLOCK_SIZE 8
+#define BCN_BC3_BLOCK_SIZE 16
+#define BCN_BC4_BLOCK_SIZE 8
+#define BCN_BC5_BLOCK_SIZE 16
+
+// Every encoder takes one 4x4 block of RGBA8 texels in row order
+void bcn_encode_bc1(const uint8_t* rgba, uint8_t* block);
+void bcn_encode_bc3(const uint8_t* rgba, uint8_t* block);
+void bcn_encode_bc4(const uint8_t* rgba, uint8_t* block);
+void bcn_encode_bc5(const uint8_t* rgba, uint8_t* block);
+
+#endif
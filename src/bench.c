@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "bench.h"
+#include "util.h"
+
+#define BENCH_ORBIT_KEYFRAMES 64
+
+bool bench_path_load(const char* path, struct bench_path* bench_path)
+{
+    memset(bench_path, 0, sizeof(*bench_path));
+
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return false;
+
+    uint32_t capacity = 16;
+    bench_path->keyframes = malloc(capacity * sizeof(*bench_path->keyframes));
+    assert(bench_path->keyframes);
+
+    char line[256];
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), fp)) {
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        struct bench_keyframe keyframe;
+        int fields = sscanf(
+            line,
+            "%f %f %f %f %f %f %f",
+            &keyframe.time,
+            &keyframe.eye[0],
+            &keyframe.eye[1],
+            &keyframe.eye[2],
+            &keyframe.center[0],
+            &keyframe.center[1],
+            &keyframe.center[2]
+        );
+
+        // Blank and comment-only lines
+        if (fields <= 0)
+            continue;
+
+        uint32_t count = bench_path->keyframe_count;
+        valid = fields == 7 &&
+            (count == 0 || keyframe.time >= bench_path->keyframes[count-1].time);
+        if (!valid)
+            break;
+
+        if (count == capacity) {
+            capacity *= 2;
+            bench_path->keyframes = realloc(
+                bench_path->keyframes,
+                capacity * sizeof(*bench_path->keyframes)
+            );
+            assert(bench_path->keyframes);
+        }
+        bench_path->keyframes[bench_path->keyframe_count++] = keyframe;
+    }
+    fclose(fp);
+
+    if (!valid || bench_path->keyframe_count == 0) {
+        bench_path_free(bench_path);
+        return false;
+    }
+
+    return true;
+}
+
+void bench_path_orbit(
+        struct bench_path* bench_path,
+        float radius,
+        float height,
+        float duration)
+{
+    bench_path->keyframe_count = BENCH_ORBIT_KEYFRAMES + 1;
+    bench_path->keyframes = malloc(
+        bench_path->keyframe_count * sizeof(*bench_path->keyframes)
+    );
+    assert(bench_path->keyframes);
+
+    // One revolution, pulling in to a fifth of the radius halfway round
+    uint32_t i;
+    for (i=0; i<bench_path->keyframe_count; i++) {
+        float t = (float)i / BENCH_ORBIT_KEYFRAMES;
+        float angle = t * 2.0f * (float)M_PI;
+        float distance = radius * (0.6f + 0.4f * cosf(angle));
+
+        struct bench_keyframe* keyframe = &bench_path->keyframes[i];
+        keyframe->time = t * duration;
+        keyframe->eye[0] = distance * cosf(angle);
+        keyframe->eye[1] = distance * sinf(angle);
+        keyframe->eye[2] = height * (0.6f + 0.4f * cosf(angle));
+        keyframe->center[0] = 0.0f;
+        keyframe->center[1] = 0.0f;
+        keyframe->center[2] = 0.0f;
+    }
+}
+
+float bench_path_duration(const struct bench_path* bench_path)
+{
+    return bench_path->keyframes[bench_path->keyframe_count-1].time;
+}
+
+void bench_path_sample(
+        const struct bench_path* bench_path,
+        float time,
+        float* eye,
+        float* center)
+{
+    const struct bench_keyframe* keyframes = bench_path->keyframes;
+    uint32_t count = bench_path->keyframe_count;
+
+    // Clamped to the ends, otherwise blended within the bracketing pair
+    uint32_t next = 0;
+    while (next < count && keyframes[next].time < time)
+        next++;
+
+    const struct bench_keyframe* a;
+    const struct bench_keyframe* b;
+    if (next == 0) {
+        a = b = &keyframes[0];
+    } else if (next == count) {
+        a = b = &keyframes[count-1];
+    } else {
+        a = &keyframes[next-1];
+        b = &keyframes[next];
+    }
+
+    float span = b->time - a->time;
+    float t = span > 0.0f ? (time - a->time) / span : 0.0f;
+
+    uint32_t i;
+    for (i=0; i<3; i++) {
+        eye[i] = a->eye[i] + (b->eye[i] - a->eye[i]) * t;
+        center[i] = a->center[i] + (b->center[i] - a->center[i]) * t;
+    }
+}
+
+void bench_path_free(struct bench_path* bench_path)
+{
+    free(bench_path->keyframes);
+    bench_path->keyframes = NULL;
+    bench_path->keyframe_count = 0;
+}
+
+void bench_report_init(struct bench_report* report, uint32_t frame_capacity)
+{
+    memset(report, 0, sizeof(*report));
+
+    report->frame_capacity = frame_capacity > 0 ? frame_capacity : 1;
+    report->cpu_ms = malloc(report->frame_capacity * sizeof(*report->cpu_ms));
+    report->gpu_ms = malloc(report->frame_capacity * sizeof(*report->gpu_ms));
+    report->draw_counts = malloc(
+        report->frame_capacity * sizeof(*report->draw_counts)
+    );
+    report->triangle_counts = malloc(
+        report->frame_capacity * sizeof(*report->triangle_counts)
+    );
+    assert(report->cpu_ms);
+    assert(report->gpu_ms);
+    assert(report->draw_counts);
+    assert(report->triangle_counts);
+}
+
+void bench_report_add_frame(
+        struct bench_report* report,
+        double cpu_ms,
+        double gpu_ms,
+        uint32_t draw_count,
+        uint32_t triangle_count)
+{
+    assert(report->frame_count < report->frame_capacity);
+
+    uint32_t frame = report->frame_count++;
+    report->cpu_ms[frame] = cpu_ms;
+    report->gpu_ms[frame] = gpu_ms;
+    report->draw_counts[frame] = draw_count;
+    report->triangle_counts[frame] = triangle_count;
+}
+
+void bench_report_add_scope(
+        struct bench_report* report,
+        const char* name,
+        double ms)
+{
+    uint32_t i;
+    for (i=0; i<report->gpu_scope_count; i++) {
+        if (strcmp(report->gpu_scopes[i].name, name) == 0)
+            break;
+    }
+
+    if (i == report->gpu_scope_count) {
+        if (report->gpu_scope_count == BENCH_MAX_SCOPES)
+            return;
+
+        report->gpu_scopes[i].name = name;
+        report->gpu_scopes[i].ms = malloc(
+            report->frame_capacity * sizeof(*report->gpu_scopes[i].ms)
+        );
+        assert(report->gpu_scopes[i].ms);
+        report->gpu_scopes[i].count = 0;
+        report->gpu_scope_count++;
+    }
+
+    struct bench_scope* scope = &report->gpu_scopes[i];
+    if (scope->count < report->frame_capacity)
+        scope->ms[scope->count++] = ms;
+}
+
+void bench_report_add_counter(
+        struct bench_report* report,
+        const char* scope,
+        const char* name,
+        double value)
+{
+    uint32_t i;
+    for (i=0; i<report->gpu_counter_count; i++) {
+        struct bench_counter* counter = &report->gpu_counters[i];
+        if (strcmp(counter->scope, scope) == 0 &&
+            strcmp(counter->name, name) == 0) {
+            break;
+        }
+    }
+
+    if (i == report->gpu_counter_count) {
+        if (report->gpu_counter_count == BENCH_MAX_COUNTERS)
+            return;
+
+        report->gpu_counters[i].scope = scope;
+        report->gpu_counters[i].name = name;
+        report->gpu_counters[i].sum = 0.0;
+        report->gpu_counters[i].count = 0;
+        report->gpu_counter_count++;
+    }
+
+    report->gpu_counters[i].sum += value;
+    report->gpu_counters[i].count++;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double value_a = *(const double*)a;
+    double value_b = *(const double*)b;
+
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+double bench_percentile(
+        const double* values,
+        uint32_t count,
+        double percentile)
+{
+    if (count == 0)
+        return 0.0;
+
+    double* sorted = malloc(count * sizeof(*sorted));
+    assert(sorted);
+    memcpy(sorted, values, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), compare_doubles);
+
+    uint32_t rank = (uint32_t)ceil(percentile / 100.0 * count);
+    double value = sorted[rank > 0 ? rank - 1 : 0];
+    free(sorted);
+
+    return value;
+}
+
+// Summary of a series as a JSON object
+static void bench_write_series(
+        FILE* fp,
+        const char* indent,
+        const char* name,
+        const double* values,
+        uint32_t count)
+{
+    double sum = 0.0;
+    double max = 0.0;
+    uint32_t i;
+    for (i=0; i<count; i++) {
+        sum += values[i];
+        max = values[i] > max ? values[i] : max;
+    }
+
+    fprintf(fp,
+        "%s\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+        "\"p99\": %.4f, \"max\": %.4f}",
+        indent,
+        name,
+        count > 0 ? sum / count : 0.0,
+        bench_percentile(values, count, 50.0),
+        bench_percentile(values, count, 95.0),
+        bench_percentile(values, count, 99.0),
+        max
+    );
+}
+
+bool bench_report_write_json(
+        const struct bench_report* report,
+        const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    // Frames still in flight when the run ended have no GPU time
+    double* gpu_ms = malloc(report->frame_capacity * sizeof(*gpu_ms));
+    assert(gpu_ms);
+    uint32_t gpu_count = 0;
+    uint64_t draws = 0;
+    uint64_t triangles = 0;
+
+    uint32_t i;
+    for (i=0; i<report->frame_count; i++) {
+        if (report->gpu_ms[i] >= 0.0)
+            gpu_ms[gpu_count++] = report->gpu_ms[i];
+        draws += report->draw_counts[i];
+        triangles += report->triangle_counts[i];
+    }
+
+    uint32_t frames = report->frame_count > 0 ? report->frame_count : 1;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"path\": ");
+    util_write_json_string(fp, report->path_name);
+    fprintf(fp, ",\n");
+    fprintf(fp, "  \"width\": %u,\n", report->width);
+    fprintf(fp, "  \"height\": %u,\n", report->height);
+    fprintf(fp, "  \"frames\": %u,\n", report->frame_count);
+    bench_write_series(fp, "  ", "cpu_ms", report->cpu_ms, report->frame_count);
+    fprintf(fp, ",\n");
+    if (gpu_count > 0)
+        bench_write_series(fp, "  ", "gpu_ms", gpu_ms, gpu_count);
+    else
+        fprintf(fp, "  \"gpu_ms\": null");
+    fprintf(fp, ",\n");
+
+    fprintf(fp, "  \"gpu_scopes_ms\": {");
+    for (i=0; i<report->gpu_scope_count; i++) {
+        const struct bench_scope* scope = &report->gpu_scopes[i];
+        fprintf(fp, i > 0 ? ",\n" : "\n");
+        bench_write_series(fp, "    ", scope->name, scope->ms, scope->count);
+    }
+    fprintf(fp, report->gpu_scope_count > 0 ? "\n  },\n" : "},\n");
+
+    // Counters grouped under their scope, in the order scopes first appear
+    fprintf(fp, "  \"gpu_statistics\": {");
+    bool first_scope = true;
+    for (i=0; i<report->gpu_counter_count; i++) {
+        const struct bench_counter* counter = &report->gpu_counters[i];
+
+        uint32_t j;
+        for (j=0; j<i; j++) {
+            if (strcmp(report->gpu_counters[j].scope, counter->scope) == 0)
+                break;
+        }
+        if (j < i)
+            continue;
+
+        fprintf(fp, "%s\n    \"%s\": {",
+            first_scope ? "" : ",",
+            counter->scope
+        );
+        first_scope = false;
+
+        bool first_counter = true;
+        for (j=i; j<report->gpu_counter_count; j++) {
+            const struct bench_counter* other = &report->gpu_counters[j];
+            if (strcmp(other->scope, counter->scope) != 0)
+                continue;
+
+            fprintf(fp, "%s\"%s\": %.1f",
+                first_counter ? "" : ", ",
+                other->name,
+                other->count > 0 ? other->sum / other->count : 0.0
+            );
+            first_counter = false;
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, first_scope ? "},\n" : "\n  },\n");
+    fprintf(fp, "  \"draws_per_frame\": %.1f,\n", (double)draws / frames);
+    fprintf(fp, "  \"triangles_per_frame\": %.1f\n", (double)triangles / frames);
+    fprintf(fp, "}\n");
+
+    free(gpu_ms);
+
+    return fclose(fp) == 0;
+}
+
+void bench_report_free(struct bench_report* report)
+{
+    free(report->cpu_ms);
+    free(report->gpu_ms);
+    free(report->draw_counts);
+    free(report->triangle_counts);
+
+    uint32_t i;
+    for (i=0; i<report->gpu_scope_count; i++)
+        free(report->gpu_scopes[i].ms);
+
+    memset(report, 0, sizeof(*report));
+}
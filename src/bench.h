@@ -0,0 +1,125 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BENCH_MAX_SCOPES 16
+#define BENCH_MAX_COUNTERS 64
+
+// Camera position and target at a point in time, paths are played back
+// by linearly interpolating between keyframes
+struct bench_keyframe
+{
+    float time;
+    float eye[3];
+    float center[3];
+};
+
+struct bench_path
+{
+    struct bench_keyframe* keyframes;
+    uint32_t keyframe_count;
+};
+
+// Samples of one named GPU scope, only from frames the profiler resolved
+struct bench_scope
+{
+    const char* name;
+    double* ms;
+    uint32_t count;
+};
+
+// Per-frame mean of a counter within a scope, such as a pass's fragment
+// shader invocations
+struct bench_counter
+{
+    const char* scope;
+    const char* name;
+    double sum;
+    uint32_t count;
+};
+
+// Per-frame samples collected over a run, gpu_ms is negative for frames
+// without a GPU time
+struct bench_report
+{
+    const char* path_name;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_count;
+    uint32_t frame_capacity;
+    double* cpu_ms;
+    double* gpu_ms;
+    uint32_t* draw_counts;
+    uint32_t* triangle_counts;
+    struct bench_scope gpu_scopes[BENCH_MAX_SCOPES];
+    uint32_t gpu_scope_count;
+    struct bench_counter gpu_counters[BENCH_MAX_COUNTERS];
+    uint32_t gpu_counter_count;
+};
+
+// Text file, one keyframe per line as "time eye.xyz center.xyz" with '#'
+// starting a comment, keyframes must be in time order
+bool bench_path_load(const char* path, struct bench_path* bench_path);
+
+// Scripted orbit around the origin that also moves in and out, so a run
+// covers every mesh LOD and several texture levels
+void bench_path_orbit(
+    struct bench_path* bench_path,
+    float radius,
+    float height,
+    float duration
+);
+
+float bench_path_duration(const struct bench_path* bench_path);
+
+void bench_path_sample(
+    const struct bench_path* bench_path,
+    float time,
+    float* eye,
+    float* center
+);
+
+void bench_path_free(struct bench_path* bench_path);
+
+void bench_report_init(struct bench_report* report, uint32_t frame_capacity);
+
+void bench_report_add_frame(
+    struct bench_report* report,
+    double cpu_ms,
+    double gpu_ms,
+    uint32_t draw_count,
+    uint32_t triangle_count
+);
+
+// The name is kept, not copied
+void bench_report_add_scope(
+    struct bench_report* report,
+    const char* name,
+    double ms
+);
+
+// Names are kept, not copied
+void bench_report_add_counter(
+    struct bench_report* report,
+    const char* scope,
+    const char* name,
+    double value
+);
+
+// Nearest-rank percentile of count values, which are left untouched
+double bench_percentile(
+    const double* values,
+    uint32_t count,
+    double percentile
+);
+
+bool bench_report_write_json(
+    const struct bench_report* report,
+    const char* path
+);
+
+void bench_report_free(struct bench_report* report);
+
+#endif
@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "cave.h"
+#include "util.h"
+
+// Densities are evaluated a block at a time, keeping the warped
+// positions on the stack and letting worms be culled per block
+#define CAVE_BLOCK 256
+
+// Worms turn by up to this many radians per segment and are steered by
+// noise at this frequency along their path
+#define CAVE_WORM_TURN 0.6f
+#define CAVE_WORM_PITCH 0.4f
+#define CAVE_WORM_STEER_FREQUENCY 0.03f
+
+// Tunnel radii vary by this share of the worm radius
+#define CAVE_WORM_RADIUS_VARIATION 0.4f
+
+struct cave_segment
+{
+    float start[3];
+    float end[3];
+    float radius;
+    float min[3];
+    float max[3];
+};
+
+void cave_default_params(struct cave_params* params, uint64_t seed)
+{
+    params->seed = seed;
+    params->fractal.octaves = 4;
+    params->fractal.frequency = 0.02f;
+    params->fractal.lacunarity = 2.0f;
+    params->fractal.gain = 0.5f;
+    params->threshold = -0.2f;
+    params->warp_frequency = 0.008f;
+    params->warp_strength = 12.0f;
+    params->worms_per_region = 2;
+    params->worm_radius = 3.5f;
+    params->worm_step = 4.0f;
+}
+
+void cave_init(struct cave* cave, const struct cave_params* params)
+{
+    assert(params->worms_per_region <= CAVE_MAX_WORMS_PER_REGION);
+    cave->params = *params;
+
+    // Every field gets its own permutation from the one seed
+    noise_init(&cave->density_noise, params->seed);
+    uint32_t i;
+    for (i=0; i<3; i++)
+        noise_init(&cave->warp_noise[i], params->seed + 1 + i);
+    noise_init(&cave->worm_noise, params->seed + 4);
+}
+
+// Uniform in [0, 1), splitmix64 seeded by the region
+static float cave_random(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 40) * (1.0f / 16777216.0f);
+}
+
+static int32_t cave_region(float v)
+{
+    return (int32_t)floorf(v / CAVE_REGION_SIZE);
+}
+
+// Furthest a region's worms carve from the region's bounds
+static float cave_worm_reach(const struct cave_params* params)
+{
+    return CAVE_WORM_SEGMENTS * params->worm_step +
+        params->worm_radius * (1.0f + CAVE_WORM_RADIUS_VARIATION);
+}
+
+static uint32_t cave_add_region_worms(
+        const struct cave* cave,
+        int32_t region_x,
+        int32_t region_y,
+        int32_t region_z,
+        struct cave_segment* segments)
+{
+    const struct cave_params* params = &cave->params;
+
+    int32_t region[3] = {region_x, region_y, region_z};
+    uint64_t state = util_hash(&params->seed, sizeof(params->seed),
+        UTIL_FNV1A_SEED);
+    state = util_hash(region, sizeof(region), state);
+
+    uint32_t segment_count = 0;
+    uint32_t worm, i, j;
+    for (worm=0; worm<params->worms_per_region; worm++) {
+        float position[3];
+        for (j=0; j<3; j++) {
+            position[j] = (region[j] + cave_random(&state)) *
+                CAVE_REGION_SIZE;
+        }
+        float yaw = cave_random(&state) * 2.0f * (float)M_PI;
+
+        // Offsets keep the three steering fields of one worm unrelated
+        float offset = worm * 1000.0f;
+        for (i=0; i<CAVE_WORM_SEGMENTS; i++) {
+            float steer[3];
+            for (j=0; j<3; j++)
+                steer[j] = position[j] * CAVE_WORM_STEER_FREQUENCY + offset;
+
+            yaw += CAVE_WORM_TURN *
+                noise_simplex(&cave->worm_noise, steer[0], steer[1], steer[2]);
+            float pitch = CAVE_WORM_PITCH * noise_simplex(
+                &cave->worm_noise, steer[0] + 100.0f, steer[1], steer[2]);
+            float radius = params->worm_radius *
+                (1.0f + CAVE_WORM_RADIUS_VARIATION * noise_simplex(
+                    &cave->worm_noise, steer[0], steer[1] + 100.0f, steer[2]));
+
+            struct cave_segment* segment = &segments[segment_count++];
+            segment->start[0] = position[0];
+            segment->start[1] = position[1];
+            segment->start[2] = position[2];
+            segment->end[0] = position[0] +
+                cosf(pitch) * cosf(yaw) * params->worm_step;
+            segment->end[1] = position[1] + sinf(pitch) * params->worm_step;
+            segment->end[2] = position[2] +
+                cosf(pitch) * sinf(yaw) * params->worm_step;
+            segment->radius = radius;
+
+            for (j=0; j<3; j++) {
+                segment->min[j] = fminf(segment->start[j], segment->end[j]) -
+                    radius;
+                segment->max[j] = fmaxf(segment->start[j], segment->end[j]) +
+                    radius;
+                position[j] = segment->end[j];
+            }
+        }
+    }
+
+    return segment_count;
+}
+
+static void cave_get_bounds(
+        const float* x,
+        const float* y,
+        const float* z,
+        uint32_t count,
+        float* min,
+        float* max)
+{
+    min[0] = max[0] = x[0];
+    min[1] = max[1] = y[0];
+    min[2] = max[2] = z[0];
+
+    uint32_t i;
+    for (i=1; i<count; i++) {
+        min[0] = fminf(min[0], x[i]);
+        min[1] = fminf(min[1], y[i]);
+        min[2] = fminf(min[2], z[i]);
+        max[0] = fmaxf(max[0], x[i]);
+        max[1] = fmaxf(max[1], y[i]);
+        max[2] = fmaxf(max[2], z[i]);
+    }
+}
+
+static bool cave_segment_overlaps(
+        const struct cave_segment* segment,
+        const float* min,
+        const float* max)
+{
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        if (segment->min[j] > max[j] || segment->max[j] < min[j])
+            return false;
+    }
+
+    return true;
+}
+
+// Distance to the segment relative to its radius, negative inside
+static void cave_carve_segment(
+        const struct cave_segment* segment,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    float dx = segment->end[0] - segment->start[0];
+    float dy = segment->end[1] - segment->start[1];
+    float dz = segment->end[2] - segment->start[2];
+    float length_squared = dx*dx + dy*dy + dz*dz;
+    float inv_length_squared = length_squared > 0.0f ?
+        1.0f / length_squared : 0.0f;
+    float inv_radius = 1.0f / segment->radius;
+
+    uint32_t i;
+    for (i=0; i<count; i++) {
+        float px = x[i] - segment->start[0];
+        float py = y[i] - segment->start[1];
+        float pz = z[i] - segment->start[2];
+
+        float t = (px*dx + py*dy + pz*dz) * inv_length_squared;
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+        float qx = px - dx * t;
+        float qy = py - dy * t;
+        float qz = pz - dz * t;
+        float distance = sqrtf(qx*qx + qy*qy + qz*qz);
+
+        float tunnel = (distance - segment->radius) * inv_radius;
+        out[i] = tunnel < out[i] ? tunnel : out[i];
+    }
+}
+
+void cave_density_batch(
+        const struct cave* cave,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    const struct cave_params* params = &cave->params;
+
+    // Every worm that can reach the samples, generated once for the batch
+    float min[3], max[3];
+    cave_get_bounds(x, y, z, count, min, max);
+
+    float reach = cave_worm_reach(params);
+    int32_t region_min[3], region_max[3];
+    uint32_t region_count = 1;
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        region_min[j] = cave_region(min[j] - reach);
+        region_max[j] = cave_region(max[j] + reach);
+        region_count *= region_max[j] - region_min[j] + 1;
+    }
+
+    struct cave_segment* segments = malloc(
+        region_count * params->worms_per_region * CAVE_WORM_SEGMENTS *
+            sizeof(*segments) + 1
+    );
+    assert(segments);
+
+    uint32_t segment_count = 0;
+    int32_t rx, ry, rz;
+    for (rz=region_min[2]; rz<=region_max[2]; rz++) {
+        for (ry=region_min[1]; ry<=region_max[1]; ry++) {
+            for (rx=region_min[0]; rx<=region_max[0]; rx++) {
+                struct cave_segment* added = &segments[segment_count];
+                uint32_t added_count = cave_add_region_worms(
+                    cave,
+                    rx,
+                    ry,
+                    rz,
+                    added
+                );
+
+                // Most of a worm passes by the samples, only what touches
+                // them is kept for the blocks to test
+                uint32_t i;
+                for (i=0; i<added_count; i++) {
+                    if (cave_segment_overlaps(&added[i], min, max))
+                        segments[segment_count++] = added[i];
+                }
+            }
+        }
+    }
+
+    float warp_x[CAVE_BLOCK];
+    float warp_y[CAVE_BLOCK];
+    float warp_z[CAVE_BLOCK];
+    float warp[3][CAVE_BLOCK];
+
+    uint32_t start;
+    for (start=0; start<count; start+=CAVE_BLOCK) {
+        uint32_t block_count = count - start < CAVE_BLOCK ?
+            count - start : CAVE_BLOCK;
+        const float* block_x = &x[start];
+        const float* block_y = &y[start];
+        const float* block_z = &z[start];
+        float* block_out = &out[start];
+
+        uint32_t i;
+        for (i=0; i<block_count; i++) {
+            warp_x[i] = block_x[i] * params->warp_frequency;
+            warp_y[i] = block_y[i] * params->warp_frequency;
+            warp_z[i] = block_z[i] * params->warp_frequency;
+        }
+        for (j=0; j<3; j++) {
+            noise_simplex_batch(
+                &cave->warp_noise[j],
+                warp_x,
+                warp_y,
+                warp_z,
+                warp[j],
+                block_count
+            );
+        }
+        for (i=0; i<block_count; i++) {
+            warp_x[i] = block_x[i] + warp[0][i] * params->warp_strength;
+            warp_y[i] = block_y[i] + warp[1][i] * params->warp_strength;
+            warp_z[i] = block_z[i] + warp[2][i] * params->warp_strength;
+        }
+
+        noise_fractal_batch(
+            &cave->density_noise,
+            &params->fractal,
+            warp_x,
+            warp_y,
+            warp_z,
+            block_out,
+            block_count
+        );
+        for (i=0; i<block_count; i++)
+            block_out[i] -= params->threshold;
+
+        // Worms carve in unwarped space so tunnels stay round
+        float block_min[3], block_max[3];
+        cave_get_bounds(
+            block_x,
+            block_y,
+            block_z,
+            block_count,
+            block_min,
+            block_max
+        );
+
+        uint32_t s;
+        for (s=0; s<segment_count; s++) {
+            if (!cave_segment_overlaps(&segments[s], block_min, block_max))
+                continue;
+
+            cave_carve_segment(
+                &segments[s],
+                block_x,
+                block_y,
+                block_z,
+                block_out,
+                block_count
+            );
+        }
+    }
+
+    free(segments);
+}
+
+float cave_density(const struct cave* cave, float x, float y, float z)
+{
+    float density;
+    cave_density_batch(cave, &x, &y, &z, &density, 1);
+    return density;
+}
@@ -0,0 +1,56 @@
+#ifndef CAVE_H_
+#define CAVE_H_
+
+#include <stdint.h>
+
+#include "noise.h"
+
+// Worms are spawned per region of the world, each short enough to only
+// reach into the neighbouring regions
+#define CAVE_REGION_SIZE 128.0f
+#define CAVE_MAX_WORMS_PER_REGION 4
+#define CAVE_WORM_SEGMENTS 32
+
+struct cave_params
+{
+    uint64_t seed;
+    // Density of the rock, in about [-1, 1] before the threshold
+    struct noise_fractal fractal;
+    // Noise below the threshold is open space
+    float threshold;
+    // Positions are offset by low frequency noise before sampling the
+    // density, bending the blobby pockets into winding passages
+    float warp_frequency;
+    float warp_strength;
+    // Tunnels carved along noise steered paths, linking up the pockets
+    uint32_t worms_per_region;
+    float worm_radius;
+    float worm_step;
+};
+
+struct cave
+{
+    struct cave_params params;
+    struct noise density_noise;
+    struct noise warp_noise[3];
+    struct noise worm_noise;
+};
+
+void cave_default_params(struct cave_params* params, uint64_t seed);
+
+void cave_init(struct cave* cave, const struct cave_params* params);
+
+// Positive is rock and negative open, with the surface at 0. The same
+// seed always gives the same field, whichever noise ISA is used
+void cave_density_batch(
+    const struct cave* cave,
+    const float* x,
+    const float* y,
+    const float* z,
+    float* out,
+    uint32_t count
+);
+
+float cave_density(const struct cave* cave, float x, float y, float z);
+
+#endif
@@ -0,0 +1,1037 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "cave.h"
+#include "noise.h"
+#include "voxel.h"
+#include "mesher.h"
+#include "octree.h"
+#include "jobs.h"
+#include "util.h"
+
+// Cave density tool, measures noise and density throughput on a single
+// core for every ISA the CPU supports, or writes a horizontal slice of the
+// density field as a greyscale image, rock light and open space dark.
+// store generates a cube of chunks into the voxel store and measures its
+// memory use and access speed. mesh meshes the same cube with every
+// method on all cores and measures triangle throughput and chunk latency.
+// dig carves a winding tunnel through the cube a sphere at a time, meshing
+// the chunks each one changes again before the next, as a player digging
+// does every frame, and measures how long until the edit can be drawn.
+// lod meshes the cube at every level of detail and measures how the
+// triangles and time per chunk fall, and what skirts add back.
+// octree builds a sparse voxel octree over the cube, rounded up to a power
+// of two chunks on a side, and measures its memory against the store's,
+// ray casts against stepping voxel by voxel, and coarse box reads
+//
+//     cavegen bench [seed]
+//     cavegen slice <output .pgm> [seed] [height]
+//     cavegen store [seed] [chunks per side]
+//     cavegen mesh [seed] [chunks per side]
+//     cavegen lod [seed] [chunks per side]
+//     cavegen dig [seed] [radius]
+//     cavegen octree [seed] [chunks per side]
+
+// Samples per benchmark pass, a 64 unit cube at unit spacing
+#define CAVEGEN_BENCH_SIZE 64
+#define CAVEGEN_BENCH_SECONDS 0.5
+
+#define CAVEGEN_SLICE_SIZE 512
+
+#define CAVEGEN_STORE_CHUNKS 8
+#define CAVEGEN_STORE_LOOKUPS 10000000
+
+// Starting size of the arena standing in for a staging buffer, grown and
+// meshed again if it overflows
+#define CAVEGEN_MESH_ARENA (64 * 1024 * 1024)
+
+// Spheres carved along the tunnel, each a radius further than the last
+#define CAVEGEN_DIG_RADIUS 3.0f
+#define CAVEGEN_DIG_EDITS 1000
+#define CAVEGEN_FRAME_SECONDS (1.0 / 60.0)
+
+// Voxels are a metre on a side
+#define CAVEGEN_VOXELS_PER_KM3 1e9
+#define CAVEGEN_RAYS 1000000
+#define CAVEGEN_RAY_DISTANCE 128.0f
+#define CAVEGEN_OCTREE_LODS 4
+
+struct samples
+{
+    float* x;
+    float* y;
+    float* z;
+    uint32_t count;
+};
+
+static void samples_init(struct samples* samples, uint32_t count)
+{
+    samples->x = malloc(count * sizeof(float));
+    samples->y = malloc(count * sizeof(float));
+    samples->z = malloc(count * sizeof(float));
+    assert(samples->x && samples->y && samples->z);
+    samples->count = count;
+}
+
+static void samples_free(struct samples* samples)
+{
+    free(samples->x);
+    free(samples->y);
+    free(samples->z);
+}
+
+enum field
+{
+    FIELD_SIMPLEX,
+    FIELD_FRACTAL,
+    FIELD_CAVE,
+    FIELD_COUNT
+};
+
+static const char* field_names[] = {
+    "simplex",
+    "fractal",
+    "cave"
+};
+
+static void evaluate(
+        enum field field,
+        const struct cave* cave,
+        const struct samples* samples,
+        float* out)
+{
+    switch (field) {
+    case FIELD_SIMPLEX:
+        noise_simplex_batch(
+            &cave->density_noise,
+            samples->x,
+            samples->y,
+            samples->z,
+            out,
+            samples->count
+        );
+        break;
+    case FIELD_FRACTAL:
+        noise_fractal_batch(
+            &cave->density_noise,
+            &cave->params.fractal,
+            samples->x,
+            samples->y,
+            samples->z,
+            out,
+            samples->count
+        );
+        break;
+    default:
+        cave_density_batch(
+            cave,
+            samples->x,
+            samples->y,
+            samples->z,
+            out,
+            samples->count
+        );
+        break;
+    }
+}
+
+// Millions of samples per second, repeating passes until enough time has
+// passed to be stable
+static double measure(
+        enum field field,
+        const struct cave* cave,
+        const struct samples* samples,
+        float* out)
+{
+    uint64_t passes = 0;
+    double start = util_time();
+    double elapsed;
+    do {
+        evaluate(field, cave, samples, out);
+        passes++;
+        elapsed = util_time() - start;
+    } while (elapsed < CAVEGEN_BENCH_SECONDS);
+
+    return passes * samples->count / elapsed / 1e6;
+}
+
+static int bench(const struct cave* cave)
+{
+    uint32_t size = CAVEGEN_BENCH_SIZE;
+    struct samples samples;
+    samples_init(&samples, size * size * size);
+
+    uint32_t x, y, z;
+    for (z=0; z<size; z++) {
+        for (y=0; y<size; y++) {
+            for (x=0; x<size; x++) {
+                uint32_t i = (z * size + y) * size + x;
+                samples.x[i] = (float)x;
+                samples.y[i] = (float)y;
+                samples.z[i] = (float)z;
+            }
+        }
+    }
+
+    float* reference = malloc(samples.count * sizeof(float));
+    float* out = malloc(samples.count * sizeof(float));
+    assert(reference && out);
+
+    printf("Million samples per second on one core, %u per pass:\n",
+        samples.count);
+
+    int status = 0;
+    uint32_t field;
+    for (field=0; field<FIELD_COUNT; field++) {
+        noise_set_isa(NOISE_ISA_SCALAR);
+        evaluate(field, cave, &samples, reference);
+
+        printf("    %s:", field_names[field]);
+
+        uint32_t isa;
+        for (isa=0; isa<NOISE_ISA_COUNT; isa++) {
+            if (!noise_set_isa(isa))
+                continue;
+
+            double rate = measure(field, cave, &samples, out);
+            bool matches = memcmp(
+                out,
+                reference,
+                samples.count * sizeof(float)
+            ) == 0;
+
+            printf(" %s %.1f%s",
+                noise_get_isa_name(isa),
+                rate,
+                matches ? "" : " (differs from scalar)"
+            );
+            if (!matches)
+                status = 1;
+        }
+        printf("\n");
+    }
+
+    free(out);
+    free(reference);
+    samples_free(&samples);
+
+    return status;
+}
+
+static int slice(const struct cave* cave, const char* path, float height)
+{
+    uint32_t size = CAVEGEN_SLICE_SIZE;
+    struct samples samples;
+    samples_init(&samples, size);
+
+    float* density = malloc(size * sizeof(float));
+    uint8_t* pixels = malloc(size * size);
+    assert(density && pixels);
+
+    // One row per batch keeps the worms generated per call local
+    uint32_t x, z;
+    for (z=0; z<size; z++) {
+        for (x=0; x<size; x++) {
+            samples.x[x] = (float)x;
+            samples.y[x] = height;
+            samples.z[x] = (float)z;
+        }
+        cave_density_batch(
+            cave,
+            samples.x,
+            samples.y,
+            samples.z,
+            density,
+            size
+        );
+
+        for (x=0; x<size; x++) {
+            float value = 128.0f + density[x] * 127.0f;
+            value = value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+            pixels[z * size + x] = (uint8_t)value;
+        }
+    }
+
+    FILE* fp = fopen(path, "wb");
+    bool written = fp != NULL;
+    if (fp) {
+        fprintf(fp, "P5\n%u %u\n255\n", size, size);
+        written = fwrite(pixels, 1, size * size, fp) == size * size;
+        written = fclose(fp) == 0 && written;
+    }
+
+    free(pixels);
+    free(density);
+    samples_free(&samples);
+
+    if (!written) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+// A cube of chunks centred on the origin
+static void generate(
+        const struct cave* cave,
+        int32_t chunks,
+        struct voxel_world* world)
+{
+    voxel_world_init(world);
+
+    int32_t x, y, z;
+    for (y=0; y<chunks; y++) {
+        for (z=0; z<chunks; z++) {
+            for (x=0; x<chunks; x++) {
+                struct voxel_chunk* chunk = voxel_world_add(
+                    world,
+                    x - chunks / 2,
+                    y - chunks / 2,
+                    z - chunks / 2,
+                    VOXEL_MATERIAL_AIR
+                );
+                voxel_chunk_generate(chunk, cave);
+            }
+        }
+    }
+}
+
+static int store(const struct cave* cave, int32_t chunks)
+{
+    struct voxel_world world;
+
+    double start = util_time();
+    generate(cave, chunks, &world);
+    double generate_time = util_time() - start;
+
+    struct voxel_world_stats stats;
+    voxel_world_get_stats(&world, &stats);
+    uint64_t voxels = (uint64_t)stats.chunk_count * VOXEL_CHUNK_VOLUME;
+
+    printf("%u chunks generated in %.2f s, %.2f ms each\n",
+        stats.chunk_count,
+        generate_time,
+        generate_time * 1e3 / stats.chunk_count
+    );
+    printf("%u uniform, %u packed, %u RLE\n",
+        stats.encoding_counts[VOXEL_ENCODING_UNIFORM],
+        stats.encoding_counts[VOXEL_ENCODING_PACKED],
+        stats.encoding_counts[VOXEL_ENCODING_RLE]
+    );
+    printf("%.2f MiB, %.3f bytes per voxel, %.1fx smaller than 16-bit\n",
+        stats.bytes / (1024.0 * 1024.0),
+        (double)stats.bytes / voxels,
+        voxels * 2.0 / stats.bytes
+    );
+
+    // Random points spread over the whole cube, so most miss the cache
+    int32_t x, y, z;
+    int32_t extent = chunks * VOXEL_CHUNK_SIZE;
+    int32_t offset = chunks / 2 * VOXEL_CHUNK_SIZE;
+    uint32_t state = 1;
+    uint64_t checksum = 0;
+    start = util_time();
+    uint32_t i;
+    for (i=0; i<CAVEGEN_STORE_LOOKUPS; i++) {
+        state = state * 1664525u + 1013904223u;
+        x = (int32_t)((state >> 8) % extent) - offset;
+        y = (int32_t)((state >> 4) % extent) - offset;
+        z = (int32_t)(((state >> 16) ^ state) % extent) - offset;
+        checksum += voxel_world_get(&world, x, y, z);
+    }
+    double lookup_time = util_time() - start;
+
+    // Every chunk with a one voxel border, as a mesher reads it
+    uint32_t size[3] = {
+        VOXEL_CHUNK_SIZE + 2,
+        VOXEL_CHUNK_SIZE + 2,
+        VOXEL_CHUNK_SIZE + 2
+    };
+    uint16_t* box = malloc(size[0] * size[1] * size[2] * sizeof(*box));
+    assert(box);
+
+    start = util_time();
+    for (y=0; y<chunks; y++) {
+        for (z=0; z<chunks; z++) {
+            for (x=0; x<chunks; x++) {
+                int32_t min[3] = {
+                    (x - chunks / 2) * VOXEL_CHUNK_SIZE - 1,
+                    (y - chunks / 2) * VOXEL_CHUNK_SIZE - 1,
+                    (z - chunks / 2) * VOXEL_CHUNK_SIZE - 1
+                };
+                voxel_world_read(&world, min, size, box);
+                checksum += box[0];
+            }
+        }
+    }
+    double read_time = util_time() - start;
+
+    printf("Random lookups: %.1f million per second (checksum %llu)\n",
+        CAVEGEN_STORE_LOOKUPS / lookup_time / 1e6,
+        (unsigned long long)checksum
+    );
+    printf("Chunk reads with borders: %.3f ms each\n",
+        read_time * 1e3 / stats.chunk_count
+    );
+
+    free(box);
+    voxel_world_destroy(&world);
+
+    return 0;
+}
+
+// Meshes every chunk, growing the arena and going again if it overflows.
+// Returns the seconds the last try took
+static double mesh_all(
+        struct job_pool* pool,
+        const struct voxel_world* world,
+        enum mesher_method method,
+        uint32_t lod,
+        uint32_t skirts,
+        const int32_t* coords,
+        uint32_t chunk_count,
+        struct mesher_arena* arena,
+        struct mesher_mesh* meshes)
+{
+    double start, elapsed;
+    bool overflowed;
+    do {
+        arena->used = 0;
+        start = util_time();
+        mesher_mesh_chunks(
+            pool,
+            world,
+            method,
+            lod,
+            skirts,
+            coords,
+            chunk_count,
+            arena,
+            meshes
+        );
+        elapsed = util_time() - start;
+
+        overflowed = arena->used > arena->capacity;
+        if (overflowed) {
+            arena->capacity = arena->used;
+            arena->data = realloc(arena->data, arena->capacity);
+            assert(arena->data);
+        }
+    } while (overflowed);
+
+    return elapsed;
+}
+
+// Coordinates of a cube of chunks centred on the origin, three per chunk
+static int32_t* cube_coords(int32_t chunks)
+{
+    uint32_t chunk_count = (uint32_t)(chunks * chunks * chunks);
+    int32_t* coords = malloc(chunk_count * 3 * sizeof(*coords));
+    assert(coords);
+
+    uint32_t i = 0;
+    int32_t x, y, z;
+    for (y=0; y<chunks; y++) {
+        for (z=0; z<chunks; z++) {
+            for (x=0; x<chunks; x++) {
+                coords[i * 3] = x - chunks / 2;
+                coords[i * 3 + 1] = y - chunks / 2;
+                coords[i * 3 + 2] = z - chunks / 2;
+                i++;
+            }
+        }
+    }
+
+    return coords;
+}
+
+static int mesh(const struct cave* cave, int32_t chunks)
+{
+    struct voxel_world world;
+    generate(cave, chunks, &world);
+
+    uint32_t chunk_count = (uint32_t)(chunks * chunks * chunks);
+    int32_t* coords = cube_coords(chunks);
+    struct mesher_mesh* meshes = malloc(chunk_count * sizeof(*meshes));
+    assert(meshes);
+
+    struct job_pool pool;
+    jobs_init(&pool, 0);
+
+    struct mesher_arena arena = {.capacity = CAVEGEN_MESH_ARENA};
+    arena.data = malloc(arena.capacity);
+    assert(arena.data);
+
+    printf("%u chunks on %u workers and the main thread:\n",
+        chunk_count,
+        pool.thread_count
+    );
+
+    uint32_t i, method;
+    for (method=0; method<MESHER_METHOD_COUNT; method++) {
+        double elapsed = mesh_all(
+            &pool,
+            &world,
+            method,
+            0,
+            0,
+            coords,
+            chunk_count,
+            &arena,
+            meshes
+        );
+
+        uint64_t triangles = 0;
+        uint64_t vertices = 0;
+        double total_time = 0.0;
+        double max_time = 0.0;
+        for (i=0; i<chunk_count; i++) {
+            triangles += meshes[i].index_count / 3;
+            vertices += meshes[i].vertex_count;
+            total_time += meshes[i].time;
+            if (meshes[i].time > max_time)
+                max_time = meshes[i].time;
+        }
+
+        printf("    %s: %llu triangles, %llu vertices, %.2f MiB, "
+            "%.1f KiB per chunk\n",
+            mesher_get_method_name(method),
+            (unsigned long long)triangles,
+            (unsigned long long)vertices,
+            arena.used / (1024.0 * 1024.0),
+            arena.used / 1024.0 / chunk_count
+        );
+        printf("        %.2f million triangles per second, %.1f chunks at once\n",
+            triangles / elapsed / 1e6,
+            total_time / elapsed
+        );
+        printf("        %.3f ms per chunk on average, %.3f ms at most\n",
+            total_time * 1e3 / chunk_count,
+            max_time * 1e3
+        );
+    }
+
+    free(arena.data);
+    jobs_destroy(&pool);
+    free(meshes);
+    free(coords);
+    voxel_world_destroy(&world);
+
+    return 0;
+}
+
+// Every method at every level of detail, then again with skirts on every
+// face, the most a chunk between rings of the world's can have
+static int lod(const struct cave* cave, int32_t chunks)
+{
+    struct voxel_world world;
+    generate(cave, chunks, &world);
+
+    uint32_t chunk_count = (uint32_t)(chunks * chunks * chunks);
+    int32_t* coords = cube_coords(chunks);
+    struct mesher_mesh* meshes = malloc(chunk_count * sizeof(*meshes));
+    assert(meshes);
+
+    struct job_pool pool;
+    jobs_init(&pool, 0);
+
+    struct mesher_arena arena = {.capacity = CAVEGEN_MESH_ARENA};
+    arena.data = malloc(arena.capacity);
+    assert(arena.data);
+
+    printf("%u chunks on %u workers and the main thread:\n",
+        chunk_count,
+        pool.thread_count
+    );
+
+    uint32_t i, method, level;
+    for (method=0; method<MESHER_METHOD_COUNT; method++) {
+        printf("    %s:\n", mesher_get_method_name(method));
+
+        uint64_t full_triangles = 0;
+        for (level=0; level<=MESHER_MAX_LOD; level++) {
+            uint64_t triangles[2] = {0, 0};
+            double total_time[2] = {0.0, 0.0};
+            double max_time = 0.0;
+            uint32_t skirted;
+            for (skirted=0; skirted<2; skirted++) {
+                mesh_all(
+                    &pool,
+                    &world,
+                    method,
+                    level,
+                    skirted ? MESHER_SKIRT_ALL : 0,
+                    coords,
+                    chunk_count,
+                    &arena,
+                    meshes
+                );
+                for (i=0; i<chunk_count; i++) {
+                    triangles[skirted] += meshes[i].index_count / 3;
+                    total_time[skirted] += meshes[i].time;
+                    if (!skirted && meshes[i].time > max_time)
+                        max_time = meshes[i].time;
+                }
+            }
+            if (level == 0)
+                full_triangles = triangles[0];
+
+            printf("        %ux: %llu triangles, %.1f%% of full detail, "
+                "%.1f%% more skirted\n",
+                1u << level,
+                (unsigned long long)triangles[0],
+                full_triangles ?
+                    triangles[0] * 100.0 / full_triangles : 0.0,
+                triangles[0] ?
+                    (triangles[1] - triangles[0]) * 100.0 / triangles[0] : 0.0
+            );
+            printf("            %.3f ms per chunk on average, %.3f ms at "
+                "most, %.3f ms skirted\n",
+                total_time[0] * 1e3 / chunk_count,
+                max_time * 1e3,
+                total_time[1] * 1e3 / chunk_count
+            );
+        }
+    }
+
+    free(arena.data);
+    jobs_destroy(&pool);
+    free(meshes);
+    free(coords);
+    voxel_world_destroy(&world);
+
+    return 0;
+}
+
+static int dig(const struct cave* cave, float radius)
+{
+    struct voxel_world world;
+    generate(cave, CAVEGEN_STORE_CHUNKS, &world);
+
+    struct job_pool pool;
+    jobs_init(&pool, 0);
+
+    struct mesher_arena arena = {.capacity = CAVEGEN_MESH_ARENA};
+    arena.data = malloc(arena.capacity);
+    assert(arena.data);
+
+    // Enough for every chunk of the cube
+    uint32_t chunk_capacity = CAVEGEN_STORE_CHUNKS * CAVEGEN_STORE_CHUNKS *
+        CAVEGEN_STORE_CHUNKS;
+    int32_t* coords = malloc(chunk_capacity * 3 * sizeof(*coords));
+    struct mesher_mesh* meshes = malloc(chunk_capacity * sizeof(*meshes));
+    assert(coords && meshes);
+
+    // The tunnel winds around the cube's middle, well inside its chunks
+    float reach = CAVEGEN_STORE_CHUNKS * VOXEL_CHUNK_SIZE * 0.3f;
+
+    uint64_t changed_edits = 0;
+    uint64_t remeshed = 0;
+    uint64_t triangles = 0;
+    uint32_t late = 0;
+    double edit_time = 0.0;
+    double mesh_time = 0.0;
+    double max_latency = 0.0;
+
+    uint32_t i;
+    for (i=0; i<CAVEGEN_DIG_EDITS; i++) {
+        float t = (float)i * radius / reach;
+        struct voxel_edit edit = {
+            .shape = VOXEL_SHAPE_SPHERE,
+            .center = {
+                reach * sinf(t),
+                reach * 0.5f * sinf(t * 1.7f),
+                reach * cosf(t * 0.6f)
+            },
+            .extent = {radius, radius, radius},
+            .material = VOXEL_MATERIAL_AIR
+        };
+
+        double start = util_time();
+        int32_t changed_min[3], changed_max[3];
+        bool changed = voxel_world_edit(
+            &world,
+            &edit,
+            changed_min,
+            changed_max
+        );
+        double edited = util_time();
+        edit_time += edited - start;
+        if (!changed)
+            continue;
+
+        // Chunks outside the cube have no mesh to replace
+        int32_t chunk_min[3], chunk_max[3];
+        mesher_get_dependent_chunks(
+            changed_min,
+            changed_max,
+            0,
+            chunk_min,
+            chunk_max
+        );
+        uint32_t chunk_count = 0;
+        int32_t x, y, z;
+        for (y=chunk_min[1]; y<=chunk_max[1]; y++) {
+            for (z=chunk_min[2]; z<=chunk_max[2]; z++) {
+                for (x=chunk_min[0]; x<=chunk_max[0]; x++) {
+                    if (!voxel_world_find(&world, x, y, z))
+                        continue;
+
+                    coords[chunk_count * 3] = x;
+                    coords[chunk_count * 3 + 1] = y;
+                    coords[chunk_count * 3 + 2] = z;
+                    chunk_count++;
+                }
+            }
+        }
+
+        mesh_all(
+            &pool,
+            &world,
+            MESHER_SURFACE_NETS,
+            0,
+            0,
+            coords,
+            chunk_count,
+            &arena,
+            meshes
+        );
+        double meshed = util_time();
+        mesh_time += meshed - edited;
+
+        double latency = meshed - start;
+        if (latency > max_latency)
+            max_latency = latency;
+        if (latency > CAVEGEN_FRAME_SECONDS)
+            late++;
+
+        uint32_t j;
+        for (j=0; j<chunk_count; j++)
+            triangles += meshes[j].index_count / 3;
+        remeshed += chunk_count;
+        changed_edits++;
+    }
+
+    printf("%llu of %u spheres of radius %.1f changed voxels, "
+        "on %u workers and the main thread\n",
+        (unsigned long long)changed_edits,
+        CAVEGEN_DIG_EDITS,
+        radius,
+        pool.thread_count
+    );
+    if (changed_edits > 0) {
+        printf("    %.2f chunks meshed again per edit, "
+            "%.0f triangles each\n",
+            (double)remeshed / changed_edits,
+            (double)triangles / remeshed
+        );
+        printf("    %.3f ms editing and %.3f ms meshing per edit\n",
+            edit_time * 1e3 / CAVEGEN_DIG_EDITS,
+            mesh_time * 1e3 / changed_edits
+        );
+        printf("    %.3f ms at most, %u edits took longer than a frame\n",
+            max_latency * 1e3,
+            late
+        );
+    }
+
+    free(meshes);
+    free(coords);
+    free(arena.data);
+    jobs_destroy(&pool);
+    voxel_world_destroy(&world);
+
+    return 0;
+}
+
+// Steps voxel by voxel through the store, the baseline for the octree.
+// Each plane's time is its distance from the origin times the inverse
+// step, in doubles like the octree's, so both see the same crossings
+static bool march(
+        const struct voxel_world* world,
+        const float* origin,
+        const float* direction,
+        float max_distance,
+        int32_t* voxel)
+{
+    int32_t step[3];
+    double next[3], inverse[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        voxel[j] = (int32_t)floorf(origin[j]);
+        step[j] = direction[j] < 0.0f ? -1 : 1;
+        inverse[j] = direction[j] != 0.0f ?
+            1.0 / fabs((double)direction[j]) : INFINITY;
+        double boundary = direction[j] < 0.0f ?
+            (double)origin[j] - voxel[j] : voxel[j] + 1 - (double)origin[j];
+        next[j] = direction[j] != 0.0f ? boundary * inverse[j] : INFINITY;
+    }
+
+    double distance = 0.0;
+    while (distance <= max_distance) {
+        if (voxel_world_get(world, voxel[0], voxel[1], voxel[2]) !=
+            VOXEL_MATERIAL_AIR)
+            return true;
+
+        uint32_t axis = next[0] < next[1] ?
+            (next[0] < next[2] ? 0 : 2) :
+            (next[1] < next[2] ? 1 : 2);
+        distance = next[axis];
+        voxel[axis] += step[axis];
+
+        int32_t plane = step[axis] > 0 ? voxel[axis] + 1 : voxel[axis];
+        double boundary = step[axis] > 0 ?
+            plane - (double)origin[axis] : (double)origin[axis] - plane;
+        next[axis] = boundary * inverse[axis];
+    }
+
+    return false;
+}
+
+static int octree(const struct cave* cave, int32_t chunks)
+{
+    uint32_t chunk_depth = 0;
+    while ((1 << chunk_depth) < chunks)
+        chunk_depth++;
+    chunks = 1 << chunk_depth;
+
+    struct voxel_world world;
+    generate(cave, chunks, &world);
+
+    struct voxel_world_stats stats;
+    voxel_world_get_stats(&world, &stats);
+    double voxels = (double)stats.chunk_count * VOXEL_CHUNK_VOLUME;
+
+    struct octree tree;
+    int32_t chunk_min[3] = {-chunks / 2, -chunks / 2, -chunks / 2};
+    double start = util_time();
+    octree_build(&tree, &world, chunk_min, chunk_depth);
+    double build_time = util_time() - start;
+
+    size_t bytes = octree_bytes(&tree);
+    printf("%u chunks built in %.2f s, %u nodes, %u leaves, %u bricks\n",
+        stats.chunk_count,
+        build_time,
+        tree.node_count,
+        tree.leaf_count,
+        tree.brick_count
+    );
+    printf("Octree: %.2f MiB, %.3f bytes per voxel, %.1f MiB per km3\n",
+        bytes / (1024.0 * 1024.0),
+        bytes / voxels,
+        bytes / voxels * CAVEGEN_VOXELS_PER_KM3 / (1024.0 * 1024.0)
+    );
+    printf("Store: %.2f MiB, %.3f bytes per voxel, %.1f MiB per km3\n",
+        stats.bytes / (1024.0 * 1024.0),
+        stats.bytes / voxels,
+        stats.bytes / voxels * CAVEGEN_VOXELS_PER_KM3 / (1024.0 * 1024.0)
+    );
+
+    // Rays from open space anywhere in the cube in any direction, as a
+    // player would cast them, the same ones for both so the hits can be
+    // compared
+    float* rays = malloc(CAVEGEN_RAYS * 6 * sizeof(*rays));
+    assert(rays);
+    float extent = (float)(chunks * VOXEL_CHUNK_SIZE);
+    uint32_t state = 1;
+    uint32_t i, j;
+    for (i=0; i<CAVEGEN_RAYS; i++) {
+        float* ray = &rays[i * 6];
+        do {
+            for (j=0; j<3; j++) {
+                state = state * 1664525u + 1013904223u;
+                ray[j] = ((state >> 8) / 16777216.0f - 0.5f) * extent;
+            }
+        } while (voxel_world_get(
+            &world,
+            (int32_t)floorf(ray[0]),
+            (int32_t)floorf(ray[1]),
+            (int32_t)floorf(ray[2])) != VOXEL_MATERIAL_AIR);
+
+        float length;
+        do {
+            for (j=0; j<3; j++) {
+                state = state * 1664525u + 1013904223u;
+                ray[3 + j] = (state >> 8) / 8388608.0f - 1.0f;
+            }
+            length = sqrtf(ray[3] * ray[3] + ray[4] * ray[4] +
+                ray[5] * ray[5]);
+        } while (length > 1.0f || length < 0.01f);
+        for (j=0; j<3; j++)
+            ray[3 + j] /= length;
+    }
+
+    uint8_t* hits = malloc(CAVEGEN_RAYS);
+    int32_t* voxels_hit = malloc(CAVEGEN_RAYS * 3 * sizeof(*voxels_hit));
+    assert(hits && voxels_hit);
+
+    uint32_t hit_count = 0;
+    start = util_time();
+    for (i=0; i<CAVEGEN_RAYS; i++) {
+        struct octree_hit hit;
+        hits[i] = octree_raycast(
+            &tree,
+            &rays[i * 6],
+            &rays[i * 6 + 3],
+            CAVEGEN_RAY_DISTANCE,
+            0,
+            &hit
+        );
+        memcpy(&voxels_hit[i * 3], hit.voxel, sizeof(hit.voxel));
+        hit_count += hits[i];
+    }
+    double octree_time = util_time() - start;
+
+    uint32_t agree = 0;
+    start = util_time();
+    for (i=0; i<CAVEGEN_RAYS; i++) {
+        int32_t voxel[3];
+        bool hit = march(
+            &world,
+            &rays[i * 6],
+            &rays[i * 6 + 3],
+            CAVEGEN_RAY_DISTANCE,
+            voxel
+        );
+        agree += hit == hits[i] &&
+            (!hit || memcmp(voxel, &voxels_hit[i * 3], sizeof(voxel)) == 0);
+    }
+    double march_time = util_time() - start;
+
+    printf("Rays up to %.0f voxels: %.2f million per second, "
+        "%.2f voxel by voxel\n",
+        CAVEGEN_RAY_DISTANCE,
+        CAVEGEN_RAYS / octree_time / 1e6,
+        CAVEGEN_RAYS / march_time / 1e6
+    );
+    printf("    %.1f%% hit, %u of %u agree\n",
+        hit_count * 100.0 / CAVEGEN_RAYS,
+        agree,
+        CAVEGEN_RAYS
+    );
+
+    // Boxes of a chunk's worth of cells with borders, as a mesher would
+    // read them at each level of detail
+    uint32_t size[3] = {
+        VOXEL_CHUNK_SIZE + 2,
+        VOXEL_CHUNK_SIZE + 2,
+        VOXEL_CHUNK_SIZE + 2
+    };
+    uint16_t* box = malloc(size[0] * size[1] * size[2] * sizeof(*box));
+    assert(box);
+
+    uint32_t lod;
+    for (lod=0; lod<CAVEGEN_OCTREE_LODS && lod<=tree.depth; lod++) {
+        int32_t cells = (chunks * VOXEL_CHUNK_SIZE) >> lod;
+        int32_t boxes = (cells + VOXEL_CHUNK_SIZE - 1) / VOXEL_CHUNK_SIZE;
+        uint64_t checksum = 0;
+        int32_t x, y, z;
+        start = util_time();
+        for (y=0; y<boxes; y++) {
+            for (z=0; z<boxes; z++) {
+                for (x=0; x<boxes; x++) {
+                    int32_t min[3] = {
+                        (tree.origin[0] >> lod) + x * VOXEL_CHUNK_SIZE - 1,
+                        (tree.origin[1] >> lod) + y * VOXEL_CHUNK_SIZE - 1,
+                        (tree.origin[2] >> lod) + z * VOXEL_CHUNK_SIZE - 1
+                    };
+                    octree_read(&tree, min, size, lod, box);
+                    checksum += box[0];
+                }
+            }
+        }
+        double read_time = util_time() - start;
+
+        printf("Reads at %ux: %.3f ms per box of %u cells, %d boxes "
+            "(checksum %llu)\n",
+            1u << lod,
+            read_time * 1e3 / (boxes * boxes * boxes),
+            size[0],
+            boxes * boxes * boxes,
+            (unsigned long long)checksum
+        );
+    }
+
+    free(box);
+    free(voxels_hit);
+    free(hits);
+    free(rays);
+    octree_destroy(&tree);
+    voxel_world_destroy(&world);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    bool is_bench = argc >= 2 && strcmp(argv[1], "bench") == 0;
+    bool is_slice = argc >= 3 && strcmp(argv[1], "slice") == 0;
+    bool is_store = argc >= 2 && strcmp(argv[1], "store") == 0;
+    bool is_mesh = argc >= 2 && strcmp(argv[1], "mesh") == 0;
+    bool is_lod = argc >= 2 && strcmp(argv[1], "lod") == 0;
+    bool is_dig = argc >= 2 && strcmp(argv[1], "dig") == 0;
+    bool is_octree = argc >= 2 && strcmp(argv[1], "octree") == 0;
+    if (!is_bench && !is_slice && !is_store && !is_mesh && !is_lod &&
+        !is_dig && !is_octree) {
+        fprintf(stderr,
+            "usage: %s bench [seed]\n"
+            "       %s slice <output .pgm> [seed] [height]\n"
+            "       %s store [seed] [chunks per side]\n"
+            "       %s mesh [seed] [chunks per side]\n"
+            "       %s lod [seed] [chunks per side]\n"
+            "       %s dig [seed] [radius]\n"
+            "       %s octree [seed] [chunks per side]\n",
+            argv[0],
+            argv[0],
+            argv[0],
+            argv[0],
+            argv[0],
+            argv[0],
+            argv[0]
+        );
+        return 1;
+    }
+
+    uint32_t seed_arg = is_slice ? 3 : 2;
+    uint64_t seed = 1;
+    if ((uint32_t)argc > seed_arg)
+        seed = strtoull(argv[seed_arg], NULL, 10);
+
+    struct cave_params params;
+    cave_default_params(&params, seed);
+
+    struct cave cave;
+    cave_init(&cave, &params);
+
+    if (is_bench)
+        return bench(&cave);
+
+    if (is_dig) {
+        float radius = CAVEGEN_DIG_RADIUS;
+        if (argc > 3)
+            radius = strtof(argv[3], NULL);
+        return dig(&cave, radius > 0.0f ? radius : CAVEGEN_DIG_RADIUS);
+    }
+
+    if (is_store || is_mesh || is_lod || is_octree) {
+        int32_t chunks = CAVEGEN_STORE_CHUNKS;
+        if (argc > 3)
+            chunks = atoi(argv[3]);
+        chunks = chunks > 0 ? chunks : 1;
+        if (is_octree)
+            return octree(&cave, chunks);
+        if (is_lod)
+            return lod(&cave, chunks);
+        return is_store ? store(&cave, chunks) : mesh(&cave, chunks);
+    }
+
+    float height = 0.0f;
+    if (argc > 4)
+        height = strtof(argv[4], NULL);
+
+    return slice(&cave, argv[2], height);
+}
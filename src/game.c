@@ -1,23 +1,247 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
 #include "renderer.h"
+#include "bench.h"
+#include "util.h"
+#include "trace.h"
 #include "game.h"
 
-void game_init(struct game* self)
+#define GAME_HEADLESS_FRAMES 100
+
+// Scripted benchmark orbit, wide enough to pass through every LOD
+#define GAME_BENCH_ORBIT_RADIUS 24.0f
+#define GAME_BENCH_ORBIT_HEIGHT 12.0f
+#define GAME_BENCH_ORBIT_DURATION 10.0f
+
+// Frames averaged per overlay update, so the title stays readable
+#define GAME_OVERLAY_INTERVAL 30
+
+//     main [--headless] [--frames <count>] [--output <frame.ppm>]
+//          [--bench <report.json>] [--path <camera path>]
+//          [--trace <trace.json>] [--overlay]
+void game_init(struct game* self, int argc, char** argv)
 {
     memset(self, 0, sizeof(*self));
 
     self->running = true;
+    self->frame_limit = GAME_HEADLESS_FRAMES;
+
+    int i;
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0)
+            self->headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            self->frame_limit = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            self->frame_output = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+            self->bench_output = argv[++i];
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+            self->camera_path = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            self->trace_output = argv[++i];
+        else if (strcmp(argv[i], "--overlay") == 0)
+            self->overlay = true;
+    }
+
+    trace_set_thread_name("main");
+    if (self->trace_output)
+        trace_enable(true);
+
+    // Headless runs go straight to Vulkan, there is no window system
+    if (self->headless)
+        return;
 
-	glfwInit();
+    glfwInit();
 
     assert(glfwVulkanSupported() == GLFW_TRUE);
 }
 
+// Frames are placed evenly along the path rather than by wall clock, so
+// every run renders the same views whatever the frame rate
+static void game_run_bench(
+        struct game* self,
+        struct renderer_resources* resources)
+{
+    struct bench_path path;
+    if (self->camera_path) {
+        if (!bench_path_load(self->camera_path, &path)) {
+            printf("Failed to load camera path %s\n", self->camera_path);
+            return;
+        }
+    } else {
+        bench_path_orbit(
+            &path,
+            GAME_BENCH_ORBIT_RADIUS,
+            GAME_BENCH_ORBIT_HEIGHT,
+            GAME_BENCH_ORBIT_DURATION
+        );
+    }
+
+    struct bench_report report;
+    bench_report_init(&report, self->frame_limit);
+    report.path_name = self->camera_path ? self->camera_path : "orbit";
+    report.width = resources->swapchain_extent.width;
+    report.height = resources->swapchain_extent.height;
+
+    float duration = bench_path_duration(&path);
+    uint32_t frame;
+    for (frame=0; frame<self->frame_limit; frame++) {
+        float time = self->frame_limit > 1 ?
+            duration * frame / (self->frame_limit - 1) : 0.0f;
+        bench_path_sample(
+            &path,
+            time,
+            resources->camera.eye,
+            resources->camera.center
+        );
+
+        TRACE_BEGIN(scope, "frame");
+        if (!self->headless)
+            glfwPollEvents();
+
+        double start = util_time();
+        renderer_render(resources);
+        double cpu_time = (util_time() - start) * 1000.0;
+        TRACE_END(scope);
+
+        // GPU times trail by a few frames, they belong to whichever frame
+        // the profiler resolved during this one
+        struct renderer_gpu_profiler* profiler = &resources->gpu_profiler;
+        bench_report_add_frame(
+            &report,
+            cpu_time,
+            profiler->resolved ? profiler->frame_time : -1.0,
+            resources->stats.draw_count,
+            resources->stats.triangle_count
+        );
+
+        uint32_t i, j;
+        for (i=0; profiler->resolved && i<profiler->scope_count; i++) {
+            struct renderer_gpu_scope* gpu_scope = &profiler->scopes[i];
+            bench_report_add_scope(&report, gpu_scope->name, gpu_scope->time);
+
+            for (j=0; gpu_scope->has_statistics &&
+                    j<RENDERER_GPU_STATISTIC_COUNT; j++) {
+                bench_report_add_counter(
+                    &report,
+                    gpu_scope->name,
+                    renderer_get_gpu_statistic_name(j),
+                    (double)gpu_scope->statistics[j]
+                );
+            }
+        }
+    }
+
+    if (bench_report_write_json(&report, self->bench_output))
+        printf("Wrote %s\n", self->bench_output);
+    else
+        printf("Failed to write %s\n", self->bench_output);
+
+    bench_report_free(&report);
+    bench_path_free(&path);
+}
+
+static void game_run_headless(struct game* self)
+{
+    struct renderer_resources resources;
+
+    renderer_create_resources(&resources, NULL);
+    printf("Headless renderer created, rendering %u frames.\n",
+        self->frame_limit);
+
+    if (self->bench_output) {
+        game_run_bench(self, &resources);
+    } else {
+        uint32_t frame;
+        for (frame=0; frame<self->frame_limit; frame++) {
+            TRACE_BEGIN(scope, "frame");
+            renderer_render(&resources);
+            TRACE_END(scope);
+        }
+    }
+
+    if (self->frame_output && self->frame_limit > 0) {
+        if (renderer_save_frame(&resources, self->frame_output))
+            printf("Wrote %s\n", self->frame_output);
+        else
+            printf("Failed to write %s\n", self->frame_output);
+    }
+
+    renderer_destroy_resources(&resources);
+    printf("Renderer resources destroyed successfully.\n");
+}
+
+// There is no text rendering, the window title doubles as the overlay
+static void game_update_overlay(
+        GLFWwindow* window,
+        struct renderer_resources* resources,
+        double frame_time)
+{
+    char title[256];
+    int length = snprintf(title, sizeof(title),
+        "%.2f ms, %u draws, %u triangles",
+        frame_time,
+        resources->stats.draw_count,
+        resources->stats.triangle_count
+    );
+
+    if (resources->stats.gpu_time >= 0.0 && length < (int)sizeof(title)) {
+        length += snprintf(title + length, sizeof(title) - length,
+            ", GPU %.2f ms",
+            resources->stats.gpu_time
+        );
+    }
+
+    uint32_t scope = renderer_find_gpu_scope(
+        &resources->gpu_profiler,
+        "render_pass"
+    );
+    if (scope != UINT32_MAX && length < (int)sizeof(title)) {
+        struct renderer_gpu_scope* render_pass;
+        render_pass = &resources->gpu_profiler.scopes[scope];
+        if (render_pass->has_statistics) {
+            uint64_t* statistics = render_pass->statistics;
+            snprintf(title + length, sizeof(title) - length,
+                ", %llu vertices, %llu clipped primitives, %llu fragments",
+                (unsigned long long)
+                    statistics[RENDERER_GPU_STATISTIC_VERTEX_INVOCATIONS],
+                (unsigned long long)
+                    statistics[RENDERER_GPU_STATISTIC_CLIPPING_PRIMITIVES],
+                (unsigned long long)
+                    statistics[RENDERER_GPU_STATISTIC_FRAGMENT_INVOCATIONS]
+            );
+        }
+    }
+
+    glfwSetWindowTitle(window, title);
+}
+
+// After the renderer is destroyed, so its worker threads have stopped
+static void game_write_trace(struct game* self)
+{
+    if (!self->trace_output)
+        return;
+
+    if (trace_write(self->trace_output))
+        printf("Wrote %s\n", self->trace_output);
+    else
+        printf("Failed to write %s\n", self->trace_output);
+
+    trace_shutdown();
+}
+
 void game_setup_renderer(struct game* self)
 {
+    if (self->headless) {
+        game_run_headless(self);
+        game_write_trace(self);
+        return;
+    }
+
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
     GLFWwindow* window = glfwCreateWindow(
@@ -37,13 +261,32 @@ void game_setup_renderer(struct game* self)
     renderer_create_resources(&resources, window);
     printf("Renderer created prepared successfully.\n");
 
-    while(!glfwWindowShouldClose(window)) {
+    if (self->bench_output)
+        game_run_bench(self, &resources);
+
+    double overlay_start = util_time();
+    uint32_t overlay_frames = 0;
+    while(!self->bench_output && !glfwWindowShouldClose(window)) {
+        TRACE_BEGIN(scope, "frame");
         glfwPollEvents();
         renderer_render(&resources);
+        TRACE_END(scope);
+
+        if (self->overlay && ++overlay_frames == GAME_OVERLAY_INTERVAL) {
+            double now = util_time();
+            game_update_overlay(
+                window,
+                &resources,
+                (now - overlay_start) * 1000.0 / overlay_frames
+            );
+            overlay_start = now;
+            overlay_frames = 0;
+        }
     }
 
     renderer_destroy_resources(&resources);
     printf("Renderer resources destroyed successfully.\n");
 
     glfwDestroyWindow(window);
+    game_write_trace(self);
 }
@@ -3,12 +3,26 @@
 
 #include "stdbool.h"
 
+#include <stdint.h>
+
+// Headless runs render frame_limit frames offscreen, then optionally
+// write the last one to frame_output. Benchmarks play camera_path, or a
+// scripted orbit, over frame_limit frames and write bench_output. With a
+// trace_output CPU scopes are recorded and written there on exit
 struct game
 {
     bool running;
+    bool headless;
+    uint32_t frame_limit;
+    const char* frame_output;
+    const char* bench_output;
+    const char* camera_path;
+    const char* trace_output;
+    // Frame stats in the window title
+    bool overlay;
 };
 
-void game_init(struct game* self);
+void game_init(struct game* self, int argc, char** argv);
 void game_setup_renderer(struct game* self);
 
 #endif
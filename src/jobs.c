@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "trace.h"
+
+// Takes the next job off the queue, the pool mutex must be held
+static bool jobs_pop(struct job_pool* pool, struct job* job)
+{
+    if (pool->queue_count == 0)
+        return false;
+
+    *job = pool->queue[pool->queue_head];
+    pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+    pool->queue_count--;
+
+    return true;
+}
+
+// Runs a job with the pool mutex released, then retires it
+static void jobs_run(struct job_pool* pool, struct job* job)
+{
+    pthread_mutex_unlock(&pool->mutex);
+    TRACE_BEGIN(scope, "job");
+    job->function(job->data);
+    TRACE_END(scope);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (job->group && --job->group->pending == 0)
+        pthread_cond_broadcast(&pool->job_finished);
+}
+
+static void* jobs_worker(void* data)
+{
+    struct job_pool* pool = data;
+
+    trace_set_thread_name("jobs worker");
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->running) {
+        struct job job;
+        if (jobs_pop(pool, &job))
+            jobs_run(pool, &job);
+        else
+            pthread_cond_wait(&pool->job_available, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+void jobs_init(struct job_pool* pool, uint32_t thread_count)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    if (thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 1 ? (uint32_t)cores - 1 : 1;
+    }
+    if (thread_count > JOBS_MAX_THREADS)
+        thread_count = JOBS_MAX_THREADS;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->job_finished, NULL);
+
+    pool->queue_capacity = 64;
+    pool->queue = malloc(pool->queue_capacity * sizeof(*pool->queue));
+    assert(pool->queue);
+
+    pool->running = true;
+
+    uint32_t i;
+    for (i=0; i<thread_count; i++) {
+        int result = pthread_create(
+            &pool->threads[i],
+            NULL,
+            jobs_worker,
+            pool
+        );
+        assert(result == 0);
+    }
+    pool->thread_count = thread_count;
+}
+
+void jobs_submit(
+        struct job_pool* pool,
+        struct job_group* group,
+        job_function function,
+        void* data)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    // Grow the ring, unwrapping it into the new allocation
+    if (pool->queue_count == pool->queue_capacity) {
+        uint32_t capacity = pool->queue_capacity * 2;
+        struct job* queue = malloc(capacity * sizeof(*queue));
+        assert(queue);
+
+        uint32_t i;
+        for (i=0; i<pool->queue_count; i++) {
+            queue[i] = pool->queue[
+                (pool->queue_head + i) % pool->queue_capacity
+            ];
+        }
+
+        free(pool->queue);
+        pool->queue = queue;
+        pool->queue_capacity = capacity;
+        pool->queue_head = 0;
+    }
+
+    struct job job = {
+        .function = function,
+        .data = data,
+        .group = group
+    };
+    uint32_t tail = (pool->queue_head + pool->queue_count) %
+        pool->queue_capacity;
+    pool->queue[tail] = job;
+    pool->queue_count++;
+
+    if (group)
+        group->pending++;
+
+    pthread_cond_signal(&pool->job_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void jobs_wait(struct job_pool* pool, struct job_group* group)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (group->pending > 0) {
+        struct job job;
+        if (jobs_pop(pool, &job))
+            jobs_run(pool, &job);
+        else
+            pthread_cond_wait(&pool->job_finished, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+bool jobs_done(struct job_pool* pool, struct job_group* group)
+{
+    pthread_mutex_lock(&pool->mutex);
+    bool done = group->pending == 0;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return done;
+}
+
+void jobs_destroy(struct job_pool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = false;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    uint32_t i;
+    for (i=0; i<pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->queue);
+    pthread_cond_destroy(&pool->job_finished);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_mutex_destroy(&pool->mutex);
+}
@@ -0,0 +1,61 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define JOBS_MAX_THREADS 32
+
+typedef void (*job_function)(void* data);
+
+struct job
+{
+    job_function function;
+    void* data;
+    struct job_group* group;
+};
+
+// Jobs submitted against a group can be waited on together
+struct job_group
+{
+    uint32_t pending;
+};
+
+// Fixed set of worker threads pulling from one shared queue
+struct job_pool
+{
+    pthread_t threads[JOBS_MAX_THREADS];
+    uint32_t thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t job_available;
+    pthread_cond_t job_finished;
+
+    struct job* queue;
+    uint32_t queue_capacity;
+    uint32_t queue_head;
+    uint32_t queue_count;
+
+    bool running;
+};
+
+// A thread_count of 0 uses one worker per core, less the calling thread
+void jobs_init(struct job_pool* pool, uint32_t thread_count);
+
+void jobs_submit(
+    struct job_pool* pool,
+    struct job_group* group,
+    job_function function,
+    void* data
+);
+
+// Runs queued jobs on the calling thread until the group is done
+void jobs_wait(struct job_pool* pool, struct job_group* group);
+
+// Whether every job in the group has finished, without waiting
+bool jobs_done(struct job_pool* pool, struct job_group* group);
+
+void jobs_destroy(struct job_pool* pool);
+
+#endif
@@ -9,7 +9,7 @@
 int main(int argc, char* argv[])
 {
     struct game game;
-    game_init(&game);
+    game_init(&game, argc, argv);
     game_setup_renderer(&game);
 
     return 0;
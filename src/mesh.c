@@ -0,0 +1,727 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "mesh.h"
+#include "trace.h"
+
+// Symmetric 4x4 error quadric, stored as its upper triangle
+struct mesh_quadric
+{
+    double a00, a01, a02, a03;
+    double a11, a12, a13;
+    double a22, a23;
+    double a33;
+};
+
+struct mesh_collapse
+{
+    uint32_t src;
+    uint32_t dst;
+    double cost;
+};
+
+static const float* mesh_position(
+        const float* positions,
+        size_t position_stride,
+        uint32_t index)
+{
+    return (const float*)((const char*)positions + position_stride * index);
+}
+
+static void mesh_quadric_add_plane(
+        struct mesh_quadric* q,
+        double a,
+        double b,
+        double c,
+        double d)
+{
+    q->a00 += a*a; q->a01 += a*b; q->a02 += a*c; q->a03 += a*d;
+    q->a11 += b*b; q->a12 += b*c; q->a13 += b*d;
+    q->a22 += c*c; q->a23 += c*d;
+    q->a33 += d*d;
+}
+
+static void mesh_quadric_add(
+        struct mesh_quadric* q,
+        const struct mesh_quadric* other)
+{
+    q->a00 += other->a00; q->a01 += other->a01;
+    q->a02 += other->a02; q->a03 += other->a03;
+    q->a11 += other->a11; q->a12 += other->a12; q->a13 += other->a13;
+    q->a22 += other->a22; q->a23 += other->a23;
+    q->a33 += other->a33;
+}
+
+static double mesh_quadric_error(
+        const struct mesh_quadric* q,
+        const float* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+
+    double error =
+        q->a00*x*x + 2*q->a01*x*y + 2*q->a02*x*z + 2*q->a03*x +
+        q->a11*y*y + 2*q->a12*y*z + 2*q->a13*y +
+        q->a22*z*z + 2*q->a23*z +
+        q->a33;
+
+    return error > 0.0 ? error : 0.0;
+}
+
+static void mesh_triangle_normal(
+        const float* p0,
+        const float* p1,
+        const float* p2,
+        double* n)
+{
+    double e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+    double e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+static int mesh_compare_collapse(
+        const void* a,
+        const void* b)
+{
+    const struct mesh_collapse* ca = a;
+    const struct mesh_collapse* cb = b;
+
+    if (ca->cost < cb->cost)
+        return -1;
+    if (ca->cost > cb->cost)
+        return 1;
+    return 0;
+}
+
+static uint32_t mesh_edge_hash(
+        uint64_t key,
+        uint32_t capacity)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)(key & (capacity - 1));
+}
+
+// Vertices on open edges (mesh borders and attribute seams) are locked so
+// simplification can't open holes or tear UVs apart
+static void mesh_find_locked_vertices(
+        const uint32_t* indices,
+        uint32_t index_count,
+        uint8_t* locked)
+{
+    uint32_t capacity = 1;
+    while (capacity < index_count * 2)
+        capacity <<= 1;
+
+    uint64_t* keys = malloc(capacity * sizeof(*keys));
+    uint32_t* counts = calloc(capacity, sizeof(*counts));
+    assert(keys && counts);
+    memset(keys, 0xff, capacity * sizeof(*keys));
+
+    uint32_t i, j;
+    for (i=0; i<index_count; i+=3)
+    {
+        for (j=0; j<3; j++)
+        {
+            uint32_t a = indices[i+j];
+            uint32_t b = indices[i+(j+1)%3];
+            uint64_t key = a < b ?
+                ((uint64_t)a << 32) | b :
+                ((uint64_t)b << 32) | a;
+
+            uint32_t slot = mesh_edge_hash(key, capacity);
+            while (keys[slot] != UINT64_MAX && keys[slot] != key)
+                slot = (slot + 1) & (capacity - 1);
+
+            keys[slot] = key;
+            counts[slot]++;
+        }
+    }
+
+    for (i=0; i<capacity; i++)
+    {
+        if (keys[i] != UINT64_MAX && counts[i] != 2)
+        {
+            locked[keys[i] >> 32] = 1;
+            locked[keys[i] & 0xffffffff] = 1;
+        }
+    }
+
+    free(keys);
+    free(counts);
+}
+
+uint32_t mesh_simplify(
+        const float* positions,
+        size_t position_stride,
+        uint32_t vertex_count,
+        uint32_t* indices,
+        uint32_t index_count,
+        uint32_t target_index_count,
+        float* error)
+{
+    double max_cost = 0.0;
+
+    struct mesh_quadric* quadrics;
+    quadrics = calloc(vertex_count, sizeof(*quadrics));
+    assert(quadrics);
+
+    uint8_t* locked = calloc(vertex_count, 1);
+    uint8_t* touched = malloc(vertex_count);
+    uint32_t* remap = malloc(vertex_count * sizeof(*remap));
+    uint32_t* adjacency_offsets = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = malloc((index_count + 1) * sizeof(uint32_t));
+    struct mesh_collapse* collapses = malloc(
+        (index_count + 1) * sizeof(*collapses)
+    );
+    assert(locked && touched && remap);
+    assert(adjacency_offsets && adjacency && collapses);
+
+    mesh_find_locked_vertices(indices, index_count, locked);
+
+    // Sum of squared distances to the planes of each vertex's triangles
+    uint32_t i, j, k;
+    for (i=0; i<index_count; i+=3)
+    {
+        const float* p0 = mesh_position(positions, position_stride, indices[i]);
+        const float* p1 = mesh_position(positions, position_stride, indices[i+1]);
+        const float* p2 = mesh_position(positions, position_stride, indices[i+2]);
+
+        double n[3];
+        mesh_triangle_normal(p0, p1, p2, n);
+        double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length <= 0.0)
+            continue;
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+
+        for (j=0; j<3; j++)
+            mesh_quadric_add_plane(&quadrics[indices[i+j]], n[0], n[1], n[2], d);
+    }
+
+    // Each pass collapses an independent set of the cheapest edges
+    while (index_count > target_index_count)
+    {
+        // Vertex to triangle adjacency for the flip test
+        memset(adjacency_offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+        for (i=0; i<index_count; i++)
+            adjacency_offsets[indices[i] + 1]++;
+        for (i=0; i<vertex_count; i++)
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+        for (i=0; i<index_count; i++)
+            adjacency[adjacency_offsets[indices[i]]++] = i / 3;
+        for (i=vertex_count; i>0; i--)
+            adjacency_offsets[i] = adjacency_offsets[i - 1];
+        adjacency_offsets[0] = 0;
+
+        uint32_t collapse_count = 0;
+        for (i=0; i<index_count; i+=3)
+        {
+            for (j=0; j<3; j++)
+            {
+                uint32_t a = indices[i+j];
+                uint32_t b = indices[i+(j+1)%3];
+
+                // Visit each shared edge once
+                if (a > b)
+                    continue;
+                if (locked[a] && locked[b])
+                    continue;
+
+                struct mesh_quadric q = quadrics[a];
+                mesh_quadric_add(&q, &quadrics[b]);
+
+                double cost_ab = locked[a] ? INFINITY : mesh_quadric_error(
+                    &q, mesh_position(positions, position_stride, b));
+                double cost_ba = locked[b] ? INFINITY : mesh_quadric_error(
+                    &q, mesh_position(positions, position_stride, a));
+
+                struct mesh_collapse* collapse = &collapses[collapse_count++];
+                collapse->src = cost_ab <= cost_ba ? a : b;
+                collapse->dst = cost_ab <= cost_ba ? b : a;
+                collapse->cost = cost_ab <= cost_ba ? cost_ab : cost_ba;
+            }
+        }
+
+        qsort(collapses, collapse_count, sizeof(*collapses),
+              mesh_compare_collapse);
+
+        for (i=0; i<vertex_count; i++)
+            remap[i] = i;
+        memset(touched, 0, vertex_count);
+
+        // Each collapse removes roughly two triangles
+        uint32_t collapses_needed =
+            (index_count - target_index_count) / 6 + 1;
+        uint32_t collapses_done = 0;
+
+        for (i=0; i<collapse_count && collapses_done<collapses_needed; i++)
+        {
+            uint32_t src = collapses[i].src;
+            uint32_t dst = collapses[i].dst;
+
+            if (touched[src] || touched[dst])
+                continue;
+
+            // Reject collapses that would flip a surviving triangle
+            const float* dst_pos = mesh_position(
+                positions, position_stride, dst);
+            bool flips = false;
+            for (j=adjacency_offsets[src]; j<adjacency_offsets[src+1]; j++)
+            {
+                uint32_t* tri = &indices[adjacency[j] * 3];
+                if (tri[0] == dst || tri[1] == dst || tri[2] == dst)
+                    continue;
+
+                const float* p[3];
+                const float* q[3];
+                for (k=0; k<3; k++)
+                {
+                    p[k] = mesh_position(positions, position_stride, tri[k]);
+                    q[k] = tri[k] == src ? dst_pos : p[k];
+                }
+
+                double before[3], after[3];
+                mesh_triangle_normal(p[0], p[1], p[2], before);
+                mesh_triangle_normal(q[0], q[1], q[2], after);
+
+                if (before[0]*after[0] +
+                    before[1]*after[1] +
+                    before[2]*after[2] <= 0.0)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips)
+                continue;
+
+            // Lock the one-ring so quadrics and positions stay valid
+            for (j=adjacency_offsets[src]; j<adjacency_offsets[src+1]; j++)
+            {
+                uint32_t* tri = &indices[adjacency[j] * 3];
+                touched[tri[0]] = 1;
+                touched[tri[1]] = 1;
+                touched[tri[2]] = 1;
+            }
+
+            remap[src] = dst;
+            mesh_quadric_add(&quadrics[dst], &quadrics[src]);
+            if (collapses[i].cost > max_cost)
+                max_cost = collapses[i].cost;
+            collapses_done++;
+        }
+
+        if (collapses_done == 0)
+            break;
+
+        // Apply the collapses and drop degenerate triangles
+        uint32_t write = 0;
+        for (i=0; i<index_count; i+=3)
+        {
+            uint32_t a = remap[indices[i]];
+            uint32_t b = remap[indices[i+1]];
+            uint32_t c = remap[indices[i+2]];
+
+            if (a == b || b == c || c == a)
+                continue;
+
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        index_count = write;
+    }
+
+    free(quadrics);
+    free(locked);
+    free(touched);
+    free(remap);
+    free(adjacency_offsets);
+    free(adjacency);
+    free(collapses);
+
+    if (error)
+        *error = (float)sqrt(max_cost);
+
+    return index_count;
+}
+
+uint32_t mesh_build_lods(
+        const float* positions,
+        size_t position_stride,
+        uint32_t vertex_count,
+        const uint32_t* indices,
+        uint32_t index_count,
+        struct mesh_lod* lods,
+        uint32_t max_lod_count,
+        uint32_t** lod_indices,
+        uint32_t* lod_index_count)
+{
+    assert(max_lod_count > 0);
+
+    TRACE_BEGIN(scope, "mesh_build_lods");
+
+    uint32_t arena_capacity = index_count * 2;
+    uint32_t* arena = malloc(arena_capacity * sizeof(*arena));
+    assert(arena);
+
+    memcpy(arena, indices, index_count * sizeof(*arena));
+    lods[0].first_index = 0;
+    lods[0].index_count = index_count;
+    lods[0].error = 0.0f;
+
+    uint32_t arena_count = index_count;
+    uint32_t lod_count = 1;
+
+    while (lod_count < max_lod_count)
+    {
+        struct mesh_lod* previous = &lods[lod_count - 1];
+
+        if (arena_count + previous->index_count > arena_capacity)
+        {
+            arena_capacity = arena_count + previous->index_count;
+            arena = realloc(arena, arena_capacity * sizeof(*arena));
+            assert(arena);
+        }
+        uint32_t* level = &arena[arena_count];
+
+        memcpy(
+            level,
+            &arena[previous->first_index],
+            previous->index_count * sizeof(*arena)
+        );
+
+        uint32_t target = (previous->index_count / 6) * 3;
+
+        float error;
+        uint32_t count = mesh_simplify(
+            positions,
+            position_stride,
+            vertex_count,
+            level,
+            previous->index_count,
+            target,
+            &error
+        );
+
+        if (count == 0 ||
+            count > previous->index_count * MESH_LOD_MIN_REDUCTION)
+        {
+            break;
+        }
+
+        lods[lod_count].first_index = arena_count;
+        lods[lod_count].index_count = count;
+        // Errors accumulate through the chain, never report less than
+        // the level this one was built from
+        lods[lod_count].error = error > previous->error ?
+            error : previous->error;
+
+        arena_count += count;
+        lod_count++;
+    }
+
+    *lod_indices = realloc(arena, arena_count * sizeof(*arena));
+    *lod_index_count = arena_count;
+
+    TRACE_END(scope);
+    return lod_count;
+}
+
+void mesh_get_bounds(
+        const float* positions,
+        size_t position_stride,
+        uint32_t vertex_count,
+        float* bounds)
+{
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    uint32_t i, j;
+    for (i=0; i<vertex_count; i++)
+    {
+        const float* p = mesh_position(positions, position_stride, i);
+        for (j=0; j<3; j++)
+        {
+            if (p[j] < min[j]) min[j] = p[j];
+            if (p[j] > max[j]) max[j] = p[j];
+        }
+    }
+
+    for (j=0; j<3; j++)
+        bounds[j] = (min[j] + max[j]) * 0.5f;
+
+    float radius = 0.0f;
+    for (i=0; i<vertex_count; i++)
+    {
+        const float* p = mesh_position(positions, position_stride, i);
+        float dx = p[0] - bounds[0];
+        float dy = p[1] - bounds[1];
+        float dz = p[2] - bounds[2];
+        float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+        if (distance > radius)
+            radius = distance;
+    }
+    bounds[3] = radius;
+}
+
+static void mesh_meshlet_bounds(
+        const float* positions,
+        size_t position_stride,
+        const uint32_t* indices,
+        struct mesh_meshlet* meshlet)
+{
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    double normal_sum[3] = {0.0, 0.0, 0.0};
+
+    uint32_t i, j;
+    for (i=0; i<meshlet->index_count; i++)
+    {
+        const float* p = mesh_position(positions, position_stride, indices[i]);
+        for (j=0; j<3; j++)
+        {
+            if (p[j] < min[j]) min[j] = p[j];
+            if (p[j] > max[j]) max[j] = p[j];
+        }
+    }
+
+    for (j=0; j<3; j++)
+        meshlet->center[j] = (min[j] + max[j]) * 0.5f;
+
+    meshlet->radius = 0.0f;
+    for (i=0; i<meshlet->index_count; i++)
+    {
+        const float* p = mesh_position(positions, position_stride, indices[i]);
+        float dx = p[0] - meshlet->center[0];
+        float dy = p[1] - meshlet->center[1];
+        float dz = p[2] - meshlet->center[2];
+        float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+        if (distance > meshlet->radius)
+            meshlet->radius = distance;
+    }
+
+    // Cone axis is the average unit normal, the cutoff is widened by 90
+    // degrees so the test against the view vector stays conservative
+    double* normals = malloc(meshlet->index_count / 3 * 3 * sizeof(*normals));
+    assert(normals);
+    uint32_t normal_count = 0;
+
+    for (i=0; i+2<meshlet->index_count; i+=3)
+    {
+        double* n = &normals[normal_count * 3];
+        mesh_triangle_normal(
+            mesh_position(positions, position_stride, indices[i]),
+            mesh_position(positions, position_stride, indices[i+1]),
+            mesh_position(positions, position_stride, indices[i+2]),
+            n
+        );
+
+        double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length == 0.0)
+            continue;
+
+        for (j=0; j<3; j++)
+        {
+            n[j] /= length;
+            normal_sum[j] += n[j];
+        }
+        normal_count++;
+    }
+
+    double axis_length = sqrt(
+        normal_sum[0]*normal_sum[0] +
+        normal_sum[1]*normal_sum[1] +
+        normal_sum[2]*normal_sum[2]
+    );
+
+    meshlet->cone_axis[0] = 0.0f;
+    meshlet->cone_axis[1] = 0.0f;
+    meshlet->cone_axis[2] = 0.0f;
+    meshlet->cone_cutoff = 1.0f;
+
+    if (normal_count > 0 && axis_length > 0.0)
+    {
+        double axis[3];
+        double min_dot = 1.0;
+        for (j=0; j<3; j++)
+            axis[j] = normal_sum[j] / axis_length;
+
+        for (i=0; i<normal_count; i++)
+        {
+            double* n = &normals[i * 3];
+            double dot = n[0]*axis[0] + n[1]*axis[1] + n[2]*axis[2];
+            if (dot < min_dot)
+                min_dot = dot;
+        }
+
+        // Normals spread over more than a hemisphere can't be culled
+        if (min_dot > 0.1)
+        {
+            for (j=0; j<3; j++)
+                meshlet->cone_axis[j] = (float)axis[j];
+            meshlet->cone_cutoff = (float)sqrt(1.0 - min_dot*min_dot);
+        }
+    }
+
+    free(normals);
+}
+
+uint32_t mesh_build_meshlets(
+        const float* positions,
+        size_t position_stride,
+        uint32_t vertex_count,
+        uint32_t* indices,
+        uint32_t index_count,
+        struct mesh_meshlet** meshlets)
+{
+    TRACE_BEGIN(scope, "mesh_build_meshlets");
+
+    uint32_t triangle_count = index_count / 3;
+    uint32_t i, j, k;
+
+    // Vertex to triangle adjacency in compressed rows
+    uint32_t* adjacency_offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t* adjacency = malloc(index_count * sizeof(uint32_t));
+    assert(adjacency_offsets && adjacency);
+
+    for (i=0; i<triangle_count * 3; i++)
+        adjacency_offsets[indices[i] + 1]++;
+    for (i=0; i<vertex_count; i++)
+        adjacency_offsets[i + 1] += adjacency_offsets[i];
+
+    uint32_t* adjacency_fill = malloc(vertex_count * sizeof(uint32_t));
+    assert(adjacency_fill);
+    memcpy(adjacency_fill, adjacency_offsets, vertex_count * sizeof(uint32_t));
+    for (i=0; i<triangle_count * 3; i++)
+        adjacency[adjacency_fill[indices[i]]++] = i / 3;
+    free(adjacency_fill);
+
+    // Vertex membership is stamped with the meshlet number plus one, so
+    // the array never needs clearing between meshlets
+    uint32_t* vertex_stamp = calloc(vertex_count, sizeof(uint32_t));
+    bool* emitted = calloc(triangle_count, sizeof(bool));
+    uint32_t* order = malloc(triangle_count * sizeof(uint32_t));
+    assert(vertex_stamp && emitted && order);
+
+    uint32_t meshlet_capacity = triangle_count / MESH_MESHLET_MAX_TRIANGLES + 1;
+    struct mesh_meshlet* result = malloc(meshlet_capacity * sizeof(*result));
+    assert(result);
+
+    uint32_t meshlet_vertices[MESH_MESHLET_MAX_VERTICES];
+    uint32_t meshlet_vertex_count = 0;
+    uint32_t meshlet_count = 0;
+    uint32_t order_count = 0;
+    uint32_t seed_cursor = 0;
+
+    while (order_count < triangle_count)
+    {
+        // Start a new meshlet from the next unemitted triangle
+        while (emitted[seed_cursor])
+            seed_cursor++;
+
+        if (meshlet_count == meshlet_capacity)
+        {
+            meshlet_capacity *= 2;
+            result = realloc(result, meshlet_capacity * sizeof(*result));
+            assert(result);
+        }
+
+        struct mesh_meshlet* meshlet = &result[meshlet_count];
+        uint32_t stamp = meshlet_count + 1;
+        uint32_t meshlet_triangle_count = 0;
+        uint32_t next = seed_cursor;
+
+        meshlet->first_index = order_count * 3;
+        meshlet_vertex_count = 0;
+
+        while (next != UINT32_MAX)
+        {
+            emitted[next] = true;
+            order[order_count++] = next;
+            meshlet_triangle_count++;
+
+            for (k=0; k<3; k++)
+            {
+                uint32_t v = indices[next * 3 + k];
+                if (vertex_stamp[v] != stamp)
+                {
+                    vertex_stamp[v] = stamp;
+                    meshlet_vertices[meshlet_vertex_count++] = v;
+                }
+            }
+
+            if (meshlet_triangle_count == MESH_MESHLET_MAX_TRIANGLES)
+                break;
+
+            // Grow through neighbouring triangles, preferring the ones that
+            // add the fewest new vertices to the meshlet
+            next = UINT32_MAX;
+            uint32_t best_new = 4;
+            for (i=0; i<meshlet_vertex_count && best_new > 0; i++)
+            {
+                uint32_t v = meshlet_vertices[i];
+                for (j=adjacency_offsets[v]; j<adjacency_offsets[v+1]; j++)
+                {
+                    uint32_t t = adjacency[j];
+                    if (emitted[t])
+                        continue;
+
+                    uint32_t new_vertices = 0;
+                    for (k=0; k<3; k++)
+                        new_vertices += vertex_stamp[indices[t*3 + k]] != stamp;
+
+                    if (new_vertices < best_new &&
+                        meshlet_vertex_count + new_vertices <=
+                            MESH_MESHLET_MAX_VERTICES)
+                    {
+                        best_new = new_vertices;
+                        next = t;
+                    }
+                }
+            }
+        }
+
+        meshlet->index_count = meshlet_triangle_count * 3;
+        meshlet_count++;
+    }
+
+    // Rewrite the indices in meshlet order
+    uint32_t* reordered = malloc(triangle_count * 3 * sizeof(uint32_t));
+    assert(reordered);
+    for (i=0; i<triangle_count; i++)
+        memcpy(&reordered[i*3], &indices[order[i]*3], 3 * sizeof(uint32_t));
+    memcpy(indices, reordered, triangle_count * 3 * sizeof(uint32_t));
+    free(reordered);
+
+    for (i=0; i<meshlet_count; i++)
+    {
+        mesh_meshlet_bounds(
+            positions,
+            position_stride,
+            &indices[result[i].first_index],
+            &result[i]
+        );
+    }
+
+    free(order);
+    free(emitted);
+    free(vertex_stamp);
+    free(adjacency);
+    free(adjacency_offsets);
+
+    *meshlets = realloc(result, meshlet_count * sizeof(*result));
+
+    TRACE_END(scope);
+    return meshlet_count;
+}
@@ -1,14 +1,76 @@
 #ifndef MESH_H_
 #define MESH_H_
 
-struct mesh
+#include <stdint.h>
+#include <stddef.h>
+
+#define MESH_MAX_LODS 5
+
+// Stop building levels once a level would keep more than this fraction
+// of the previous level's triangles
+#define MESH_LOD_MIN_REDUCTION 0.8f
+
+// Meshlet limits, sized so a cluster's vertices and triangles fit the
+// per-workgroup budgets common to mesh and compute culling
+#define MESH_MESHLET_MAX_VERTICES 64
+#define MESH_MESHLET_MAX_TRIANGLES 124
+
+// One level of detail inside a contiguous index arena
+struct mesh_lod
 {
-    VkBuffer vbo;
-    VkDeviceMemory
-    VkBuffer ibo;
-    uint32_t* vertices;
-    uint32_t* indices;
-    float transform[4];
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
 };
 
+// Run of spatially coherent triangles with a bounding sphere and a normal
+// cone, a cone_cutoff of 1 marks a cluster that can't be backface culled
+struct mesh_meshlet
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+uint32_t mesh_simplify(
+    const float* positions,
+    size_t position_stride,
+    uint32_t vertex_count,
+    uint32_t* indices,
+    uint32_t index_count,
+    uint32_t target_index_count,
+    float* error
+);
+
+uint32_t mesh_build_lods(
+    const float* positions,
+    size_t position_stride,
+    uint32_t vertex_count,
+    const uint32_t* indices,
+    uint32_t index_count,
+    struct mesh_lod* lods,
+    uint32_t max_lod_count,
+    uint32_t** lod_indices,
+    uint32_t* lod_index_count
+);
+
+uint32_t mesh_build_meshlets(
+    const float* positions,
+    size_t position_stride,
+    uint32_t vertex_count,
+    uint32_t* indices,
+    uint32_t index_count,
+    struct mesh_meshlet** meshlets
+);
+
+void mesh_get_bounds(
+    const float* positions,
+    size_t position_stride,
+    uint32_t vertex_count,
+    float* bounds
+);
+
 #endif
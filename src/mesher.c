@@ -0,0 +1,1154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "mesher.h"
+#include "mesh.h"
+#include "trace.h"
+#include "util.h"
+
+// Corner densities sit on voxel corners, each the share of the eight
+// voxels around it that are solid. Surface nets needs cells up to the far
+// border to join up with the next chunk, which needs one more corner and
+// one more voxel past that. Coarser levels of detail use the start of
+// each, with cells of several voxels
+#define MESHER_CELLS (VOXEL_CHUNK_SIZE + 1)
+#define MESHER_CORNERS (VOXEL_CHUNK_SIZE + 2)
+#define MESHER_BOX (VOXEL_CHUNK_SIZE + 3)
+
+// Offset into the density of the eight corners of a cell, bit 0 of the
+// corner picks x, bit 1 y and bit 2 z
+#define MESHER_CORNER_OFFSET(corner) \
+    (((corner) & 1) + \
+    ((corner) & 2 ? MESHER_CORNERS * MESHER_CORNERS : 0) + \
+    ((corner) & 4 ? MESHER_CORNERS : 0))
+
+// Kuhn's split of the cube, walking from corner 0 to corner 7 one axis at
+// a time in every order. Neighbouring cubes split their shared faces the
+// same way, and every edge runs from a corner to one with more bits set
+static const uint8_t mesher_tetrahedra[6][4] = {
+    {0, 1, 3, 7},
+    {0, 1, 5, 7},
+    {0, 2, 3, 7},
+    {0, 2, 6, 7},
+    {0, 4, 5, 7},
+    {0, 4, 6, 7}
+};
+
+static const char* mesher_method_names[] = {
+    "surface nets",
+    "marching tetrahedra",
+    "cubes",
+    "greedy cubes"
+};
+
+// Bit columns of the chunk's voxels along each axis, indexed by the axis
+// then the next two in turn. Bit 0 is the cell before the chunk and the
+// bit after its last cell the one after
+struct mesher_columns
+{
+    uint64_t bits[3][VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE];
+};
+
+struct mesher_scratch
+{
+    // Cells on a side of the chunk, and voxels on a side of a cell
+    uint32_t size;
+    float scale;
+    uint32_t skirts;
+
+    uint16_t* materials;
+    uint8_t* solid;
+    float* density;
+    // Cubes, rock of any material and of each material in the chunk
+    struct mesher_columns* opaque;
+    struct mesher_columns* owned;
+    uint16_t* chunk_materials;
+    uint32_t chunk_material_count;
+    // Surface nets by cell, marching tetrahedra by cell and edge direction
+    uint32_t* cell_vertices;
+    uint32_t* edge_vertices;
+
+    struct renderer_vertex* vertices;
+    uint32_t vertex_count;
+    uint32_t vertex_capacity;
+    uint32_t* indices;
+    uint32_t index_count;
+    uint32_t index_capacity;
+};
+
+const char* mesher_get_method_name(enum mesher_method method)
+{
+    assert(method < MESHER_METHOD_COUNT);
+    return mesher_method_names[method];
+}
+
+static uint32_t mesher_corner_index(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (y * MESHER_CORNERS + z) * MESHER_CORNERS + x;
+}
+
+static uint32_t mesher_cell_index(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (y * MESHER_CELLS + z) * MESHER_CELLS + x;
+}
+
+static uint32_t mesher_box_index(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (y * MESHER_BOX + z) * MESHER_BOX + x;
+}
+
+// Halves a cube of materials on each axis in place, side being even
+static void mesher_downsample(uint16_t* materials, uint32_t side)
+{
+    uint32_t half = side / 2;
+    uint32_t x, y, z, i;
+    for (y=0; y<half; y++) {
+        for (z=0; z<half; z++) {
+            for (x=0; x<half; x++) {
+                uint16_t block[8];
+                for (i=0; i<8; i++) {
+                    block[i] = materials[
+                        ((2 * y + (i >> 1 & 1)) * side +
+                            2 * z + (i >> 2 & 1)) * side +
+                        2 * x + (i & 1)];
+                }
+                materials[(y * half + z) * half + x] = voxel_stand_in(block);
+            }
+        }
+    }
+}
+
+// False when the box is all rock or all air and can't hold a surface.
+// Skirts can still close off an all rock chunk next to a coarser one
+static bool mesher_read_box(
+        const struct voxel_world* world,
+        const int32_t* coord,
+        uint32_t lod,
+        struct mesher_scratch* scratch)
+{
+    // Coarser boxes are read whole, then halved down to their cells
+    uint32_t box = scratch->size + 3;
+    int32_t scale = 1 << lod;
+    int32_t min[3];
+    uint32_t size[3];
+    uint32_t i, j;
+    for (j=0; j<3; j++) {
+        min[j] = coord[j] * VOXEL_CHUNK_SIZE - scale;
+        size[j] = box * scale;
+    }
+
+    uint16_t* materials = scratch->materials;
+    if (lod > 0) {
+        materials = malloc(
+            (size_t)size[0] * size[1] * size[2] * sizeof(*materials)
+        );
+        assert(materials);
+    }
+    voxel_world_read(world, min, size, materials);
+    for (i=0; i<lod; i++)
+        mesher_downsample(materials, size[0] >> i);
+
+    uint8_t* solid = scratch->solid;
+    uint32_t solid_count = 0;
+    uint32_t x, y, z;
+    for (y=0; y<box; y++) {
+        for (z=0; z<box; z++) {
+            uint32_t first = mesher_box_index(0, y, z);
+            if (lod > 0) {
+                memcpy(
+                    &scratch->materials[first],
+                    &materials[(y * box + z) * box],
+                    box * sizeof(*materials)
+                );
+            }
+            for (x=0; x<box; x++) {
+                solid[first + x] =
+                    scratch->materials[first + x] != VOXEL_MATERIAL_AIR;
+                solid_count += solid[first + x];
+            }
+        }
+    }
+
+    if (lod > 0)
+        free(materials);
+
+    return solid_count > 0 &&
+        (solid_count < box * box * box || scratch->skirts != 0);
+}
+
+static void mesher_build_density(struct mesher_scratch* scratch)
+{
+    // Summing neighbours along x, then z, then y in place leaves each
+    // voxel holding the solid count of the 2x2x2 block it starts
+    uint8_t* solid = scratch->solid;
+    uint32_t box = scratch->size + 3;
+    uint32_t x, y, z;
+    uint32_t row = MESHER_BOX;
+    uint32_t layer = MESHER_BOX * MESHER_BOX;
+    for (y=0; y<box; y++) {
+        for (z=0; z<box; z++) {
+            uint8_t* line = &solid[y * layer + z * row];
+            for (x=0; x<box-1; x++)
+                line[x] += line[x + 1];
+        }
+    }
+    for (y=0; y<box; y++) {
+        for (z=0; z<box-1; z++) {
+            uint8_t* line = &solid[y * layer + z * row];
+            for (x=0; x<box-1; x++)
+                line[x] += line[x + row];
+        }
+    }
+    for (y=0; y<box-1; y++) {
+        for (z=0; z<box-1; z++) {
+            uint8_t* line = &solid[y * layer + z * row];
+            for (x=0; x<box-1; x++)
+                line[x] += line[x + layer];
+        }
+    }
+
+    // Half a voxel of bias keeps every corner off the surface, so edges
+    // are crossed strictly between their ends
+    for (y=0; y<box-1; y++) {
+        for (z=0; z<box-1; z++) {
+            const uint8_t* line = &solid[y * layer + z * row];
+            float* out = &scratch->density[mesher_corner_index(0, y, z)];
+            for (x=0; x<box-1; x++)
+                out[x] = line[x] - 3.5f;
+        }
+    }
+}
+
+// Averaged forward differences over the cell starting at the corner,
+// pointing into the rock
+static void mesher_cell_gradient(const float* d, float* gradient)
+{
+    gradient[0] = (d[1] - d[0]) + (d[3] - d[2]) + (d[5] - d[4]) +
+        (d[7] - d[6]);
+    gradient[1] = (d[2] - d[0]) + (d[3] - d[1]) + (d[6] - d[4]) +
+        (d[7] - d[5]);
+    gradient[2] = (d[4] - d[0]) + (d[5] - d[1]) + (d[6] - d[2]) +
+        (d[7] - d[3]);
+}
+
+static void mesher_get_cell(
+        const float* density,
+        uint32_t x,
+        uint32_t y,
+        uint32_t z,
+        float* d)
+{
+    const float* first = &density[mesher_corner_index(x, y, z)];
+    uint32_t i;
+    for (i=0; i<8; i++)
+        d[i] = first[MESHER_CORNER_OFFSET(i)];
+}
+
+static uint32_t mesher_add_vertex(
+        struct mesher_scratch* scratch,
+        const float* position,
+        const float* gradient)
+{
+    if (scratch->vertex_count == scratch->vertex_capacity) {
+        scratch->vertex_capacity *= 2;
+        scratch->vertices = realloc(
+            scratch->vertices,
+            scratch->vertex_capacity * sizeof(*scratch->vertices)
+        );
+        assert(scratch->vertices);
+    }
+
+    // Planar mapping along the axis the surface faces most
+    float ax = fabsf(gradient[0]);
+    float ay = fabsf(gradient[1]);
+    float az = fabsf(gradient[2]);
+    uint32_t u_axis = 0, v_axis = 2;
+    if (ax >= ay && ax >= az) {
+        u_axis = 2;
+        v_axis = 1;
+    } else if (az >= ay) {
+        v_axis = 1;
+    }
+
+    struct renderer_vertex* vertex = &scratch->vertices[scratch->vertex_count];
+    vertex->x = position[0];
+    vertex->y = position[1];
+    vertex->z = position[2];
+    vertex->u = position[u_axis] * MESHER_TEXTURE_SCALE;
+    vertex->v = position[v_axis] * MESHER_TEXTURE_SCALE;
+
+    return scratch->vertex_count++;
+}
+
+static void mesher_add_triangle(
+        struct mesher_scratch* scratch,
+        uint32_t a,
+        uint32_t b,
+        uint32_t c)
+{
+    if (scratch->index_count + 3 > scratch->index_capacity) {
+        scratch->index_capacity *= 2;
+        scratch->indices = realloc(
+            scratch->indices,
+            scratch->index_capacity * sizeof(*scratch->indices)
+        );
+        assert(scratch->indices);
+    }
+
+    scratch->indices[scratch->index_count++] = a;
+    scratch->indices[scratch->index_count++] = b;
+    scratch->indices[scratch->index_count++] = c;
+}
+
+// Strip from the edge between two vertices on a skirted face, hanging two
+// cells into the rock within the face's plane. That covers a neighbour a
+// level coarser or finer, whichever side of the edge its surface passes,
+// so it faces both ways
+static void mesher_add_skirt(
+        struct mesher_scratch* scratch,
+        uint32_t a,
+        uint32_t b,
+        uint32_t axis,
+        const float* into)
+{
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    normal[axis] = 1.0f;
+
+    float depth = 2.0f * scratch->scale;
+    const struct renderer_vertex* top[2] = {
+        &scratch->vertices[a],
+        &scratch->vertices[b]
+    };
+    float bottom[2][3];
+    uint32_t i;
+    for (i=0; i<2; i++) {
+        bottom[i][0] = top[i]->x + into[0] * depth;
+        bottom[i][1] = top[i]->y + into[1] * depth;
+        bottom[i][2] = top[i]->z + into[2] * depth;
+    }
+
+    uint32_t quad[4] = {a, b, 0, 0};
+    quad[2] = mesher_add_vertex(scratch, bottom[1], normal);
+    quad[3] = mesher_add_vertex(scratch, bottom[0], normal);
+    mesher_add_triangle(scratch, quad[0], quad[1], quad[2]);
+    mesher_add_triangle(scratch, quad[0], quad[2], quad[3]);
+    mesher_add_triangle(scratch, quad[0], quad[2], quad[1]);
+    mesher_add_triangle(scratch, quad[0], quad[3], quad[2]);
+}
+
+static void mesher_surface_nets(
+        struct mesher_scratch* scratch,
+        const float* origin)
+{
+    const float* density = scratch->density;
+    uint32_t* cell_vertices = scratch->cell_vertices;
+
+    uint32_t cells = scratch->size + 1;
+    float scale = scratch->scale;
+    uint32_t x, y, z, i, j;
+    for (y=0; y<cells; y++) {
+        for (z=0; z<cells; z++) {
+            for (x=0; x<cells; x++) {
+                uint32_t cell = mesher_cell_index(x, y, z);
+                cell_vertices[cell] = UINT32_MAX;
+
+                float d[8];
+                mesher_get_cell(density, x, y, z, d);
+                uint32_t mask = 0;
+                for (i=0; i<8; i++)
+                    mask |= (uint32_t)(d[i] > 0.0f) << i;
+                if (mask == 0 || mask == 0xff)
+                    continue;
+
+                // Average of where the twelve edges cross the surface
+                float sum[3] = {0.0f, 0.0f, 0.0f};
+                uint32_t crossings = 0;
+                for (i=0; i<8; i++) {
+                    for (j=0; j<3; j++) {
+                        uint32_t other = i | 1 << j;
+                        if (other == i || !((mask >> i ^ mask >> other) & 1))
+                            continue;
+
+                        float t = d[i] / (d[i] - d[other]);
+                        sum[0] += (i & 1) + (j == 0 ? t : 0.0f);
+                        sum[1] += (i >> 1 & 1) + (j == 1 ? t : 0.0f);
+                        sum[2] += (i >> 2 & 1) + (j == 2 ? t : 0.0f);
+                        crossings++;
+                    }
+                }
+
+                float position[3] = {
+                    origin[0] + (x + sum[0] / crossings) * scale,
+                    origin[1] + (y + sum[1] / crossings) * scale,
+                    origin[2] + (z + sum[2] / crossings) * scale
+                };
+                float gradient[3];
+                mesher_cell_gradient(d, gradient);
+                cell_vertices[cell] = mesher_add_vertex(
+                    scratch,
+                    position,
+                    gradient
+                );
+            }
+        }
+    }
+
+    // A quad for every crossed edge, joining the four cells around it.
+    // Each chunk owns edges starting below its far face along the edge
+    // and past its near faces across it, so neighbours share none
+    uint32_t axis;
+    for (axis=0; axis<3; axis++) {
+        uint32_t u = (axis + 1) % 3;
+        uint32_t v = (axis + 2) % 3;
+        uint32_t min[3], max[3];
+        min[axis] = 0;
+        max[axis] = scratch->size;
+        min[u] = min[v] = 1;
+        max[u] = max[v] = scratch->size + 1;
+
+        uint32_t step[3] = {1, MESHER_CELLS * MESHER_CELLS, MESHER_CELLS};
+        uint32_t corner_step[3] = {
+            1,
+            MESHER_CORNERS * MESHER_CORNERS,
+            MESHER_CORNERS
+        };
+
+        uint32_t a[3];
+        for (a[1]=min[1]; a[1]<max[1]; a[1]++) {
+            for (a[2]=min[2]; a[2]<max[2]; a[2]++) {
+                for (a[0]=min[0]; a[0]<max[0]; a[0]++) {
+                    uint32_t corner = mesher_corner_index(a[0], a[1], a[2]);
+                    bool inside = density[corner] > 0.0f;
+                    if (inside == (density[corner + corner_step[axis]] > 0.0f))
+                        continue;
+
+                    // Counter clockwise about the axis
+                    uint32_t cell = mesher_cell_index(a[0], a[1], a[2]);
+                    uint32_t quad[4] = {
+                        cell_vertices[cell - step[u] - step[v]],
+                        cell_vertices[cell - step[v]],
+                        cell_vertices[cell],
+                        cell_vertices[cell - step[u]]
+                    };
+
+                    // Front faces look out of the rock
+                    if (inside) {
+                        mesher_add_triangle(scratch, quad[0], quad[1], quad[2]);
+                        mesher_add_triangle(scratch, quad[0], quad[2], quad[3]);
+                    } else {
+                        mesher_add_triangle(scratch, quad[0], quad[2], quad[1]);
+                        mesher_add_triangle(scratch, quad[0], quad[3], quad[2]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The mesh stops short of each face where the neighbour's quads would
+// take over, along edges joining the two cells beside each crossed edge
+// in the plane of corners those quads lie on
+static void mesher_surface_net_skirts(struct mesher_scratch* scratch)
+{
+    const float* density = scratch->density;
+    uint32_t size = scratch->size;
+    uint32_t axis, high, i;
+    for (axis=0; axis<3; axis++) {
+        for (high=0; high<2; high++) {
+            if (!(scratch->skirts & MESHER_SKIRT(axis, high)))
+                continue;
+
+            for (i=1; i<3; i++) {
+                uint32_t along = (axis + i) % 3;
+                uint32_t across = (axis + 3 - i) % 3;
+
+                uint32_t a[3];
+                a[axis] = high ? size + 1 : 0;
+                for (a[along]=0; a[along]<=size; a[along]++) {
+                    for (a[across]=1; a[across]<=size; a[across]++) {
+                        uint32_t b[3] = {a[0], a[1], a[2]};
+                        b[along]++;
+                        float from = density[mesher_corner_index(
+                            a[0], a[1], a[2])];
+                        float to = density[mesher_corner_index(
+                            b[0], b[1], b[2])];
+                        if ((from > 0.0f) == (to > 0.0f))
+                            continue;
+
+                        uint32_t cell[3] = {a[0], a[1], a[2]};
+                        cell[axis] = high ? size : 0;
+                        uint32_t first = mesher_cell_index(
+                            cell[0], cell[1], cell[2]);
+                        cell[across]--;
+                        uint32_t second = mesher_cell_index(
+                            cell[0], cell[1], cell[2]);
+
+                        float into[3] = {0.0f, 0.0f, 0.0f};
+                        into[along] = to > 0.0f ? 1.0f : -1.0f;
+                        mesher_add_skirt(
+                            scratch,
+                            scratch->cell_vertices[first],
+                            scratch->cell_vertices[second],
+                            axis,
+                            into
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Vertex where the edge between two corners of a cell crosses the surface,
+// shared by every tetrahedron and neighbouring cell using the edge. The
+// from corner has a subset of the to corner's bits
+static uint32_t mesher_edge_vertex(
+        struct mesher_scratch* scratch,
+        const float* origin,
+        const uint32_t* cell,
+        uint32_t from,
+        uint32_t to)
+{
+    uint32_t start[3] = {
+        cell[0] + (from & 1),
+        cell[1] + (from >> 1 & 1),
+        cell[2] + (from >> 2 & 1)
+    };
+    uint32_t direction = from ^ to;
+    uint32_t key = mesher_cell_index(start[0], start[1], start[2]) * 7 +
+        direction - 1;
+    if (scratch->edge_vertices[key] != UINT32_MAX)
+        return scratch->edge_vertices[key];
+
+    // Edges lie in the cell starting at their from corner, whichever cell
+    // asked, so chunks on either side of a face agree on the vertex
+    float d[8];
+    mesher_get_cell(scratch->density, start[0], start[1], start[2], d);
+    float t = d[0] / (d[0] - d[direction]);
+
+    float scale = scratch->scale;
+    float position[3] = {
+        origin[0] + (start[0] + (direction & 1 ? t : 0.0f)) * scale,
+        origin[1] + (start[1] + (direction & 2 ? t : 0.0f)) * scale,
+        origin[2] + (start[2] + (direction & 4 ? t : 0.0f)) * scale
+    };
+    float gradient[3];
+    mesher_cell_gradient(d, gradient);
+
+    scratch->edge_vertices[key] = mesher_add_vertex(
+        scratch,
+        position,
+        gradient
+    );
+    return scratch->edge_vertices[key];
+}
+
+// Winds the polygon so it faces along the direction out of the rock,
+// triangle or quad in order around its edge
+static void mesher_add_polygon(
+        struct mesher_scratch* scratch,
+        const uint32_t* polygon,
+        uint32_t count,
+        const float* out)
+{
+    const struct renderer_vertex* v = scratch->vertices;
+    const struct renderer_vertex* p0 = &v[polygon[0]];
+    const struct renderer_vertex* p1 = &v[polygon[1]];
+    const struct renderer_vertex* p2 = &v[polygon[2]];
+    const struct renderer_vertex* p3 = &v[polygon[count - 1]];
+
+    // Cross product of the diagonals, or of two edges for a triangle
+    const struct renderer_vertex* pa = count == 4 ? p2 : p1;
+    const struct renderer_vertex* pb = count == 4 ? p1 : p0;
+    float a[3] = {pa->x - p0->x, pa->y - p0->y, pa->z - p0->z};
+    float b[3] = {p3->x - pb->x, p3->y - pb->y, p3->z - pb->z};
+    float normal[3] = {
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0]
+    };
+    bool flip = normal[0] * out[0] + normal[1] * out[1] +
+        normal[2] * out[2] < 0.0f;
+
+    if (!flip) {
+        mesher_add_triangle(scratch, polygon[0], polygon[1], polygon[2]);
+        if (count == 4)
+            mesher_add_triangle(scratch, polygon[0], polygon[2], polygon[3]);
+    } else {
+        mesher_add_triangle(scratch, polygon[0], polygon[2], polygon[1]);
+        if (count == 4)
+            mesher_add_triangle(scratch, polygon[0], polygon[3], polygon[2]);
+    }
+}
+
+static void mesher_marching_tetrahedra(
+        struct mesher_scratch* scratch,
+        const float* origin)
+{
+    memset(
+        scratch->edge_vertices,
+        0xff,
+        MESHER_CELLS * MESHER_CELLS * MESHER_CELLS * 7 *
+            sizeof(*scratch->edge_vertices)
+    );
+
+    uint32_t size = scratch->size;
+    uint32_t cell[3];
+    uint32_t i, j, k;
+    for (cell[1]=0; cell[1]<size; cell[1]++) {
+        for (cell[2]=0; cell[2]<size; cell[2]++) {
+            for (cell[0]=0; cell[0]<size; cell[0]++) {
+                float d[8];
+                mesher_get_cell(scratch->density, cell[0], cell[1], cell[2], d);
+                uint32_t mask = 0;
+                for (i=0; i<8; i++)
+                    mask |= (uint32_t)(d[i] > 0.0f) << i;
+                if (mask == 0 || mask == 0xff)
+                    continue;
+
+                for (i=0; i<6; i++) {
+                    const uint8_t* corners = mesher_tetrahedra[i];
+                    uint32_t inside[4], outside[4];
+                    uint32_t inside_count = 0, outside_count = 0;
+                    for (j=0; j<4; j++) {
+                        if (mask >> corners[j] & 1)
+                            inside[inside_count++] = j;
+                        else
+                            outside[outside_count++] = j;
+                    }
+                    if (inside_count == 0 || outside_count == 0)
+                        continue;
+
+                    // Out of the rock, from the inside corners' centre to
+                    // the outside corners'
+                    float out[3] = {0.0f, 0.0f, 0.0f};
+                    for (j=0; j<4; j++) {
+                        float sign = mask >> corners[j] & 1 ?
+                            -1.0f / inside_count : 1.0f / outside_count;
+                        for (k=0; k<3; k++)
+                            out[k] += sign * (corners[j] >> k & 1);
+                    }
+
+                    // Tetrahedron corners are in order of their bits, so
+                    // the lower of a pair is the edge's from corner
+                    uint32_t polygon[4];
+                    uint32_t count = 0;
+                    if (inside_count == 2) {
+                        uint32_t order[4][2] = {
+                            {inside[0], outside[0]},
+                            {inside[0], outside[1]},
+                            {inside[1], outside[1]},
+                            {inside[1], outside[0]}
+                        };
+                        for (j=0; j<4; j++) {
+                            uint32_t a = order[j][0] < order[j][1] ?
+                                order[j][0] : order[j][1];
+                            uint32_t b = order[j][0] ^ order[j][1] ^ a;
+                            polygon[count++] = mesher_edge_vertex(
+                                scratch,
+                                origin,
+                                cell,
+                                corners[a],
+                                corners[b]
+                            );
+                        }
+                    } else {
+                        uint32_t lone = inside_count == 1 ?
+                            inside[0] : outside[0];
+                        for (j=0; j<4; j++) {
+                            if (j == lone)
+                                continue;
+                            uint32_t a = j < lone ? j : lone;
+                            uint32_t b = j < lone ? lone : j;
+                            polygon[count++] = mesher_edge_vertex(
+                                scratch,
+                                origin,
+                                cell,
+                                corners[a],
+                                corners[b]
+                            );
+                        }
+                    }
+
+                    mesher_add_polygon(scratch, polygon, count, out);
+                }
+            }
+        }
+    }
+}
+
+// The tetrahedra split each face of a cell in two along the diagonal from
+// its lowest corner, the mesh ends along the lines crossing them
+static void mesher_marching_tetrahedra_skirts(
+        struct mesher_scratch* scratch,
+        const float* origin)
+{
+    uint32_t size = scratch->size;
+    uint32_t axis, high, i, j, k;
+    for (axis=0; axis<3; axis++) {
+        for (high=0; high<2; high++) {
+            if (!(scratch->skirts & MESHER_SKIRT(axis, high)))
+                continue;
+
+            uint32_t along = (axis + 1) % 3;
+            uint32_t across = (axis + 2) % 3;
+            uint32_t base = high << axis;
+            uint32_t triangles[2][3] = {
+                {base, base | 1 << along, base | 1 << along | 1 << across},
+                {base, base | 1 << across, base | 1 << along | 1 << across}
+            };
+
+            uint32_t cell[3];
+            cell[axis] = high ? size - 1 : 0;
+            for (cell[along]=0; cell[along]<size; cell[along]++) {
+                for (cell[across]=0; cell[across]<size; cell[across]++) {
+                    float d[8];
+                    mesher_get_cell(
+                        scratch->density,
+                        cell[0],
+                        cell[1],
+                        cell[2],
+                        d
+                    );
+
+                    for (i=0; i<2; i++) {
+                        const uint32_t* corners = triangles[i];
+                        uint32_t inside_count = 0;
+                        for (j=0; j<3; j++)
+                            inside_count += d[corners[j]] > 0.0f;
+                        if (inside_count == 0 || inside_count == 3)
+                            continue;
+
+                        // Into the rock, from the outside corners' centre
+                        // to the inside corners'
+                        float into[3] = {0.0f, 0.0f, 0.0f};
+                        uint32_t lone = 0;
+                        for (j=0; j<3; j++) {
+                            bool inside = d[corners[j]] > 0.0f;
+                            float sign = inside ?
+                                1.0f / inside_count :
+                                -1.0f / (3 - inside_count);
+                            for (k=0; k<3; k++)
+                                into[k] += sign * (corners[j] >> k & 1);
+                            if (inside == (inside_count == 1))
+                                lone = j;
+                        }
+                        float length = sqrtf(into[0] * into[0] +
+                            into[1] * into[1] + into[2] * into[2]);
+                        for (k=0; k<3; k++)
+                            into[k] /= length;
+
+                        // Corners are in order of their bits, so the lower
+                        // of a pair is the edge's from corner
+                        uint32_t ends[2];
+                        uint32_t count = 0;
+                        for (j=0; j<3; j++) {
+                            if (j == lone)
+                                continue;
+                            ends[count++] = mesher_edge_vertex(
+                                scratch,
+                                origin,
+                                cell,
+                                corners[j < lone ? j : lone],
+                                corners[j < lone ? lone : j]
+                            );
+                        }
+                        mesher_add_skirt(scratch, ends[0], ends[1], axis, into);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Rectangle of faces in the slice depth along the axis, facing forward
+// along it or back
+static void mesher_add_quad(
+        struct mesher_scratch* scratch,
+        const float* origin,
+        uint32_t axis,
+        bool forward,
+        uint32_t depth,
+        uint32_t u_start,
+        uint32_t v_start,
+        uint32_t width,
+        uint32_t height)
+{
+    uint32_t u = (axis + 1) % 3;
+    uint32_t v = (axis + 2) % 3;
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    normal[axis] = forward ? 1.0f : -1.0f;
+
+    // Counter clockwise about the axis
+    static const uint32_t corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    uint32_t quad[4];
+    uint32_t i;
+    float scale = scratch->scale;
+    for (i=0; i<4; i++) {
+        float position[3];
+        position[axis] = origin[axis] +
+            (depth + (forward ? 1.0f : 0.0f)) * scale;
+        position[u] = origin[u] + (u_start + corners[i][0] * width) * scale;
+        position[v] = origin[v] + (v_start + corners[i][1] * height) * scale;
+        quad[i] = mesher_add_vertex(scratch, position, normal);
+    }
+
+    if (forward) {
+        mesher_add_triangle(scratch, quad[0], quad[1], quad[2]);
+        mesher_add_triangle(scratch, quad[0], quad[2], quad[3]);
+    } else {
+        mesher_add_triangle(scratch, quad[0], quad[2], quad[1]);
+        mesher_add_triangle(scratch, quad[0], quad[3], quad[2]);
+    }
+}
+
+// Each chunk draws the faces of its own voxels, so neighbours share none.
+// Faces are found a column at a time with bit operations, gathered into
+// slices across each axis with a mask per row, and either drawn one by
+// one or grown along the row and then across rows while the rows have
+// every bit of the run set. Skirted faces see air past the chunk, so the
+// chunk is closed off there
+static void mesher_cubes(
+        struct mesher_scratch* scratch,
+        const float* origin,
+        bool greedy)
+{
+    const uint16_t* materials = scratch->materials;
+    uint32_t size = scratch->size;
+    uint32_t b[3];
+    uint32_t i, axis;
+
+    // The border only hides faces, its materials don't matter
+    uint32_t last = 0;
+    for (b[1]=1; b[1]<=size; b[1]++) {
+        for (b[2]=1; b[2]<=size; b[2]++) {
+            for (b[0]=1; b[0]<=size; b[0]++) {
+                uint16_t material = materials[
+                    mesher_box_index(b[0], b[1], b[2])];
+                if (material == VOXEL_MATERIAL_AIR ||
+                    (scratch->chunk_material_count > 0 &&
+                        material == scratch->chunk_materials[last]))
+                    continue;
+
+                for (i=0; i<scratch->chunk_material_count; i++) {
+                    if (scratch->chunk_materials[i] == material)
+                        break;
+                }
+                if (i == scratch->chunk_material_count) {
+                    scratch->chunk_materials = realloc(
+                        scratch->chunk_materials,
+                        (i + 1) * sizeof(*scratch->chunk_materials)
+                    );
+                    assert(scratch->chunk_materials);
+                    scratch->chunk_materials[i] = material;
+                    scratch->chunk_material_count++;
+                }
+                last = i;
+            }
+        }
+    }
+
+    scratch->owned = calloc(
+        scratch->chunk_material_count,
+        sizeof(*scratch->owned)
+    );
+    assert(scratch->owned);
+
+    struct mesher_columns* opaque = scratch->opaque;
+    for (b[1]=0; b[1]<size+2; b[1]++) {
+        for (b[2]=0; b[2]<size+2; b[2]++) {
+            for (b[0]=0; b[0]<size+2; b[0]++) {
+                uint16_t material = materials[
+                    mesher_box_index(b[0], b[1], b[2])];
+                if (material == VOXEL_MATERIAL_AIR)
+                    continue;
+
+                bool inner[3];
+                bool skirted = false;
+                for (i=0; i<3; i++) {
+                    inner[i] = b[i] >= 1 && b[i] <= size;
+                    skirted = skirted || (!inner[i] &&
+                        (scratch->skirts & MESHER_SKIRT(i, b[i] != 0)));
+                }
+                if (skirted)
+                    continue;
+
+                for (axis=0; axis<3; axis++) {
+                    uint32_t u = (axis + 1) % 3;
+                    uint32_t v = (axis + 2) % 3;
+                    if (inner[u] && inner[v]) {
+                        opaque->bits[axis][b[u] - 1][b[v] - 1] |=
+                            1ull << b[axis];
+                    }
+                }
+                if (!inner[0] || !inner[1] || !inner[2])
+                    continue;
+
+                if (scratch->chunk_materials[last] != material) {
+                    for (last=0; last<scratch->chunk_material_count; last++) {
+                        if (scratch->chunk_materials[last] == material)
+                            break;
+                    }
+                }
+                struct mesher_columns* owned = &scratch->owned[last];
+                for (axis=0; axis<3; axis++) {
+                    uint32_t u = (axis + 1) % 3;
+                    uint32_t v = (axis + 2) % 3;
+                    owned->bits[axis][b[u] - 1][b[v] - 1] |= 1ull << b[axis];
+                }
+            }
+        }
+    }
+
+    // Rows across v by slice, bits along u
+    uint32_t slices[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE];
+    uint32_t material;
+    for (material=0; material<scratch->chunk_material_count; material++) {
+        const struct mesher_columns* owned = &scratch->owned[material];
+        for (axis=0; axis<3; axis++) {
+            uint32_t direction;
+            for (direction=0; direction<2; direction++) {
+                bool forward = direction == 1;
+                memset(slices, 0, sizeof(slices));
+
+                uint32_t u, v, depth;
+                for (u=0; u<size; u++) {
+                    for (v=0; v<size; v++) {
+                        uint64_t column = opaque->bits[axis][u][v];
+                        uint64_t open = forward ? ~(column >> 1) :
+                            ~(column << 1);
+                        uint64_t faces = (owned->bits[axis][u][v] & open) >> 1;
+                        while (faces) {
+                            depth = __builtin_ctzll(faces);
+                            faces &= faces - 1;
+                            slices[depth][v] |= 1u << u;
+                        }
+                    }
+                }
+
+                for (depth=0; depth<size; depth++) {
+                    uint32_t* rows = slices[depth];
+                    for (v=0; v<size; v++) {
+                        while (rows[v]) {
+                            uint32_t start = __builtin_ctz(rows[v]);
+                            uint32_t width = 1;
+                            uint32_t height = 1;
+                            if (greedy) {
+                                width = __builtin_ctzll(
+                                    ~((uint64_t)rows[v] >> start));
+                            }
+
+                            uint32_t run = (uint32_t)
+                                (((1ull << width) - 1) << start);
+                            rows[v] &= ~run;
+                            while (greedy && v + height < size &&
+                                    (rows[v + height] & run) == run) {
+                                rows[v + height] &= ~run;
+                                height++;
+                            }
+
+                            mesher_add_quad(
+                                scratch,
+                                origin,
+                                axis,
+                                forward,
+                                depth,
+                                start,
+                                v,
+                                width,
+                                height
+                            );
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void mesher_mesh_chunk(
+        const struct voxel_world* world,
+        enum mesher_method method,
+        const int32_t* coord,
+        uint32_t lod,
+        uint32_t skirts,
+        struct mesher_arena* arena,
+        struct mesher_mesh* mesh)
+{
+    TRACE_BEGIN(scope, "mesher_mesh_chunk");
+    double start = util_time();
+    assert(lod <= MESHER_MAX_LOD);
+
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->coord[0] = coord[0];
+    mesh->coord[1] = coord[1];
+    mesh->coord[2] = coord[2];
+    mesh->lod = lod;
+    mesh->skirts = skirts;
+
+    struct mesher_scratch scratch = {
+        .size = VOXEL_CHUNK_SIZE >> lod,
+        .scale = (float)(1 << lod),
+        .skirts = skirts,
+        .vertex_capacity = 4096,
+        .index_capacity = 3 * 4096
+    };
+    uint32_t box_volume = MESHER_BOX * MESHER_BOX * MESHER_BOX;
+    scratch.materials = malloc(box_volume * sizeof(*scratch.materials));
+    scratch.solid = malloc(box_volume);
+    assert(scratch.materials && scratch.solid);
+
+    if (mesher_read_box(world, coord, lod, &scratch)) {
+        scratch.vertices = malloc(
+            scratch.vertex_capacity * sizeof(*scratch.vertices)
+        );
+        scratch.indices = malloc(
+            scratch.index_capacity * sizeof(*scratch.indices)
+        );
+        assert(scratch.vertices && scratch.indices);
+
+        float origin[3] = {
+            (float)coord[0] * VOXEL_CHUNK_SIZE,
+            (float)coord[1] * VOXEL_CHUNK_SIZE,
+            (float)coord[2] * VOXEL_CHUNK_SIZE
+        };
+        uint32_t cell_count = MESHER_CELLS * MESHER_CELLS * MESHER_CELLS;
+        if (method == MESHER_CUBES || method == MESHER_GREEDY_CUBES) {
+            scratch.opaque = calloc(1, sizeof(*scratch.opaque));
+            assert(scratch.opaque);
+            mesher_cubes(&scratch, origin, method == MESHER_GREEDY_CUBES);
+        } else {
+            scratch.density = malloc(
+                MESHER_CORNERS * MESHER_CORNERS * MESHER_CORNERS *
+                    sizeof(*scratch.density)
+            );
+            assert(scratch.density);
+            mesher_build_density(&scratch);
+        }
+
+        if (method == MESHER_SURFACE_NETS) {
+            scratch.cell_vertices = malloc(
+                cell_count * sizeof(*scratch.cell_vertices)
+            );
+            assert(scratch.cell_vertices);
+            mesher_surface_nets(&scratch, origin);
+            mesher_surface_net_skirts(&scratch);
+        } else if (method == MESHER_MARCHING_TETRAHEDRA) {
+            scratch.edge_vertices = malloc(
+                cell_count * 7 * sizeof(*scratch.edge_vertices)
+            );
+            assert(scratch.edge_vertices);
+            mesher_marching_tetrahedra(&scratch, origin);
+            mesher_marching_tetrahedra_skirts(&scratch, origin);
+        }
+    }
+
+    mesh->vertex_count = scratch.vertex_count;
+    mesh->index_count = scratch.index_count;
+    if (scratch.vertex_count > 0) {
+        mesh_get_bounds(
+            &scratch.vertices[0].x,
+            sizeof(*scratch.vertices),
+            scratch.vertex_count,
+            mesh->bounds
+        );
+
+        // Vertices are a multiple of four bytes, so every reservation
+        // keeps the indices after them aligned
+        size_t vertex_bytes = scratch.vertex_count * sizeof(*scratch.vertices);
+        size_t index_bytes = scratch.index_count * sizeof(*scratch.indices);
+        size_t offset = __atomic_fetch_add(
+            &arena->used,
+            vertex_bytes + index_bytes,
+            __ATOMIC_RELAXED
+        );
+
+        if (offset + vertex_bytes + index_bytes <= arena->capacity) {
+            uint8_t* data = arena->data;
+            mesh->vertex_offset = offset;
+            mesh->index_offset = offset + vertex_bytes;
+            memcpy(&data[mesh->vertex_offset], scratch.vertices, vertex_bytes);
+            memcpy(&data[mesh->index_offset], scratch.indices, index_bytes);
+        } else {
+            mesh->overflowed = true;
+        }
+    }
+
+    free(scratch.chunk_materials);
+    free(scratch.owned);
+    free(scratch.opaque);
+    free(scratch.edge_vertices);
+    free(scratch.cell_vertices);
+    free(scratch.indices);
+    free(scratch.vertices);
+    free(scratch.density);
+    free(scratch.solid);
+    free(scratch.materials);
+
+    mesh->time = util_time() - start;
+    TRACE_END(scope);
+}
+
+void mesher_get_dependent_chunks(
+        const int32_t* voxel_min,
+        const int32_t* voxel_max,
+        uint32_t lod,
+        int32_t* chunk_min,
+        int32_t* chunk_max)
+{
+    // A chunk's box starts a cell before it and runs three cells past it
+    int32_t scale = 1 << lod;
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        chunk_min[j] = (voxel_min[j] - (VOXEL_CHUNK_SIZE + 2 * scale - 1) +
+            VOXEL_CHUNK_MASK) >> VOXEL_CHUNK_SHIFT;
+        chunk_max[j] = (voxel_max[j] + scale) >> VOXEL_CHUNK_SHIFT;
+    }
+}
+
+void mesher_run_job(void* data)
+{
+    struct mesher_job* job = data;
+    mesher_mesh_chunk(
+        job->world,
+        job->method,
+        job->coord,
+        job->lod,
+        job->skirts,
+        job->arena,
+        job->mesh
+    );
+}
+
+void mesher_mesh_chunks(
+        struct job_pool* pool,
+        const struct voxel_world* world,
+        enum mesher_method method,
+        uint32_t lod,
+        uint32_t skirts,
+        const int32_t* coords,
+        uint32_t chunk_count,
+        struct mesher_arena* arena,
+        struct mesher_mesh* meshes)
+{
+    struct mesher_job* jobs = malloc(chunk_count * sizeof(*jobs) + 1);
+    assert(jobs);
+
+    struct job_group group = {0};
+    uint32_t i;
+    for (i=0; i<chunk_count; i++) {
+        jobs[i].world = world;
+        jobs[i].method = method;
+        jobs[i].coord = &coords[i * 3];
+        jobs[i].lod = lod;
+        jobs[i].skirts = skirts;
+        jobs[i].arena = arena;
+        jobs[i].mesh = &meshes[i];
+        jobs_submit(pool, &group, mesher_run_job, &jobs[i]);
+    }
+    jobs_wait(pool, &group);
+
+    free(jobs);
+}
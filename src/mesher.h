@@ -0,0 +1,125 @@
+#ifndef MESHER_H_
+#define MESHER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "renderer.h"
+#include "jobs.h"
+#include "voxel.h"
+
+// Texture repeats once every this many voxels, projected along the axis
+// the surface faces most
+#define MESHER_TEXTURE_SCALE (1.0f / 8.0f)
+
+// Chunks can be meshed with cells of 1 << lod voxels on a side, up to 8
+#define MESHER_MAX_LOD 3
+
+// Faces of a chunk given skirts, bit 2 * axis for its low face along the
+// axis and the next bit for its high one. A neighbour meshed at another
+// level of detail doesn't meet the mesh along the face, the skirt hides
+// the gap
+#define MESHER_SKIRT(axis, high) (1u << ((axis) * 2 + (high)))
+#define MESHER_SKIRT_ALL 0x3fu
+
+enum mesher_method
+{
+    // A vertex per surface cell at the average of its edge crossings and a
+    // quad per crossed edge. Smooth and about half the triangles
+    MESHER_SURFACE_NETS,
+    // Cells split into six tetrahedra sharing the main diagonal, cut with
+    // linear interpolation like marching cubes without its case tables
+    MESHER_MARCHING_TETRAHEDRA,
+    // A quad for every rock face open to the air, the blocky baseline
+    MESHER_CUBES,
+    // The same faces with neighbours of the same material and facing
+    // merged into the largest rectangles a row at a time
+    MESHER_GREEDY_CUBES,
+    MESHER_METHOD_COUNT
+};
+
+// Where finished meshes are written, usually a mapped staging buffer.
+// Chunks meshed in parallel reserve their space with one atomic add, used
+// can pass capacity once the arena is full
+struct mesher_arena
+{
+    void* data;
+    size_t capacity;
+    size_t used;
+};
+
+// Vertices are in world voxel units, indices start from the chunk's first
+// vertex. Offsets are in bytes from the start of the arena
+struct mesher_mesh
+{
+    int32_t coord[3];
+    uint32_t lod;
+    uint32_t skirts;
+    size_t vertex_offset;
+    uint32_t vertex_count;
+    size_t index_offset;
+    uint32_t index_count;
+    float bounds[4];
+    // The mesh didn't fit, nothing was written but the counts are right
+    bool overflowed;
+    // Seconds from reading the voxels to the mesh being in the arena
+    double time;
+};
+
+const char* mesher_get_method_name(enum mesher_method method);
+
+// Reads the chunk with a border from the neighbouring chunks, so meshes of
+// adjacent chunks at the same level of detail meet without cracks or
+// doubled faces. Coarser cells take voxel_stand_in of the eight below
+// them a level at a time, as octree_read samples them. The world can't
+// change until the mesh is done
+void mesher_mesh_chunk(
+    const struct voxel_world* world,
+    enum mesher_method method,
+    const int32_t* coord,
+    uint32_t lod,
+    uint32_t skirts,
+    struct mesher_arena* arena,
+    struct mesher_mesh* mesh
+);
+
+// Range of chunks whose meshes at the level of detail read any voxel in
+// the box, borders included, the ones to mesh again after the box is
+// edited. Inclusive
+void mesher_get_dependent_chunks(
+    const int32_t* voxel_min,
+    const int32_t* voxel_max,
+    uint32_t lod,
+    int32_t* chunk_min,
+    int32_t* chunk_max
+);
+
+// Arguments of a chunk meshed as a job, for submitting without waiting
+struct mesher_job
+{
+    const struct voxel_world* world;
+    enum mesher_method method;
+    const int32_t* coord;
+    uint32_t lod;
+    uint32_t skirts;
+    struct mesher_arena* arena;
+    struct mesher_mesh* mesh;
+};
+
+void mesher_run_job(void* data);
+
+// A job per chunk, coords holds three per chunk. Waits for all of them
+void mesher_mesh_chunks(
+    struct job_pool* pool,
+    const struct voxel_world* world,
+    enum mesher_method method,
+    uint32_t lod,
+    uint32_t skirts,
+    const int32_t* coords,
+    uint32_t chunk_count,
+    struct mesher_arena* arena,
+    struct mesher_mesh* meshes
+);
+
+#endif
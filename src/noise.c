@@ -0,0 +1,615 @@
+#include <string.h>
+
+#include "noise.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NOISE_X86
+#include <immintrin.h>
+#define NOISE_SSE2 __attribute__((target("sse2")))
+#define NOISE_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Skew and unskew factors between the cubic and the simplex grid
+#define NOISE_F3 (1.0f / 3.0f)
+#define NOISE_G3 (1.0f / 6.0f)
+
+// Octaves are evaluated a block at a time to keep the scaled positions on
+// the stack
+#define NOISE_FRACTAL_BLOCK 256
+
+// Every path runs the same float operations in the same order, none are
+// allowed to fuse into FMAs, so results match bit for bit across ISAs
+
+// NOISE_ISA_COUNT until the first call picks one
+static enum noise_isa noise_current_isa = NOISE_ISA_COUNT;
+
+static uint64_t noise_splitmix(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void noise_init(struct noise* noise, uint64_t seed)
+{
+    uint64_t state = seed;
+
+    uint32_t i;
+    for (i=0; i<256; i++)
+        noise->perm[i] = i;
+
+    // Fisher-Yates, the modulo bias is irrelevant for 256 entries
+    for (i=255; i>0; i--) {
+        uint32_t j = noise_splitmix(&state) % (i + 1);
+        int32_t swap = noise->perm[i];
+        noise->perm[i] = noise->perm[j];
+        noise->perm[j] = swap;
+    }
+
+    for (i=0; i<256; i++)
+        noise->perm[i + 256] = noise->perm[i];
+}
+
+// Truncation adjusted down for negatives, the same as the SIMD paths
+static int32_t noise_floor(float v)
+{
+    int32_t i = (int32_t)v;
+    return (float)i > v ? i - 1 : i;
+}
+
+// One of the 12 cube edge gradients, picked by the low four bits
+static float noise_grad(int32_t hash, float x, float y, float z)
+{
+    int32_t h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+static float noise_corner(int32_t hash, float x, float y, float z)
+{
+    float t = 0.6f - x*x - y*y - z*z;
+    if (t < 0.0f)
+        return 0.0f;
+
+    t *= t;
+    return t * t * noise_grad(hash, x, y, z);
+}
+
+float noise_simplex(const struct noise* noise, float x, float y, float z)
+{
+    const int32_t* perm = noise->perm;
+
+    float s = (x + y + z) * NOISE_F3;
+    int32_t i = noise_floor(x + s);
+    int32_t j = noise_floor(y + s);
+    int32_t k = noise_floor(z + s);
+
+    float t = (float)(i + j + k) * NOISE_G3;
+    float x0 = x - ((float)i - t);
+    float y0 = y - ((float)j - t);
+    float z0 = z - ((float)k - t);
+
+    // Which of the six tetrahedra of the cube the sample is in
+    int32_t xy = x0 >= y0;
+    int32_t yz = y0 >= z0;
+    int32_t xz = x0 >= z0;
+    int32_t i1 = xy & xz;
+    int32_t j1 = (!xy) & yz;
+    int32_t k1 = (!xz) & (!yz);
+    int32_t i2 = xy | xz;
+    int32_t j2 = (!xy) | yz;
+    int32_t k2 = !(xz & yz);
+
+    float x1 = x0 - (float)i1 + NOISE_G3;
+    float y1 = y0 - (float)j1 + NOISE_G3;
+    float z1 = z0 - (float)k1 + NOISE_G3;
+    float x2 = x0 - (float)i2 + 2.0f * NOISE_G3;
+    float y2 = y0 - (float)j2 + 2.0f * NOISE_G3;
+    float z2 = z0 - (float)k2 + 2.0f * NOISE_G3;
+    float x3 = x0 - 1.0f + 3.0f * NOISE_G3;
+    float y3 = y0 - 1.0f + 3.0f * NOISE_G3;
+    float z3 = z0 - 1.0f + 3.0f * NOISE_G3;
+
+    int32_t ii = i & 255;
+    int32_t jj = j & 255;
+    int32_t kk = k & 255;
+
+    float n0 = noise_corner(
+        perm[ii + perm[jj + perm[kk]]], x0, y0, z0);
+    float n1 = noise_corner(
+        perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]], x1, y1, z1);
+    float n2 = noise_corner(
+        perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]], x2, y2, z2);
+    float n3 = noise_corner(
+        perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]], x3, y3, z3);
+
+    return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+// Kernels only take whole batches, returning how many samples they did
+static uint32_t noise_simplex_scalar(
+        const struct noise* noise,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    uint32_t i;
+    for (i=0; i<count; i++)
+        out[i] = noise_simplex(noise, x[i], y[i], z[i]);
+
+    return count;
+}
+
+#ifdef NOISE_X86
+
+NOISE_SSE2 static __m128i noise_floor_sse2(__m128 v)
+{
+    __m128i i = _mm_cvttps_epi32(v);
+    __m128 below = _mm_cmpgt_ps(_mm_cvtepi32_ps(i), v);
+    return _mm_add_epi32(i, _mm_castps_si128(below));
+}
+
+NOISE_SSE2 static __m128 noise_select_sse2(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// No gather before AVX2, the lanes are looked up one at a time
+NOISE_SSE2 static __m128i noise_perm_sse2(
+        const int32_t* perm,
+        __m128i index)
+{
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, index);
+
+    uint32_t i;
+    for (i=0; i<4; i++)
+        lanes[i] = perm[lanes[i]];
+
+    return _mm_loadu_si128((const __m128i*)lanes);
+}
+
+NOISE_SSE2 static __m128 noise_corner_sse2(
+        __m128i hash,
+        __m128 x,
+        __m128 y,
+        __m128 z)
+{
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    __m128 h_lt_8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    __m128 h_lt_4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 h_12_14 = _mm_castsi128_ps(_mm_or_si128(
+        _mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+        _mm_cmpeq_epi32(h, _mm_set1_epi32(14))
+    ));
+
+    __m128 u = noise_select_sse2(h_lt_8, x, y);
+    __m128 v = noise_select_sse2(h_lt_4, y, noise_select_sse2(h_12_14, x, z));
+
+    // Bits 0 and 1 of the hash flip the signs of u and v
+    __m128 u_sign = _mm_castsi128_ps(_mm_slli_epi32(h, 31));
+    __m128 v_sign = _mm_castsi128_ps(
+        _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    __m128 grad = _mm_add_ps(_mm_xor_ps(u, u_sign), _mm_xor_ps(v, v_sign));
+
+    __m128 t = _mm_sub_ps(
+        _mm_sub_ps(
+            _mm_sub_ps(_mm_set1_ps(0.6f), _mm_mul_ps(x, x)),
+            _mm_mul_ps(y, y)
+        ),
+        _mm_mul_ps(z, z)
+    );
+    __m128 outside = _mm_cmplt_ps(t, _mm_setzero_ps());
+
+    t = _mm_mul_ps(t, t);
+    return _mm_andnot_ps(outside, _mm_mul_ps(_mm_mul_ps(t, t), grad));
+}
+
+NOISE_SSE2 static __m128 noise_simplex_sse2_4(
+        const int32_t* perm,
+        __m128 x,
+        __m128 y,
+        __m128 z)
+{
+    __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z),
+        _mm_set1_ps(NOISE_F3));
+    __m128i i = noise_floor_sse2(_mm_add_ps(x, s));
+    __m128i j = noise_floor_sse2(_mm_add_ps(y, s));
+    __m128i k = noise_floor_sse2(_mm_add_ps(z, s));
+
+    __m128 t = _mm_mul_ps(
+        _mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)),
+        _mm_set1_ps(NOISE_G3)
+    );
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+    __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+    __m128i ones = _mm_set1_epi32(-1);
+    __m128i xy = _mm_castps_si128(_mm_cmpge_ps(x0, y0));
+    __m128i yz = _mm_castps_si128(_mm_cmpge_ps(y0, z0));
+    __m128i xz = _mm_castps_si128(_mm_cmpge_ps(x0, z0));
+    __m128i one = _mm_set1_epi32(1);
+    __m128i i1 = _mm_and_si128(_mm_and_si128(xy, xz), one);
+    __m128i j1 = _mm_and_si128(_mm_andnot_si128(xy, yz), one);
+    __m128i k1 = _mm_and_si128(_mm_andnot_si128(_mm_or_si128(xz, yz), ones),
+        one);
+    __m128i i2 = _mm_and_si128(_mm_or_si128(xy, xz), one);
+    __m128i j2 = _mm_and_si128(_mm_or_si128(_mm_xor_si128(xy, ones), yz),
+        one);
+    __m128i k2 = _mm_and_si128(_mm_andnot_si128(_mm_and_si128(xz, yz), ones),
+        one);
+
+    __m128 g1 = _mm_set1_ps(NOISE_G3);
+    __m128 g2 = _mm_set1_ps(2.0f * NOISE_G3);
+    __m128 g3 = _mm_set1_ps(3.0f * NOISE_G3);
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), g1);
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), g1);
+    __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, _mm_cvtepi32_ps(k1)), g1);
+    __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i2)), g2);
+    __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j2)), g2);
+    __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, _mm_cvtepi32_ps(k2)), g2);
+    __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, _mm_set1_ps(1.0f)), g3);
+    __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, _mm_set1_ps(1.0f)), g3);
+    __m128 z3 = _mm_add_ps(_mm_sub_ps(z0, _mm_set1_ps(1.0f)), g3);
+
+    __m128i mask = _mm_set1_epi32(255);
+    __m128i ii = _mm_and_si128(i, mask);
+    __m128i jj = _mm_and_si128(j, mask);
+    __m128i kk = _mm_and_si128(k, mask);
+
+    __m128i h0 = noise_perm_sse2(perm, _mm_add_epi32(ii,
+        noise_perm_sse2(perm, _mm_add_epi32(jj,
+            noise_perm_sse2(perm, kk)))));
+    __m128i h1 = noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(ii, i1),
+        noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(jj, j1),
+            noise_perm_sse2(perm, _mm_add_epi32(kk, k1))))));
+    __m128i h2 = noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(ii, i2),
+        noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(jj, j2),
+            noise_perm_sse2(perm, _mm_add_epi32(kk, k2))))));
+    __m128i h3 = noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(ii, one),
+        noise_perm_sse2(perm, _mm_add_epi32(_mm_add_epi32(jj, one),
+            noise_perm_sse2(perm, _mm_add_epi32(kk, one))))));
+
+    __m128 n0 = noise_corner_sse2(h0, x0, y0, z0);
+    __m128 n1 = noise_corner_sse2(h1, x1, y1, z1);
+    __m128 n2 = noise_corner_sse2(h2, x2, y2, z2);
+    __m128 n3 = noise_corner_sse2(h3, x3, y3, z3);
+
+    return _mm_mul_ps(
+        _mm_set1_ps(32.0f),
+        _mm_add_ps(_mm_add_ps(_mm_add_ps(n0, n1), n2), n3)
+    );
+}
+
+NOISE_SSE2 static uint32_t noise_simplex_sse2(
+        const struct noise* noise,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    uint32_t i;
+    for (i=0; i+4<=count; i+=4) {
+        __m128 n = noise_simplex_sse2_4(
+            noise->perm,
+            _mm_loadu_ps(&x[i]),
+            _mm_loadu_ps(&y[i]),
+            _mm_loadu_ps(&z[i])
+        );
+        _mm_storeu_ps(&out[i], n);
+    }
+
+    return i;
+}
+
+NOISE_AVX2 static __m256i noise_floor_avx2(__m256 v)
+{
+    __m256i i = _mm256_cvttps_epi32(v);
+    __m256 below = _mm256_cmp_ps(_mm256_cvtepi32_ps(i), v, _CMP_GT_OQ);
+    return _mm256_add_epi32(i, _mm256_castps_si256(below));
+}
+
+NOISE_AVX2 static __m256i noise_perm_avx2(
+        const int32_t* perm,
+        __m256i index)
+{
+    return _mm256_i32gather_epi32((const int*)perm, index, 4);
+}
+
+NOISE_AVX2 static __m256 noise_corner_avx2(
+        __m256i hash,
+        __m256 x,
+        __m256 y,
+        __m256 z)
+{
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+    __m256 h_lt_8 = _mm256_castsi256_ps(
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+    __m256 h_lt_4 = _mm256_castsi256_ps(
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    __m256 h_12_14 = _mm256_castsi256_ps(_mm256_or_si256(
+        _mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+        _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))
+    ));
+
+    __m256 u = _mm256_blendv_ps(y, x, h_lt_8);
+    __m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, h_12_14), y, h_lt_4);
+
+    // Bits 0 and 1 of the hash flip the signs of u and v
+    __m256 u_sign = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+    __m256 v_sign = _mm256_castsi256_ps(
+        _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+    __m256 grad = _mm256_add_ps(
+        _mm256_xor_ps(u, u_sign),
+        _mm256_xor_ps(v, v_sign)
+    );
+
+    __m256 t = _mm256_sub_ps(
+        _mm256_sub_ps(
+            _mm256_sub_ps(_mm256_set1_ps(0.6f), _mm256_mul_ps(x, x)),
+            _mm256_mul_ps(y, y)
+        ),
+        _mm256_mul_ps(z, z)
+    );
+    __m256 outside = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ);
+
+    t = _mm256_mul_ps(t, t);
+    return _mm256_andnot_ps(
+        outside,
+        _mm256_mul_ps(_mm256_mul_ps(t, t), grad)
+    );
+}
+
+NOISE_AVX2 static __m256 noise_simplex_avx2_8(
+        const int32_t* perm,
+        __m256 x,
+        __m256 y,
+        __m256 z)
+{
+    __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), z),
+        _mm256_set1_ps(NOISE_F3));
+    __m256i i = noise_floor_avx2(_mm256_add_ps(x, s));
+    __m256i j = noise_floor_avx2(_mm256_add_ps(y, s));
+    __m256i k = noise_floor_avx2(_mm256_add_ps(z, s));
+
+    __m256 t = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(i, j), k)),
+        _mm256_set1_ps(NOISE_G3)
+    );
+    __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+    __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+    __m256 z0 = _mm256_sub_ps(z, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+
+    __m256i ones = _mm256_set1_epi32(-1);
+    __m256i xy = _mm256_castps_si256(_mm256_cmp_ps(x0, y0, _CMP_GE_OQ));
+    __m256i yz = _mm256_castps_si256(_mm256_cmp_ps(y0, z0, _CMP_GE_OQ));
+    __m256i xz = _mm256_castps_si256(_mm256_cmp_ps(x0, z0, _CMP_GE_OQ));
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i i1 = _mm256_and_si256(_mm256_and_si256(xy, xz), one);
+    __m256i j1 = _mm256_and_si256(_mm256_andnot_si256(xy, yz), one);
+    __m256i k1 = _mm256_and_si256(
+        _mm256_andnot_si256(_mm256_or_si256(xz, yz), ones), one);
+    __m256i i2 = _mm256_and_si256(_mm256_or_si256(xy, xz), one);
+    __m256i j2 = _mm256_and_si256(
+        _mm256_or_si256(_mm256_xor_si256(xy, ones), yz), one);
+    __m256i k2 = _mm256_and_si256(
+        _mm256_andnot_si256(_mm256_and_si256(xz, yz), ones), one);
+
+    __m256 g1 = _mm256_set1_ps(NOISE_G3);
+    __m256 g2 = _mm256_set1_ps(2.0f * NOISE_G3);
+    __m256 g3 = _mm256_set1_ps(3.0f * NOISE_G3);
+    __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), g1);
+    __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), g1);
+    __m256 z1 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_cvtepi32_ps(k1)), g1);
+    __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i2)), g2);
+    __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j2)), g2);
+    __m256 z2 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_cvtepi32_ps(k2)), g2);
+    __m256 x3 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_set1_ps(1.0f)), g3);
+    __m256 y3 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_set1_ps(1.0f)), g3);
+    __m256 z3 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_set1_ps(1.0f)), g3);
+
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256i ii = _mm256_and_si256(i, mask);
+    __m256i jj = _mm256_and_si256(j, mask);
+    __m256i kk = _mm256_and_si256(k, mask);
+
+    __m256i h0 = noise_perm_avx2(perm, _mm256_add_epi32(ii,
+        noise_perm_avx2(perm, _mm256_add_epi32(jj,
+            noise_perm_avx2(perm, kk)))));
+    __m256i h1 = noise_perm_avx2(perm,
+        _mm256_add_epi32(_mm256_add_epi32(ii, i1),
+        noise_perm_avx2(perm, _mm256_add_epi32(_mm256_add_epi32(jj, j1),
+            noise_perm_avx2(perm, _mm256_add_epi32(kk, k1))))));
+    __m256i h2 = noise_perm_avx2(perm,
+        _mm256_add_epi32(_mm256_add_epi32(ii, i2),
+        noise_perm_avx2(perm, _mm256_add_epi32(_mm256_add_epi32(jj, j2),
+            noise_perm_avx2(perm, _mm256_add_epi32(kk, k2))))));
+    __m256i h3 = noise_perm_avx2(perm,
+        _mm256_add_epi32(_mm256_add_epi32(ii, one),
+        noise_perm_avx2(perm, _mm256_add_epi32(_mm256_add_epi32(jj, one),
+            noise_perm_avx2(perm, _mm256_add_epi32(kk, one))))));
+
+    __m256 n0 = noise_corner_avx2(h0, x0, y0, z0);
+    __m256 n1 = noise_corner_avx2(h1, x1, y1, z1);
+    __m256 n2 = noise_corner_avx2(h2, x2, y2, z2);
+    __m256 n3 = noise_corner_avx2(h3, x3, y3, z3);
+
+    return _mm256_mul_ps(
+        _mm256_set1_ps(32.0f),
+        _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(n0, n1), n2), n3)
+    );
+}
+
+NOISE_AVX2 static uint32_t noise_simplex_avx2(
+        const struct noise* noise,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    uint32_t i;
+    for (i=0; i+8<=count; i+=8) {
+        __m256 n = noise_simplex_avx2_8(
+            noise->perm,
+            _mm256_loadu_ps(&x[i]),
+            _mm256_loadu_ps(&y[i]),
+            _mm256_loadu_ps(&z[i])
+        );
+        _mm256_storeu_ps(&out[i], n);
+    }
+
+    return i;
+}
+
+#endif
+
+bool noise_isa_supported(enum noise_isa isa)
+{
+    switch (isa) {
+        case NOISE_ISA_SCALAR:
+            return true;
+#ifdef NOISE_X86
+        case NOISE_ISA_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case NOISE_ISA_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+enum noise_isa noise_get_isa(void)
+{
+    enum noise_isa isa = __atomic_load_n(&noise_current_isa, __ATOMIC_RELAXED);
+    if (isa != NOISE_ISA_COUNT)
+        return isa;
+
+    isa = NOISE_ISA_COUNT - 1;
+    while (!noise_isa_supported(isa))
+        isa--;
+
+    __atomic_store_n(&noise_current_isa, isa, __ATOMIC_RELAXED);
+    return isa;
+}
+
+bool noise_set_isa(enum noise_isa isa)
+{
+    if (isa >= NOISE_ISA_COUNT || !noise_isa_supported(isa))
+        return false;
+
+    __atomic_store_n(&noise_current_isa, isa, __ATOMIC_RELAXED);
+    return true;
+}
+
+const char* noise_get_isa_name(enum noise_isa isa)
+{
+    switch (isa) {
+        case NOISE_ISA_SCALAR:
+            return "scalar";
+        case NOISE_ISA_SSE2:
+            return "sse2";
+        case NOISE_ISA_AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+    }
+}
+
+void noise_simplex_batch(
+        const struct noise* noise,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    uint32_t done = 0;
+    switch (noise_get_isa()) {
+#ifdef NOISE_X86
+        case NOISE_ISA_AVX2:
+            done = noise_simplex_avx2(noise, x, y, z, out, count);
+            break;
+        case NOISE_ISA_SSE2:
+            done = noise_simplex_sse2(noise, x, y, z, out, count);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    // Whatever doesn't fill a batch, the scalar path gives the same values
+    noise_simplex_scalar(
+        noise,
+        &x[done],
+        &y[done],
+        &z[done],
+        &out[done],
+        count - done
+    );
+}
+
+void noise_fractal_batch(
+        const struct noise* noise,
+        const struct noise_fractal* fractal,
+        const float* x,
+        const float* y,
+        const float* z,
+        float* out,
+        uint32_t count)
+{
+    float block_x[NOISE_FRACTAL_BLOCK];
+    float block_y[NOISE_FRACTAL_BLOCK];
+    float block_z[NOISE_FRACTAL_BLOCK];
+    float block_n[NOISE_FRACTAL_BLOCK];
+
+    uint32_t start;
+    for (start=0; start<count; start+=NOISE_FRACTAL_BLOCK) {
+        uint32_t block_count = count - start < NOISE_FRACTAL_BLOCK ?
+            count - start : NOISE_FRACTAL_BLOCK;
+
+        float* sum = &out[start];
+        memset(sum, 0, block_count * sizeof(*sum));
+
+        float frequency = fractal->frequency;
+        float amplitude = 1.0f;
+        float total_amplitude = 0.0f;
+
+        uint32_t octave, i;
+        for (octave=0; octave<fractal->octaves; octave++) {
+            for (i=0; i<block_count; i++) {
+                block_x[i] = x[start + i] * frequency;
+                block_y[i] = y[start + i] * frequency;
+                block_z[i] = z[start + i] * frequency;
+            }
+
+            noise_simplex_batch(
+                noise,
+                block_x,
+                block_y,
+                block_z,
+                block_n,
+                block_count
+            );
+
+            for (i=0; i<block_count; i++)
+                sum[i] += block_n[i] * amplitude;
+
+            total_amplitude += amplitude;
+            frequency *= fractal->lacunarity;
+            amplitude *= fractal->gain;
+        }
+
+        if (total_amplitude > 0.0f) {
+            for (i=0; i<block_count; i++)
+                sum[i] /= total_amplitude;
+        }
+    }
+}
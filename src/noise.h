@@ -0,0 +1,71 @@
+#ifndef NOISE_H_
+#define NOISE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Samples evaluated together by the widest kernel
+#define NOISE_BATCH 8
+
+enum noise_isa
+{
+    NOISE_ISA_SCALAR,
+    NOISE_ISA_SSE2,
+    NOISE_ISA_AVX2,
+    NOISE_ISA_COUNT
+};
+
+// Permutation shuffled from the seed, doubled so corner hashes never need
+// to wrap
+struct noise
+{
+    int32_t perm[512];
+};
+
+// Octaves are summed with amplitudes 1, gain, gain^2... and normalized
+// back to about [-1, 1]
+struct noise_fractal
+{
+    uint32_t octaves;
+    float frequency;
+    float lacunarity;
+    float gain;
+};
+
+void noise_init(struct noise* noise, uint64_t seed);
+
+// 3D simplex noise in about [-1, 1]
+float noise_simplex(const struct noise* noise, float x, float y, float z);
+
+// Every ISA gives bit identical results, positions are separate arrays so
+// the kernels load them directly
+void noise_simplex_batch(
+    const struct noise* noise,
+    const float* x,
+    const float* y,
+    const float* z,
+    float* out,
+    uint32_t count
+);
+
+void noise_fractal_batch(
+    const struct noise* noise,
+    const struct noise_fractal* fractal,
+    const float* x,
+    const float* y,
+    const float* z,
+    float* out,
+    uint32_t count
+);
+
+bool noise_isa_supported(enum noise_isa isa);
+
+// The widest supported ISA until set otherwise
+enum noise_isa noise_get_isa(void);
+
+// Returns false, keeping the current ISA, if the CPU doesn't support it
+bool noise_set_isa(enum noise_isa isa);
+
+const char* noise_get_isa_name(enum noise_isa isa);
+
+#endif
@@ -0,0 +1,931 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "octree.h"
+
+#define OCTREE_INITIAL_CAPACITY 1024
+
+struct octree_builder
+{
+    struct octree* octree;
+    const struct voxel_world* world;
+    // The chunk being built, unpacked
+    uint16_t* voxels;
+};
+
+// A ray in the cube's voxels, flipped along every axis it runs backwards
+// on so it only ever runs forwards. Children are flipped back as visited.
+// Times are doubles, so the time to any plane is its exact distance from
+// the start times the inverse step, with one rounding
+struct octree_ray
+{
+    const struct octree* octree;
+    double origin[3];
+    double direction[3];
+    // Mirrored so every step is positive, times to a plane are its distance
+    // from start over step
+    double start[3];
+    double inverse[3];
+    uint32_t side;
+    uint32_t mirror;
+    float max_distance;
+    uint32_t lod;
+    struct octree_hit* hit;
+};
+
+static uint32_t octree_add_children(
+        struct octree* octree,
+        const uint32_t* nodes,
+        uint16_t stand_in)
+{
+    if (octree->node_count + 8 > octree->node_capacity) {
+        octree->node_capacity *= 2;
+        octree->nodes = realloc(
+            octree->nodes,
+            octree->node_capacity * sizeof(*octree->nodes)
+        );
+        octree->stand_ins = realloc(
+            octree->stand_ins,
+            octree->node_capacity / 8 * sizeof(*octree->stand_ins)
+        );
+        assert(octree->nodes && octree->stand_ins);
+    }
+
+    uint32_t first = octree->node_count;
+    assert(first < OCTREE_BRICK);
+    memcpy(&octree->nodes[first], nodes, 8 * sizeof(*nodes));
+    octree->stand_ins[first / 8] = stand_in;
+    octree->node_count += 8;
+
+    uint32_t i;
+    for (i=0; i<8; i++)
+        octree->leaf_count += (nodes[i] & OCTREE_LEAF) != 0;
+
+    return first;
+}
+
+// Words the palette takes ahead of the indices, two materials to a word
+static uint32_t octree_brick_palette_words(uint32_t bits)
+{
+    return (1u << bits) / 2;
+}
+
+// Voxel of a brick, from any coordinate inside it
+static uint16_t octree_brick_get(
+        const struct octree* octree,
+        uint32_t brick,
+        const int32_t* voxel)
+{
+    const uint32_t* words = &octree->bricks[brick & OCTREE_BRICK_OFFSET];
+    uint32_t bits = 1u << (brick >> OCTREE_BRICK_BITS_SHIFT & 3);
+    uint32_t mask = (1u << OCTREE_BRICK_SHIFT) - 1;
+    uint32_t index = ((voxel[1] & mask) << OCTREE_BRICK_SHIFT |
+        (voxel[2] & mask)) << OCTREE_BRICK_SHIFT | (voxel[0] & mask);
+    uint32_t bit = index * bits;
+    uint32_t entry = words[octree_brick_palette_words(bits) + bit / 32] >>
+        (bit % 32) & ((1u << bits) - 1);
+    return (uint16_t)(words[entry / 2] >> (entry % 2 * 16));
+}
+
+// Every voxel of a brick, in x, z, y order
+static void octree_brick_unpack(
+        const struct octree* octree,
+        uint32_t brick,
+        uint16_t* voxels)
+{
+    const uint32_t* words = &octree->bricks[brick & OCTREE_BRICK_OFFSET];
+    uint32_t bits = 1u << (brick >> OCTREE_BRICK_BITS_SHIFT & 3);
+    uint32_t palette_words = octree_brick_palette_words(bits);
+
+    uint16_t palette[OCTREE_BRICK_PALETTE_SIZE];
+    uint32_t i, j;
+    for (i=0; i<palette_words; i++) {
+        palette[i * 2] = (uint16_t)words[i];
+        palette[i * 2 + 1] = (uint16_t)(words[i] >> 16);
+    }
+
+    // A word of indices at a time
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t per_word = 32 / bits;
+    for (i=0; i<OCTREE_BRICK_VOLUME; i+=per_word) {
+        uint32_t word = words[palette_words + i / per_word];
+        for (j=0; j<per_word; j++, word>>=bits)
+            voxels[i + j] = palette[word & mask];
+    }
+}
+
+// Materials standing in for the brick's eight halves of 2 voxels a side,
+// in child order, as a node's children stand in for theirs
+static void octree_brick_halves(const uint16_t* voxels, uint16_t* halves)
+{
+    uint32_t i, j;
+    for (i=0; i<8; i++) {
+        uint16_t materials[8];
+        for (j=0; j<8; j++) {
+            uint32_t x = (i & 1) << 1 | (j & 1);
+            uint32_t y = (i & 2) | (j >> 1 & 1);
+            uint32_t z = (i >> 2) << 1 | (j >> 2);
+            materials[j] = voxels[
+                (y << OCTREE_BRICK_SHIFT | z) << OCTREE_BRICK_SHIFT | x];
+        }
+        halves[i] = voxel_stand_in(materials);
+    }
+}
+
+// Material of a cell of 1 << level voxels inside a brick, standing in for
+// its voxels the same way the nodes above do
+static uint16_t octree_brick_material(
+        const struct octree* octree,
+        uint32_t brick,
+        const int32_t* cell_min,
+        uint32_t level)
+{
+    if (level == 0)
+        return octree_brick_get(octree, brick, cell_min);
+
+    // The whole brick's comes first in its palette
+    if (level == OCTREE_BRICK_SHIFT)
+        return (uint16_t)octree->bricks[brick & OCTREE_BRICK_OFFSET];
+
+    int32_t half = 1 << (level - 1);
+    uint16_t materials[8];
+    uint32_t i;
+    for (i=0; i<8; i++) {
+        int32_t child_min[3] = {
+            cell_min[0] + (i & 1 ? half : 0),
+            cell_min[1] + (i & 2 ? half : 0),
+            cell_min[2] + (i & 4 ? half : 0)
+        };
+        materials[i] = octree_brick_material(
+            octree,
+            brick,
+            child_min,
+            level - 1
+        );
+    }
+    return voxel_stand_in(materials);
+}
+
+// Packs a brick's voxels, in x, z, y order, as indices into a palette of
+// its own as few bits wide as they fit. The brick word, or 0 when there
+// are more materials than a brick holds
+static uint32_t octree_add_brick(
+        struct octree* octree,
+        const uint16_t* voxels)
+{
+    // The material standing in for the brick goes first, so coarse reads
+    // find it without unpacking anything
+    uint16_t halves[8];
+    octree_brick_halves(voxels, halves);
+
+    uint16_t palette[OCTREE_BRICK_PALETTE_SIZE];
+    uint8_t indices[OCTREE_BRICK_VOLUME];
+    palette[0] = voxel_stand_in(halves);
+    uint32_t palette_count = 1;
+    uint32_t i, j;
+    for (i=0; i<OCTREE_BRICK_VOLUME; i++) {
+        for (j=0; j<palette_count && palette[j] != voxels[i]; j++)
+            ;
+        if (j == palette_count) {
+            if (palette_count == OCTREE_BRICK_PALETTE_SIZE)
+                return 0;
+            palette[palette_count++] = voxels[i];
+        }
+        indices[i] = j;
+    }
+
+    uint32_t bits_log2 = 0;
+    while ((1u << (1u << bits_log2)) < palette_count)
+        bits_log2++;
+    uint32_t bits = 1u << bits_log2;
+    uint32_t palette_words = octree_brick_palette_words(bits);
+    uint32_t word_count = palette_words + OCTREE_BRICK_VOLUME * bits / 32;
+
+    if (octree->brick_word_count + word_count > octree->brick_capacity) {
+        while (octree->brick_word_count + word_count >
+                octree->brick_capacity)
+            octree->brick_capacity *= 2;
+        octree->bricks = realloc(
+            octree->bricks,
+            octree->brick_capacity * sizeof(*octree->bricks)
+        );
+        assert(octree->bricks);
+    }
+
+    uint32_t first = octree->brick_word_count;
+    assert(first + word_count <= OCTREE_BRICK_OFFSET);
+    uint32_t* words = &octree->bricks[first];
+    memset(words, 0, word_count * sizeof(*words));
+    for (i=0; i<palette_count; i++)
+        words[i / 2] |= (uint32_t)palette[i] << (i % 2 * 16);
+    for (i=0; i<OCTREE_BRICK_VOLUME; i++) {
+        uint32_t bit = i * bits;
+        words[palette_words + bit / 32] |= (uint32_t)indices[i] << (bit % 32);
+    }
+    octree->brick_word_count += word_count;
+    octree->brick_count++;
+
+    return OCTREE_BRICK | bits_log2 << OCTREE_BRICK_BITS_SHIFT | first;
+}
+
+// The node word of a child. Every cell inside a brick shares its word,
+// where it lies picks the voxels
+static uint32_t octree_child(
+        const struct octree* octree,
+        uint32_t node,
+        uint32_t child)
+{
+    if (node & OCTREE_BRICK)
+        return node;
+
+    return octree->nodes[node + child];
+}
+
+// Material of a leaf, the cell of a brick at the node's corner, otherwise
+// the one standing in for the node
+static uint16_t octree_material(
+        const struct octree* octree,
+        uint32_t node,
+        const int32_t* node_min,
+        uint32_t level)
+{
+    if (node & OCTREE_LEAF)
+        return (uint16_t)node;
+
+    if (node & OCTREE_BRICK)
+        return octree_brick_material(octree, node, node_min, level);
+
+    return octree->stand_ins[node / 8];
+}
+
+// A leaf when the children are all leaves of one material, otherwise the
+// children are added and the node points at them
+static uint32_t octree_join(
+        struct octree* octree,
+        const uint32_t* nodes,
+        const uint16_t* materials,
+        uint16_t* material)
+{
+    bool leaves = true;
+    bool uniform = true;
+    uint32_t i;
+    for (i=0; i<8; i++) {
+        leaves = leaves && (nodes[i] & OCTREE_LEAF);
+        uniform = uniform && materials[i] == materials[0];
+    }
+
+    *material = leaves && uniform ?
+        materials[0] : voxel_stand_in(materials);
+    if (leaves && uniform)
+        return OCTREE_LEAF | materials[0];
+
+    return octree_add_children(octree, nodes, *material);
+}
+
+static uint32_t octree_build_voxels(
+        struct octree_builder* builder,
+        uint32_t x,
+        uint32_t y,
+        uint32_t z,
+        uint32_t depth,
+        uint16_t* material)
+{
+    if (depth == 0) {
+        *material = builder->voxels[VOXEL_INDEX(x, y, z)];
+        return OCTREE_LEAF | *material;
+    }
+
+    // Anything but one material is a brick, if it has few enough
+    uint32_t i;
+    if (depth == OCTREE_BRICK_SHIFT) {
+        uint16_t voxels[OCTREE_BRICK_VOLUME];
+        bool uniform = true;
+        for (i=0; i<OCTREE_BRICK_VOLUME; i++) {
+            uint32_t mask = (1u << OCTREE_BRICK_SHIFT) - 1;
+            voxels[i] = builder->voxels[VOXEL_INDEX(
+                x + (i & mask),
+                y + (i >> (2 * OCTREE_BRICK_SHIFT)),
+                z + (i >> OCTREE_BRICK_SHIFT & mask)
+            )];
+            uniform = uniform && voxels[i] == voxels[0];
+        }
+
+        *material = voxels[0];
+        if (uniform)
+            return OCTREE_LEAF | *material;
+
+        uint32_t brick = octree_add_brick(builder->octree, voxels);
+        if (brick) {
+            int32_t brick_min[3] = {0, 0, 0};
+            *material = octree_brick_material(
+                builder->octree,
+                brick,
+                brick_min,
+                OCTREE_BRICK_SHIFT
+            );
+            return brick;
+        }
+    }
+
+    uint32_t half = 1u << (depth - 1);
+    uint32_t nodes[8];
+    uint16_t materials[8];
+    for (i=0; i<8; i++) {
+        nodes[i] = octree_build_voxels(
+            builder,
+            x + (i & 1 ? half : 0),
+            y + (i & 2 ? half : 0),
+            z + (i & 4 ? half : 0),
+            depth - 1,
+            &materials[i]
+        );
+    }
+
+    return octree_join(builder->octree, nodes, materials, material);
+}
+
+// Uniform and missing chunks are leaves without looking at their voxels
+static uint32_t octree_build_chunks(
+        struct octree_builder* builder,
+        const int32_t* chunk,
+        uint32_t depth,
+        uint16_t* material)
+{
+    if (depth == 0) {
+        const struct voxel_chunk* voxels = voxel_world_find(
+            builder->world,
+            chunk[0],
+            chunk[1],
+            chunk[2]
+        );
+        if (!voxels) {
+            *material = VOXEL_MATERIAL_AIR;
+            return OCTREE_LEAF | *material;
+        }
+        if (voxels->encoding == VOXEL_ENCODING_UNIFORM) {
+            *material = voxels->uniform;
+            return OCTREE_LEAF | *material;
+        }
+
+        voxel_chunk_unpack(voxels, builder->voxels);
+        return octree_build_voxels(
+            builder,
+            0,
+            0,
+            0,
+            VOXEL_CHUNK_SHIFT,
+            material
+        );
+    }
+
+    int32_t half = 1 << (depth - 1);
+    uint32_t nodes[8];
+    uint16_t materials[8];
+    uint32_t i;
+    for (i=0; i<8; i++) {
+        int32_t child[3] = {
+            chunk[0] + (i & 1 ? half : 0),
+            chunk[1] + (i & 2 ? half : 0),
+            chunk[2] + (i & 4 ? half : 0)
+        };
+        nodes[i] = octree_build_chunks(
+            builder,
+            child,
+            depth - 1,
+            &materials[i]
+        );
+    }
+
+    return octree_join(builder->octree, nodes, materials, material);
+}
+
+void octree_build(
+        struct octree* octree,
+        const struct voxel_world* world,
+        const int32_t* chunk_min,
+        uint32_t chunk_depth)
+{
+    memset(octree, 0, sizeof(*octree));
+
+    uint32_t j;
+    for (j=0; j<3; j++)
+        octree->origin[j] = chunk_min[j] * VOXEL_CHUNK_SIZE;
+    octree->depth = chunk_depth + VOXEL_CHUNK_SHIFT;
+    assert(octree->depth < 31);
+
+    octree->node_capacity = OCTREE_INITIAL_CAPACITY;
+    octree->nodes = malloc(octree->node_capacity * sizeof(*octree->nodes));
+    octree->stand_ins = malloc(
+        octree->node_capacity / 8 * sizeof(*octree->stand_ins)
+    );
+    octree->brick_capacity = OCTREE_INITIAL_CAPACITY;
+    octree->bricks = malloc(
+        octree->brick_capacity * sizeof(*octree->bricks)
+    );
+    assert(octree->nodes && octree->stand_ins && octree->bricks);
+
+    struct octree_builder builder = {
+        .octree = octree,
+        .world = world,
+        .voxels = malloc(VOXEL_CHUNK_VOLUME * sizeof(*builder.voxels))
+    };
+    assert(builder.voxels);
+
+    uint16_t material;
+    octree->root = octree_build_chunks(
+        &builder,
+        chunk_min,
+        chunk_depth,
+        &material
+    );
+    octree->leaf_count += (octree->root & OCTREE_LEAF) != 0;
+
+    free(builder.voxels);
+
+    // Never empty, so realloc can't hand back NULL for a cube of one leaf
+    octree->node_capacity = octree->node_count > 8 ? octree->node_count : 8;
+    octree->nodes = realloc(
+        octree->nodes,
+        octree->node_capacity * sizeof(*octree->nodes)
+    );
+    octree->stand_ins = realloc(
+        octree->stand_ins,
+        octree->node_capacity / 8 * sizeof(*octree->stand_ins)
+    );
+    octree->brick_capacity = octree->brick_word_count > 0 ?
+        octree->brick_word_count : 1;
+    octree->bricks = realloc(
+        octree->bricks,
+        octree->brick_capacity * sizeof(*octree->bricks)
+    );
+    assert(octree->nodes && octree->stand_ins && octree->bricks);
+}
+
+void octree_destroy(struct octree* octree)
+{
+    free(octree->nodes);
+    free(octree->stand_ins);
+    free(octree->bricks);
+    memset(octree, 0, sizeof(*octree));
+}
+
+size_t octree_bytes(const struct octree* octree)
+{
+    return sizeof(*octree) +
+        octree->node_capacity * sizeof(*octree->nodes) +
+        octree->node_capacity / 8 * sizeof(*octree->stand_ins) +
+        octree->brick_capacity * sizeof(*octree->bricks);
+}
+
+uint16_t octree_get(
+        const struct octree* octree,
+        int32_t x,
+        int32_t y,
+        int32_t z,
+        uint32_t lod)
+{
+    int32_t voxel[3] = {x, y, z};
+    uint32_t local[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        local[j] = (uint32_t)(voxel[j] - octree->origin[j]);
+        if (local[j] >> octree->depth)
+            return VOXEL_MATERIAL_AIR;
+    }
+
+    uint32_t node = octree->root;
+    uint32_t level = octree->depth;
+    while (!(node & OCTREE_LEAF) && level > lod) {
+        level--;
+        node = octree_child(
+            octree,
+            node,
+            (local[0] >> level & 1) |
+                (local[1] >> level & 1) << 1 |
+                (local[2] >> level & 1) << 2
+        );
+    }
+
+    int32_t cell_min[3];
+    for (j=0; j<3; j++)
+        cell_min[j] = (int32_t)(local[j] >> level << level);
+    return octree_material(octree, node, cell_min, level);
+}
+
+// Fills the cells of the box the node covers, min in cells and node_min in
+// voxels, both from the cube's corner
+static void octree_read_node(
+        const struct octree* octree,
+        uint32_t node,
+        const int32_t* node_min,
+        uint32_t level,
+        uint32_t lod,
+        const int32_t* min,
+        const uint32_t* size,
+        uint16_t* out)
+{
+    int32_t lo[3], hi[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        int32_t first = node_min[j] >> lod;
+        int32_t last = (node_min[j] + (1 << level) - 1) >> lod;
+        int32_t box_last = min[j] + (int32_t)size[j] - 1;
+        lo[j] = first > min[j] ? first : min[j];
+        hi[j] = last < box_last ? last : box_last;
+        if (lo[j] > hi[j])
+            return;
+    }
+
+    // Every cell of a brick at once, unpacked once rather than a node at
+    // a time. Its cells are voxels, halves or the whole brick
+    if (node & OCTREE_BRICK) {
+        uint16_t voxels[OCTREE_BRICK_VOLUME];
+        uint16_t halves[8];
+        if (lod < OCTREE_BRICK_SHIFT)
+            octree_brick_unpack(octree, node, voxels);
+        if (lod == 1)
+            octree_brick_halves(voxels, halves);
+
+        int32_t x, y, z;
+        for (y=lo[1]; y<=hi[1]; y++) {
+            for (z=lo[2]; z<=hi[2]; z++) {
+                uint16_t* row = &out[
+                    ((size_t)(y - min[1]) * size[2] + (z - min[2])) *
+                        size[0]];
+                for (x=lo[0]; x<=hi[0]; x++) {
+                    int32_t cell[3] = {
+                        (x << lod) - node_min[0],
+                        (y << lod) - node_min[1],
+                        (z << lod) - node_min[2]
+                    };
+                    uint16_t material = (uint16_t)octree->bricks[
+                        node & OCTREE_BRICK_OFFSET];
+                    if (lod == 0) {
+                        material = voxels[(cell[1] << OCTREE_BRICK_SHIFT |
+                            cell[2]) << OCTREE_BRICK_SHIFT | cell[0]];
+                    } else if (lod == 1) {
+                        material = halves[cell[0] >> 1 |
+                            (cell[1] >> 1) << 1 | (cell[2] >> 1) << 2];
+                    }
+                    row[x - min[0]] = material;
+                }
+            }
+        }
+        return;
+    }
+
+    if ((node & OCTREE_LEAF) || level == lod) {
+        uint16_t material = octree_material(octree, node, node_min, level);
+        int32_t x, y, z;
+        for (y=lo[1]; y<=hi[1]; y++) {
+            for (z=lo[2]; z<=hi[2]; z++) {
+                uint16_t* row = &out[
+                    ((size_t)(y - min[1]) * size[2] + (z - min[2])) *
+                        size[0]];
+                for (x=lo[0]; x<=hi[0]; x++)
+                    row[x - min[0]] = material;
+            }
+        }
+        return;
+    }
+
+    int32_t half = 1 << (level - 1);
+    uint32_t i;
+    for (i=0; i<8; i++) {
+        int32_t child_min[3] = {
+            node_min[0] + (i & 1 ? half : 0),
+            node_min[1] + (i & 2 ? half : 0),
+            node_min[2] + (i & 4 ? half : 0)
+        };
+        octree_read_node(
+            octree,
+            octree_child(octree, node, i),
+            child_min,
+            level - 1,
+            lod,
+            min,
+            size,
+            out
+        );
+    }
+}
+
+void octree_read(
+        const struct octree* octree,
+        const int32_t* min,
+        const uint32_t* size,
+        uint32_t lod,
+        uint16_t* out)
+{
+    assert(lod <= octree->depth);
+
+    // Cells outside the cube stay air
+    size_t count = (size_t)size[0] * size[1] * size[2];
+    size_t i;
+    for (i=0; i<count; i++)
+        out[i] = VOXEL_MATERIAL_AIR;
+
+    int32_t local_min[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        assert((octree->origin[j] & ((1 << lod) - 1)) == 0);
+        local_min[j] = min[j] - (octree->origin[j] >> lod);
+    }
+
+    int32_t root_min[3] = {0, 0, 0};
+    octree_read_node(
+        octree,
+        octree->root,
+        root_min,
+        octree->depth,
+        lod,
+        local_min,
+        size,
+        out
+    );
+}
+
+// Child the ray enters first, from the planes it enters the node through
+// and the times it crosses the node's middle
+static uint32_t octree_first_child(const double* t0, const double* tm)
+{
+    uint32_t child = 0;
+    if (t0[0] > t0[1] && t0[0] > t0[2]) {
+        child |= (tm[1] < t0[0]) << 1;
+        child |= (tm[2] < t0[0]) << 2;
+    } else if (t0[1] > t0[2]) {
+        child |= (tm[0] < t0[1]);
+        child |= (tm[2] < t0[1]) << 2;
+    } else {
+        child |= (tm[0] < t0[2]);
+        child |= (tm[1] < t0[2]) << 1;
+    }
+    return child;
+}
+
+// Through whichever plane the ray leaves the child by first, 8 once it
+// leaves the node
+static uint32_t octree_next_child(uint32_t child, const double* t1)
+{
+    uint32_t axis = t1[0] < t1[1] ?
+        (t1[0] < t1[2] ? 0 : 2) :
+        (t1[1] < t1[2] ? 1 : 2);
+    uint32_t bit = 1u << axis;
+    return child & bit ? 8 : child | bit;
+}
+
+// Time the ray crosses a voxel plane along the axis, worked out the same
+// way whichever node it bounds
+static double octree_plane_time(
+        const struct octree_ray* ray,
+        uint32_t axis,
+        int32_t plane)
+{
+    double distance = ray->mirror >> axis & 1 ?
+        ray->origin[axis] - plane : plane - ray->origin[axis];
+    return distance * ray->inverse[axis];
+}
+
+// Voxel along the axis the ray is in at the distance, inside the node.
+// Its position is rounded, so the voxel is moved until the planes either
+// side are crossed before and after, as the traversal saw them
+static int32_t octree_ray_voxel(
+        const struct octree_ray* ray,
+        uint32_t axis,
+        double distance,
+        const int32_t* node_min,
+        int32_t size)
+{
+    double position = ray->origin[axis] + ray->direction[axis] * distance;
+    int32_t voxel = (int32_t)floor(position);
+    if (ray->direction[axis] > 0.0) {
+        while (octree_plane_time(ray, axis, voxel + 1) < distance)
+            voxel++;
+        while (octree_plane_time(ray, axis, voxel) > distance)
+            voxel--;
+    } else if (ray->direction[axis] < 0.0) {
+        while (octree_plane_time(ray, axis, voxel) < distance)
+            voxel--;
+        while (octree_plane_time(ray, axis, voxel + 1) > distance)
+            voxel++;
+    }
+
+    voxel = voxel > node_min[axis] ? voxel : node_min[axis];
+    return voxel < node_min[axis] + size - 1 ?
+        voxel : node_min[axis] + size - 1;
+}
+
+// Voxel from the cube's corner, and the axis the ray came in along, if
+// it didn't start there
+static void octree_fill_hit(
+        struct octree_ray* ray,
+        const int32_t* voxel,
+        uint32_t axis,
+        uint16_t material,
+        double distance)
+{
+    const struct octree* octree = ray->octree;
+    struct octree_hit* hit = ray->hit;
+    hit->distance = (float)distance;
+    hit->material = material;
+
+    int32_t cell_mask = ~((1 << ray->lod) - 1);
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        hit->voxel[j] = (voxel[j] & cell_mask) + octree->origin[j];
+        hit->normal[j] = 0;
+        if (j == axis && distance > 0.0)
+            hit->normal[j] = ray->mirror >> j & 1 ? 1 : -1;
+    }
+}
+
+// Steps voxel by voxel through a brick like the stepping reference does,
+// rather than down two more levels of nodes
+static bool octree_trace_brick(
+        struct octree_ray* ray,
+        uint32_t brick,
+        const int32_t* node_min,
+        uint32_t axis,
+        double distance)
+{
+    int32_t size = 1 << OCTREE_BRICK_SHIFT;
+    int32_t voxel[3];
+    double next[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        voxel[j] = octree_ray_voxel(ray, j, distance, node_min, size);
+        next[j] = octree_plane_time(
+            ray,
+            j,
+            ray->mirror >> j & 1 ? voxel[j] : voxel[j] + 1
+        );
+    }
+
+    while (distance <= ray->max_distance) {
+        uint16_t material = octree_brick_get(ray->octree, brick, voxel);
+        if (material != VOXEL_MATERIAL_AIR) {
+            octree_fill_hit(ray, voxel, axis, material, distance);
+            return true;
+        }
+
+        axis = next[0] < next[1] ?
+            (next[0] < next[2] ? 0 : 2) :
+            (next[1] < next[2] ? 1 : 2);
+        int32_t step = ray->mirror >> axis & 1 ? -1 : 1;
+        voxel[axis] += step;
+        if (voxel[axis] < node_min[axis] ||
+            voxel[axis] >= node_min[axis] + size)
+            return false;
+
+        distance = next[axis];
+        next[axis] = octree_plane_time(
+            ray,
+            axis,
+            step < 0 ? voxel[axis] : voxel[axis] + 1
+        );
+    }
+
+    return false;
+}
+
+// Revelles' parametric traversal, t0 and t1 are when the ray enters and
+// leaves the node along each axis
+static bool octree_trace_node(
+        struct octree_ray* ray,
+        uint32_t node,
+        uint32_t level,
+        const int32_t* node_min,
+        const double* t0,
+        const double* t1)
+{
+    // Behind the start, or only touched by it on the way out
+    if (t1[0] <= 0.0 || t1[1] <= 0.0 || t1[2] <= 0.0)
+        return false;
+
+    double entry = t0[0] > t0[1] ? t0[0] : t0[1];
+    entry = entry > t0[2] ? entry : t0[2];
+    if (entry > ray->max_distance)
+        return false;
+
+    // Entered through whichever plane it crossed last
+    uint32_t axis = t0[0] > t0[1] ?
+        (t0[0] > t0[2] ? 0 : 2) :
+        (t0[1] > t0[2] ? 1 : 2);
+    entry = entry > 0.0 ? entry : 0.0;
+
+    const struct octree* octree = ray->octree;
+    if ((node & OCTREE_BRICK) && ray->lod == 0)
+        return octree_trace_brick(ray, node, node_min, axis, entry);
+
+    if ((node & OCTREE_LEAF) || level == ray->lod) {
+        uint16_t material = octree_material(octree, node, node_min, level);
+        if (material == VOXEL_MATERIAL_AIR)
+            return false;
+
+        int32_t voxel[3];
+        uint32_t j;
+        for (j=0; j<3; j++)
+            voxel[j] = octree_ray_voxel(ray, j, entry, node_min, 1 << level);
+        octree_fill_hit(ray, voxel, axis, material, entry);
+        return true;
+    }
+
+    // From the plane itself rather than halfway between t0 and t1, so a
+    // ray starting on it or parallel to it sits exactly at 0
+    int32_t half = 1 << (level - 1);
+    double tm[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        int32_t middle = node_min[j] + half;
+        if (ray->mirror >> j & 1)
+            middle = (int32_t)ray->side - middle;
+        tm[j] = (middle - ray->start[j]) * ray->inverse[j];
+    }
+
+    uint32_t child = octree_first_child(t0, tm);
+    while (child < 8) {
+        double child_t0[3], child_t1[3];
+        for (j=0; j<3; j++) {
+            child_t0[j] = child >> j & 1 ? tm[j] : t0[j];
+            child_t1[j] = child >> j & 1 ? t1[j] : tm[j];
+        }
+
+        uint32_t actual = child ^ ray->mirror;
+        int32_t child_min[3];
+        for (j=0; j<3; j++)
+            child_min[j] = node_min[j] + (actual >> j & 1 ? half : 0);
+
+        if (octree_trace_node(
+                ray,
+                octree_child(octree, node, actual),
+                level - 1,
+                child_min,
+                child_t0,
+                child_t1))
+            return true;
+
+        child = octree_next_child(child, child_t1);
+    }
+
+    return false;
+}
+
+bool octree_raycast(
+        const struct octree* octree,
+        const float* origin,
+        const float* direction,
+        float max_distance,
+        uint32_t lod,
+        struct octree_hit* hit)
+{
+    struct octree_ray ray = {
+        .octree = octree,
+        .side = 1u << octree->depth,
+        .mirror = 0,
+        .max_distance = max_distance,
+        .lod = lod < octree->depth ? lod : octree->depth,
+        .hit = hit
+    };
+
+    double side = (double)(1u << octree->depth);
+    double t0[3], t1[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        ray.origin[j] = (double)origin[j] - octree->origin[j];
+        ray.direction[j] = direction[j];
+
+        double start = ray.origin[j];
+        double step = direction[j];
+        if (step < 0.0) {
+            start = side - start;
+            step = -step;
+            ray.mirror |= 1u << j;
+        }
+
+        // Parallel rays keep finite times, so the middles stay defined
+        step = step > 1e-30 ? step : 1e-30;
+        ray.start[j] = start;
+        ray.inverse[j] = 1.0 / step;
+        t0[j] = -start * ray.inverse[j];
+        t1[j] = (side - start) * ray.inverse[j];
+    }
+
+    double entry = t0[0] > t0[1] ? t0[0] : t0[1];
+    entry = entry > t0[2] ? entry : t0[2];
+    double exit = t1[0] < t1[1] ? t1[0] : t1[1];
+    exit = exit < t1[2] ? exit : t1[2];
+    if (entry >= exit)
+        return false;
+
+    int32_t root_min[3] = {0, 0, 0};
+    return octree_trace_node(
+        &ray,
+        octree->root,
+        octree->depth,
+        root_min,
+        t0,
+        t1
+    );
+}
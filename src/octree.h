@@ -0,0 +1,110 @@
+#ifndef OCTREE_H_
+#define OCTREE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "voxel.h"
+
+// Node words. A leaf holds its material in the low 16 bits. A brick is a
+// node 4 voxels on a side of several materials, the offset of its words
+// and how many bits it packs each voxel in as a shift. Anything else is
+// the index of the node's first child
+#define OCTREE_LEAF 0x80000000u
+#define OCTREE_BRICK 0x40000000u
+#define OCTREE_BRICK_BITS_SHIFT 28
+#define OCTREE_BRICK_OFFSET 0x0fffffffu
+
+#define OCTREE_BRICK_SHIFT 2
+#define OCTREE_BRICK_VOLUME (1 << (3 * OCTREE_BRICK_SHIFT))
+// Materials a brick holds at most, 4 bits each. Nodes with more have
+// children like any other
+#define OCTREE_BRICK_PALETTE_SIZE 16
+
+// Sparse voxel octree over a cube of chunks. Any node whose voxels are all
+// one material is a leaf, so solid rock and open air collapse to a
+// handful of nodes however large they are. Children are stored eight at
+// a time, bit 0 of the child picks x, bit 1 y and bit 2 z
+struct octree
+{
+    // Voxel coordinate of the cube's low corner, and its side as a shift
+    int32_t origin[3];
+    uint32_t depth;
+
+    uint32_t root;
+    uint32_t* nodes;
+    // One per eight children, the material standing in for all their
+    // parent's voxels when sampled coarser, from voxel_stand_in
+    uint16_t* stand_ins;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t leaf_count;
+
+    // Each brick is its palette, two materials a word with the one
+    // standing in for the brick first, then its voxels' indices in x, z, y
+    // order. Caves of rock and air pack most in 1 bit, 12 bytes a brick
+    uint32_t* bricks;
+    uint32_t brick_word_count;
+    uint32_t brick_capacity;
+    uint32_t brick_count;
+};
+
+struct octree_hit
+{
+    // Along the ray in lengths of its direction, 0 when it starts in rock
+    float distance;
+    // The cell hit, at the sampled level of detail, and the face entered
+    int32_t voxel[3];
+    int32_t normal[3];
+    uint16_t material;
+};
+
+// Cube of 1 << chunk_depth chunks on a side from chunk_min. Chunks missing
+// from the store read as air
+void octree_build(
+    struct octree* octree,
+    const struct voxel_world* world,
+    const int32_t* chunk_min,
+    uint32_t chunk_depth
+);
+
+void octree_destroy(struct octree* octree);
+
+size_t octree_bytes(const struct octree* octree);
+
+// Material of the cell of 1 << lod voxels on a side holding the voxel,
+// air outside the cube
+uint16_t octree_get(
+    const struct octree* octree,
+    int32_t x,
+    int32_t y,
+    int32_t z,
+    uint32_t lod
+);
+
+// Copies a box of cells of 1 << lod voxels out in x, z, y order like
+// voxel_world_read, min in cells. Whole nodes are filled at once
+void octree_read(
+    const struct octree* octree,
+    const int32_t* min,
+    const uint32_t* size,
+    uint32_t lod,
+    uint16_t* out
+);
+
+// First cell of rock along the ray within max_distance, cells being
+// 1 << lod voxels on a side. Visits nodes front to back, skipping every
+// collapsed node in one step. Planes are crossed when stepping voxel by
+// voxel would cross them, so both hit the same cell but for exact ties.
+// The direction needn't be normalized, distances are in its lengths
+bool octree_raycast(
+    const struct octree* octree,
+    const float* origin,
+    const float* direction,
+    float max_distance,
+    uint32_t lod,
+    struct octree_hit* hit
+);
+
+#endif
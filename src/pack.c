@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "archive.h"
+#include "util.h"
+
+// Packs asset files into one archive the renderer maps at startup. Paths
+// are stored as given, so run it from the directory the game runs from
+//
+//     pack [-c] <output .pak> <files...>
+//
+// With -c entries are LZ4 compressed when that saves at least an eighth
+
+struct pack_input
+{
+    const char* path;
+    struct archive_data data;
+    struct archive_entry entry;
+};
+
+static int compare_entries(const void* a, const void* b)
+{
+    const struct pack_input* input_a = a;
+    const struct pack_input* input_b = b;
+
+    if (input_a->entry.path_hash != input_b->entry.path_hash)
+        return input_a->entry.path_hash < input_b->entry.path_hash ? -1 : 1;
+
+    return strcmp(input_a->path, input_b->path);
+}
+
+static bool write_padding(FILE* fp, uint64_t* offset)
+{
+    static const uint8_t zeros[ARCHIVE_ALIGNMENT];
+    uint64_t padding = (ARCHIVE_ALIGNMENT - *offset % ARCHIVE_ALIGNMENT) %
+        ARCHIVE_ALIGNMENT;
+
+    *offset += padding;
+    return fwrite(zeros, 1, padding, fp) == padding;
+}
+
+int main(int argc, char** argv)
+{
+    bool compress = argc > 1 && strcmp(argv[1], "-c") == 0;
+    int first_arg = compress ? 2 : 1;
+
+    if (argc - first_arg < 2) {
+        fprintf(stderr, "Usage: %s [-c] <output .pak> <files...>\n", argv[0]);
+        return 1;
+    }
+
+    const char* output_path = argv[first_arg];
+    uint32_t input_count = argc - first_arg - 1;
+    struct pack_input* inputs = calloc(input_count, sizeof(*inputs));
+    assert(inputs);
+
+    uint32_t i;
+    for (i=0; i<input_count; i++) {
+        struct pack_input* input = &inputs[i];
+        input->path = argv[first_arg + 1 + i];
+
+        if (!archive_read_asset(NULL, input->path, &input->data)) {
+            fprintf(stderr, "Failed to read %s\n", input->path);
+            return 1;
+        }
+
+        input->entry.path_hash = util_hash(
+            input->path,
+            strlen(input->path),
+            UTIL_FNV1A_SEED
+        );
+        input->entry.size = input->data.size;
+        input->entry.stored_size = input->data.size;
+        input->entry.compression = ARCHIVE_COMPRESSION_NONE;
+    }
+
+    // Lookups binary search the table on path hash
+    qsort(inputs, input_count, sizeof(*inputs), compare_entries);
+    for (i=1; i<input_count; i++) {
+        if (compare_entries(&inputs[i-1], &inputs[i]) == 0) {
+            fprintf(stderr, "%s is listed twice\n", inputs[i].path);
+            return 1;
+        }
+    }
+
+    // Paths follow the table in the same order
+    uint64_t names_size = 0;
+    for (i=0; i<input_count; i++) {
+        inputs[i].entry.name_offset = names_size;
+        names_size += strlen(inputs[i].path) + 1;
+    }
+
+    FILE* fp = fopen(output_path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s\n", output_path);
+        return 1;
+    }
+
+    // The header is rewritten once the table's offset is known
+    struct archive_header header = {
+        .magic = ARCHIVE_MAGIC,
+        .version = ARCHIVE_VERSION,
+        .entry_count = input_count
+    };
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1;
+    uint64_t offset = sizeof(header);
+
+    uint64_t total_size = 0;
+    uint64_t total_stored = 0;
+    for (i=0; i<input_count && written; i++) {
+        struct pack_input* input = &inputs[i];
+        const uint8_t* stored = input->data.data;
+        uint8_t* compressed = NULL;
+
+        if (compress) {
+            size_t bound = archive_compress_bound(input->data.size);
+            compressed = malloc(bound);
+            assert(compressed);
+
+            size_t compressed_size = archive_compress(
+                input->data.data,
+                input->data.size,
+                compressed,
+                bound
+            );
+
+            // Already compressed formats like PNG don't shrink, keep those
+            // mapped directly instead of paying to decompress them
+            if (compressed_size < input->data.size - input->data.size / 8) {
+                stored = compressed;
+                input->entry.stored_size = compressed_size;
+                input->entry.compression = ARCHIVE_COMPRESSION_LZ4;
+            }
+        }
+
+        written = write_padding(fp, &offset);
+        input->entry.offset = offset;
+        written = written && fwrite(
+            stored,
+            1,
+            input->entry.stored_size,
+            fp
+        ) == input->entry.stored_size;
+        offset += input->entry.stored_size;
+
+        total_size += input->entry.size;
+        total_stored += input->entry.stored_size;
+
+        printf("%s: %llu bytes%s\n",
+            input->path,
+            (unsigned long long)input->entry.stored_size,
+            input->entry.compression == ARCHIVE_COMPRESSION_LZ4 ?
+                " (lz4)" : ""
+        );
+
+        free(compressed);
+    }
+
+    written = written && write_padding(fp, &offset);
+    header.toc_offset = offset;
+    for (i=0; i<input_count && written; i++)
+        written = fwrite(&inputs[i].entry, sizeof(inputs[i].entry), 1, fp) == 1;
+    offset += (uint64_t)input_count * sizeof(struct archive_entry);
+
+    header.names_offset = offset;
+    header.names_size = names_size;
+    for (i=0; i<input_count && written; i++) {
+        size_t length = strlen(inputs[i].path) + 1;
+        written = fwrite(inputs[i].path, 1, length, fp) == length;
+    }
+
+    written = written &&
+        fseek(fp, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    if (fclose(fp) != 0 || !written) {
+        fprintf(stderr, "Failed to write %s\n", output_path);
+        remove(output_path);
+        return 1;
+    }
+
+    printf("%s: %u entries, %llu bytes stored of %llu\n",
+        output_path,
+        input_count,
+        (unsigned long long)total_stored,
+        (unsigned long long)total_size
+    );
+
+    for (i=0; i<input_count; i++)
+        archive_data_free(&inputs[i].data);
+    free(inputs);
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 
 #include <assimp/cimport.h>
@@ -11,6 +12,10 @@
 #include "linmath.h"
 
 #include "renderer.h"
+#include "streamer.h"
+#include "world.h"
+#include "util.h"
+#include "trace.h"
 
 #define APP_NAME "Game"
 #define APP_VERSION_MAJOR 1
@@ -19,36 +24,97 @@
 
 #define VALIDATION_ENABLED 1
 
+// Fewest indices per draw before 16-bit index ranges stop paying off
+#define RENDERER_MIN_INDEX_RANGE_SIZE 3072
+
+// Largest on-screen error, in pixels, tolerated when picking a mesh LOD
+#define RENDERER_LOD_ERROR_PIXELS 1.0f
+
+// Anisotropy used for textures when the device supports it
+#define RENDERER_MAX_ANISOTROPY 8.0f
+
+// Decoded source images are cached here between runs
+#define RENDERER_TEXTURE_CACHE_DIR "cache/textures"
+
+// Device memory streamed textures may occupy, in MiB, unless overridden
+// by the TEXTURE_BUDGET_MB environment variable
+#define RENDERER_TEXTURE_BUDGET_MB 256
+
+// Setting the CAVE_SEED environment variable streams a cave of that seed
+// around the camera alongside the model, smooth unless CAVE_BLOCKY is set
+
+// Packed assets, loose files under assets/ are used when it's missing
+#define RENDERER_ARCHIVE_PATH "assets.pak"
+
+// Headless rendering cycles through this many offscreen images
+#define RENDERER_HEADLESS_WIDTH 640
+#define RENDERER_HEADLESS_HEIGHT 480
+#define RENDERER_HEADLESS_IMAGE_COUNT 2
+#define RENDERER_HEADLESS_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
 void renderer_create_resources(
         struct renderer_resources* resources,
         GLFWwindow* window)
 {
-    resources->instance = renderer_get_instance();
-    assert(resources->instance != VK_NULL_HANDLE);
+    TRACE_BEGIN(scope, "renderer_create_resources");
 
-    PFN_vkCreateDebugReportCallbackEXT fp_create_debug_callback;
-    fp_create_debug_callback =
-            (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(
-                    resources->instance,
-                    "vkCreateDebugReportCallbackEXT"
-            );
-    assert(*fp_create_debug_callback);
+    // Worker threads for asset decoding
+    resources->jobs = malloc(sizeof(*resources->jobs));
+    assert(resources->jobs);
+    jobs_init(resources->jobs, 0);
 
-    resources->debug_callback_ext = renderer_get_debug_callback(
-        resources->instance,
-        fp_create_debug_callback
-    );
+    // Left unopened when there is no archive, every read then falls back
+    // to loose files
+    resources->archive = malloc(sizeof(*resources->archive));
+    assert(resources->archive);
+    if (!archive_open(resources->archive, RENDERER_ARCHIVE_PATH))
+        printf("No %s, loading loose assets\n", RENDERER_ARCHIVE_PATH);
 
-    resources->surface = renderer_get_surface(
-        resources->instance,
-        window
+    resources->shader_cache.module_count = 0;
+    resources->shader_cache.hits = 0;
+
+    resources->headless = window == NULL;
+    resources->image_index = 0;
+
+    bool debug_report;
+    resources->instance = renderer_get_instance(
+        resources->headless,
+        &debug_report
     );
-    assert(resources->surface != VK_NULL_HANDLE);
+    assert(resources->instance != VK_NULL_HANDLE);
 
-    const char* device_extensions[] = {
+    resources->debug_callback_ext = VK_NULL_HANDLE;
+    if (debug_report) {
+        PFN_vkCreateDebugReportCallbackEXT fp_create_debug_callback;
+        fp_create_debug_callback =
+                (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(
+                        resources->instance,
+                        "vkCreateDebugReportCallbackEXT"
+                );
+        assert(*fp_create_debug_callback);
+
+        resources->debug_callback_ext = renderer_get_debug_callback(
+            resources->instance,
+            fp_create_debug_callback
+        );
+    }
+
+    // Headless needs neither a surface nor the swapchain extension, so
+    // software implementations without WSI can run it
+    resources->surface = VK_NULL_HANDLE;
+    if (!resources->headless) {
+        resources->surface = renderer_get_surface(
+            resources->instance,
+            window
+        );
+        assert(resources->surface != VK_NULL_HANDLE);
+    }
+
+    // Room for the optional extensions appended once a device is picked
+    const char* device_extensions[2] = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
-    uint32_t device_extension_count = 1;
+    uint32_t device_extension_count = resources->headless ? 0 : 1;
 
     resources->physical_device = renderer_get_physical_device(
         resources->instance,
@@ -58,6 +124,24 @@ void renderer_create_resources(
     );
     assert(resources->physical_device != VK_NULL_HANDLE);
 
+    // Driver reported budgets for the memory tracker, the query itself is
+    // core in 1.1
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(
+        resources->physical_device,
+        &device_properties
+    );
+    bool memory_budget =
+        device_properties.apiVersion >= VK_API_VERSION_1_1 &&
+        renderer_device_extension_supported(
+            resources->physical_device,
+            VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+        );
+    if (memory_budget) {
+        device_extensions[device_extension_count++] =
+            VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+
 	VkPhysicalDeviceFeatures required_features;
     memset(&required_features, VK_FALSE, sizeof(required_features));
     /*required_features.geometryShader = VK_TRUE;
@@ -67,6 +151,31 @@ void renderer_create_resources(
     required_features.sampleRateShading = VK_TRUE;
     required_features.samplerAnisotropy = VK_TRUE;*/
 
+    // Visible clusters go out in a single indirect call when supported,
+    // otherwise one indirect call per cluster
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(resources->physical_device, &supported_features);
+    required_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+    resources->multi_draw_indirect = supported_features.multiDrawIndirect;
+
+    // Oblique cave walls keep their detail with anisotropic filtering
+    required_features.samplerAnisotropy = supported_features.samplerAnisotropy;
+
+    // Cooked textures are only usable when BC formats can be sampled
+    required_features.textureCompressionBC =
+        supported_features.textureCompressionBC;
+    resources->texture_compression_bc = supported_features.textureCompressionBC;
+
+    // Needed for the wireframe pipeline variant
+    required_features.fillModeNonSolid = supported_features.fillModeNonSolid;
+    resources->fill_mode_non_solid = supported_features.fillModeNonSolid;
+
+    // Per pass vertex, primitive and fragment counts for the profiler
+    required_features.pipelineStatisticsQuery =
+        supported_features.pipelineStatisticsQuery;
+    resources->pipeline_statistics_query =
+        supported_features.pipelineStatisticsQuery;
+
     resources->device = renderer_get_device(
         resources->physical_device,
         resources->surface,
@@ -76,6 +185,12 @@ void renderer_create_resources(
     );
     assert(resources->device != VK_NULL_HANDLE);
 
+    renderer_create_memory_tracker(
+        resources->physical_device,
+        memory_budget,
+        &resources->memory
+    );
+
     uint32_t graphics_family_index = renderer_get_graphics_queue(
         resources->physical_device
     );
@@ -86,65 +201,100 @@ void renderer_create_resources(
         &resources->graphics_queue
     );
 
-    uint32_t present_family_index = renderer_get_present_queue(
+    resources->command_pool = renderer_get_command_pool(
         resources->physical_device,
-        resources->surface
-    );
-    vkGetDeviceQueue(
-        resources->device,
-        present_family_index,
-        0,
-        &resources->present_queue
+        resources->device
     );
+    assert(resources->command_pool != VK_NULL_HANDLE);
 
     VkSurfaceFormatKHR image_format;
-    image_format = renderer_get_image_format(
-        resources->physical_device,
-        resources->surface
-    );
+    VkImageLayout final_layout;
+    if (resources->headless) {
+        resources->present_queue = resources->graphics_queue;
+        resources->swapchain = VK_NULL_HANDLE;
 
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
-    resources->swapchain_extent = renderer_get_swapchain_extent(
-        resources->physical_device,
-        resources->surface,
-        window_width,
-        window_height
-    );
+        // Frames stay in TRANSFER_SRC_OPTIMAL so they can be read back
+        image_format.format = RENDERER_HEADLESS_FORMAT;
+        image_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
-    resources->swapchain = renderer_get_swapchain(
-        resources->physical_device,
-        resources->device,
-        resources->surface,
-        image_format,
-        resources->swapchain_extent,
-        VK_NULL_HANDLE
-    );
-    assert(resources->swapchain != VK_NULL_HANDLE);
+        resources->swapchain_extent.width = RENDERER_HEADLESS_WIDTH;
+        resources->swapchain_extent.height = RENDERER_HEADLESS_HEIGHT;
+        resources->swapchain_image_count = RENDERER_HEADLESS_IMAGE_COUNT;
 
-    resources->command_pool = renderer_get_command_pool(
-        resources->physical_device,
-        resources->device
-    );
-    assert(resources->command_pool != VK_NULL_HANDLE);
+        resources->swapchain_buffers = malloc(
+            resources->swapchain_image_count *
+                sizeof(*resources->swapchain_buffers)
+        );
+        assert(resources->swapchain_buffers);
 
-    resources->swapchain_image_count = renderer_get_swapchain_image_count(
-        resources->device,
-        resources->swapchain
-    );
+        renderer_create_offscreen_buffers(
+            resources->physical_device,
+            resources->device,
+            resources->command_pool,
+            image_format.format,
+            resources->swapchain_extent,
+            resources->swapchain_buffers,
+            resources->swapchain_image_count,
+            &resources->memory
+        );
+    } else {
+        uint32_t present_family_index = renderer_get_present_queue(
+            resources->physical_device,
+            resources->surface
+        );
+        vkGetDeviceQueue(
+            resources->device,
+            present_family_index,
+            0,
+            &resources->present_queue
+        );
 
-    resources->swapchain_buffers = malloc(
-        resources->swapchain_image_count * sizeof(*resources->swapchain_buffers)
-    );
+        image_format = renderer_get_image_format(
+            resources->physical_device,
+            resources->surface
+        );
+        final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        int window_width, window_height;
+        glfwGetWindowSize(window, &window_width, &window_height);
+        resources->swapchain_extent = renderer_get_swapchain_extent(
+            resources->physical_device,
+            resources->surface,
+            window_width,
+            window_height
+        );
 
-    renderer_create_swapchain_buffers(
-        resources->device,
-        resources->command_pool,
-        resources->swapchain,
-        image_format,
-        resources->swapchain_buffers,
-        resources->swapchain_image_count
-    );
+        resources->swapchain = renderer_get_swapchain(
+            resources->physical_device,
+            resources->device,
+            resources->surface,
+            image_format,
+            resources->swapchain_extent,
+            VK_NULL_HANDLE
+        );
+        assert(resources->swapchain != VK_NULL_HANDLE);
+
+        resources->swapchain_image_count = renderer_get_swapchain_image_count(
+            resources->device,
+            resources->swapchain
+        );
+
+        resources->swapchain_buffers = malloc(
+            resources->swapchain_image_count *
+                sizeof(*resources->swapchain_buffers)
+        );
+        assert(resources->swapchain_buffers);
+
+        renderer_create_swapchain_buffers(
+            resources->device,
+            resources->command_pool,
+            resources->swapchain,
+            image_format,
+            resources->swapchain_buffers,
+            resources->swapchain_image_count
+        );
+    }
 
     VkFormat depth_format;
     depth_format = renderer_get_depth_format(
@@ -160,13 +310,15 @@ void renderer_create_resources(
         resources->graphics_queue,
         resources->command_pool,
         resources->swapchain_extent,
-        depth_format
+        depth_format,
+        &resources->memory
     );
 
     resources->render_pass = renderer_get_render_pass(
         resources->device,
         image_format.format,
-        depth_format
+        depth_format,
+        final_layout
     );
     assert(resources->render_pass != VK_NULL_HANDLE);
 
@@ -185,7 +337,8 @@ void renderer_create_resources(
     );
 
     resources->descriptor_pool = renderer_get_descriptor_pool(
-        resources->device
+        resources->device,
+        resources->swapchain_image_count
     );
     assert(resources->descriptor_pool != VK_NULL_HANDLE);
 
@@ -194,11 +347,31 @@ void renderer_create_resources(
     );
     assert(resources->descriptor_layout != VK_NULL_HANDLE);
 
+    resources->cull_descriptor_layout = renderer_get_cull_descriptor_layout(
+        resources->device
+    );
+    assert(resources->cull_descriptor_layout != VK_NULL_HANDLE);
+
     resources->uniform_buffer = renderer_get_uniform_buffer(
         resources->physical_device,
         resources->device,
-        &resources->staging_uniform_buffer
-    );
+        &resources->staging_uniform_buffer,
+        &resources->memory
+    );
+
+    struct renderer_camera camera = {
+        .eye = {12.0f, 12.0f, 12.0f},
+        .center = {0.0f, 0.0f, 0.0f},
+        .up = {0.0f, 0.0f, 1.0f},
+        .fov = 0.78f,
+        .near = 0.1f,
+        // Every resident chunk is drawn, out to the unload distance plus
+        // the reach of a chunk's corners past its centre
+        .far = (WORLD_LOAD_RADIUS + WORLD_UNLOAD_MARGIN + 1.0f) *
+            VOXEL_CHUNK_SIZE
+    };
+    resources->camera = camera;
+    memset(&resources->stats, 0, sizeof(resources->stats));
 
     resources->base_graphics_pipeline_layout = renderer_get_pipeline_layout(
         resources->device,
@@ -208,55 +381,348 @@ void renderer_create_resources(
         0
     );
 
-    resources->base_graphics_pipeline = renderer_get_base_graphics_pipeline(
+    // Variants are created on demand, the base pipeline is the default
+    // state and what variants derive from
+    memset(&resources->pipelines, 0, sizeof(resources->pipelines));
+    VkPipelineCacheCreateInfo pipeline_cache_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = 0,
+        .pInitialData = NULL
+    };
+    VkResult result;
+    result = vkCreatePipelineCache(
         resources->device,
-        resources->swapchain_extent,
-        resources->base_graphics_pipeline_layout,
-        resources->render_pass,
-        0
+        &pipeline_cache_info,
+        NULL,
+        &resources->pipelines.cache
     );
+    assert(result == VK_SUCCESS);
 
-    renderer_load_textured_model(resources);
+    resources->base_graphics_pipeline = VK_NULL_HANDLE;
+    struct renderer_pipeline_state base_state;
+    base_state = renderer_get_default_pipeline_state();
+    resources->base_graphics_pipeline = renderer_get_pipeline(
+        resources,
+        &base_state,
+        true
+    );
 
-    renderer_record_draw_commands(
-        resources->base_graphics_pipeline,
-        resources->base_graphics_pipeline_layout,
-        resources->render_pass,
-        resources->swapchain_extent,
-        resources->framebuffers,
-        resources->swapchain_buffers,
+    VkPushConstantRange cull_push_constant_range = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(struct renderer_cull_constants)
+    };
+    resources->cull_pipeline_layout = renderer_get_pipeline_layout(
+        resources->device,
+        &resources->cull_descriptor_layout,
+        1,
+        &cull_push_constant_range,
+        1
+    );
+    resources->cull_pipeline = renderer_get_compute_pipeline(
+        resources->device,
+        resources->pipelines.cache,
+        renderer_get_shader_module(
+            resources->device,
+            resources->archive,
+            &resources->shader_cache,
+            "assets/shaders/cull.spv"
+        ),
+        resources->cull_pipeline_layout
+    );
+
+    uint64_t texture_budget_mb = RENDERER_TEXTURE_BUDGET_MB;
+    const char* texture_budget_env = getenv("TEXTURE_BUDGET_MB");
+    if (texture_budget_env)
+        texture_budget_mb = strtoull(texture_budget_env, NULL, 10);
+
+    resources->streamer = malloc(sizeof(*resources->streamer));
+    assert(resources->streamer);
+    streamer_init(
+        resources->streamer,
+        resources->physical_device,
+        resources->device,
+        resources->graphics_queue,
+        resources->command_pool,
         resources->swapchain_image_count,
-        &resources->mesh
+        texture_budget_mb * 1024 * 1024
     );
 
+    renderer_create_gpu_profiler(
+        resources->physical_device,
+        resources->device,
+        resources->pipeline_statistics_query,
+        &resources->gpu_profiler
+    );
+    resources->streamer->profiler = &resources->gpu_profiler;
+    resources->streamer->memory = &resources->memory;
+    resources->stats.gpu_time = -1.0;
+
+    resources->world = NULL;
+    const char* cave_seed_env = getenv("CAVE_SEED");
+    if (cave_seed_env) {
+        resources->world = malloc(sizeof(*resources->world));
+        assert(resources->world);
+        world_init(
+            resources->world,
+            resources->physical_device,
+            resources->device,
+            resources->graphics_queue,
+            resources->command_pool,
+            &resources->memory,
+            resources->jobs,
+            resources->swapchain_image_count,
+            getenv("CAVE_BLOCKY") ? MESHER_GREEDY_CUBES : MESHER_SURFACE_NETS,
+            strtoull(cave_seed_env, NULL, 10)
+        );
+    }
+
+    resources->dig_radius = 0.0f;
+    const char* dig_radius_env = getenv("CAVE_DIG_RADIUS");
+    if (resources->world && dig_radius_env)
+        resources->dig_radius = strtof(dig_radius_env, NULL);
+
+    renderer_load_textured_model(resources);
+
+    // Largest number of clusters any single LOD can submit
+    uint32_t max_draw_count = 0;
+    uint32_t i;
+    for (i=0; i<resources->mesh.lod_count; i++)
+        max_draw_count = MAX(max_draw_count, resources->mesh.lods[i].cluster_count);
+
+    // Command buffers are recorded every frame once their fence signals,
+    // which also guards the image's indirect buffer and descriptor sets
+    for (i=0; i<resources->swapchain_image_count; i++) {
+        resources->swapchain_buffers[i].fence = renderer_get_fence(
+            resources->device,
+            VK_FENCE_CREATE_SIGNALED_BIT
+        );
+        resources->swapchain_buffers[i].indirect_buffer =
+            renderer_get_indirect_buffer(
+                resources->physical_device,
+                resources->device,
+                max_draw_count,
+                &resources->memory
+            );
+        resources->swapchain_buffers[i].draw_count = 0;
+        resources->swapchain_buffers[i].cull_descriptor_set =
+            renderer_get_cull_descriptor_set(
+                resources->device,
+                resources->descriptor_pool,
+                resources->cull_descriptor_layout,
+                &resources->mesh.cluster_buffer,
+                &resources->swapchain_buffers[i].indirect_buffer
+            );
+        resources->swapchain_buffers[i].descriptor_set =
+            renderer_get_descriptor_set(
+                resources->device,
+                resources->descriptor_pool,
+                &resources->descriptor_layout,
+                1,
+                &resources->uniform_buffer,
+                resources->mesh.texture
+            );
+        if (resources->mesh.texture_streamed) {
+            streamer_set_descriptor_set(
+                resources->streamer,
+                resources->mesh.streamed_texture,
+                i,
+                resources->swapchain_buffers[i].descriptor_set
+            );
+        }
+    }
+
     resources->image_available = renderer_get_semaphore(resources->device);
     resources->render_finished = renderer_get_semaphore(resources->device);
+
+    TRACE_END(scope);
+}
+
+// A tunnel winding around what the camera looks at, one sphere a frame,
+// so edits are measured as they're drawn
+static void renderer_dig(struct renderer_resources* resources)
+{
+    float reach = 3.0f * VOXEL_CHUNK_SIZE;
+    float t = resources->stats.frame_count * resources->dig_radius / reach;
+    float* center = resources->camera.center;
+    float radius = resources->dig_radius;
+    struct voxel_edit edit = {
+        .shape = VOXEL_SHAPE_SPHERE,
+        .center = {
+            center[0] + reach * sinf(t),
+            center[1] + reach * 0.5f * sinf(t * 1.7f),
+            center[2] + reach * cosf(t * 0.6f)
+        },
+        .extent = {radius, radius, radius},
+        .material = VOXEL_MATERIAL_AIR
+    };
+    world_edit(resources->world, &edit);
 }
 
 void renderer_render(
         struct renderer_resources* resources)
 {
+    TRACE_BEGIN(scope, "renderer_render");
+
+    // Before anything this frame writes timestamps
+    struct renderer_gpu_profiler* profiler = &resources->gpu_profiler;
+    renderer_begin_gpu_frame(resources->device, profiler);
+    if (profiler->resolved)
+        resources->stats.gpu_time = profiler->frame_time;
+
     renderer_update_uniform_buffer(
         resources->physical_device,
         resources->device,
         resources->graphics_queue,
         resources->command_pool,
         resources->swapchain_extent,
+        &resources->camera,
         &resources->uniform_buffer,
-        &resources->staging_uniform_buffer
+        &resources->staging_uniform_buffer,
+        profiler
     );
 
+    // Headless frames cycle through the offscreen images, the fences
+    // below keep them from being reused while still in flight
     uint32_t image_index;
     VkResult result;
-    result = vkAcquireNextImageKHR(
+    if (resources->headless) {
+        image_index = resources->stats.frame_count %
+            resources->swapchain_image_count;
+    } else {
+        TRACE_BEGIN(acquire_scope, "acquire_image");
+        result = vkAcquireNextImageKHR(
+            resources->device,
+            resources->swapchain,
+            UINT64_MAX,
+            resources->image_available,
+            VK_NULL_HANDLE,
+            &image_index
+        );
+        assert(result == VK_SUCCESS);
+        TRACE_END(acquire_scope);
+    }
+    resources->image_index = image_index;
+
+    struct swapchain_buffer* swapchain_buffer;
+    swapchain_buffer = &resources->swapchain_buffers[image_index];
+
+    // Wait until the last submission of this image's commands retired
+    TRACE_BEGIN(fence_scope, "wait_for_fence");
+    result = vkWaitForFences(
         resources->device,
-        resources->swapchain,
-        UINT64_MAX,
-        resources->image_available,
-        VK_NULL_HANDLE,
-        &image_index
+        1,
+        &swapchain_buffer->fence,
+        VK_TRUE,
+        UINT64_MAX
     );
     assert(result == VK_SUCCESS);
+    vkResetFences(resources->device, 1, &swapchain_buffer->fence);
+    TRACE_END(fence_scope);
+
+    uint32_t lod = renderer_select_lod(
+        &resources->mesh,
+        &resources->camera,
+        resources->swapchain_extent
+    );
+
+    // Stream in the texture level the mesh's screen footprint samples,
+    // before recording since it may repoint this image's descriptor set
+    if (resources->mesh.texture_streamed) {
+        struct streamer_texture* texture;
+        texture = &resources->streamer->textures[resources->mesh.streamed_texture];
+
+        uint32_t texture_level = renderer_get_texture_level(
+            &resources->mesh,
+            &resources->camera,
+            resources->swapchain_extent,
+            MAX(texture->file.header.width, texture->file.header.height)
+        );
+        streamer_request(
+            resources->streamer,
+            resources->mesh.streamed_texture,
+            texture_level
+        );
+    }
+    TRACE_BEGIN(streamer_scope, "streamer_update");
+    streamer_update(resources->streamer, image_index);
+    TRACE_END(streamer_scope);
+
+    // After the fence, so what the image's last frame used can be reused
+    if (resources->world) {
+        if (resources->dig_radius > 0.0f)
+            renderer_dig(resources);
+
+        TRACE_BEGIN(world_scope, "world_update");
+        world_update(resources->world, &resources->camera, image_index);
+        TRACE_END(world_scope);
+    }
+
+    // What the cull pass kept when this image was last drawn, the counts
+    // trail by as many frames as there are images
+    struct renderer_stats* stats = &resources->stats;
+    uint32_t draw_count = renderer_count_drawn_clusters(
+        swapchain_buffer->indirect_buffer.mapped,
+        swapchain_buffer->draw_count,
+        &stats->triangle_count
+    );
+
+    struct renderer_cull_constants cull_constants;
+    renderer_get_cull_constants(
+        &resources->mesh,
+        lod,
+        &resources->camera,
+        resources->swapchain_extent,
+        &cull_constants
+    );
+    swapchain_buffer->draw_count = cull_constants.cluster_count;
+
+    // Drawn with the base pipeline until the mesh's variant is compiled
+    VkPipeline pipeline = renderer_get_pipeline(
+        resources,
+        &resources->mesh.pipeline_state,
+        false
+    );
+
+    renderer_record_draw_commands(
+        pipeline,
+        resources->base_graphics_pipeline_layout,
+        resources->render_pass,
+        resources->swapchain_extent,
+        resources->framebuffers[image_index],
+        swapchain_buffer->cmd,
+        &resources->mesh,
+        swapchain_buffer->descriptor_set,
+        swapchain_buffer->indirect_buffer.buffer,
+        resources->cull_pipeline,
+        resources->cull_pipeline_layout,
+        swapchain_buffer->cull_descriptor_set,
+        &cull_constants,
+        resources->multi_draw_indirect,
+        resources->world,
+        &resources->gpu_profiler
+    );
+
+    stats->draw_count = draw_count;
+    if (resources->world) {
+        stats->draw_count += resources->world->stats.draw_count;
+        stats->triangle_count += resources->world->stats.triangle_count;
+    }
+    stats->cluster_count = resources->mesh.lods[lod].cluster_count;
+    stats->full_detail_triangle_count =
+        resources->mesh.lods[0].index_count / 3;
+    stats->total_draw_count += stats->draw_count;
+    stats->total_cluster_count += stats->cluster_count;
+    stats->total_triangle_count += stats->triangle_count;
+    stats->total_full_detail_triangle_count +=
+        stats->full_detail_triangle_count;
+    stats->frame_count++;
+
+    renderer_update_memory_budget(&resources->memory);
+    if (stats->frame_count % RENDERER_MEMORY_LOG_INTERVAL == 0)
+        renderer_log_memory(&resources->memory);
 
     VkSemaphore wait_semaphores[] = {resources->image_available};
     VkPipelineStageFlags wait_stages[] = {
@@ -265,15 +731,16 @@ void renderer_render(
 
     VkSemaphore signal_semaphores[] = {resources->render_finished};
 
+    // Nothing to acquire or present without a swapchain
     VkSubmitInfo submit_info = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .pNext = NULL,
-        .waitSemaphoreCount = 1,
+        .waitSemaphoreCount = resources->headless ? 0 : 1,
         .pWaitSemaphores = wait_semaphores,
         .pWaitDstStageMask = wait_stages,
         .commandBufferCount = 1,
-        .pCommandBuffers = &(resources->swapchain_buffers[image_index].cmd),
-        .signalSemaphoreCount = 1,
+        .pCommandBuffers = &swapchain_buffer->cmd,
+        .signalSemaphoreCount = resources->headless ? 0 : 1,
         .pSignalSemaphores = signal_semaphores
     };
 
@@ -281,10 +748,15 @@ void renderer_render(
         resources->graphics_queue,
         1,
         &submit_info,
-        VK_NULL_HANDLE
+        swapchain_buffer->fence
     );
     assert(result == VK_SUCCESS);
 
+    if (resources->headless) {
+        TRACE_END(scope);
+        return;
+    }
+
     VkSwapchainKHR swapchains[] = {resources->swapchain};
 
 	VkPresentInfoKHR present_info = {
@@ -299,6 +771,8 @@ void renderer_render(
     };
 
     vkQueuePresentKHR(resources->present_queue, &present_info);
+
+    TRACE_END(scope);
 }
 
 void renderer_destroy_resources(
@@ -308,36 +782,173 @@ void renderer_destroy_resources(
 
     uint32_t i;
 
+    struct renderer_stats* stats = &resources->stats;
+    if (stats->frame_count > 0) {
+        printf("Triangles per frame: %llu submitted, %llu at full detail\n",
+            (unsigned long long)
+                (stats->total_triangle_count / stats->frame_count),
+            (unsigned long long)
+                (stats->total_full_detail_triangle_count / stats->frame_count)
+        );
+        printf("Clusters per frame: %llu drawn of %llu in the selected LOD\n",
+            (unsigned long long)(stats->total_draw_count / stats->frame_count),
+            (unsigned long long)(stats->total_cluster_count / stats->frame_count)
+        );
+    }
+
+    struct renderer_gpu_profiler* profiler = &resources->gpu_profiler;
+    if (profiler->resolved_frames > 0) {
+        printf("GPU time per frame over %llu frames, %llu dropped:\n",
+            (unsigned long long)profiler->resolved_frames,
+            (unsigned long long)profiler->dropped_frames
+        );
+        for (i=0; i<profiler->scope_count; i++) {
+            struct renderer_gpu_scope* scope = &profiler->scopes[i];
+            printf("    %s: %.3f ms\n",
+                scope->name,
+                scope->total_time / profiler->resolved_frames
+            );
+
+            if (!scope->has_statistics)
+                continue;
+
+            uint32_t j;
+            for (j=0; j<RENDERER_GPU_STATISTIC_COUNT; j++) {
+                printf("        %s: %llu\n",
+                    renderer_get_gpu_statistic_name(j),
+                    (unsigned long long)
+                        (scope->total_statistics[j] / profiler->resolved_frames)
+                );
+            }
+        }
+    }
+
+    struct streamer_stats* streamer_stats = &resources->streamer->stats;
+    printf("Texture streaming: %llu bytes resident, %u pending, "
+        "%llu misses, %llu uploads, %llu evictions\n",
+        (unsigned long long)streamer_stats->resident_bytes,
+        streamer_stats->pending_requests,
+        (unsigned long long)streamer_stats->misses,
+        (unsigned long long)streamer_stats->uploads,
+        (unsigned long long)streamer_stats->evictions
+    );
+    if (resources->world) {
+        struct world_stats* world_stats = &resources->world->stats;
+        printf("World streaming: %u chunks resident in %llu bytes, "
+            "%llu generated, %llu meshed, %llu again for level of detail, "
+            "%llu uploads of %llu bytes, "
+            "%llu bytes in the busiest frame, %llu unloads, "
+            "%llu uploads waiting on the pool\n",
+            world_stats->resident_chunks,
+            (unsigned long long)world_stats->resident_bytes,
+            (unsigned long long)world_stats->generated,
+            (unsigned long long)world_stats->meshed,
+            (unsigned long long)world_stats->lod_changes,
+            (unsigned long long)world_stats->uploads,
+            (unsigned long long)world_stats->upload_bytes,
+            (unsigned long long)world_stats->peak_frame_upload_bytes,
+            (unsigned long long)world_stats->unloads,
+            (unsigned long long)world_stats->pool_full
+        );
+
+        uint64_t swaps = MAX(world_stats->edit_swaps, 1);
+        printf("World edits: %llu swapped in, "
+            "%.1f frames %.2f ms mean latency, "
+            "%u frames %.2f ms at most, %llu split over frames\n",
+            (unsigned long long)world_stats->edit_swaps,
+            (double)world_stats->edit_latency_frames / swaps,
+            world_stats->edit_latency_ms / swaps,
+            world_stats->max_edit_latency_frames,
+            world_stats->max_edit_latency_ms,
+            (unsigned long long)world_stats->edit_splits
+        );
+    }
+    printf("Shader modules: %u created, %llu cache hits\n",
+        resources->shader_cache.module_count,
+        (unsigned long long)resources->shader_cache.hits
+    );
+    printf("Pipelines: %u created, %llu lookups hit, %llu fallback draws, "
+        "%u blocking compiles\n",
+        resources->pipelines.count,
+        (unsigned long long)resources->pipelines.hits,
+        (unsigned long long)resources->pipelines.fallbacks,
+        resources->pipelines.blocking_compiles
+    );
+
+    // Peaks cover loading, sizes are what's still live before teardown
+    renderer_log_memory(&resources->memory);
+
     vkDestroySemaphore(resources->device, resources->image_available, NULL);
     vkDestroySemaphore(resources->device, resources->render_finished, NULL);
+    renderer_destroy_gpu_profiler(resources->device, profiler);
 
     vkDestroyBuffer(resources->device, resources->mesh.vbo.buffer, NULL);
-    vkFreeMemory(resources->device, resources->mesh.vbo.memory, NULL);
+    renderer_free_memory(
+            resources->device, &resources->memory, resources->mesh.vbo.memory);
     vkDestroyBuffer(resources->device, resources->mesh.ibo.buffer, NULL);
-    vkFreeMemory(resources->device, resources->mesh.ibo.memory, NULL);
+    renderer_free_memory(
+            resources->device, &resources->memory, resources->mesh.ibo.memory);
+    vkDestroyBuffer(
+            resources->device, resources->mesh.cluster_buffer.buffer, NULL);
+    renderer_free_memory(
+            resources->device,
+            &resources->memory,
+            resources->mesh.cluster_buffer.memory
+    );
+    free(resources->mesh.index_ranges);
+    free(resources->mesh.clusters);
+    free(resources->mesh.lods);
 
-    vkDestroyImage(resources->device, resources->mesh.texture->image, NULL);
-    vkDestroyImageView(
-            resources->device, resources->mesh.texture->image_view, NULL);
-    vkFreeMemory(resources->device, resources->mesh.texture->memory, NULL);
-    vkDestroySampler(
-            resources->device, resources->mesh.texture->sampler, NULL);
-    free(resources->mesh.texture);
+    if (!resources->mesh.texture_streamed) {
+        vkDestroyImage(resources->device, resources->mesh.texture->image, NULL);
+        vkDestroyImageView(
+                resources->device, resources->mesh.texture->image_view, NULL);
+        renderer_free_memory(
+                resources->device,
+                &resources->memory,
+                resources->mesh.texture->memory
+        );
+        vkDestroySampler(
+                resources->device, resources->mesh.texture->sampler, NULL);
+        free(resources->mesh.texture);
+    }
+    streamer_destroy(resources->streamer);
+    free(resources->streamer);
+    if (resources->world) {
+        world_destroy(resources->world);
+        free(resources->world);
+    }
 
     vkDestroyPipelineLayout(
             resources->device, resources->base_graphics_pipeline_layout, NULL);
-    vkDestroyPipeline(
-            resources->device, resources->base_graphics_pipeline, NULL);
+    vkDestroyPipeline(resources->device, resources->cull_pipeline, NULL);
+    vkDestroyPipelineLayout(
+            resources->device, resources->cull_pipeline_layout, NULL);
+    renderer_destroy_pipeline_map(
+        resources->device,
+        resources->jobs,
+        &resources->pipelines
+    );
+    renderer_destroy_shader_cache(resources->device, &resources->shader_cache);
 
     vkDestroyBuffer(
             resources->device, resources->staging_uniform_buffer.buffer, NULL);
-    vkFreeMemory(
-            resources->device, resources->staging_uniform_buffer.memory, NULL);
+    renderer_free_memory(
+            resources->device,
+            &resources->memory,
+            resources->staging_uniform_buffer.memory
+    );
     vkDestroyBuffer(resources->device, resources->uniform_buffer.buffer, NULL);
-    vkFreeMemory(resources->device, resources->uniform_buffer.memory, NULL);
+    renderer_free_memory(
+            resources->device,
+            &resources->memory,
+            resources->uniform_buffer.memory
+    );
 
     vkDestroyDescriptorSetLayout(
             resources->device, resources->descriptor_layout, NULL);
+    vkDestroyDescriptorSetLayout(
+            resources->device, resources->cull_descriptor_layout, NULL);
     vkDestroyDescriptorPool(
             resources->device, resources->descriptor_pool, NULL);
 
@@ -354,14 +965,49 @@ void renderer_destroy_resources(
     vkDestroyImage(resources->device, resources->depth_image.image, NULL);
     vkDestroyImageView(
             resources->device, resources->depth_image.image_view, NULL);
-    vkFreeMemory(resources->device, resources->depth_image.memory, NULL);
+    renderer_free_memory(
+            resources->device,
+            &resources->memory,
+            resources->depth_image.memory
+    );
 
     for (i=0; i<resources->swapchain_image_count; i++) {
+        vkDestroyFence(
+            resources->device,
+            resources->swapchain_buffers[i].fence,
+            NULL
+        );
+        vkUnmapMemory(
+            resources->device,
+            resources->swapchain_buffers[i].indirect_buffer.memory
+        );
+        vkDestroyBuffer(
+            resources->device,
+            resources->swapchain_buffers[i].indirect_buffer.buffer,
+            NULL
+        );
+        renderer_free_memory(
+            resources->device,
+            &resources->memory,
+            resources->swapchain_buffers[i].indirect_buffer.memory
+        );
         vkDestroyImageView(
             resources->device,
             resources->swapchain_buffers[i].image_view,
             NULL
         );
+        if (resources->headless) {
+            vkDestroyImage(
+                resources->device,
+                resources->swapchain_buffers[i].image,
+                NULL
+            );
+            renderer_free_memory(
+                resources->device,
+                &resources->memory,
+                resources->swapchain_buffers[i].memory
+            );
+        }
         vkFreeCommandBuffers(
             resources->device,
             resources->command_pool,
@@ -374,37 +1020,183 @@ void renderer_destroy_resources(
 
     vkDestroyCommandPool(resources->device, resources->command_pool, NULL);
 
-    vkDestroySwapchainKHR(
-        resources->device,
-        resources->swapchain,
-        NULL
-    );
+    if (!resources->headless) {
+        vkDestroySwapchainKHR(
+            resources->device,
+            resources->swapchain,
+            NULL
+        );
+    }
 
     vkDestroyDevice(resources->device, NULL);
 
-    vkDestroySurfaceKHR(
-        resources->instance,
-        resources->surface,
-        NULL
-    );
+    if (!resources->headless) {
+        vkDestroySurfaceKHR(
+            resources->instance,
+            resources->surface,
+            NULL
+        );
+    }
 
-    PFN_vkDestroyDebugReportCallbackEXT fp_destroy_debug_callback;
-    fp_destroy_debug_callback =
-            (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(
-                    resources->instance,
-                    "vkDestroyDebugReportCallbackEXT"
-            );
-    assert(*fp_destroy_debug_callback);
-    fp_destroy_debug_callback(
-        resources->instance,
-        resources->debug_callback_ext,
-        NULL
-    );
+    if (resources->debug_callback_ext != VK_NULL_HANDLE) {
+        PFN_vkDestroyDebugReportCallbackEXT fp_destroy_debug_callback;
+        fp_destroy_debug_callback =
+                (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(
+                        resources->instance,
+                        "vkDestroyDebugReportCallbackEXT"
+                );
+        assert(*fp_destroy_debug_callback);
+        fp_destroy_debug_callback(
+            resources->instance,
+            resources->debug_callback_ext,
+            NULL
+        );
+    }
 
     vkDestroyInstance(resources->instance, NULL);
+
+    jobs_destroy(resources->jobs);
+    free(resources->jobs);
+
+    // Streamed textures read straight from the mapping until here
+    archive_close(resources->archive);
+    free(resources->archive);
+}
+
+bool renderer_save_frame(
+        struct renderer_resources* resources,
+        const char* path)
+{
+    assert(resources->headless);
+    assert(RENDERER_HEADLESS_FORMAT == VK_FORMAT_R8G8B8A8_UNORM);
+
+    vkDeviceWaitIdle(resources->device);
+
+    VkExtent2D extent = resources->swapchain_extent;
+    VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+
+    struct renderer_buffer readback = renderer_get_buffer(
+        resources->physical_device,
+        resources->device,
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &resources->memory,
+        RENDERER_MEMORY_STAGING
+    );
+
+    VkCommandBuffer copy_cmd;
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = resources->command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkResult result;
+    result = vkAllocateCommandBuffers(
+        resources->device,
+        &cmd_alloc_info,
+        &copy_cmd
+    );
+    assert(result == VK_SUCCESS);
+
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+    result = vkBeginCommandBuffer(copy_cmd, &cmd_begin_info);
+    assert(result == VK_SUCCESS);
+
+    // The render pass left the frame in TRANSFER_SRC_OPTIMAL, its color
+    // writes still need to be made visible to the copy
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = resources->swapchain_buffers[resources->image_index].image,
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
+    };
+    vkCmdPipelineBarrier(
+        copy_cmd,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, NULL,
+        0, NULL,
+        1, &barrier
+    );
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1}
+    };
+    vkCmdCopyImageToBuffer(
+        copy_cmd,
+        resources->swapchain_buffers[resources->image_index].image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        readback.buffer,
+        1,
+        &region
+    );
+
+    renderer_submit_command_buffer(
+        resources->physical_device,
+        resources->device,
+        resources->graphics_queue,
+        &copy_cmd
+    );
+    vkFreeCommandBuffers(
+        resources->device,
+        resources->command_pool,
+        1,
+        &copy_cmd
+    );
+
+    uint8_t* pixels;
+    result = vkMapMemory(
+        resources->device,
+        readback.memory,
+        0,
+        size,
+        0,
+        (void**)&pixels
+    );
+    assert(result == VK_SUCCESS);
+
+    bool written = false;
+    FILE* fp = fopen(path, "wb");
+    if (fp) {
+        fprintf(fp, "P6\n%u %u\n255\n", extent.width, extent.height);
+
+        uint32_t i;
+        written = true;
+        for (i=0; i<extent.width * extent.height && written; i++)
+            written = fwrite(&pixels[i * 4], 1, 3, fp) == 3;
+
+        written = fclose(fp) == 0 && written;
+    }
+
+    vkUnmapMemory(resources->device, readback.memory);
+    vkDestroyBuffer(resources->device, readback.buffer, NULL);
+    renderer_free_memory(resources->device, &resources->memory, readback.memory);
+
+    return written;
 }
 
-VkInstance renderer_get_instance()
+VkInstance renderer_get_instance(bool headless, bool* debug_report)
 {
     VkInstance instance_handle;
     instance_handle = VK_NULL_HANDLE;
@@ -427,22 +1219,24 @@ VkInstance renderer_get_instance()
                 APP_VERSION_PATCH),
         .pEngineName = "No Engine",
         .engineVersion = VK_MAKE_VERSION(0,0,0),
-        .apiVersion = VK_API_VERSION_1_0
+        .apiVersion = VK_API_VERSION_1_1
     };
     create_info.pApplicationInfo = &app_info;
 
-    // Validation layers
-    const char* enabled_layers[] = {"VK_LAYER_LUNARG_standard_validation"};
-    uint32_t enabled_layer_count = 1;
+    // Validation layers, the Khronos one in current SDKs, the LunarG
+    // meta layer in older ones
+    const char* validation_layers[] = {
+        "VK_LAYER_KHRONOS_validation",
+        "VK_LAYER_LUNARG_standard_validation"
+    };
+    const char* enabled_layer = NULL;
 
-	VkLayerProperties* available_layers;
-    uint32_t available_layer_count;
+    VkLayerProperties* available_layers;
+    uint32_t available_layer_count = 0;
 
     vkEnumerateInstanceLayerProperties(&available_layer_count, NULL);
-    assert(available_layer_count > 0);
-
     available_layers = malloc(
-        available_layer_count * sizeof(*available_layers)
+        MAX(available_layer_count, 1) * sizeof(*available_layers)
     );
     assert(available_layers);
 
@@ -452,48 +1246,47 @@ VkInstance renderer_get_instance()
     );
 
     uint32_t i, j;
-    bool layer_found = true;
-    for (i = 0; i < enabled_layer_count; i++)
-    {
-        if (VALIDATION_ENABLED)
-            break;
-
-        layer_found = false;
-        for (j = 0; j < available_layer_count; j++)
-        {
-            if (!strcmp(enabled_layers[i], available_layers[j].layerName))
-            {
-                layer_found = true;
+    for (i=0; VALIDATION_ENABLED && !enabled_layer &&
+            i<sizeof(validation_layers)/sizeof(*validation_layers); i++) {
+        for (j=0; j<available_layer_count; j++) {
+            if (!strcmp(validation_layers[i], available_layers[j].layerName)) {
+                enabled_layer = validation_layers[i];
                 break;
             }
         }
-
-        if (layer_found)
-            break;
     }
-    assert(layer_found);
+    free(available_layers);
 
-    if (VALIDATION_ENABLED) {
-        create_info.enabledLayerCount = enabled_layer_count;
-        create_info.ppEnabledLayerNames = enabled_layers;
-    } else {
-        create_info.enabledLayerCount = 0;
-        create_info.ppEnabledLayerNames = NULL;
+    if (VALIDATION_ENABLED && !enabled_layer)
+        printf("No validation layers installed, running without\n");
+
+    create_info.enabledLayerCount = enabled_layer ? 1 : 0;
+    create_info.ppEnabledLayerNames = enabled_layer ? &enabled_layer : NULL;
+
+    // Extensions, headless runs never initialise GLFW and need no WSI
+    const char** glfw_extensions = NULL;
+    uint32_t glfw_extension_count = 0;
+    if (!headless) {
+        glfw_extensions = glfwGetRequiredInstanceExtensions(
+            &glfw_extension_count
+        );
     }
 
-    // Extensions
-    const char** glfw_extensions;
-    uint32_t glfw_extension_count;
-    glfw_extensions = glfwGetRequiredInstanceExtensions(
-        &glfw_extension_count
-    );
+    // Validation layers provide debug report themselves
+    *debug_report = renderer_instance_extension_supported(
+            NULL,
+            VK_EXT_DEBUG_REPORT_EXTENSION_NAME
+        ) || (enabled_layer && renderer_instance_extension_supported(
+            enabled_layer,
+            VK_EXT_DEBUG_REPORT_EXTENSION_NAME
+        ));
 
     const char* my_extensions[] = {VK_EXT_DEBUG_REPORT_EXTENSION_NAME};
-    uint32_t my_extension_count = 1;
+    uint32_t my_extension_count = *debug_report ? 1 : 0;
 
     char** all_extensions;
     uint32_t all_extension_count = glfw_extension_count + my_extension_count;
-    all_extensions = malloc(all_extension_count * sizeof(char*));
+    all_extensions = malloc(MAX(all_extension_count, 1) * sizeof(char*));
 
     for (i=0; i<glfw_extension_count; i++)
     {
@@ -521,7 +1314,6 @@ VkInstance renderer_get_instance()
     for (i=0; i<all_extension_count; i++)
         free(all_extensions[i]);
     free(all_extensions);
-    free(available_layers);
 
     return instance_handle;
 }
@@ -639,7 +1431,7 @@ VkPhysicalDevice renderer_get_physical_device(
     for (i=0; i<physical_device_count; i++)
     {
         // Ensure required extensions are supported
-        if (physical_device_extensions_supported(
+        if (!physical_device_extensions_supported(
                 physical_devices[i],
                 device_extension_count,
                 device_extensions))
@@ -650,26 +1442,30 @@ VkPhysicalDevice renderer_get_physical_device(
 
         // Ensure there is at least one surface format
         // compatible with the surface
-        uint32_t format_count;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(
-            physical_devices[i],
-            surface,
-            &format_count,
-            NULL
-        );
+        uint32_t format_count = 1;
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceFormatsKHR(
+                physical_devices[i],
+                surface,
+                &format_count,
+                NULL
+            );
+        }
         if (format_count < 1) {
             printf("No surface formats available\n");
             continue;
         }
 
         // Ensured there is at least one present mode available
-        uint32_t present_mode_count;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(
-            physical_devices[i],
-            surface,
-            &present_mode_count,
-            NULL
-        );
+        uint32_t present_mode_count = 1;
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfacePresentModesKHR(
+                physical_devices[i],
+                surface,
+                &present_mode_count,
+                NULL
+            );
+        }
         if (present_mode_count < 1) {
             printf("No present modes available for surface\n");
             continue;
@@ -704,14 +1500,18 @@ VkPhysicalDevice renderer_get_physical_device(
                 queue_family_properties[j].queueCount > 0 &&
                 queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT;
 
-            VkResult wsi_query_result;
-            wsi_query_result = vkGetPhysicalDeviceSurfaceSupportKHR(
-                physical_devices[i],
-                j,
-                surface,
-                &wsi_support
-            );
-            assert(wsi_query_result == VK_SUCCESS);
+            // Without a surface only graphics support matters
+            wsi_support = VK_TRUE;
+            if (surface != VK_NULL_HANDLE) {
+                VkResult wsi_query_result;
+                wsi_query_result = vkGetPhysicalDeviceSurfaceSupportKHR(
+                    physical_devices[i],
+                    j,
+                    surface,
+                    &wsi_support
+                );
+                assert(wsi_query_result == VK_SUCCESS);
+            }
 
             if (wsi_support && graphics_bit)
                 break;
@@ -747,10 +1547,9 @@ bool physical_device_extensions_supported(
         &available_extension_count,
         NULL
     );
-    assert(available_extension_count > 0);
 
     available_extensions = malloc(
-        available_extension_count * sizeof(*available_extensions)
+        MAX(available_extension_count, 1) * sizeof(*available_extensions)
     );
     assert(available_extensions);
 
@@ -762,22 +1561,27 @@ bool physical_device_extensions_supported(
     );
 
     // Determine if device's extensions contain necessary extensions
+    bool supported = true;
     uint32_t i, j;
-    for (i=0; i<required_extension_count; i++)
+    for (i=0; i<required_extension_count && supported; i++)
     {
+        supported = false;
         for (j=0; j<available_extension_count; j++)
         {
-            if (strcmp(
+            if (!strcmp(
                     required_extensions[i],
                     available_extensions[j].extensionName
                 ))
             {
-                return false;
+                supported = true;
+                break;
             }
         }
     }
 
-    return true;
+    free(available_extensions);
+
+    return supported;
 }
 
 uint32_t renderer_get_graphics_queue(
@@ -803,12 +1607,17 @@ uint32_t renderer_get_graphics_queue(
         queue_family_properties
     );
 
+    // Clusters are culled in a compute pass recorded with the draws, a
+    // device with graphics has at least one family that does both
+    VkQueueFlags queue_flags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+
     uint32_t i;
     bool graphics_queue_found = false;
     for (i=0; i<queue_family_count; i++)
     {
         if (queue_family_properties[i].queueCount > 0 &&
-            queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            (queue_family_properties[i].queueFlags & queue_flags) ==
+                queue_flags)
         {
             graphics_queue_index = i;
             graphics_queue_found = true;
@@ -886,10 +1695,13 @@ VkDevice renderer_get_device(
     uint32_t graphics_family_index = renderer_get_graphics_queue(
         physical_device
     );
-    uint32_t present_family_index = renderer_get_present_queue(
-        physical_device,
-        surface
-    );
+    uint32_t present_family_index = graphics_family_index;
+    if (surface != VK_NULL_HANDLE) {
+        present_family_index = renderer_get_present_queue(
+            physical_device,
+            surface
+        );
+    }
 
     uint32_t device_queue_count = 2;
     uint32_t device_queue_indices[] = {
@@ -962,7 +1774,7 @@ VkCommandPool renderer_get_command_pool(
     VkCommandPoolCreateInfo command_pool_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = NULL,
-        .flags = 0,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
         .queueFamilyIndex = graphics_family_index
     };
 
@@ -1284,6 +2096,7 @@ void renderer_create_swapchain_buffers(
         assert(result == VK_SUCCESS);
 
         swapchain_buffers[i].image = images[i];
+        swapchain_buffers[i].memory = VK_NULL_HANDLE;
         view_info.image = swapchain_buffers[i].image;
 
         result = vkCreateImageView(
@@ -1296,6 +2109,63 @@ void renderer_create_swapchain_buffers(
     }
 }
 
+void renderer_create_offscreen_buffers(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkCommandPool command_pool,
+        VkFormat image_format,
+        VkExtent2D extent,
+        struct swapchain_buffer* swapchain_buffers,
+        uint32_t swapchain_image_count,
+        struct renderer_memory* memory)
+{
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    VkExtent3D image_extent = {extent.width, extent.height, 1};
+
+    uint32_t i;
+    for (i=0; i<swapchain_image_count; i++) {
+        VkResult result;
+        result = vkAllocateCommandBuffers(
+            device,
+            &cmd_alloc_info,
+            &swapchain_buffers[i].cmd
+        );
+        assert(result == VK_SUCCESS);
+
+        // The render pass starts from UNDEFINED, so the image's initial
+        // layout never needs a transition
+        struct renderer_image image = renderer_get_image(
+            physical_device,
+            device,
+            image_extent,
+            1,
+            image_format,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            memory,
+            RENDERER_MEMORY_ATTACHMENT
+        );
+
+        swapchain_buffers[i].image = image.image;
+        swapchain_buffers[i].memory = image.memory;
+        swapchain_buffers[i].image_view = renderer_get_texture_view(
+            device,
+            image.image,
+            image_format,
+            1
+        );
+    }
+}
+
 void renderer_submit_command_buffer(
         VkPhysicalDevice physical_device,
         VkDevice device,
@@ -1337,7 +2207,8 @@ void renderer_change_image_layout(
         VkImageLayout old_layout,
         VkImageLayout new_layout,
         VkAccessFlagBits src_access_mask,
-        VkImageAspectFlags aspect_mask)
+        VkImageAspectFlags aspect_mask,
+        uint32_t mip_levels)
 {
     VkCommandBuffer cmd = VK_NULL_HANDLE;
     VkCommandBufferAllocateInfo cmd_alloc_info = {
@@ -1382,7 +2253,7 @@ void renderer_change_image_layout(
         .subresourceRange = {
             aspect_mask,
             0,
-            1,
+            mip_levels,
             0,
             1
         }
@@ -1505,9 +2376,11 @@ struct renderer_image renderer_get_depth_image(
         VkQueue queue,
         VkCommandPool command_pool,
         VkExtent2D extent,
-        VkFormat depth_format)
+        VkFormat depth_format,
+        struct renderer_memory* memory)
 {
     struct renderer_image depth_image;
+    depth_image.mip_levels = 1;
 
     VkImageCreateInfo image_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -1559,9 +2432,12 @@ struct renderer_image renderer_get_depth_image(
         .memoryTypeIndex = mem_type
     };
 
-    result = vkAllocateMemory(
-        device, &mem_alloc_info, NULL, &depth_image.memory);
-    assert(result == VK_SUCCESS);
+    depth_image.memory = renderer_allocate_memory(
+        device,
+        memory,
+        RENDERER_MEMORY_ATTACHMENT,
+        &mem_alloc_info
+    );
 
     result = vkBindImageMemory(
         device, depth_image.image, depth_image.memory, 0);
@@ -1576,7 +2452,8 @@ struct renderer_image renderer_get_depth_image(
         VK_IMAGE_LAYOUT_UNDEFINED,
         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
         0,
-        VK_IMAGE_ASPECT_DEPTH_BIT
+        VK_IMAGE_ASPECT_DEPTH_BIT,
+        1
     );
 
     VkImageViewCreateInfo image_view_info = {
@@ -1613,7 +2490,8 @@ struct renderer_image renderer_get_depth_image(
 VkRenderPass renderer_get_render_pass(
         VkDevice device,
         VkFormat image_format,
-        VkFormat depth_format)
+        VkFormat depth_format,
+        VkImageLayout final_layout)
 {
     VkRenderPass render_pass_handle;
     render_pass_handle = VK_NULL_HANDLE;
@@ -1627,7 +2505,7 @@ VkRenderPass renderer_get_render_pass(
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        .finalLayout = final_layout
     };
     VkAttachmentReference color_ref = {
         .attachment = 0,
@@ -1746,7 +2624,9 @@ struct renderer_buffer renderer_get_buffer(
         VkDevice device,
         VkDeviceSize size,
         VkBufferUsageFlags usage,
-        VkMemoryPropertyFlags memory_flags)
+        VkMemoryPropertyFlags memory_flags,
+        struct renderer_memory* memory,
+        enum renderer_memory_category category)
 {
     struct renderer_buffer buffer;
 
@@ -1780,14 +2660,12 @@ struct renderer_buffer renderer_get_buffer(
 		)
 	};
 
-    VkResult result;
-    result = vkAllocateMemory(
+    buffer.memory = renderer_allocate_memory(
         device,
-        &alloc_info,
-        NULL,
-        &buffer.memory
+        memory,
+        category,
+        &alloc_info
     );
-    assert(result == VK_SUCCESS);
 
     vkBindBufferMemory(
         device,
@@ -1805,7 +2683,8 @@ struct renderer_buffer renderer_get_vertex_buffer(
         VkQueue queue,
         VkCommandPool command_pool,
         struct renderer_vertex* vertices,
-        uint32_t vertex_count)
+        uint32_t vertex_count,
+        struct renderer_memory* memory)
 {
     struct renderer_buffer vbo;
     struct renderer_buffer staging_vbo;
@@ -1818,7 +2697,9 @@ struct renderer_buffer renderer_get_vertex_buffer(
         mem_size,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_STAGING
     );
 
     vkMapMemory(device, staging_vbo.memory, 0, mem_size, 0, &vbo.mapped);
@@ -1831,7 +2712,9 @@ struct renderer_buffer renderer_get_vertex_buffer(
         mem_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT |
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_MESH
     );
 
     VkCommandBuffer copy_cmd;
@@ -1884,23 +2767,150 @@ struct renderer_buffer renderer_get_vertex_buffer(
     );
 
     vkDestroyBuffer(device, staging_vbo.buffer, NULL);
-    vkFreeMemory(device, staging_vbo.memory, NULL);
+    renderer_free_memory(device, memory, staging_vbo.memory);
 
     return vbo;
 }
 
+VkIndexType renderer_get_index_type(
+        uint32_t* indices,
+        uint32_t vertex_count,
+        struct renderer_mesh_lod* lods,
+        uint32_t lod_count,
+        struct renderer_index_range** index_ranges,
+        uint32_t* index_range_count)
+{
+    uint32_t index_count = 0;
+    uint32_t l, i, j;
+    for (l=0; l<lod_count; l++)
+        index_count += lods[l].index_count;
+
+    struct renderer_index_range* ranges;
+    ranges = malloc((index_count / 3 + lod_count) * sizeof(*ranges));
+    assert(ranges);
+
+    // Every vertex is addressable with 16 bits, draw each LOD in one range
+    if (vertex_count <= UINT16_MAX)
+    {
+        for (l=0; l<lod_count; l++)
+        {
+            ranges[l].first_index = lods[l].first_index;
+            ranges[l].index_count = lods[l].index_count;
+            ranges[l].vertex_offset = 0;
+            lods[l].first_range = l;
+            lods[l].range_count = 1;
+        }
+
+        *index_ranges = realloc(ranges, lod_count * sizeof(*ranges));
+        *index_range_count = lod_count;
+        return VK_INDEX_TYPE_UINT16;
+    }
+
+    // Split each LOD into runs of whole triangles whose indices span less
+    // than 2^16, each run is later drawn with its own vertex offset
+    uint32_t range_count = 0;
+    bool rebase = true;
+
+    for (l=0; l<lod_count && rebase; l++)
+    {
+        uint32_t lod_end = lods[l].first_index + lods[l].index_count;
+        uint32_t range_start = lods[l].first_index;
+        uint32_t range_min = UINT32_MAX;
+        uint32_t range_max = 0;
+
+        lods[l].first_range = range_count;
+
+        for (i=range_start; i+2<lod_end; i+=3)
+        {
+            uint32_t tri_min = MIN(indices[i], MIN(indices[i+1], indices[i+2]));
+            uint32_t tri_max = MAX(indices[i], MAX(indices[i+1], indices[i+2]));
+
+            // A single triangle spanning too far can't be rebased at all
+            if (tri_max - tri_min > UINT16_MAX)
+            {
+                rebase = false;
+                break;
+            }
+
+            if (MAX(range_max, tri_max) - MIN(range_min, tri_min) > UINT16_MAX)
+            {
+                ranges[range_count].first_index = range_start;
+                ranges[range_count].index_count = i - range_start;
+                ranges[range_count].vertex_offset = range_min;
+                range_count++;
+
+                range_start = i;
+                range_min = tri_min;
+                range_max = tri_max;
+            }
+            else
+            {
+                range_min = MIN(range_min, tri_min);
+                range_max = MAX(range_max, tri_max);
+            }
+        }
+        if (rebase && range_start < lod_end)
+        {
+            ranges[range_count].first_index = range_start;
+            ranges[range_count].index_count = lod_end - range_start;
+            ranges[range_count].vertex_offset = range_min;
+            range_count++;
+        }
+
+        lods[l].range_count = range_count - lods[l].first_range;
+    }
+
+    // Poor vertex locality would mean many tiny draws, which costs more
+    // than the bandwidth saved, so keep 32-bit indices in that case
+    if (!rebase ||
+        (uint64_t)range_count * RENDERER_MIN_INDEX_RANGE_SIZE > index_count)
+    {
+        for (l=0; l<lod_count; l++)
+        {
+            ranges[l].first_index = lods[l].first_index;
+            ranges[l].index_count = lods[l].index_count;
+            ranges[l].vertex_offset = 0;
+            lods[l].first_range = l;
+            lods[l].range_count = 1;
+        }
+
+        *index_ranges = realloc(ranges, lod_count * sizeof(*ranges));
+        *index_range_count = lod_count;
+        return VK_INDEX_TYPE_UINT32;
+    }
+
+    // Rebase indices so they fit in 16 bits relative to their range
+    for (i=0; i<range_count; i++)
+    {
+        for (j=0; j<ranges[i].index_count; j++)
+            indices[ranges[i].first_index + j] -= ranges[i].vertex_offset;
+    }
+
+    *index_ranges = realloc(ranges, range_count * sizeof(*ranges));
+    *index_range_count = range_count;
+    return VK_INDEX_TYPE_UINT16;
+}
+
 struct renderer_buffer renderer_get_index_buffer(
         VkPhysicalDevice physical_device,
         VkDevice device,
         VkQueue queue,
         VkCommandPool command_pool,
         uint32_t* indices,
-        uint32_t index_count)
+        uint32_t index_count,
+        VkIndexType index_type,
+        struct renderer_memory* memory)
 {
     struct renderer_buffer ibo;
     struct renderer_buffer staging_ibo;
 
-    VkDeviceSize mem_size = sizeof(*indices) * index_count;
+    VkDeviceSize index_size;
+    if (index_type == VK_INDEX_TYPE_UINT16)
+        index_size = sizeof(uint16_t);
+    else
+        index_size = sizeof(uint32_t);
+
+    VkDeviceSize mem_size = index_size * index_count;
 
     staging_ibo = renderer_get_buffer(
         physical_device,
@@ -1908,11 +2918,23 @@ struct renderer_buffer renderer_get_index_buffer(
         mem_size,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_STAGING
     );
 
     vkMapMemory(device, staging_ibo.memory, 0, mem_size, 0, &ibo.mapped);
-    memcpy(ibo.mapped, indices, (size_t)mem_size);
+    if (index_type == VK_INDEX_TYPE_UINT16)
+    {
+        // Narrow straight into the staging buffer
+        uint32_t i;
+        for (i=0; i<index_count; i++)
+            ((uint16_t*)ibo.mapped)[i] = (uint16_t)indices[i];
+    }
+    else
+    {
+        memcpy(ibo.mapped, indices, (size_t)mem_size);
+    }
     vkUnmapMemory(device, staging_ibo.memory);
 
     ibo = renderer_get_buffer(
@@ -1921,7 +2943,9 @@ struct renderer_buffer renderer_get_index_buffer(
         mem_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT |
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_MESH
     );
 
     VkCommandBuffer copy_cmd;
@@ -1974,7 +2998,9 @@ struct renderer_buffer renderer_get_index_buffer(
     );
 
     vkDestroyBuffer(device, staging_ibo.buffer, NULL);
-    vkFreeMemory(device, staging_ibo.memory, NULL);
+    renderer_free_memory(device, memory, staging_ibo.memory);
+
+    ibo.size = mem_size;
 
     return ibo;
 }
@@ -1982,7 +3008,8 @@ struct renderer_buffer renderer_get_index_buffer(
 struct renderer_buffer renderer_get_uniform_buffer(
         VkPhysicalDevice physical_device,
         VkDevice device,
-        struct renderer_buffer* staging_buffer)
+        struct renderer_buffer* staging_buffer,
+        struct renderer_memory* memory)
 {
     struct renderer_buffer uniform_buffer;
     uint32_t uniform_buffer_size = sizeof(float) * 16 * 3;
@@ -1994,7 +3021,9 @@ struct renderer_buffer renderer_get_uniform_buffer(
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_UNIFORM
     );
     staging_buffer->size = uniform_buffer_size;
 
@@ -2004,7 +3033,9 @@ struct renderer_buffer renderer_get_uniform_buffer(
         uniform_buffer_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT |
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_UNIFORM
     );
     uniform_buffer.size = uniform_buffer_size;
 
@@ -2017,20 +3048,27 @@ void renderer_update_uniform_buffer(
         VkQueue queue,
         VkCommandPool command_pool,
         VkExtent2D swapchain_extent,
+        struct renderer_camera* camera,
         struct renderer_buffer* uniform_buffer,
-        struct renderer_buffer* staging_buffer)
+        struct renderer_buffer* staging_buffer,
+        struct renderer_gpu_profiler* profiler)
 {
+    TRACE_BEGIN(scope, "renderer_update_uniform_buffer");
+
     mat4x4 viewprojection[2];
     memset(viewprojection, 0, sizeof(viewprojection));
 
-    vec3 eye = {12.0f, 12.0f, 12.0f};
-    vec3 center = {0.0f, 0.0f, 0.0f};
-    vec3 up = {0.0f, 0.0f, 1.0f};
-    mat4x4_look_at(viewprojection[0], eye, center, up);
+    mat4x4_look_at(viewprojection[0], camera->eye, camera->center, camera->up);
 
     float aspect = (float)swapchain_extent.width/swapchain_extent.height;
 
-    mat4x4_perspective(viewprojection[1], 0.78f, aspect, 0.1f, 100.0f);
+    mat4x4_perspective(
+        viewprojection[1],
+        camera->fov,
+        aspect,
+        camera->near,
+        camera->far
+    );
     viewprojection[1][1][1] *= -1;
 
     vkMapMemory(
@@ -2041,12 +3079,11 @@ void renderer_update_uniform_buffer(
         0,
         &uniform_buffer->mapped
     );
-    memset(uniform_buffer->mapped, 0, 3*sizeof(mat4x4));
-    ((float*)uniform_buffer->mapped)[16] = 1.f;
-    ((float*)uniform_buffer->mapped)[21] = 1.f;
-    ((float*)uniform_buffer->mapped)[26] = 1.f;
-    ((float*)uniform_buffer->mapped)[31] = 1.f;
-    memcpy(uniform_buffer->mapped, viewprojection, 2*sizeof(mat4x4));
+    // In the shader's order, projection, view, then an identity model
+    mat4x4* matrices = uniform_buffer->mapped;
+    mat4x4_dup(matrices[0], viewprojection[1]);
+    mat4x4_dup(matrices[1], viewprojection[0]);
+    mat4x4_identity(matrices[2]);
     vkUnmapMemory(device, staging_buffer->memory);
 
     VkCommandBuffer copy_cmd;
@@ -2076,6 +3113,11 @@ void renderer_update_uniform_buffer(
         .size = uniform_buffer->size
     };
 
+    uint32_t gpu_scope = renderer_begin_gpu_scope(
+        profiler,
+        copy_cmd,
+        "uniform_upload"
+    );
     vkCmdCopyBuffer(
         copy_cmd,
         staging_buffer->buffer,
@@ -2083,6 +3125,7 @@ void renderer_update_uniform_buffer(
         1,
         &region
     );
+    renderer_end_gpu_scope(profiler, copy_cmd, gpu_scope);
 
     renderer_submit_command_buffer(
         physical_device,
@@ -2097,19 +3140,25 @@ void renderer_update_uniform_buffer(
         1,
         &copy_cmd
     );
+
+    TRACE_END(scope);
 }
 
 struct renderer_image renderer_get_image(
         VkPhysicalDevice physical_device,
         VkDevice device,
         VkExtent3D extent,
+        uint32_t mip_levels,
         VkFormat format,
         VkImageTiling tiling,
         VkImageUsageFlags usage,
-        VkMemoryPropertyFlags memory_flags)
+        VkMemoryPropertyFlags memory_flags,
+        struct renderer_memory* memory,
+        enum renderer_memory_category category)
 {
     struct renderer_image image;
     memset(&image, 0, sizeof(image));
+    image.mip_levels = mip_levels;
 
     VkImageCreateInfo image_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -2118,7 +3167,7 @@ struct renderer_image renderer_get_image(
         .imageType = VK_IMAGE_TYPE_2D,
         .format = format,
         .extent = {extent.width, extent.height, extent.depth},
-        .mipLevels = 1,
+        .mipLevels = mip_levels,
         .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
         .tiling = tiling,
@@ -2151,43 +3200,343 @@ struct renderer_image renderer_get_image(
 		)
 	};
 
-    result = vkAllocateMemory(device, &alloc_info, NULL, &image.memory);
-    assert(result == VK_SUCCESS);
+    image.memory = renderer_allocate_memory(
+        device,
+        memory,
+        category,
+        &alloc_info
+    );
 
     vkBindImageMemory(device, image.image, image.memory, 0);
 
     return image;
 }
 
-struct renderer_image renderer_load_texture(
-    const char* src,
-    VkPhysicalDevice physical_device,
-    VkDevice device,
-    VkQueue queue,
-    VkCommandPool command_pool)
+uint32_t renderer_get_mip_levels(
+        VkPhysicalDevice physical_device,
+        VkFormat format,
+        uint32_t width,
+        uint32_t height)
 {
-    struct renderer_image tex_image;
-
-    stbi_uc* pixels = NULL;
-    int tex_width, tex_height, tex_channels;
-    pixels = stbi_load(
-        src,
-        &tex_width,
-        &tex_height,
-        &tex_channels,
-        STBI_rgb_alpha
+    // Mips are blitted with linear filtering, without it only the base
+    // level is created
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(
+        physical_device,
+        format,
+        &format_properties
+    );
+    if (!(format_properties.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        return 1;
+    }
+
+    uint32_t mip_levels = 1;
+    uint32_t size = MAX(width, height);
+    while (size > 1) {
+        size /= 2;
+        mip_levels++;
+    }
+
+    return mip_levels;
+}
+
+void renderer_generate_mipmaps(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        VkImage image,
+        uint32_t width,
+        uint32_t height,
+        uint32_t mip_levels)
+{
+    VkCommandBuffer cmd;
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    VkResult result;
+    result = vkAllocateCommandBuffers(device, &cmd_alloc_info, &cmd);
+    assert(result == VK_SUCCESS);
+
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+    result = vkBeginCommandBuffer(cmd, &cmd_begin_info);
+    assert(result == VK_SUCCESS);
+
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = {
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            0,
+            1,
+            0,
+            1
+        }
+    };
+
+    int32_t mip_width = width;
+    int32_t mip_height = height;
+
+    // Each level is blitted from the one above it, which is then done
+    // being written and can move to its sampled layout
+    uint32_t i;
+    for (i=1; i<mip_levels; i++) {
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            NULL,
+            0,
+            NULL,
+            1,
+            &barrier
+        );
+
+        VkImageBlit blit = {
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1},
+            .srcOffsets = {{0, 0, 0}, {mip_width, mip_height, 1}},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1},
+            .dstOffsets = {
+                {0, 0, 0},
+                {MAX(mip_width / 2, 1), MAX(mip_height / 2, 1), 1}
+            }
+        };
+        vkCmdBlitImage(
+            cmd,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &blit,
+            VK_FILTER_LINEAR
+        );
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0,
+            NULL,
+            0,
+            NULL,
+            1,
+            &barrier
+        );
+
+        mip_width = MAX(mip_width / 2, 1);
+        mip_height = MAX(mip_height / 2, 1);
+    }
+
+    // The smallest level is only ever written
+    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &barrier
+    );
+
+    renderer_submit_command_buffer(
+        physical_device,
+        device,
+        queue,
+        &cmd
+    );
+
+    vkFreeCommandBuffers(device, command_pool, 1, &cmd);
+}
+
+VkImageView renderer_get_texture_view(
+        VkDevice device,
+        VkImage image,
+        VkFormat format,
+        uint32_t mip_levels)
+{
+    VkImageView image_view;
+
+    VkImageViewCreateInfo image_view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.components = {
+			.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.a = VK_COMPONENT_SWIZZLE_IDENTITY
+		},
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = mip_levels,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1
+    };
+    VkResult result;
+    result = vkCreateImageView(
+        device,
+        &image_view_info,
+        NULL,
+        &image_view
+    );
+    assert(result == VK_SUCCESS);
+
+    return image_view;
+}
+
+VkSampler renderer_get_texture_sampler(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        uint32_t mip_levels)
+{
+    VkSampler sampler;
+
+    // NO_MIPMAPS samples only the full resolution level, to measure what
+    // the mip chain saves in texel fetches
+    float max_lod = (float)mip_levels;
+    if (getenv("NO_MIPMAPS"))
+        max_lod = 0.0f;
+
+    // Anisotropy was enabled on the device whenever it is supported
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physical_device, &features);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	VkSamplerCreateInfo sampler_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.mipLodBias =0.0f,
+		.anisotropyEnable = features.samplerAnisotropy,
+		.maxAnisotropy = MIN(
+            properties.limits.maxSamplerAnisotropy,
+            RENDERER_MAX_ANISOTROPY
+        ),
+		.compareEnable = VK_FALSE,
+		.compareOp = VK_COMPARE_OP_ALWAYS,
+		.minLod = 0.0f,
+		.maxLod = max_lod,
+		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+		.unnormalizedCoordinates = VK_FALSE
+    };
+    VkResult result;
+    result = vkCreateSampler(
+        device,
+        &sampler_info,
+        NULL,
+        &sampler
+    );
+    assert(result == VK_SUCCESS);
+
+    return sampler;
+}
+
+void renderer_decode_textures(
+        struct job_pool* jobs,
+        struct texture_decode* decodes,
+        uint32_t decode_count)
+{
+    double start = util_time();
+
+    struct job_group group = {0};
+    uint32_t i;
+    for (i=0; i<decode_count; i++) {
+        decodes[i].cache_dir = RENDERER_TEXTURE_CACHE_DIR;
+        jobs_submit(jobs, &group, texture_decode, &decodes[i]);
+    }
+    jobs_wait(jobs, &group);
+
+    uint32_t cache_hits = 0;
+    for (i=0; i<decode_count; i++) {
+        assert(decodes[i].pixels);
+        cache_hits += decodes[i].cache_hit;
+    }
+
+    printf("Decoded %u textures in %.1f ms, %u from cache\n",
+        decode_count,
+        (util_time() - start) * 1000.0,
+        cache_hits
+    );
+}
+
+struct renderer_image renderer_load_texture(
+    const uint8_t* pixels,
+    uint32_t tex_width,
+    uint32_t tex_height,
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    struct renderer_memory* memory)
+{
+    struct renderer_image tex_image;
+
+    uint32_t mip_levels = renderer_get_mip_levels(
+        physical_device,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        tex_width,
+        tex_height
     );
-    assert(pixels && tex_width && tex_height);
 
     VkExtent3D extent = {.width = tex_width, .height = tex_height, .depth = 1};
     tex_image = renderer_get_image(
         physical_device,
         device,
         extent,
+        mip_levels,
         VK_FORMAT_R8G8B8A8_UNORM,
         VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+        VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_TEXTURE
     );
 
     tex_image.width = tex_width;
@@ -2201,7 +3550,9 @@ struct renderer_image renderer_load_texture(
         tex_image.size,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_STAGING
     );
 
     VkResult result;
@@ -2216,7 +3567,6 @@ struct renderer_image renderer_load_texture(
     assert(result == VK_SUCCESS);
     memcpy(tex_image.mapped, pixels, (size_t)tex_image.size);
     vkUnmapMemory(device, staging_buffer.memory);
-    stbi_image_free(pixels);
 
     renderer_change_image_layout(
         physical_device,
@@ -2227,7 +3577,8 @@ struct renderer_image renderer_load_texture(
         VK_IMAGE_LAYOUT_PREINITIALIZED,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VK_ACCESS_HOST_WRITE_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        mip_levels
     );
 
     VkCommandBuffer copy_cmd;
@@ -2282,117 +3633,364 @@ struct renderer_image renderer_load_texture(
         &copy_cmd
     );
 
-    renderer_change_image_layout(
+    // Leaves every level in SHADER_READ_ONLY_OPTIMAL
+    renderer_generate_mipmaps(
         physical_device,
         device,
         queue,
         command_pool,
         tex_image.image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT
+        tex_width,
+        tex_height,
+        mip_levels
     );
 
     vkDestroyBuffer(device, staging_buffer.buffer, NULL);
-    vkFreeMemory(device, staging_buffer.memory, NULL);
+    renderer_free_memory(device, memory, staging_buffer.memory);
 
-    VkImageViewCreateInfo image_view_info = {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.image = tex_image.image,
-		.viewType = VK_IMAGE_VIEW_TYPE_2D,
-		.format = VK_FORMAT_R8G8B8A8_UNORM,
-		.components = {
-			.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.a = VK_COMPONENT_SWIZZLE_IDENTITY
-		},
-		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-		.subresourceRange.baseMipLevel = 0,
-		.subresourceRange.levelCount = 1,
-		.subresourceRange.baseArrayLayer = 0,
-		.subresourceRange.layerCount = 1
-    };
-    result = vkCreateImageView(
+    tex_image.image_view = renderer_get_texture_view(
         device,
-        &image_view_info,
-        NULL,
-        &tex_image.image_view
+        tex_image.image,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        mip_levels
     );
-    assert(result == VK_SUCCESS);
-
-	VkSamplerCreateInfo sampler_info = {
-		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.magFilter = VK_FILTER_LINEAR,
-		.minFilter = VK_FILTER_LINEAR,
-		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-		.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-		.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-		.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-		.mipLodBias =0.0f,
-		.anisotropyEnable = VK_TRUE,
-		.maxAnisotropy = 1.0f,
-		.compareEnable = VK_FALSE,
-		.compareOp = VK_COMPARE_OP_ALWAYS,
-		.minLod = 0.0f,
-		.maxLod = 0.0f,
-		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
-		.unnormalizedCoordinates = VK_FALSE
-    };
-    result = vkCreateSampler(
+    tex_image.sampler = renderer_get_texture_sampler(
+        physical_device,
         device,
-        &sampler_info,
-        NULL,
-        &tex_image.sampler
+        mip_levels
     );
-    assert(result == VK_SUCCESS);
 
     return tex_image;
 }
 
-VkDescriptorPool renderer_get_descriptor_pool(
-        VkDevice device)
+VkFormat renderer_get_texture_format(
+        enum texture_format format)
 {
-    VkDescriptorPool descriptor_pool_handle;
-    descriptor_pool_handle = VK_NULL_HANDLE;
+    switch (format) {
+    case TEXTURE_FORMAT_BC1:
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case TEXTURE_FORMAT_BC3:
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+    case TEXTURE_FORMAT_BC4:
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+    case TEXTURE_FORMAT_BC5:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    default:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
 
-    VkDescriptorPoolSize ubo_pool_size = {
-        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = 1
-    };
+struct renderer_image renderer_begin_compressed_texture_upload(
+        struct texture_file* file,
+        uint32_t first_level,
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        struct renderer_gpu_profiler* profiler,
+        struct renderer_memory* memory,
+        struct renderer_texture_upload* upload)
+{
+    struct renderer_image tex_image;
 
-    VkDescriptorPoolSize sampler_pool_size = {
-        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = 1
-    };
+    struct texture_file_header* header = &file->header;
+    VkFormat format = renderer_get_texture_format(header->format);
 
-    VkDescriptorPoolSize pool_sizes[] = {
-        ubo_pool_size,
-        sampler_pool_size
-    };
+    // Only levels from first_level down are uploaded, the image's base
+    // level is the file's first_level
+    assert(first_level < header->mip_levels);
+    uint32_t mip_levels = header->mip_levels - first_level;
+    uint32_t width = MAX(header->width >> first_level, 1);
+    uint32_t height = MAX(header->height >> first_level, 1);
 
-    VkDescriptorPoolCreateInfo descriptor_pool_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .maxSets = 1,
-        .poolSizeCount = 2,
-        .pPoolSizes = pool_sizes
+    VkExtent3D extent = {
+        .width = width,
+        .height = height,
+        .depth = 1
     };
-
-    VkResult result;
-    result = vkCreateDescriptorPool(
+    tex_image = renderer_get_image(
+        physical_device,
         device,
-        &descriptor_pool_info,
-        NULL,
-        &descriptor_pool_handle
-    );
-    assert(result == VK_SUCCESS);
+        extent,
+        mip_levels,
+        format,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_TEXTURE
+    );
+
+    tex_image.width = width;
+    tex_image.height = height;
+
+    // Every level goes through one staging buffer, each copy region
+    // points at its level's blocks
+    VkBufferImageCopy regions[TEXTURE_MAX_MIP_LEVELS];
+    VkDeviceSize staging_size = 0;
+    uint32_t i;
+    for (i=0; i<mip_levels; i++) {
+        VkBufferImageCopy region = {
+            .bufferOffset = staging_size,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1},
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {
+                MAX(width >> i, 1),
+                MAX(height >> i, 1),
+                1
+            }
+        };
+        regions[i] = region;
+        staging_size += file->levels[first_level + i].size;
+    }
+    tex_image.size = staging_size;
+
+    struct renderer_buffer* staging_buffer = &upload->staging_buffer;
+    *staging_buffer = renderer_get_buffer(
+        physical_device,
+        device,
+        staging_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_STAGING
+    );
+
+    VkResult result;
+    result = vkMapMemory(
+        device,
+        staging_buffer->memory,
+        0,
+        staging_size,
+        0,
+        &tex_image.mapped
+    );
+    assert(result == VK_SUCCESS);
+    for (i=0; i<mip_levels; i++) {
+        memcpy(
+            (uint8_t*)tex_image.mapped + regions[i].bufferOffset,
+            file->data + file->levels[first_level + i].offset,
+            (size_t)file->levels[first_level + i].size
+        );
+    }
+    vkUnmapMemory(device, staging_buffer->memory);
+
+    // Both layout changes and the copy go in one command buffer, which
+    // the fence reports on instead of the queue being waited on
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    result = vkAllocateCommandBuffers(device, &cmd_alloc_info, &upload->cmd);
+    assert(result == VK_SUCCESS);
+
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+    result = vkBeginCommandBuffer(upload->cmd, &cmd_begin_info);
+    assert(result == VK_SUCCESS);
+
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_HOST_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = tex_image.image,
+        .subresourceRange = {
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            0,
+            mip_levels,
+            0,
+            1
+        }
+    };
+    vkCmdPipelineBarrier(
+        upload->cmd,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &barrier
+    );
+
+    uint32_t gpu_scope = renderer_begin_gpu_scope(
+        profiler,
+        upload->cmd,
+        "texture_upload"
+    );
+    vkCmdCopyBufferToImage(
+        upload->cmd,
+        staging_buffer->buffer,
+        tex_image.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        mip_levels,
+        regions
+    );
+    renderer_end_gpu_scope(profiler, upload->cmd, gpu_scope);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(
+        upload->cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &barrier
+    );
+
+    result = vkEndCommandBuffer(upload->cmd);
+    assert(result == VK_SUCCESS);
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &upload->cmd,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+    upload->fence = renderer_get_fence(device, 0);
+    result = vkQueueSubmit(queue, 1, &submit_info, upload->fence);
+    assert(result == VK_SUCCESS);
+
+    tex_image.image_view = renderer_get_texture_view(
+        device,
+        tex_image.image,
+        format,
+        mip_levels
+    );
+    tex_image.sampler = renderer_get_texture_sampler(
+        physical_device,
+        device,
+        mip_levels
+    );
+
+    return tex_image;
+}
+
+bool renderer_texture_upload_done(
+        VkDevice device,
+        struct renderer_texture_upload* upload)
+{
+    return vkGetFenceStatus(device, upload->fence) == VK_SUCCESS;
+}
+
+void renderer_finish_texture_upload(
+        VkDevice device,
+        VkCommandPool command_pool,
+        struct renderer_memory* memory,
+        struct renderer_texture_upload* upload)
+{
+    VkResult result;
+    result = vkWaitForFences(device, 1, &upload->fence, VK_TRUE, UINT64_MAX);
+    assert(result == VK_SUCCESS);
+
+    vkDestroyFence(device, upload->fence, NULL);
+    vkFreeCommandBuffers(device, command_pool, 1, &upload->cmd);
+    vkDestroyBuffer(device, upload->staging_buffer.buffer, NULL);
+    renderer_free_memory(device, memory, upload->staging_buffer.memory);
+}
+
+struct renderer_image renderer_load_compressed_texture(
+        struct texture_file* file,
+        uint32_t first_level,
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        struct renderer_gpu_profiler* profiler,
+        struct renderer_memory* memory)
+{
+    struct renderer_texture_upload upload;
+    struct renderer_image tex_image = renderer_begin_compressed_texture_upload(
+        file,
+        first_level,
+        physical_device,
+        device,
+        queue,
+        command_pool,
+        profiler,
+        memory,
+        &upload
+    );
+    renderer_finish_texture_upload(device, command_pool, memory, &upload);
+
+    return tex_image;
+}
+
+VkDescriptorPool renderer_get_descriptor_pool(
+        VkDevice device,
+        uint32_t image_count)
+{
+    VkDescriptorPool descriptor_pool_handle;
+    descriptor_pool_handle = VK_NULL_HANDLE;
+
+    VkDescriptorPoolSize ubo_pool_size = {
+        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorCount = image_count
+    };
+
+    VkDescriptorPoolSize sampler_pool_size = {
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = image_count
+    };
+
+    // Clusters and draws
+    VkDescriptorPoolSize storage_pool_size = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2 * image_count
+    };
+
+    VkDescriptorPoolSize pool_sizes[] = {
+        ubo_pool_size,
+        sampler_pool_size,
+        storage_pool_size
+    };
+
+    VkDescriptorPoolCreateInfo descriptor_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = 2 * image_count,
+        .poolSizeCount = 3,
+        .pPoolSizes = pool_sizes
+    };
+
+    VkResult result;
+    result = vkCreateDescriptorPool(
+        device,
+        &descriptor_pool_info,
+        NULL,
+        &descriptor_pool_handle
+    );
+    assert(result == VK_SUCCESS);
 
     return descriptor_pool_handle;
 }
@@ -2519,34 +4117,142 @@ VkDescriptorSet renderer_get_descriptor_set(
     return descriptor_set_handle;
 }
 
+VkDescriptorSetLayout renderer_get_cull_descriptor_layout(
+        VkDevice device)
+{
+    VkDescriptorSetLayout descriptor_layout_handle;
+    descriptor_layout_handle = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayoutBinding cluster_layout_binding = {
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = NULL
+    };
+
+    VkDescriptorSetLayoutBinding draw_layout_binding = {
+        .binding = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = NULL
+    };
+
+    VkDescriptorSetLayoutBinding layout_bindings[2] = {
+        cluster_layout_binding,
+        draw_layout_binding
+    };
+
+    VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .bindingCount = 2,
+        .pBindings = layout_bindings
+    };
+
+    VkResult result;
+    result = vkCreateDescriptorSetLayout(
+        device,
+        &descriptor_layout_info,
+        NULL,
+        &descriptor_layout_handle
+    );
+    assert(result == VK_SUCCESS);
+
+    return descriptor_layout_handle;
+}
+
+VkDescriptorSet renderer_get_cull_descriptor_set(
+        VkDevice device,
+        VkDescriptorPool descriptor_pool,
+        VkDescriptorSetLayout descriptor_layout,
+        struct renderer_buffer* cluster_buffer,
+        struct renderer_buffer* indirect_buffer)
+{
+    VkDescriptorSet descriptor_set_handle;
+    descriptor_set_handle = VK_NULL_HANDLE;
+
+    VkDescriptorSetAllocateInfo descriptor_set_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &descriptor_layout
+    };
+
+    VkResult result;
+    result = vkAllocateDescriptorSets(
+        device,
+        &descriptor_set_info,
+        &descriptor_set_handle
+    );
+    assert(result == VK_SUCCESS);
+
+    VkDescriptorBufferInfo buffer_infos[2] = {
+        {
+            .buffer = cluster_buffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        },
+        {
+            .buffer = indirect_buffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        }
+    };
+
+    VkWriteDescriptorSet descriptor_write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = NULL,
+        .dstSet = descriptor_set_handle,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 2,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = NULL,
+        .pBufferInfo = buffer_infos,
+        .pTexelBufferView = NULL
+    };
+
+    vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, NULL);
+
+    return descriptor_set_handle;
+}
+
 VkShaderModule renderer_get_shader_module(
         VkDevice device,
+        struct archive* archive,
+        struct renderer_shader_cache* cache,
         const char* fname)
 {
-    VkShaderModule module;
+    // SPIR-V is handed to the driver straight from the mapping, which is
+    // page or archive aligned and so satisfies pCode's alignment
+    struct archive_data code;
+    bool code_read = archive_read_asset(archive, fname, &code);
+    assert(code_read);
+    assert(code.size > 0 && code.size % 4 == 0);
 
-    FILE* fp = fopen(fname, "r");
-    assert(fp);
+    uint64_t hash = util_hash(code.data, code.size, UTIL_FNV1A_SEED);
 
-    uint32_t code_size;
-    fseek(fp, 0L, SEEK_END);
-    code_size = ftell(fp);
-    rewind(fp);
-
-    char* shader_code_buffer;
-    shader_code_buffer = malloc(code_size);
-    assert(shader_code_buffer);
+    uint32_t i;
+    for (i=0; i<cache->module_count; i++) {
+        if (cache->modules[i].hash == hash) {
+            archive_data_free(&code);
+            cache->hits++;
+            return cache->modules[i].module;
+        }
+    }
 
-    size_t bytes_read;
-    bytes_read = fread(shader_code_buffer, 1, code_size, fp);
-    assert(bytes_read);
+    VkShaderModule module;
 
     VkShaderModuleCreateInfo shader_module_info = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .codeSize = code_size,
-        .pCode = (uint32_t*)(shader_code_buffer)
+        .codeSize = code.size,
+        .pCode = (const uint32_t*)code.data
     };
 
     VkResult result;
@@ -2558,14 +4264,31 @@ VkShaderModule renderer_get_shader_module(
     );
     assert(result == VK_SUCCESS);
 
-    free(shader_code_buffer);
+    archive_data_free(&code);
+
+    assert(cache->module_count < RENDERER_MAX_SHADER_MODULES);
+    cache->modules[cache->module_count].hash = hash;
+    cache->modules[cache->module_count].module = module;
+    cache->module_count++;
 
     return module;
 }
 
+void renderer_destroy_shader_cache(
+        VkDevice device,
+        struct renderer_shader_cache* cache)
+{
+    uint32_t i;
+    for (i=0; i<cache->module_count; i++)
+        vkDestroyShaderModule(device, cache->modules[i].module, NULL);
+
+    cache->module_count = 0;
+}
+
 VkPipelineShaderStageCreateInfo renderer_get_shader_stage(
         VkShaderStageFlagBits stage,
-        VkShaderModule module)
+        VkShaderModule module,
+        const VkSpecializationInfo* specialization_info)
 {
     VkPipelineShaderStageCreateInfo shader_stage_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -2574,7 +4297,7 @@ VkPipelineShaderStageCreateInfo renderer_get_shader_stage(
         .stage = stage,
         .module = module,
         .pName = "main",
-        .pSpecializationInfo = NULL
+        .pSpecializationInfo = specialization_info
     };
 
     shader_stage_info.module = module;
@@ -2704,6 +4427,7 @@ VkPipelineViewportStateCreateInfo renderer_get_viewport_state(
 }
 
 VkPipelineRasterizationStateCreateInfo renderer_get_rasterization_state(
+        VkPolygonMode polygon_mode,
         VkCullModeFlags cull_mode,
         VkFrontFace front_face)
 {
@@ -2713,7 +4437,7 @@ VkPipelineRasterizationStateCreateInfo renderer_get_rasterization_state(
         .flags = 0,
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
+        .polygonMode = polygon_mode,
         .cullMode = cull_mode,
         .frontFace = front_face,
         .depthBiasEnable = VK_FALSE,
@@ -2744,14 +4468,15 @@ VkPipelineMultisampleStateCreateInfo renderer_get_multisample_state(
     return multisample_state;
 }
 
-VkPipelineDepthStencilStateCreateInfo renderer_get_depth_stencil_state()
+VkPipelineDepthStencilStateCreateInfo renderer_get_depth_stencil_state(
+        VkBool32 depth_write)
 {
     VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
         .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
+        .depthWriteEnable = depth_write,
         .depthCompareOp = VK_COMPARE_OP_LESS,
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
@@ -2856,6 +4581,7 @@ VkPipelineLayout renderer_get_pipeline_layout(
 
 VkPipeline renderer_get_graphics_pipeline(
         VkDevice device,
+        VkPipelineCache pipeline_cache,
         VkGraphicsPipelineCreateInfo* create_info)
 {
     VkPipeline graphics_pipeline_handle;
@@ -2864,7 +4590,7 @@ VkPipeline renderer_get_graphics_pipeline(
     VkResult result;
     result = vkCreateGraphicsPipelines(
         device,
-        VK_NULL_HANDLE,
+        pipeline_cache,
         1,
         create_info,
         NULL,
@@ -2875,35 +4601,102 @@ VkPipeline renderer_get_graphics_pipeline(
     return graphics_pipeline_handle;
 }
 
-VkPipeline renderer_get_base_graphics_pipeline(
+VkPipeline renderer_get_compute_pipeline(
         VkDevice device,
+        VkPipelineCache pipeline_cache,
+        VkShaderModule module,
+        VkPipelineLayout pipeline_layout)
+{
+    VkPipeline compute_pipeline_handle;
+    compute_pipeline_handle = VK_NULL_HANDLE;
+
+    VkComputePipelineCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stage = renderer_get_shader_stage(
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            module,
+            NULL
+        ),
+        .layout = pipeline_layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1
+    };
+
+    VkResult result;
+    result = vkCreateComputePipelines(
+        device,
+        pipeline_cache,
+        1,
+        &create_info,
+        NULL,
+        &compute_pipeline_handle
+    );
+    assert(result == VK_SUCCESS);
+
+    return compute_pipeline_handle;
+}
+
+struct renderer_pipeline_state renderer_get_default_pipeline_state()
+{
+    struct renderer_pipeline_state state = {
+        .features = 0,
+        .polygon_mode = VK_POLYGON_MODE_FILL,
+        .cull_mode = VK_CULL_MODE_BACK_BIT,
+        .depth_write = VK_TRUE
+    };
+
+    return state;
+}
+
+VkPipeline renderer_get_variant_graphics_pipeline(
+        VkDevice device,
+        VkShaderModule vert_shader_module,
+        VkShaderModule frag_shader_module,
+        VkPipelineCache pipeline_cache,
         VkExtent2D swapchain_extent,
         VkPipelineLayout pipeline_layout,
         VkRenderPass render_pass,
-        uint32_t subpass)
+        uint32_t subpass,
+        const struct renderer_pipeline_state* state,
+        VkPipeline base_pipeline)
 {
-    VkPipeline base_graphics_pipeline;
+    VkPipeline graphics_pipeline;
+
+    // Every stage sees every feature constant, ids a stage doesn't
+    // declare are ignored
+    VkSpecializationMapEntry specialization_entries[
+        RENDERER_PIPELINE_FEATURE_COUNT
+    ];
+    VkBool32 specialization_data[RENDERER_PIPELINE_FEATURE_COUNT];
+    uint32_t i;
+    for (i=0; i<RENDERER_PIPELINE_FEATURE_COUNT; i++) {
+        specialization_entries[i].constantID = i;
+        specialization_entries[i].offset = i * sizeof(VkBool32);
+        specialization_entries[i].size = sizeof(VkBool32);
+        specialization_data[i] = (state->features >> i) & 1;
+    }
+
+    VkSpecializationInfo specialization_info = {
+        .mapEntryCount = RENDERER_PIPELINE_FEATURE_COUNT,
+        .pMapEntries = specialization_entries,
+        .dataSize = sizeof(specialization_data),
+        .pData = specialization_data
+    };
 
-    VkShaderModule vert_shader_module;
-    vert_shader_module = renderer_get_shader_module(
-        device,
-        "assets/shaders/vert.spv"
-    );
     VkPipelineShaderStageCreateInfo vert_shader_stage;
     vert_shader_stage = renderer_get_shader_stage(
         VK_SHADER_STAGE_VERTEX_BIT,
-        vert_shader_module
+        vert_shader_module,
+        &specialization_info
     );
 
-    VkShaderModule frag_shader_module;
-    frag_shader_module = renderer_get_shader_module(
-        device,
-        "assets/shaders/frag.spv"
-    );
     VkPipelineShaderStageCreateInfo frag_shader_stage;
     frag_shader_stage = renderer_get_shader_stage(
         VK_SHADER_STAGE_FRAGMENT_BIT,
-        frag_shader_module
+        frag_shader_module,
+        &specialization_info
     );
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {
@@ -2956,7 +4749,8 @@ VkPipeline renderer_get_base_graphics_pipeline(
 
     VkPipelineRasterizationStateCreateInfo rasterization_state;
     rasterization_state = renderer_get_rasterization_state(
-        VK_CULL_MODE_BACK_BIT,
+        state->polygon_mode,
+        state->cull_mode,
         VK_FRONT_FACE_COUNTER_CLOCKWISE
     );
 
@@ -2964,7 +4758,7 @@ VkPipeline renderer_get_base_graphics_pipeline(
     multisample_state = renderer_get_multisample_state(VK_SAMPLE_COUNT_1_BIT);
 
     VkPipelineDepthStencilStateCreateInfo depth_stencil_state;
-    depth_stencil_state = renderer_get_depth_stencil_state();
+    depth_stencil_state = renderer_get_depth_stencil_state(state->depth_write);
 
     VkPipelineColorBlendAttachmentState color_blend_attachment;
     color_blend_attachment = renderer_get_color_blend_attachment();
@@ -2973,10 +4767,16 @@ VkPipeline renderer_get_base_graphics_pipeline(
         &color_blend_attachment, 1
     );
 
-    VkGraphicsPipelineCreateInfo base_pipeline_info = {
+    // Variants derive from the base pipeline, which drivers may use to
+    // build them faster
+    VkPipelineCreateFlags flags = base_pipeline == VK_NULL_HANDLE ?
+        VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT :
+        VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = NULL,
-        .flags = 0,
+        .flags = flags,
         .stageCount = shader_stage_count,
         .pStages = shader_stages,
         .pVertexInputState = &vertex_input_state,
@@ -2991,55 +4791,249 @@ VkPipeline renderer_get_base_graphics_pipeline(
         .layout = pipeline_layout,
         .renderPass = render_pass,
         .subpass = subpass,
-        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineHandle = base_pipeline,
         .basePipelineIndex = -1
     };
 
-    base_graphics_pipeline = renderer_get_graphics_pipeline(
+    graphics_pipeline = renderer_get_graphics_pipeline(
         device,
-        &base_pipeline_info
+        pipeline_cache,
+        &pipeline_info
+    );
+
+    return graphics_pipeline;
+}
+
+void renderer_compile_pipeline(void* data)
+{
+    struct renderer_pipeline_compile* compile = data;
+
+    TRACE_BEGIN(scope, "renderer_compile_pipeline");
+    double start = util_time();
+    compile->pipeline = renderer_get_variant_graphics_pipeline(
+        compile->device,
+        compile->vert_shader_module,
+        compile->frag_shader_module,
+        compile->pipeline_cache,
+        compile->swapchain_extent,
+        compile->pipeline_layout,
+        compile->render_pass,
+        compile->subpass,
+        &compile->state,
+        compile->base_pipeline
+    );
+    compile->compile_time = util_time() - start;
+    TRACE_END(scope);
+}
+
+VkPipeline renderer_get_pipeline(
+        struct renderer_resources* resources,
+        const struct renderer_pipeline_state* state,
+        bool wait)
+{
+    struct renderer_pipeline_map* map = &resources->pipelines;
+    uint64_t hash = util_hash(state, sizeof(*state), UTIL_FNV1A_SEED);
+
+    // Linear probing, known permutations are found without recompiling
+    uint32_t slot = hash & (RENDERER_MAX_PIPELINES - 1);
+    struct renderer_pipeline_entry* entry = NULL;
+    while (map->entries[slot].used) {
+        struct renderer_pipeline_entry* candidate = &map->entries[slot];
+        if (candidate->hash == hash &&
+            memcmp(&candidate->compile.state, state, sizeof(*state)) == 0) {
+            entry = candidate;
+            break;
+        }
+        slot = (slot + 1) & (RENDERER_MAX_PIPELINES - 1);
+    }
+
+    if (entry && entry->ready) {
+        map->hits++;
+        return entry->compile.pipeline;
+    }
+
+    // Unknown permutations compile on a worker against the shared
+    // pipeline cache
+    if (!entry) {
+        assert(map->count + 1 < RENDERER_MAX_PIPELINES);
+
+        entry = &map->entries[slot];
+        entry->used = true;
+        entry->ready = false;
+        entry->hash = hash;
+        entry->compile_group.pending = 0;
+        map->count++;
+
+        struct renderer_pipeline_compile* compile = &entry->compile;
+        compile->device = resources->device;
+        compile->vert_shader_module = renderer_get_shader_module(
+            resources->device,
+            resources->archive,
+            &resources->shader_cache,
+            "assets/shaders/vert.spv"
+        );
+        compile->frag_shader_module = renderer_get_shader_module(
+            resources->device,
+            resources->archive,
+            &resources->shader_cache,
+            "assets/shaders/frag.spv"
+        );
+        compile->pipeline_cache = map->cache;
+        compile->swapchain_extent = resources->swapchain_extent;
+        compile->pipeline_layout = resources->base_graphics_pipeline_layout;
+        compile->render_pass = resources->render_pass;
+        compile->subpass = 0;
+        compile->state = *state;
+        compile->base_pipeline = resources->base_graphics_pipeline;
+        compile->pipeline = VK_NULL_HANDLE;
+
+        jobs_submit(
+            resources->jobs,
+            &entry->compile_group,
+            renderer_compile_pipeline,
+            compile
+        );
+    }
+
+    // Without a base pipeline to draw with there is no choice but to wait
+    if (!wait && resources->base_graphics_pipeline == VK_NULL_HANDLE)
+        wait = true;
+
+    if (wait) {
+        double start = util_time();
+        jobs_wait(resources->jobs, &entry->compile_group);
+        map->blocking_compiles++;
+        printf("Pipeline %016llx blocked for %.1f ms\n",
+            (unsigned long long)hash,
+            (util_time() - start) * 1000.0
+        );
+    } else if (!jobs_done(resources->jobs, &entry->compile_group)) {
+        map->fallbacks++;
+        return resources->base_graphics_pipeline;
+    }
+
+    entry->ready = true;
+    printf("Pipeline %016llx compiled in %.1f ms\n",
+        (unsigned long long)hash,
+        entry->compile.compile_time * 1000.0
     );
 
-    vkDestroyShaderModule(device, vert_shader_module, NULL);
-    vkDestroyShaderModule(device, frag_shader_module, NULL);
+    return entry->compile.pipeline;
+}
+
+void renderer_destroy_pipeline_map(
+        VkDevice device,
+        struct job_pool* jobs,
+        struct renderer_pipeline_map* map)
+{
+    uint32_t i;
+    for (i=0; i<RENDERER_MAX_PIPELINES; i++) {
+        struct renderer_pipeline_entry* entry = &map->entries[i];
+        if (!entry->used)
+            continue;
 
-    return base_graphics_pipeline;
+        // Compiles still in flight finish before their pipeline goes
+        jobs_wait(jobs, &entry->compile_group);
+        vkDestroyPipeline(device, entry->compile.pipeline, NULL);
+        entry->used = false;
+    }
+    map->count = 0;
+
+    vkDestroyPipelineCache(device, map->cache, NULL);
+    map->cache = VK_NULL_HANDLE;
 }
 
 void renderer_load_textured_model(
         struct renderer_resources* resources)
 {
-    struct renderer_image tex_image;
-    tex_image = renderer_load_texture(
-        "assets/textures/robot-texture.png",
-        resources->physical_device,
-        resources->device,
-        resources->graphics_queue,
-        resources->command_pool
-    );
+    TRACE_BEGIN(scope, "renderer_load_textured_model");
+
+    // Prefer the cooked texture, which streams its finer levels on demand,
+    // falling back to decoding the whole source image up front
+    struct texture_file texture_file;
+    struct archive_data texture_data;
+    resources->mesh.texture_streamed = resources->texture_compression_bc &&
+        archive_read_asset(
+            resources->archive,
+            "assets/textures/robot-texture.ctex",
+            &texture_data
+        ) &&
+        texture_file_parse(&texture_data, &texture_file);
+
+    if (resources->mesh.texture_streamed) {
+        resources->mesh.streamed_texture = streamer_add_texture(
+            resources->streamer,
+            &texture_file
+        );
+        resources->mesh.texture = streamer_get_image(
+            resources->streamer,
+            resources->mesh.streamed_texture
+        );
+    } else {
+        struct archive_data source;
+        bool source_read = archive_read_asset(
+            resources->archive,
+            "assets/textures/robot-texture.png",
+            &source
+        );
+        assert(source_read);
+
+        struct texture_decode decode = {
+            .path = "assets/textures/robot-texture.png",
+            .source = source.data,
+            .source_size = source.size
+        };
+        renderer_decode_textures(resources->jobs, &decode, 1);
+        archive_data_free(&source);
+
+        struct renderer_image tex_image;
+        tex_image = renderer_load_texture(
+            decode.pixels,
+            decode.width,
+            decode.height,
+            resources->physical_device,
+            resources->device,
+            resources->graphics_queue,
+            resources->command_pool,
+            &resources->memory
+        );
+        texture_decode_free(&decode);
 
-    resources->mesh.texture = malloc(sizeof(tex_image));
-    assert(resources->mesh.texture);
-    memcpy(resources->mesh.texture, &tex_image, sizeof(tex_image));
+        resources->mesh.texture = malloc(sizeof(tex_image));
+        assert(resources->mesh.texture);
+        memcpy(resources->mesh.texture, &tex_image, sizeof(tex_image));
+    }
 
-    resources->mesh.descriptor_set = renderer_get_descriptor_set(
-        resources->device,
-        resources->descriptor_pool,
-        &resources->descriptor_layout,
-        1,
-        &resources->uniform_buffer,
-        &tex_image
+    // Sampled through the TEXTURED specialization, drawn as lines when the
+    // WIREFRAME environment variable is set and the device allows it
+    resources->mesh.pipeline_state = renderer_get_default_pipeline_state();
+    resources->mesh.pipeline_state.features |=
+        RENDERER_PIPELINE_FEATURE_TEXTURED;
+    if (getenv("WIREFRAME") && resources->fill_mode_non_solid) {
+        resources->mesh.pipeline_state.polygon_mode = VK_POLYGON_MODE_LINE;
+        resources->mesh.pipeline_state.cull_mode = VK_CULL_MODE_NONE;
+    }
+
+    struct archive_data model_data;
+    bool model_read = archive_read_asset(
+        resources->archive,
+        "assets/models/robot.dae",
+        &model_data
     );
+    assert(model_read);
 
     const struct aiScene* scene = NULL;
-    scene = aiImportFile(
-        "assets/models/robot.dae",
+    scene = aiImportFileFromMemory(
+        (const char*)model_data.data,
+        model_data.size,
         aiProcess_Triangulate |
         aiProcess_GenSmoothNormals |
         aiProcess_FlipUVs |
-        aiProcess_JoinIdenticalVertices
+        aiProcess_JoinIdenticalVertices,
+        "dae"
     );
     assert(scene);
+    archive_data_free(&model_data);
 
     struct aiMesh* mesh = scene->mMeshes[0];
 
@@ -3047,7 +5041,7 @@ void renderer_load_textured_model(
     vertices = malloc(mesh->mNumVertices * sizeof(*vertices));
     assert(vertices);
 
-    uint32_t i;
+    uint32_t i, j;
     for (i=0; i<mesh->mNumVertices; i++) {
         vertices[i].x = mesh->mVertices[i].x;
         vertices[i].y = mesh->mVertices[i].y;
@@ -3063,16 +5057,101 @@ void renderer_load_textured_model(
         resources->graphics_queue,
         resources->command_pool,
         vertices,
-        resources->mesh.vertex_count
+        resources->mesh.vertex_count,
+        &resources->memory
     );
 
-    uint32_t* indices = malloc(mesh->mNumFaces * 3 * sizeof(*indices));
-    assert(indices);
+    uint32_t* face_indices = malloc(mesh->mNumFaces * 3 * sizeof(uint32_t));
+    assert(face_indices);
 
     for (i=0; i<mesh->mNumFaces * 3; i++) {
-        indices[i] = mesh->mFaces[(int)(i/3.f)].mIndices[i%3];
+        face_indices[i] = mesh->mFaces[(int)(i/3.f)].mIndices[i%3];
+    }
+
+    // All LODs share the vertex buffer and sit back to back in one index
+    // buffer, finest level first
+    struct mesh_lod lods[MESH_MAX_LODS];
+    uint32_t* indices;
+    resources->mesh.lod_count = mesh_build_lods(
+        &vertices[0].x,
+        sizeof(*vertices),
+        resources->mesh.vertex_count,
+        face_indices,
+        mesh->mNumFaces * 3,
+        lods,
+        MESH_MAX_LODS,
+        &indices,
+        &resources->mesh.index_count
+    );
+    free(face_indices);
+
+    mesh_get_bounds(
+        &vertices[0].x,
+        sizeof(*vertices),
+        resources->mesh.vertex_count,
+        resources->mesh.bounds
+    );
+
+    resources->mesh.lods = malloc(
+        resources->mesh.lod_count * sizeof(*resources->mesh.lods)
+    );
+    assert(resources->mesh.lods);
+    for (i=0; i<resources->mesh.lod_count; i++) {
+        resources->mesh.lods[i].first_index = lods[i].first_index;
+        resources->mesh.lods[i].index_count = lods[i].index_count;
+        resources->mesh.lods[i].error = lods[i].error;
+    }
+
+    // Split every LOD into meshlets, reordering its triangles so each
+    // meshlet is a contiguous run of indices
+    struct mesh_meshlet* meshlets = NULL;
+    uint32_t meshlet_count = 0;
+    uint32_t lod_meshlet_counts[MESH_MAX_LODS];
+    for (i=0; i<resources->mesh.lod_count; i++) {
+        struct mesh_meshlet* lod_meshlets;
+        lod_meshlet_counts[i] = mesh_build_meshlets(
+            &vertices[0].x,
+            sizeof(*vertices),
+            resources->mesh.vertex_count,
+            &indices[lods[i].first_index],
+            lods[i].index_count,
+            &lod_meshlets
+        );
+
+        meshlets = realloc(
+            meshlets,
+            (meshlet_count + lod_meshlet_counts[i]) * sizeof(*meshlets)
+        );
+        assert(meshlets);
+        for (j=0; j<lod_meshlet_counts[i]; j++) {
+            meshlets[meshlet_count + j] = lod_meshlets[j];
+            meshlets[meshlet_count + j].first_index += lods[i].first_index;
+        }
+        meshlet_count += lod_meshlet_counts[i];
+        free(lod_meshlets);
     }
-    resources->mesh.index_count = i;
+
+    resources->mesh.index_type = renderer_get_index_type(
+        indices,
+        resources->mesh.vertex_count,
+        resources->mesh.lods,
+        resources->mesh.lod_count,
+        &resources->mesh.index_ranges,
+        &resources->mesh.index_range_count
+    );
+
+    renderer_create_clusters(&resources->mesh, meshlets, lod_meshlet_counts);
+    free(meshlets);
+
+    resources->mesh.cluster_buffer = renderer_get_cluster_buffer(
+        resources->physical_device,
+        resources->device,
+        resources->graphics_queue,
+        resources->command_pool,
+        resources->mesh.clusters,
+        resources->mesh.cluster_count,
+        &resources->memory
+    );
 
     resources->mesh.ibo = renderer_get_index_buffer(
         resources->physical_device,
@@ -3080,151 +5159,1140 @@ void renderer_load_textured_model(
         resources->graphics_queue,
         resources->command_pool,
         indices,
-        resources->mesh.index_count
+        resources->mesh.index_count,
+        resources->mesh.index_type,
+        &resources->memory
     );
 
     aiReleaseImport(scene);
 
     free(vertices);
     free(indices);
+
+    TRACE_END(scope);
 }
 
-void renderer_record_draw_commands(
-        VkPipeline pipeline,
-        VkPipelineLayout pipeline_layout,
-        VkRenderPass render_pass,
-        VkExtent2D swapchain_extent,
-        VkFramebuffer* framebuffers,
-        struct swapchain_buffer* swapchain_buffers,
-        uint32_t swapchain_image_count,
-        struct renderer_mesh* mesh)
+uint32_t renderer_select_lod(
+        struct renderer_mesh* mesh,
+        struct renderer_camera* camera,
+        VkExtent2D swapchain_extent)
 {
-    VkCommandBufferBeginInfo cmd_begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = NULL,
-        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-        .pInheritanceInfo = NULL
-    };
+    float dx = mesh->bounds[0] - camera->eye[0];
+    float dy = mesh->bounds[1] - camera->eye[1];
+    float dz = mesh->bounds[2] - camera->eye[2];
+    float distance = sqrtf(dx*dx + dy*dy + dz*dz) - mesh->bounds[3];
 
-    VkClearValue clear_values[2];
-    clear_values[0].color.float32[0] = 0.0f;
-    clear_values[0].color.float32[1] = 0.0f;
-    clear_values[0].color.float32[2] = 0.0f;
-    clear_values[0].color.float32[3] = 1.0f;
-    clear_values[1].depthStencil.depth = 1.0f;
-    clear_values[1].depthStencil.stencil = 0;
+    if (distance <= camera->near)
+        return 0;
 
-    VkRenderPassBeginInfo render_pass_info = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .pNext = NULL,
-        .renderPass = render_pass,
-        .renderArea.offset = {0,0},
-        .renderArea.extent = {swapchain_extent.width, swapchain_extent.height},
-        .clearValueCount = 2,
-        .pClearValues = clear_values,
-    };
+    // Pixels covered by one object space unit at unit distance
+    float projection_scale =
+        swapchain_extent.height / (2.0f * tanf(camera->fov * 0.5f));
 
+    // Coarsest level whose error still projects below the threshold
+    uint32_t lod = 0;
     uint32_t i;
-    for (i=0; i<swapchain_image_count; i++) {
-        VkResult result;
-        result = vkBeginCommandBuffer(
-            swapchain_buffers[i].cmd,
-            &cmd_begin_info
-        );
-        assert(result == VK_SUCCESS);
+    for (i=1; i<mesh->lod_count; i++)
+    {
+        float error_pixels = mesh->lods[i].error * projection_scale / distance;
+        if (error_pixels > RENDERER_LOD_ERROR_PIXELS)
+            break;
 
-        render_pass_info.framebuffer = framebuffers[i];
-        vkCmdBeginRenderPass(
-            swapchain_buffers[i].cmd,
-            &render_pass_info,
-            VK_SUBPASS_CONTENTS_INLINE
-        );
+        lod = i;
+    }
 
-        VkViewport viewport = {
-            .x = 0,
-            .y = 0,
-            .width = swapchain_extent.width,
-            .height = swapchain_extent.height,
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
-        };
-        vkCmdSetViewport(swapchain_buffers[i].cmd, 0, 1, &viewport);
+    return lod;
+}
 
-        VkRect2D scissor = {
-            .offset = {0,0},
-            .extent = {swapchain_extent.width, swapchain_extent.height}
-        };
-        vkCmdSetScissor(swapchain_buffers[i].cmd, 0, 1, &scissor);
+uint32_t renderer_get_texture_level(
+        struct renderer_mesh* mesh,
+        struct renderer_camera* camera,
+        VkExtent2D swapchain_extent,
+        uint32_t texture_size)
+{
+    float dx = mesh->bounds[0] - camera->eye[0];
+    float dy = mesh->bounds[1] - camera->eye[1];
+    float dz = mesh->bounds[2] - camera->eye[2];
+    float distance = sqrtf(dx*dx + dy*dy + dz*dz) - mesh->bounds[3];
+
+    if (distance <= camera->near)
+        return 0;
+
+    // Screen height of the bounding sphere's diameter in pixels, assuming
+    // the texture is mapped across the mesh once
+    float projection_scale =
+        swapchain_extent.height / (2.0f * tanf(camera->fov * 0.5f));
+    float footprint = 2.0f * mesh->bounds[3] * projection_scale / distance;
+
+    // Level at which one texel covers about one pixel
+    float texels_per_pixel = texture_size / MAX(footprint, 1.0f);
+    if (texels_per_pixel <= 1.0f)
+        return 0;
+
+    return (uint32_t)floorf(log2f(texels_per_pixel));
+}
 
-        vkCmdBindPipeline(
-            swapchain_buffers[i].cmd,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipeline
-        );
+void renderer_create_clusters(
+        struct renderer_mesh* mesh,
+        struct mesh_meshlet* meshlets,
+        uint32_t* lod_meshlet_counts)
+{
+    uint32_t meshlet_count = 0;
+    uint32_t l, i, j;
+    for (l=0; l<mesh->lod_count; l++)
+        meshlet_count += lod_meshlet_counts[l];
+
+    // A meshlet straddling an index range boundary is split in two, each
+    // boundary can split at most one meshlet
+    mesh->clusters = malloc(
+        (meshlet_count + mesh->index_range_count) * sizeof(*mesh->clusters)
+    );
+    assert(mesh->clusters);
+    mesh->cluster_count = 0;
+
+    struct mesh_meshlet* meshlet = meshlets;
+    for (l=0; l<mesh->lod_count; l++) {
+        struct renderer_mesh_lod* lod = &mesh->lods[l];
+        lod->first_cluster = mesh->cluster_count;
+
+        for (i=0; i<lod_meshlet_counts[l]; i++, meshlet++) {
+            uint32_t meshlet_end = meshlet->first_index + meshlet->index_count;
+
+            for (j=0; j<lod->range_count; j++) {
+                struct renderer_index_range* range;
+                range = &mesh->index_ranges[lod->first_range + j];
+
+                uint32_t first = MAX(meshlet->first_index, range->first_index);
+                uint32_t end = MIN(
+                    meshlet_end,
+                    range->first_index + range->index_count
+                );
+                if (first >= end)
+                    continue;
+
+                struct renderer_cluster* cluster;
+                cluster = &mesh->clusters[mesh->cluster_count++];
+                cluster->first_index = first;
+                cluster->index_count = end - first;
+                cluster->vertex_offset = range->vertex_offset;
+                memcpy(cluster->center, meshlet->center, sizeof(cluster->center));
+                cluster->radius = meshlet->radius;
+                memcpy(
+                    cluster->cone_axis,
+                    meshlet->cone_axis,
+                    sizeof(cluster->cone_axis)
+                );
+                cluster->cone_cutoff = meshlet->cone_cutoff;
+            }
+        }
 
-        VkDeviceSize offsets[] = {0};
+        lod->cluster_count = mesh->cluster_count - lod->first_cluster;
+    }
 
-        vkCmdBindVertexBuffers(
-            swapchain_buffers[i].cmd,
-            0,
-            1,
-            &mesh->vbo.buffer,
-            offsets
-        );
+    mesh->clusters = realloc(
+        mesh->clusters,
+        mesh->cluster_count * sizeof(*mesh->clusters)
+    );
+}
 
-        vkCmdBindIndexBuffer(
-            swapchain_buffers[i].cmd,
-            mesh->ibo.buffer,
-            0,
-            VK_INDEX_TYPE_UINT32
-        );
+// Read by the cull pass only, so it is uploaded once with the mesh
+struct renderer_buffer renderer_get_cluster_buffer(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        struct renderer_cluster* clusters,
+        uint32_t cluster_count,
+        struct renderer_memory* memory)
+{
+    struct renderer_buffer cluster_buffer;
+    struct renderer_buffer staging_buffer;
 
-        vkCmdBindDescriptorSets(
-            swapchain_buffers[i].cmd,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipeline_layout,
-            0,
-            1,
-            &mesh->descriptor_set,
-            0,
-            NULL
-        );
+    VkDeviceSize mem_size = sizeof(*clusters) * MAX(cluster_count, 1);
 
-        vkCmdDrawIndexed(
-            swapchain_buffers[i].cmd,
-            mesh->index_count,
-            1,
-            0,
-            0,
-            0
-        );
+    staging_buffer = renderer_get_buffer(
+        physical_device,
+        device,
+        mem_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_STAGING
+    );
 
-        vkCmdEndRenderPass(swapchain_buffers[i].cmd);
+    void* mapped;
+    vkMapMemory(device, staging_buffer.memory, 0, mem_size, 0, &mapped);
+    memcpy(mapped, clusters, sizeof(*clusters) * cluster_count);
+    vkUnmapMemory(device, staging_buffer.memory);
 
-        result = vkEndCommandBuffer(swapchain_buffers[i].cmd);
-        assert(result == VK_SUCCESS);
-    }
-}
+    cluster_buffer = renderer_get_buffer(
+        physical_device,
+        device,
+        mem_size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_MESH
+    );
+    cluster_buffer.size = mem_size;
+    cluster_buffer.mapped = NULL;
 
-VkSemaphore renderer_get_semaphore(
-        VkDevice device)
-{
-    VkSemaphore semaphore_handle;
+    VkCommandBuffer copy_cmd;
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkResult result;
+    result = vkAllocateCommandBuffers(device, &cmd_alloc_info, &copy_cmd);
+    assert(result == VK_SUCCESS);
 
-    VkSemaphoreCreateInfo semaphore_info = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = NULL,
-        .flags = 0
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+    result = vkBeginCommandBuffer(copy_cmd, &cmd_begin_info);
+    assert(result == VK_SUCCESS);
+
+    VkBufferCopy region = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = mem_size
     };
 
-    VkResult result;
-    result = vkCreateSemaphore(
+    vkCmdCopyBuffer(
+        copy_cmd,
+        staging_buffer.buffer,
+        cluster_buffer.buffer,
+        1,
+        &region
+    );
+
+    renderer_submit_command_buffer(
+        physical_device,
         device,
-        &semaphore_info,
-        NULL,
-        &semaphore_handle
+        queue,
+        &copy_cmd
     );
-    assert(result == VK_SUCCESS);
 
-    return semaphore_handle;
+    vkFreeCommandBuffers(
+        device,
+        command_pool,
+        1,
+        &copy_cmd
+    );
+
+    vkDestroyBuffer(device, staging_buffer.buffer, NULL);
+    renderer_free_memory(device, memory, staging_buffer.memory);
+
+    return cluster_buffer;
+}
+
+struct renderer_buffer renderer_get_indirect_buffer(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        uint32_t draw_count,
+        struct renderer_memory* memory)
+{
+    VkDeviceSize indirect_buffer_size;
+    indirect_buffer_size = MAX(draw_count, 1) *
+        sizeof(VkDrawIndexedIndirectCommand);
+
+    struct renderer_buffer indirect_buffer;
+    indirect_buffer = renderer_get_buffer(
+        physical_device,
+        device,
+        indirect_buffer_size,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memory,
+        RENDERER_MEMORY_INDIRECT
+    );
+    indirect_buffer.size = indirect_buffer_size;
+
+    // Stays mapped, so the draws the cull pass kept can be counted once
+    // the image's fence signals
+    VkResult result;
+    result = vkMapMemory(
+        device,
+        indirect_buffer.memory,
+        0,
+        indirect_buffer.size,
+        0,
+        &indirect_buffer.mapped
+    );
+    assert(result == VK_SUCCESS);
+
+    return indirect_buffer;
+}
+
+void renderer_get_cull_constants(
+        struct renderer_mesh* mesh,
+        uint32_t lod,
+        struct renderer_camera* camera,
+        VkExtent2D swapchain_extent,
+        struct renderer_cull_constants* constants)
+{
+    mat4x4 view, projection, view_projection;
+    mat4x4_look_at(view, camera->eye, camera->center, camera->up);
+
+    float aspect = (float)swapchain_extent.width/swapchain_extent.height;
+    mat4x4_perspective(
+        projection,
+        camera->fov,
+        aspect,
+        camera->near,
+        camera->far
+    );
+    mat4x4_mul(view_projection, projection, view);
+
+    // Left, right, bottom, top, near and far planes as row 3 +/- row n of
+    // the column major view projection, normalized so distances are in
+    // world units
+    float (*planes)[4] = constants->planes;
+    uint32_t i, j;
+    for (i=0; i<6; i++) {
+        float sign = (i % 2) ? -1.0f : 1.0f;
+        for (j=0; j<4; j++)
+            planes[i][j] = view_projection[j][3] + sign * view_projection[j][i/2];
+
+        float length = sqrtf(
+            planes[i][0]*planes[i][0] +
+            planes[i][1]*planes[i][1] +
+            planes[i][2]*planes[i][2]
+        );
+        for (j=0; j<4; j++)
+            planes[i][j] /= length;
+    }
+
+    memcpy(constants->eye, camera->eye, sizeof(camera->eye));
+    constants->eye[3] = 1.0f;
+    constants->first_cluster = mesh->lods[lod].first_cluster;
+    constants->cluster_count = mesh->lods[lod].cluster_count;
+}
+
+uint32_t renderer_count_drawn_clusters(
+        VkDrawIndexedIndirectCommand* draw_commands,
+        uint32_t draw_count,
+        uint32_t* triangle_count)
+{
+    uint32_t drawn = 0;
+    *triangle_count = 0;
+
+    uint32_t i;
+    for (i=0; i<draw_count; i++) {
+        if (draw_commands[i].instanceCount == 0)
+            continue;
+
+        drawn++;
+        *triangle_count += draw_commands[i].indexCount / 3;
+    }
+
+    return drawn;
+}
+
+void renderer_record_draw_commands(
+        VkPipeline pipeline,
+        VkPipelineLayout pipeline_layout,
+        VkRenderPass render_pass,
+        VkExtent2D swapchain_extent,
+        VkFramebuffer framebuffer,
+        VkCommandBuffer cmd,
+        struct renderer_mesh* mesh,
+        VkDescriptorSet descriptor_set,
+        VkBuffer indirect_buffer,
+        VkPipeline cull_pipeline,
+        VkPipelineLayout cull_pipeline_layout,
+        VkDescriptorSet cull_descriptor_set,
+        struct renderer_cull_constants* cull_constants,
+        bool multi_draw_indirect,
+        struct world* world,
+        struct renderer_gpu_profiler* profiler)
+{
+    VkCommandBufferBeginInfo cmd_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+
+    VkClearValue clear_values[2];
+    clear_values[0].color.float32[0] = 0.0f;
+    clear_values[0].color.float32[1] = 0.0f;
+    clear_values[0].color.float32[2] = 0.0f;
+    clear_values[0].color.float32[3] = 1.0f;
+    clear_values[1].depthStencil.depth = 1.0f;
+    clear_values[1].depthStencil.stencil = 0;
+
+    VkRenderPassBeginInfo render_pass_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .pNext = NULL,
+        .renderPass = render_pass,
+        .framebuffer = framebuffer,
+        .renderArea.offset = {0,0},
+        .renderArea.extent = {swapchain_extent.width, swapchain_extent.height},
+        .clearValueCount = 2,
+        .pClearValues = clear_values,
+    };
+
+    VkResult result;
+    result = vkBeginCommandBuffer(cmd, &cmd_begin_info);
+    assert(result == VK_SUCCESS);
+
+    // Every cluster of the LOD gets a draw, culled ones have no instances
+    uint32_t draw_count = cull_constants->cluster_count;
+    uint32_t cull_scope = renderer_begin_gpu_scope(profiler, cmd, "cull");
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        cull_pipeline_layout,
+        0,
+        1,
+        &cull_descriptor_set,
+        0,
+        NULL
+    );
+    vkCmdPushConstants(
+        cmd,
+        cull_pipeline_layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(*cull_constants),
+        cull_constants
+    );
+    vkCmdDispatch(
+        cmd,
+        (draw_count + RENDERER_CULL_GROUP_SIZE - 1) / RENDERER_CULL_GROUP_SIZE,
+        1,
+        1
+    );
+
+    VkMemoryBarrier cull_barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+    };
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0,
+        1,
+        &cull_barrier,
+        0,
+        NULL,
+        0,
+        NULL
+    );
+
+    renderer_end_gpu_scope(profiler, cmd, cull_scope);
+
+    uint32_t gpu_scope = renderer_begin_gpu_scope(profiler, cmd, "render_pass");
+    uint32_t statistics = renderer_begin_gpu_statistics(
+        profiler,
+        cmd,
+        "render_pass"
+    );
+
+    vkCmdBeginRenderPass(
+        cmd,
+        &render_pass_info,
+        VK_SUBPASS_CONTENTS_INLINE
+    );
+
+    VkViewport viewport = {
+        .x = 0,
+        .y = 0,
+        .width = swapchain_extent.width,
+        .height = swapchain_extent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor = {
+        .offset = {0,0},
+        .extent = {swapchain_extent.width, swapchain_extent.height}
+    };
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindPipeline(
+        cmd,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline
+    );
+
+    VkDeviceSize offsets[] = {0};
+
+    vkCmdBindVertexBuffers(
+        cmd,
+        0,
+        1,
+        &mesh->vbo.buffer,
+        offsets
+    );
+
+    vkCmdBindIndexBuffer(
+        cmd,
+        mesh->ibo.buffer,
+        0,
+        mesh->index_type
+    );
+
+    vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_layout,
+        0,
+        1,
+        &descriptor_set,
+        0,
+        NULL
+    );
+
+    if (multi_draw_indirect && draw_count > 0) {
+        vkCmdDrawIndexedIndirect(
+            cmd,
+            indirect_buffer,
+            0,
+            draw_count,
+            sizeof(VkDrawIndexedIndirectCommand)
+        );
+    } else {
+        uint32_t i;
+        for (i=0; i<draw_count; i++) {
+            vkCmdDrawIndexedIndirect(
+                cmd,
+                indirect_buffer,
+                i * sizeof(VkDrawIndexedIndirectCommand),
+                1,
+                sizeof(VkDrawIndexedIndirectCommand)
+            );
+        }
+    }
+
+    // Chunks are in world space, which the model matrix leaves alone
+    if (world)
+        world_record_draws(world, cmd);
+
+    vkCmdEndRenderPass(cmd);
+
+    renderer_end_gpu_statistics(profiler, cmd, statistics);
+    renderer_end_gpu_scope(profiler, cmd, gpu_scope);
+
+    result = vkEndCommandBuffer(cmd);
+    assert(result == VK_SUCCESS);
+}
+
+VkSemaphore renderer_get_semaphore(
+        VkDevice device)
+{
+    VkSemaphore semaphore_handle;
+
+    VkSemaphoreCreateInfo semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+
+    VkResult result;
+    result = vkCreateSemaphore(
+        device,
+        &semaphore_info,
+        NULL,
+        &semaphore_handle
+    );
+    assert(result == VK_SUCCESS);
+
+    return semaphore_handle;
+}
+
+VkFence renderer_get_fence(
+        VkDevice device,
+        VkFenceCreateFlags flags)
+{
+    VkFence fence_handle;
+
+    VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = flags
+    };
+
+    VkResult result;
+    result = vkCreateFence(
+        device,
+        &fence_info,
+        NULL,
+        &fence_handle
+    );
+    assert(result == VK_SUCCESS);
+
+    return fence_handle;
+}
+
+void renderer_create_gpu_profiler(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        bool pipeline_statistics,
+        struct renderer_gpu_profiler* profiler)
+{
+    memset(profiler, 0, sizeof(*profiler));
+
+    // Devices guaranteeing timestamps on every graphics and compute queue
+    // are all that's supported, rather than checking the queue family
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if (!properties.limits.timestampComputeAndGraphics)
+        return;
+
+    profiler->timestamp_period = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo query_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = RENDERER_GPU_PROFILER_FRAMES *
+            RENDERER_MAX_GPU_SCOPE_WRITES * 2,
+        .pipelineStatistics = 0
+    };
+
+    VkResult result;
+    result = vkCreateQueryPool(
+        device,
+        &query_pool_info,
+        NULL,
+        &profiler->query_pool
+    );
+    assert(result == VK_SUCCESS);
+
+    if (!pipeline_statistics)
+        return;
+
+    VkQueryPoolCreateInfo statistics_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = RENDERER_GPU_PROFILER_FRAMES *
+            RENDERER_MAX_GPU_STATISTICS_WRITES,
+        .pipelineStatistics = RENDERER_GPU_STATISTIC_FLAGS
+    };
+
+    result = vkCreateQueryPool(
+        device,
+        &statistics_pool_info,
+        NULL,
+        &profiler->statistics_pool
+    );
+    assert(result == VK_SUCCESS);
+}
+
+void renderer_destroy_gpu_profiler(
+        VkDevice device,
+        struct renderer_gpu_profiler* profiler)
+{
+    if (profiler->query_pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, profiler->query_pool, NULL);
+    if (profiler->statistics_pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, profiler->statistics_pool, NULL);
+    profiler->query_pool = VK_NULL_HANDLE;
+    profiler->statistics_pool = VK_NULL_HANDLE;
+}
+
+void renderer_begin_gpu_frame(
+        VkDevice device,
+        struct renderer_gpu_profiler* profiler)
+{
+    profiler->resolved = false;
+    profiler->frame++;
+
+    uint32_t slot = profiler->frame % RENDERER_GPU_PROFILER_FRAMES;
+    struct renderer_gpu_profiler_frame* frame = &profiler->frames[slot];
+    if (frame->write_count == 0 && frame->statistics_write_count == 0)
+        return;
+
+    // No VK_QUERY_RESULT_WAIT_BIT, a frame still in flight is dropped
+    // rather than stalling the CPU
+    uint64_t timestamps[RENDERER_MAX_GPU_SCOPE_WRITES * 2];
+    VkResult result = VK_SUCCESS;
+    if (frame->write_count > 0) {
+        result = vkGetQueryPoolResults(
+            device,
+            profiler->query_pool,
+            slot * RENDERER_MAX_GPU_SCOPE_WRITES * 2,
+            frame->write_count * 2,
+            sizeof(timestamps),
+            timestamps,
+            sizeof(timestamps[0]),
+            VK_QUERY_RESULT_64_BIT
+        );
+    }
+
+    uint64_t statistics[RENDERER_MAX_GPU_STATISTICS_WRITES]
+        [RENDERER_GPU_STATISTIC_COUNT];
+    if (result == VK_SUCCESS && frame->statistics_write_count > 0) {
+        result = vkGetQueryPoolResults(
+            device,
+            profiler->statistics_pool,
+            slot * RENDERER_MAX_GPU_STATISTICS_WRITES,
+            frame->statistics_write_count,
+            sizeof(statistics),
+            statistics,
+            sizeof(statistics[0]),
+            VK_QUERY_RESULT_64_BIT
+        );
+    }
+
+    uint32_t i, j;
+    if (result == VK_SUCCESS) {
+        for (i=0; i<profiler->scope_count; i++) {
+            profiler->scopes[i].time = 0.0;
+            memset(
+                profiler->scopes[i].statistics,
+                0,
+                sizeof(profiler->scopes[i].statistics)
+            );
+        }
+
+        profiler->frame_time = 0.0;
+        for (i=0; i<frame->write_count; i++) {
+            uint64_t start = timestamps[i * 2];
+            uint64_t end = timestamps[i * 2 + 1];
+            double time = end > start ?
+                (end - start) * (double)profiler->timestamp_period / 1e6 :
+                0.0;
+
+            struct renderer_gpu_scope* scope;
+            scope = &profiler->scopes[frame->scopes[i]];
+            scope->time += time;
+            scope->total_time += time;
+            profiler->frame_time += time;
+        }
+
+        for (i=0; i<frame->statistics_write_count; i++) {
+            struct renderer_gpu_scope* scope;
+            scope = &profiler->scopes[frame->statistics_scopes[i]];
+            for (j=0; j<RENDERER_GPU_STATISTIC_COUNT; j++) {
+                scope->statistics[j] += statistics[i][j];
+                scope->total_statistics[j] += statistics[i][j];
+            }
+        }
+
+        profiler->resolved = true;
+        profiler->resolved_frames++;
+    } else {
+        profiler->dropped_frames++;
+    }
+
+    frame->write_count = 0;
+    frame->statistics_write_count = 0;
+}
+
+uint32_t renderer_find_gpu_scope(
+        struct renderer_gpu_profiler* profiler,
+        const char* name)
+{
+    uint32_t scope;
+    for (scope=0; scope<profiler->scope_count; scope++) {
+        if (strcmp(profiler->scopes[scope].name, name) == 0)
+            return scope;
+    }
+
+    if (profiler->scope_count == RENDERER_MAX_GPU_SCOPES)
+        return UINT32_MAX;
+
+    memset(&profiler->scopes[scope], 0, sizeof(profiler->scopes[scope]));
+    profiler->scopes[scope].name = name;
+    profiler->scope_count++;
+
+    return scope;
+}
+
+uint32_t renderer_begin_gpu_scope(
+        struct renderer_gpu_profiler* profiler,
+        VkCommandBuffer cmd,
+        const char* name)
+{
+    if (!profiler || profiler->query_pool == VK_NULL_HANDLE)
+        return UINT32_MAX;
+
+    uint32_t slot = profiler->frame % RENDERER_GPU_PROFILER_FRAMES;
+    struct renderer_gpu_profiler_frame* frame = &profiler->frames[slot];
+    if (frame->write_count == RENDERER_MAX_GPU_SCOPE_WRITES)
+        return UINT32_MAX;
+
+    uint32_t scope = renderer_find_gpu_scope(profiler, name);
+    if (scope == UINT32_MAX)
+        return UINT32_MAX;
+
+    uint32_t write = slot * RENDERER_MAX_GPU_SCOPE_WRITES + frame->write_count;
+    frame->scopes[frame->write_count++] = scope;
+
+    vkCmdResetQueryPool(cmd, profiler->query_pool, write * 2, 2);
+    vkCmdWriteTimestamp(
+        cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        profiler->query_pool,
+        write * 2
+    );
+
+    return write;
+}
+
+void renderer_end_gpu_scope(
+        struct renderer_gpu_profiler* profiler,
+        VkCommandBuffer cmd,
+        uint32_t write)
+{
+    if (write == UINT32_MAX)
+        return;
+
+    vkCmdWriteTimestamp(
+        cmd,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        profiler->query_pool,
+        write * 2 + 1
+    );
+}
+
+uint32_t renderer_begin_gpu_statistics(
+        struct renderer_gpu_profiler* profiler,
+        VkCommandBuffer cmd,
+        const char* name)
+{
+    if (!profiler || profiler->statistics_pool == VK_NULL_HANDLE)
+        return UINT32_MAX;
+
+    uint32_t slot = profiler->frame % RENDERER_GPU_PROFILER_FRAMES;
+    struct renderer_gpu_profiler_frame* frame = &profiler->frames[slot];
+    if (frame->statistics_write_count == RENDERER_MAX_GPU_STATISTICS_WRITES)
+        return UINT32_MAX;
+
+    uint32_t scope = renderer_find_gpu_scope(profiler, name);
+    if (scope == UINT32_MAX)
+        return UINT32_MAX;
+    profiler->scopes[scope].has_statistics = true;
+
+    uint32_t write = slot * RENDERER_MAX_GPU_STATISTICS_WRITES +
+        frame->statistics_write_count;
+    frame->statistics_scopes[frame->statistics_write_count++] = scope;
+
+    vkCmdResetQueryPool(cmd, profiler->statistics_pool, write, 1);
+    vkCmdBeginQuery(cmd, profiler->statistics_pool, write, 0);
+
+    return write;
+}
+
+void renderer_end_gpu_statistics(
+        struct renderer_gpu_profiler* profiler,
+        VkCommandBuffer cmd,
+        uint32_t write)
+{
+    if (write == UINT32_MAX)
+        return;
+
+    vkCmdEndQuery(cmd, profiler->statistics_pool, write);
+}
+
+const char* renderer_get_gpu_statistic_name(
+        enum renderer_gpu_statistic statistic)
+{
+    switch (statistic) {
+        case RENDERER_GPU_STATISTIC_INPUT_VERTICES:
+            return "input_vertices";
+        case RENDERER_GPU_STATISTIC_INPUT_PRIMITIVES:
+            return "input_primitives";
+        case RENDERER_GPU_STATISTIC_VERTEX_INVOCATIONS:
+            return "vertex_invocations";
+        case RENDERER_GPU_STATISTIC_CLIPPING_INVOCATIONS:
+            return "clipping_invocations";
+        case RENDERER_GPU_STATISTIC_CLIPPING_PRIMITIVES:
+            return "clipping_primitives";
+        case RENDERER_GPU_STATISTIC_FRAGMENT_INVOCATIONS:
+            return "fragment_invocations";
+        default:
+            return "unknown";
+    }
+}
+
+double renderer_get_gpu_scope_time(
+        struct renderer_gpu_profiler* profiler,
+        const char* name)
+{
+    if (profiler->query_pool == VK_NULL_HANDLE)
+        return -1.0;
+
+    uint32_t i;
+    for (i=0; i<profiler->scope_count; i++) {
+        if (strcmp(profiler->scopes[i].name, name) == 0)
+            return profiler->scopes[i].time;
+    }
+
+    return -1.0;
+}
+
+bool renderer_instance_extension_supported(
+        const char* layer,
+        const char* extension)
+{
+    uint32_t extension_count = 0;
+    vkEnumerateInstanceExtensionProperties(layer, &extension_count, NULL);
+
+    VkExtensionProperties* extensions = malloc(
+        MAX(extension_count, 1) * sizeof(*extensions)
+    );
+    assert(extensions);
+
+    vkEnumerateInstanceExtensionProperties(
+        layer,
+        &extension_count,
+        extensions
+    );
+
+    bool supported = false;
+    uint32_t i;
+    for (i=0; i<extension_count; i++) {
+        if (strcmp(extensions[i].extensionName, extension) == 0) {
+            supported = true;
+            break;
+        }
+    }
+
+    free(extensions);
+
+    return supported;
+}
+
+bool renderer_device_extension_supported(
+        VkPhysicalDevice physical_device,
+        const char* extension)
+{
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(
+        physical_device,
+        NULL,
+        &extension_count,
+        NULL
+    );
+
+    VkExtensionProperties* extensions = malloc(
+        MAX(extension_count, 1) * sizeof(*extensions)
+    );
+    assert(extensions);
+
+    vkEnumerateDeviceExtensionProperties(
+        physical_device,
+        NULL,
+        &extension_count,
+        extensions
+    );
+
+    bool supported = false;
+    uint32_t i;
+    for (i=0; i<extension_count; i++) {
+        if (strcmp(extensions[i].extensionName, extension) == 0) {
+            supported = true;
+            break;
+        }
+    }
+
+    free(extensions);
+
+    return supported;
+}
+
+void renderer_create_memory_tracker(
+        VkPhysicalDevice physical_device,
+        bool budget_supported,
+        struct renderer_memory* memory)
+{
+    memset(memory, 0, sizeof(*memory));
+
+    memory->physical_device = physical_device;
+    memory->budget_supported = budget_supported;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory->properties);
+
+    renderer_update_memory_budget(memory);
+}
+
+VkDeviceMemory renderer_allocate_memory(
+        VkDevice device,
+        struct renderer_memory* memory,
+        enum renderer_memory_category category,
+        const VkMemoryAllocateInfo* alloc_info)
+{
+    VkDeviceMemory device_memory;
+
+    VkResult result;
+    result = vkAllocateMemory(device, alloc_info, NULL, &device_memory);
+    assert(result == VK_SUCCESS);
+
+    if (!memory)
+        return device_memory;
+
+    assert(memory->allocation_count < RENDERER_MAX_ALLOCATIONS);
+    uint32_t type = alloc_info->memoryTypeIndex;
+    struct renderer_allocation* allocation =
+        &memory->allocations[memory->allocation_count++];
+    allocation->memory = device_memory;
+    allocation->size = alloc_info->allocationSize;
+    allocation->heap = memory->properties.memoryTypes[type].heapIndex;
+    allocation->category = category;
+
+    struct renderer_memory_category_stats* stats =
+        &memory->categories[category];
+    stats->bytes += allocation->size;
+    stats->peak_bytes = MAX(stats->peak_bytes, stats->bytes);
+    stats->allocation_count++;
+    stats->total_allocations++;
+
+    memory->heap_bytes[allocation->heap] += allocation->size;
+
+    // Without the extension usage is the renderer's own, so it can be
+    // checked on every allocation without querying the driver
+    if (!memory->budget_supported)
+        renderer_update_memory_budget(memory);
+
+    return device_memory;
+}
+
+void renderer_free_memory(
+        VkDevice device,
+        struct renderer_memory* memory,
+        VkDeviceMemory device_memory)
+{
+    if (device_memory == VK_NULL_HANDLE)
+        return;
+
+    vkFreeMemory(device, device_memory, NULL);
+
+    if (!memory)
+        return;
+
+    uint32_t i;
+    for (i=0; i<memory->allocation_count; i++) {
+        if (memory->allocations[i].memory == device_memory)
+            break;
+    }
+    assert(i < memory->allocation_count);
+
+    struct renderer_allocation* allocation = &memory->allocations[i];
+    memory->categories[allocation->category].bytes -= allocation->size;
+    memory->categories[allocation->category].allocation_count--;
+    memory->heap_bytes[allocation->heap] -= allocation->size;
+
+    // Order doesn't matter, the last allocation takes the freed slot
+    memory->allocations[i] =
+        memory->allocations[--memory->allocation_count];
+}
+
+void renderer_update_memory_budget(
+        struct renderer_memory* memory)
+{
+    uint32_t heap_count = memory->properties.memoryHeapCount;
+
+    uint32_t i;
+    if (memory->budget_supported) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+            .sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+            .pNext = NULL
+        };
+        VkPhysicalDeviceMemoryProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+            .pNext = &budget
+        };
+        vkGetPhysicalDeviceMemoryProperties2(
+            memory->physical_device,
+            &properties
+        );
+
+        for (i=0; i<heap_count; i++) {
+            memory->heap_budget[i] = budget.heapBudget[i];
+            memory->heap_usage[i] = budget.heapUsage[i];
+        }
+    } else {
+        for (i=0; i<heap_count; i++) {
+            memory->heap_budget[i] = memory->properties.memoryHeaps[i].size;
+            memory->heap_usage[i] = memory->heap_bytes[i];
+        }
+    }
+
+    for (i=0; i<heap_count; i++) {
+        bool near_budget = memory->heap_budget[i] > 0 &&
+            memory->heap_usage[i] * 100 >=
+                memory->heap_budget[i] * RENDERER_MEMORY_WARNING_PERCENT;
+
+        if (near_budget && !memory->heap_warned[i]) {
+            fprintf(stderr, "Device memory heap %u at %llu of %llu MiB "
+                "budget\n",
+                i,
+                (unsigned long long)(memory->heap_usage[i] >> 20),
+                (unsigned long long)(memory->heap_budget[i] >> 20)
+            );
+        }
+
+        // Warns again only after dropping back under the threshold
+        memory->heap_warned[i] = near_budget;
+    }
+}
+
+void renderer_log_memory(
+        struct renderer_memory* memory)
+{
+    printf("Device memory:");
+
+    uint32_t i;
+    for (i=0; i<RENDERER_MEMORY_CATEGORY_COUNT; i++) {
+        struct renderer_memory_category_stats* stats = &memory->categories[i];
+        printf(" %s %.1f/%.1f MiB (%u)",
+            renderer_get_memory_category_name(i),
+            stats->bytes / (1024.0 * 1024.0),
+            stats->peak_bytes / (1024.0 * 1024.0),
+            stats->allocation_count
+        );
+    }
+
+    for (i=0; i<memory->properties.memoryHeapCount; i++) {
+        printf(", heap %u %llu/%llu MiB",
+            i,
+            (unsigned long long)(memory->heap_usage[i] >> 20),
+            (unsigned long long)(memory->heap_budget[i] >> 20)
+        );
+    }
+    printf("\n");
+}
+
+const char* renderer_get_memory_category_name(
+        enum renderer_memory_category category)
+{
+    switch (category) {
+        case RENDERER_MEMORY_MESH:
+            return "mesh";
+        case RENDERER_MEMORY_TEXTURE:
+            return "texture";
+        case RENDERER_MEMORY_UNIFORM:
+            return "uniform";
+        case RENDERER_MEMORY_STAGING:
+            return "staging";
+        case RENDERER_MEMORY_ATTACHMENT:
+            return "attachment";
+        case RENDERER_MEMORY_INDIRECT:
+            return "indirect";
+        default:
+            return "unknown";
+    }
 }
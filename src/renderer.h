@@ -5,9 +5,15 @@
 #include <GLFW/glfw3.h>
 
 #include "stb_image.h"
+#include "mesh.h"
+#include "texture.h"
+#include "jobs.h"
+#include "archive.h"
 
 #include <stdbool.h>
 
+struct streamer;
+
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
@@ -26,6 +32,7 @@ struct renderer_image
     VkSampler sampler;
     uint32_t width;
     uint32_t height;
+    uint32_t mip_levels;
     void* mapped;
 };
 
@@ -37,11 +44,153 @@ struct renderer_buffer
     void* mapped;
 };
 
+// Texture data in flight to its image, the fence signals once the image is
+// ready to sample and the rest can be freed
+struct renderer_texture_upload
+{
+    VkCommandBuffer cmd;
+    VkFence fence;
+    struct renderer_buffer staging_buffer;
+};
+
+// Device memory is accounted per category, every allocation goes through
+// renderer_allocate_memory and renderer_free_memory
+enum renderer_memory_category
+{
+    RENDERER_MEMORY_MESH,
+    RENDERER_MEMORY_TEXTURE,
+    RENDERER_MEMORY_UNIFORM,
+    RENDERER_MEMORY_STAGING,
+    RENDERER_MEMORY_ATTACHMENT,
+    RENDERER_MEMORY_INDIRECT,
+    RENDERER_MEMORY_CATEGORY_COUNT
+};
+
+#define RENDERER_MAX_ALLOCATIONS 1024
+
+// Frames between memory log lines
+#define RENDERER_MEMORY_LOG_INTERVAL 1000
+
+// Warn once a heap's usage passes this share of its budget
+#define RENDERER_MEMORY_WARNING_PERCENT 90
+
+struct renderer_memory_category_stats
+{
+    uint64_t bytes;
+    uint64_t peak_bytes;
+    uint32_t allocation_count;
+    uint64_t total_allocations;
+};
+
+struct renderer_allocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t heap;
+    enum renderer_memory_category category;
+};
+
+// Budgets come from VK_EXT_memory_budget when the device has it and are
+// otherwise the heap sizes, usage then only counts the renderer's own
+struct renderer_memory
+{
+    VkPhysicalDevice physical_device;
+    VkPhysicalDeviceMemoryProperties properties;
+    bool budget_supported;
+    struct renderer_memory_category_stats categories
+        [RENDERER_MEMORY_CATEGORY_COUNT];
+    struct renderer_allocation allocations[RENDERER_MAX_ALLOCATIONS];
+    uint32_t allocation_count;
+    VkDeviceSize heap_bytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heap_budget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heap_usage[VK_MAX_MEMORY_HEAPS];
+    bool heap_warned[VK_MAX_MEMORY_HEAPS];
+};
+
+// Headless images are allocated by the renderer and own their memory,
+// swapchain images leave it VK_NULL_HANDLE
 struct swapchain_buffer
 {
     VkImage image;
+    VkDeviceMemory memory;
     VkImageView image_view;
     VkCommandBuffer cmd;
+    VkFence fence;
+    // One draw per cluster of the drawn LOD, written by the cull pass
+    struct renderer_buffer indirect_buffer;
+    // Draws the image's last frame culled, read back once its fence signals
+    uint32_t draw_count;
+    VkDescriptorSet cull_descriptor_set;
+    // The mesh's uniforms and texture, one set per image so streamed
+    // textures can be swapped while other images are in flight
+    VkDescriptorSet descriptor_set;
+};
+
+// Run of indices that can be drawn with a single vkCmdDrawIndexed, stored
+// relative to vertex_offset so 16-bit indices can address large meshes
+struct renderer_index_range
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t vertex_offset;
+};
+
+// Meshlet clipped to a single index range, culled as a unit by the cull
+// compute pass, which reads it as 11 words
+struct renderer_cluster
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t vertex_offset;
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+// Level of detail as a run of index ranges and the clusters covering them,
+// error is in object space units
+struct renderer_mesh_lod
+{
+    uint32_t first_range;
+    uint32_t range_count;
+    uint32_t first_cluster;
+    uint32_t cluster_count;
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+};
+
+// Must match local_size_x in assets/shaders/cull.comp
+#define RENDERER_CULL_GROUP_SIZE 64
+
+// Push constants of assets/shaders/cull.comp
+struct renderer_cull_constants
+{
+    float planes[6][4];
+    float eye[4];
+    uint32_t first_cluster;
+    uint32_t cluster_count;
+};
+
+// Shader features, each one a boolean specialization constant whose id is
+// its bit index, so variants share the same SPIR-V
+enum renderer_pipeline_feature
+{
+    RENDERER_PIPELINE_FEATURE_TEXTURED = 1 << 0,
+    RENDERER_PIPELINE_FEATURE_ALPHA_TEST = 1 << 1
+};
+
+#define RENDERER_PIPELINE_FEATURE_COUNT 2
+
+// Everything that tells one pipeline apart from another. It is hashed and
+// compared as raw bytes, so it holds only 32-bit fields and no padding
+struct renderer_pipeline_state
+{
+    uint32_t features;
+    uint32_t polygon_mode;
+    uint32_t cull_mode;
+    uint32_t depth_write;
 };
 
 struct renderer_mesh
@@ -50,8 +199,167 @@ struct renderer_mesh
     uint32_t vertex_count;
     struct renderer_buffer ibo;
     uint32_t index_count;
-    VkDescriptorSet descriptor_set;
+    VkIndexType index_type;
+    struct renderer_index_range* index_ranges;
+    uint32_t index_range_count;
+    struct renderer_cluster* clusters;
+    uint32_t cluster_count;
+    struct renderer_buffer cluster_buffer;
+    struct renderer_mesh_lod* lods;
+    uint32_t lod_count;
+    float bounds[4];
     struct renderer_image* texture;
+    bool texture_streamed;
+    uint32_t streamed_texture;
+    struct renderer_pipeline_state pipeline_state;
+};
+
+struct renderer_camera
+{
+    float eye[3];
+    float center[3];
+    float up[3];
+    float fov;
+    float near;
+    float far;
+};
+
+struct renderer_stats
+{
+    uint64_t frame_count;
+    uint32_t draw_count;
+    uint32_t cluster_count;
+    uint32_t triangle_count;
+    uint32_t full_detail_triangle_count;
+    uint64_t total_cluster_count;
+    uint64_t total_draw_count;
+    uint64_t total_triangle_count;
+    uint64_t total_full_detail_triangle_count;
+    // Milliseconds of GPU time of the last frame the profiler resolved,
+    // negative when timestamps aren't available
+    double gpu_time;
+};
+
+// Timestamps are written into a ring of frames and read back once the
+// ring comes around again, by when the GPU has long finished with them
+#define RENDERER_GPU_PROFILER_FRAMES 4
+#define RENDERER_MAX_GPU_SCOPES 16
+#define RENDERER_MAX_GPU_SCOPE_WRITES 32
+#define RENDERER_MAX_GPU_STATISTICS_WRITES 8
+
+// Pipeline statistics collected per pass, in the order the query returns
+// them, which follows their VkQueryPipelineStatisticFlagBits
+enum renderer_gpu_statistic
+{
+    RENDERER_GPU_STATISTIC_INPUT_VERTICES,
+    RENDERER_GPU_STATISTIC_INPUT_PRIMITIVES,
+    RENDERER_GPU_STATISTIC_VERTEX_INVOCATIONS,
+    RENDERER_GPU_STATISTIC_CLIPPING_INVOCATIONS,
+    RENDERER_GPU_STATISTIC_CLIPPING_PRIMITIVES,
+    RENDERER_GPU_STATISTIC_FRAGMENT_INVOCATIONS,
+    RENDERER_GPU_STATISTIC_COUNT
+};
+
+#define RENDERER_GPU_STATISTIC_FLAGS ( \
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+// Named span of GPU work, times and statistics are the sum of every write
+// of the scope in a frame
+struct renderer_gpu_scope
+{
+    const char* name;
+    double time;
+    double total_time;
+    bool has_statistics;
+    uint64_t statistics[RENDERER_GPU_STATISTIC_COUNT];
+    uint64_t total_statistics[RENDERER_GPU_STATISTIC_COUNT];
+};
+
+struct renderer_gpu_profiler_frame
+{
+    uint32_t scopes[RENDERER_MAX_GPU_SCOPE_WRITES];
+    uint32_t write_count;
+    uint32_t statistics_scopes[RENDERER_MAX_GPU_STATISTICS_WRITES];
+    uint32_t statistics_write_count;
+};
+
+// Statistics need the pipelineStatisticsQuery feature, without it
+// statistics_pool stays VK_NULL_HANDLE
+struct renderer_gpu_profiler
+{
+    VkQueryPool query_pool;
+    VkQueryPool statistics_pool;
+    float timestamp_period;
+    struct renderer_gpu_scope scopes[RENDERER_MAX_GPU_SCOPES];
+    uint32_t scope_count;
+    struct renderer_gpu_profiler_frame frames[RENDERER_GPU_PROFILER_FRAMES];
+    uint64_t frame;
+    // Set when the last renderer_begin_gpu_frame resolved a frame
+    bool resolved;
+    double frame_time;
+    uint64_t resolved_frames;
+    uint64_t dropped_frames;
+};
+
+// Shader modules are shared by every pipeline using the same SPIR-V
+#define RENDERER_MAX_SHADER_MODULES 32
+
+struct renderer_shader_module
+{
+    uint64_t hash;
+    VkShaderModule module;
+};
+
+struct renderer_shader_cache
+{
+    struct renderer_shader_module modules[RENDERER_MAX_SHADER_MODULES];
+    uint32_t module_count;
+    uint64_t hits;
+};
+
+// Open addressed on the state's hash, must be a power of two
+#define RENDERER_MAX_PIPELINES 64
+
+// Everything a worker thread needs to create one pipeline, the shader
+// modules are looked up beforehand since the shader cache isn't shared
+struct renderer_pipeline_compile
+{
+    VkDevice device;
+    VkShaderModule vert_shader_module;
+    VkShaderModule frag_shader_module;
+    VkPipelineCache pipeline_cache;
+    VkExtent2D swapchain_extent;
+    VkPipelineLayout pipeline_layout;
+    VkRenderPass render_pass;
+    uint32_t subpass;
+    struct renderer_pipeline_state state;
+    VkPipeline base_pipeline;
+    VkPipeline pipeline;
+    double compile_time;
+};
+
+struct renderer_pipeline_entry
+{
+    bool used;
+    bool ready;
+    uint64_t hash;
+    struct renderer_pipeline_compile compile;
+    struct job_group compile_group;
+};
+
+struct renderer_pipeline_map
+{
+    VkPipelineCache cache;
+    struct renderer_pipeline_entry entries[RENDERER_MAX_PIPELINES];
+    uint32_t count;
+    uint64_t hits;
+    uint64_t fallbacks;
+    uint32_t blocking_compiles;
 };
 
 struct renderer_resources
@@ -81,8 +389,33 @@ struct renderer_resources
     struct renderer_mesh mesh;
     VkDescriptorPool descriptor_pool;
     VkDescriptorSetLayout descriptor_layout;
+    VkDescriptorSetLayout cull_descriptor_layout;
+    VkPipelineLayout cull_pipeline_layout;
+    VkPipeline cull_pipeline;
+
+    struct renderer_camera camera;
+    struct renderer_stats stats;
+    bool multi_draw_indirect;
+    bool texture_compression_bc;
+    struct streamer* streamer;
+    // Streamed cave chunks around the camera, NULL unless enabled
+    struct world* world;
+    // Radius of the sphere dug out every frame, zero when not digging
+    float dig_radius;
+    struct job_pool* jobs;
+    struct archive* archive;
+    struct renderer_shader_cache shader_cache;
+    struct renderer_pipeline_map pipelines;
+    bool fill_mode_non_solid;
+    bool pipeline_statistics_query;
+    // Rendering into offscreen images, without a surface or swapchain
+    bool headless;
+    uint32_t image_index;
+    struct renderer_gpu_profiler gpu_profiler;
+    struct renderer_memory memory;
 };
 
+// A NULL window renders headless
 void renderer_create_resources(
     struct renderer_resources* resources,
     GLFWwindow* window
@@ -96,7 +429,15 @@ void renderer_destroy_resources(
     struct renderer_resources* resources
 );
 
-VkInstance renderer_get_instance();
+// Writes the last rendered headless frame as a binary PPM
+bool renderer_save_frame(
+    struct renderer_resources* resources,
+    const char* path
+);
+
+// Validation and the debug report extension are enabled only where the
+// loader has them, bare installs such as CI software drivers have neither
+VkInstance renderer_get_instance(bool headless, bool* debug_report);
 
 VkDebugReportCallbackEXT renderer_get_debug_callback(
     VkInstance instance,
@@ -187,6 +528,17 @@ void renderer_create_swapchain_buffers(
     uint32_t swapchain_buffer_count
 );
 
+void renderer_create_offscreen_buffers(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkCommandPool command_pool,
+    VkFormat image_format,
+    VkExtent2D extent,
+    struct swapchain_buffer* swapchain_buffers,
+    uint32_t swapchain_buffer_count,
+    struct renderer_memory* memory
+);
+
 void renderer_submit_command_buffer(
     VkPhysicalDevice physical_device,
     VkDevice device,
@@ -203,7 +555,8 @@ void renderer_change_image_layout(
     VkImageLayout old_layout,
     VkImageLayout new_layout,
     VkAccessFlagBits src_access_mask,
-    VkImageAspectFlags aspect_mask
+    VkImageAspectFlags aspect_mask,
+    uint32_t mip_levels
 );
 
 uint32_t renderer_find_memory_type(
@@ -225,13 +578,15 @@ struct renderer_image renderer_get_depth_image(
     VkQueue queue,
     VkCommandPool command_pool,
     VkExtent2D extent,
-    VkFormat depth_format
+    VkFormat depth_format,
+    struct renderer_memory* memory
 );
 
 VkRenderPass renderer_get_render_pass(
     VkDevice device,
     VkFormat image_format,
-    VkFormat depth_format
+    VkFormat depth_format,
+    VkImageLayout final_layout
 );
 
 void renderer_create_framebuffers(
@@ -249,7 +604,9 @@ struct renderer_buffer renderer_get_buffer(
     VkDevice device,
     VkDeviceSize size,
     VkBufferUsageFlags usage,
-    VkMemoryPropertyFlags memory_flags
+    VkMemoryPropertyFlags memory_flags,
+    struct renderer_memory* memory,
+    enum renderer_memory_category category
 );
 
 struct renderer_buffer renderer_get_vertex_buffer(
@@ -258,7 +615,17 @@ struct renderer_buffer renderer_get_vertex_buffer(
     VkQueue queue,
     VkCommandPool command_pool,
     struct renderer_vertex* vertices,
-    uint32_t vertex_count
+    uint32_t vertex_count,
+    struct renderer_memory* memory
+);
+
+VkIndexType renderer_get_index_type(
+    uint32_t* indices,
+    uint32_t vertex_count,
+    struct renderer_mesh_lod* lods,
+    uint32_t lod_count,
+    struct renderer_index_range** index_ranges,
+    uint32_t* index_range_count
 );
 
 struct renderer_buffer renderer_get_index_buffer(
@@ -267,13 +634,16 @@ struct renderer_buffer renderer_get_index_buffer(
     VkQueue queue,
     VkCommandPool command_pool,
     uint32_t* indices,
-    uint32_t index_count
+    uint32_t index_count,
+    VkIndexType index_type,
+    struct renderer_memory* memory
 );
 
 struct renderer_buffer renderer_get_uniform_buffer(
     VkPhysicalDevice physical_device,
     VkDevice device,
-    struct renderer_buffer* staging_buffer
+    struct renderer_buffer* staging_buffer,
+    struct renderer_memory* memory
 );
 
 void renderer_update_uniform_buffer(
@@ -282,30 +652,119 @@ void renderer_update_uniform_buffer(
     VkQueue queue,
     VkCommandPool command_pool,
     VkExtent2D swapchain_extent,
+    struct renderer_camera* camera,
     struct renderer_buffer* uniform_buffer,
-    struct renderer_buffer* staging_buffer
+    struct renderer_buffer* staging_buffer,
+    struct renderer_gpu_profiler* profiler
 );
 
 struct renderer_image renderer_get_image(
     VkPhysicalDevice physical_device,
     VkDevice device,
     VkExtent3D extent,
+    uint32_t mip_levels,
     VkFormat format,
     VkImageTiling tiling,
     VkImageUsageFlags usage,
-    VkMemoryPropertyFlags memory_flags
+    VkMemoryPropertyFlags memory_flags,
+    struct renderer_memory* memory,
+    enum renderer_memory_category category
+);
+
+uint32_t renderer_get_mip_levels(
+    VkPhysicalDevice physical_device,
+    VkFormat format,
+    uint32_t width,
+    uint32_t height
+);
+
+void renderer_generate_mipmaps(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    VkImage image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mip_levels
+);
+
+VkImageView renderer_get_texture_view(
+    VkDevice device,
+    VkImage image,
+    VkFormat format,
+    uint32_t mip_levels
+);
+
+VkSampler renderer_get_texture_sampler(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    uint32_t mip_levels
+);
+
+void renderer_decode_textures(
+    struct job_pool* jobs,
+    struct texture_decode* decodes,
+    uint32_t decode_count
 );
 
 struct renderer_image renderer_load_texture(
-    const char* src,
+    const uint8_t* pixels,
+    uint32_t tex_width,
+    uint32_t tex_height,
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    struct renderer_memory* memory
+);
+
+VkFormat renderer_get_texture_format(
+    enum texture_format format
+);
+
+// Submits the copy and returns straight away, the image may be sampled once
+// renderer_texture_upload_done says so
+struct renderer_image renderer_begin_compressed_texture_upload(
+    struct texture_file* file,
+    uint32_t first_level,
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    struct renderer_gpu_profiler* profiler,
+    struct renderer_memory* memory,
+    struct renderer_texture_upload* upload
+);
+
+bool renderer_texture_upload_done(
+    VkDevice device,
+    struct renderer_texture_upload* upload
+);
+
+// Waits for the upload if it hasn't finished, then frees its staging
+void renderer_finish_texture_upload(
+    VkDevice device,
+    VkCommandPool command_pool,
+    struct renderer_memory* memory,
+    struct renderer_texture_upload* upload
+);
+
+struct renderer_image renderer_load_compressed_texture(
+    struct texture_file* file,
+    uint32_t first_level,
     VkPhysicalDevice physical_device,
     VkDevice device,
     VkQueue queue,
-    VkCommandPool command_pool
+    VkCommandPool command_pool,
+    struct renderer_gpu_profiler* profiler,
+    struct renderer_memory* memory
 );
 
+// Each image has a set for drawing and one for culling
 VkDescriptorPool renderer_get_descriptor_pool(
-    VkDevice device
+    VkDevice device,
+    uint32_t image_count
 );
 
 VkDescriptorSetLayout renderer_get_descriptor_layout(
@@ -321,14 +780,34 @@ VkDescriptorSet renderer_get_descriptor_set(
     struct renderer_image* tex_image
 );
 
+VkDescriptorSetLayout renderer_get_cull_descriptor_layout(
+    VkDevice device
+);
+
+VkDescriptorSet renderer_get_cull_descriptor_set(
+    VkDevice device,
+    VkDescriptorPool descriptor_pool,
+    VkDescriptorSetLayout descriptor_layout,
+    struct renderer_buffer* cluster_buffer,
+    struct renderer_buffer* indirect_buffer
+);
+
 VkShaderModule renderer_get_shader_module(
     VkDevice device,
+    struct archive* archive,
+    struct renderer_shader_cache* cache,
     const char* fname
 );
 
+void renderer_destroy_shader_cache(
+    VkDevice device,
+    struct renderer_shader_cache* cache
+);
+
 VkPipelineShaderStageCreateInfo renderer_get_shader_stage(
     VkShaderStageFlagBits stage,
-    VkShaderModule module
+    VkShaderModule module,
+    const VkSpecializationInfo* specialization_info
 );
 
 VkVertexInputBindingDescription renderer_get_binding_description(
@@ -373,6 +852,7 @@ VkPipelineViewportStateCreateInfo renderer_get_viewport_state(
 );
 
 VkPipelineRasterizationStateCreateInfo renderer_get_rasterization_state(
+    VkPolygonMode polygon_mode,
     VkCullModeFlags cull_mode,
     VkFrontFace front_face
 );
@@ -381,7 +861,9 @@ VkPipelineMultisampleStateCreateInfo renderer_get_multisample_state(
     VkSampleCountFlagBits rasterization_samples
 );
 
-VkPipelineDepthStencilStateCreateInfo renderer_get_depth_stencil_state();
+VkPipelineDepthStencilStateCreateInfo renderer_get_depth_stencil_state(
+    VkBool32 depth_write
+);
 
 VkPipelineColorBlendAttachmentState renderer_get_color_blend_attachment();
 
@@ -400,34 +882,244 @@ VkPipelineLayout renderer_get_pipeline_layout(
 
 VkPipeline renderer_get_graphics_pipeline(
     VkDevice device,
+    VkPipelineCache pipeline_cache,
     VkGraphicsPipelineCreateInfo* create_info
 );
 
-VkPipeline renderer_get_base_graphics_pipeline(
+VkPipeline renderer_get_compute_pipeline(
     VkDevice device,
+    VkPipelineCache pipeline_cache,
+    VkShaderModule module,
+    VkPipelineLayout pipeline_layout
+);
+
+struct renderer_pipeline_state renderer_get_default_pipeline_state();
+
+VkPipeline renderer_get_variant_graphics_pipeline(
+    VkDevice device,
+    VkShaderModule vert_shader_module,
+    VkShaderModule frag_shader_module,
+    VkPipelineCache pipeline_cache,
     VkExtent2D swapchain_extent,
     VkPipelineLayout pipeline_layout,
     VkRenderPass render_pass,
-    uint32_t subpass
+    uint32_t subpass,
+    const struct renderer_pipeline_state* state,
+    VkPipeline base_pipeline
+);
+
+// Job function, takes a struct renderer_pipeline_compile
+void renderer_compile_pipeline(void* data);
+
+VkPipeline renderer_get_pipeline(
+    struct renderer_resources* resources,
+    const struct renderer_pipeline_state* state,
+    bool wait
+);
+
+void renderer_destroy_pipeline_map(
+    VkDevice device,
+    struct job_pool* jobs,
+    struct renderer_pipeline_map* map
 );
 
 void renderer_load_textured_model(
     struct renderer_resources* resources
 );
 
+uint32_t renderer_select_lod(
+    struct renderer_mesh* mesh,
+    struct renderer_camera* camera,
+    VkExtent2D swapchain_extent
+);
+
+uint32_t renderer_get_texture_level(
+    struct renderer_mesh* mesh,
+    struct renderer_camera* camera,
+    VkExtent2D swapchain_extent,
+    uint32_t texture_size
+);
+
+void renderer_create_clusters(
+    struct renderer_mesh* mesh,
+    struct mesh_meshlet* meshlets,
+    uint32_t* lod_meshlet_counts
+);
+
+struct renderer_buffer renderer_get_indirect_buffer(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    uint32_t draw_count,
+    struct renderer_memory* memory
+);
+
+struct renderer_buffer renderer_get_cluster_buffer(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    struct renderer_cluster* clusters,
+    uint32_t cluster_count,
+    struct renderer_memory* memory
+);
+
+void renderer_get_cull_constants(
+    struct renderer_mesh* mesh,
+    uint32_t lod,
+    struct renderer_camera* camera,
+    VkExtent2D swapchain_extent,
+    struct renderer_cull_constants* constants
+);
+
+// Clusters the cull pass kept and their triangles, from draws it wrote
+uint32_t renderer_count_drawn_clusters(
+    VkDrawIndexedIndirectCommand* draw_commands,
+    uint32_t draw_count,
+    uint32_t* triangle_count
+);
+
 void renderer_record_draw_commands(
     VkPipeline pipeline,
     VkPipelineLayout pipeline_layout,
     VkRenderPass render_pass,
     VkExtent2D swapchain_extent,
-    VkFramebuffer* framebuffers,
-    struct swapchain_buffer* swapchain_buffers,
-    uint32_t swapchain_image_count,
-    struct renderer_mesh* mesh
+    VkFramebuffer framebuffer,
+    VkCommandBuffer cmd,
+    struct renderer_mesh* mesh,
+    VkDescriptorSet descriptor_set,
+    VkBuffer indirect_buffer,
+    VkPipeline cull_pipeline,
+    VkPipelineLayout cull_pipeline_layout,
+    VkDescriptorSet cull_descriptor_set,
+    struct renderer_cull_constants* cull_constants,
+    bool multi_draw_indirect,
+    struct world* world,
+    struct renderer_gpu_profiler* profiler
 );
 
 VkSemaphore renderer_get_semaphore(
     VkDevice device
 );
 
+VkFence renderer_get_fence(
+    VkDevice device,
+    VkFenceCreateFlags flags
+);
+
+// Without timestamp support on the device the profiler is left disabled
+// and every scope reads as unavailable
+void renderer_create_gpu_profiler(
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    bool pipeline_statistics,
+    struct renderer_gpu_profiler* profiler
+);
+
+void renderer_destroy_gpu_profiler(
+    VkDevice device,
+    struct renderer_gpu_profiler* profiler
+);
+
+// Moves to the next frame of the ring, resolving the frame last written
+// there if the GPU is done with it, otherwise it is dropped
+void renderer_begin_gpu_frame(
+    VkDevice device,
+    struct renderer_gpu_profiler* profiler
+);
+
+// Writes the scope's start timestamp, outside of any render pass. The
+// name is kept, not copied. Returns the write to end the scope with
+uint32_t renderer_begin_gpu_scope(
+    struct renderer_gpu_profiler* profiler,
+    VkCommandBuffer cmd,
+    const char* name
+);
+
+void renderer_end_gpu_scope(
+    struct renderer_gpu_profiler* profiler,
+    VkCommandBuffer cmd,
+    uint32_t write
+);
+
+// Index of the named scope, added if it isn't known yet. UINT32_MAX once
+// every scope is taken
+uint32_t renderer_find_gpu_scope(
+    struct renderer_gpu_profiler* profiler,
+    const char* name
+);
+
+// Pipeline statistics of the commands until the matching end, begun and
+// ended outside of any render pass
+uint32_t renderer_begin_gpu_statistics(
+    struct renderer_gpu_profiler* profiler,
+    VkCommandBuffer cmd,
+    const char* name
+);
+
+void renderer_end_gpu_statistics(
+    struct renderer_gpu_profiler* profiler,
+    VkCommandBuffer cmd,
+    uint32_t write
+);
+
+const char* renderer_get_gpu_statistic_name(
+    enum renderer_gpu_statistic statistic
+);
+
+// Milliseconds in the last resolved frame, negative for unknown scopes or
+// while the profiler is disabled
+double renderer_get_gpu_scope_time(
+    struct renderer_gpu_profiler* profiler,
+    const char* name
+);
+
+bool renderer_device_extension_supported(
+    VkPhysicalDevice physical_device,
+    const char* extension
+);
+
+// Layer is NULL for the loader's and drivers' own extensions
+bool renderer_instance_extension_supported(
+    const char* layer,
+    const char* extension
+);
+
+// budget_supported only when VK_EXT_memory_budget was enabled on the
+// device, which also needs Vulkan 1.1 for the properties query
+void renderer_create_memory_tracker(
+    VkPhysicalDevice physical_device,
+    bool budget_supported,
+    struct renderer_memory* memory
+);
+
+// Asserts on failure like every other allocation. A NULL tracker
+// allocates without accounting
+VkDeviceMemory renderer_allocate_memory(
+    VkDevice device,
+    struct renderer_memory* memory,
+    enum renderer_memory_category category,
+    const VkMemoryAllocateInfo* alloc_info
+);
+
+// Accepts VK_NULL_HANDLE
+void renderer_free_memory(
+    VkDevice device,
+    struct renderer_memory* memory,
+    VkDeviceMemory device_memory
+);
+
+// Refreshes each heap's budget and usage, warning once per heap when its
+// usage nears the budget
+void renderer_update_memory_budget(
+    struct renderer_memory* memory
+);
+
+void renderer_log_memory(
+    struct renderer_memory* memory
+);
+
+const char* renderer_get_memory_category_name(
+    enum renderer_memory_category category
+);
+
 #endif
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "streamer.h"
+
+// Bytes of level data from first_level down to the smallest level
+static uint64_t streamer_level_bytes(
+        struct texture_file* file,
+        uint32_t first_level)
+{
+    uint64_t bytes = 0;
+    uint32_t i;
+    for (i=first_level; i<file->header.mip_levels; i++)
+        bytes += file->levels[i].size;
+
+    return bytes;
+}
+
+static void streamer_destroy_image(
+        struct streamer* streamer,
+        struct renderer_image* image)
+{
+    vkDestroySampler(streamer->device, image->sampler, NULL);
+    vkDestroyImageView(streamer->device, image->image_view, NULL);
+    vkDestroyImage(streamer->device, image->image, NULL);
+    renderer_free_memory(streamer->device, streamer->memory, image->memory);
+}
+
+// Points the frame's descriptor set at the texture's current image
+static void streamer_write_descriptor_set(
+        struct streamer* streamer,
+        struct streamer_texture* texture,
+        uint32_t frame)
+{
+    if (texture->descriptor_sets[frame] == VK_NULL_HANDLE)
+        return;
+
+    VkDescriptorImageInfo image_info = {
+        .sampler = texture->image.sampler,
+        .imageView = texture->image.image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+
+    VkWriteDescriptorSet sampler_descriptor_write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = NULL,
+        .dstSet = texture->descriptor_sets[frame],
+        .dstBinding = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &image_info,
+        .pBufferInfo = NULL,
+        .pTexelBufferView = NULL
+    };
+
+    vkUpdateDescriptorSets(
+        streamer->device,
+        1,
+        &sampler_descriptor_write,
+        0,
+        NULL
+    );
+}
+
+// Frames in flight may still sample the image through their descriptor
+// sets, it is destroyed once they have all been pointed elsewhere
+static void streamer_retire(
+        struct streamer* streamer,
+        struct renderer_image* image)
+{
+    if (streamer->retired_count == streamer->retired_capacity) {
+        streamer->retired_capacity = streamer->retired_capacity ?
+            streamer->retired_capacity * 2 : 16;
+        streamer->retired = realloc(
+            streamer->retired,
+            streamer->retired_capacity * sizeof(*streamer->retired)
+        );
+        assert(streamer->retired);
+    }
+
+    struct streamer_retired* retired =
+        &streamer->retired[streamer->retired_count++];
+    retired->image = *image;
+    retired->frame_mask = (1u << streamer->frame_count) - 1;
+}
+
+// Starts rebuilding the texture's image with level as its base, the
+// current image stays bound until the upload's fence signals
+static void streamer_begin_level(
+        struct streamer* streamer,
+        struct streamer_texture* texture,
+        uint32_t level)
+{
+    texture->loading_image = renderer_begin_compressed_texture_upload(
+        &texture->file,
+        level,
+        streamer->physical_device,
+        streamer->device,
+        streamer->queue,
+        streamer->command_pool,
+        streamer->profiler,
+        streamer->memory,
+        &texture->upload
+    );
+    texture->loading_level = level;
+    texture->loading = true;
+
+    uint64_t bytes = streamer_level_bytes(&texture->file, level);
+    streamer->stats.resident_bytes -= texture->resident_bytes;
+    streamer->stats.resident_bytes += bytes;
+    texture->resident_bytes = bytes;
+}
+
+// Replaces the texture's image with its finished upload, every frame's
+// descriptor set follows as that frame comes round again
+static void streamer_swap_level(
+        struct streamer* streamer,
+        struct streamer_texture* texture)
+{
+    renderer_finish_texture_upload(
+        streamer->device,
+        streamer->command_pool,
+        streamer->memory,
+        &texture->upload
+    );
+
+    streamer_retire(streamer, &texture->image);
+    texture->image = texture->loading_image;
+    texture->resident_level = texture->loading_level;
+    texture->loading = false;
+    texture->stale_frames = (1u << streamer->frame_count) - 1;
+}
+
+// Drops the least recently used texture that wasn't needed this frame back
+// to its resident tail, returns false when nothing can be evicted
+static bool streamer_evict(
+        struct streamer* streamer,
+        struct streamer_texture* keep)
+{
+    struct streamer_texture* victim = NULL;
+
+    uint32_t i;
+    for (i=0; i<streamer->texture_count; i++) {
+        struct streamer_texture* texture = &streamer->textures[i];
+        if (texture == keep ||
+            texture->loading ||
+            texture->resident_level == texture->tail_level ||
+            texture->last_used_frame == streamer->frame) {
+            continue;
+        }
+
+        if (!victim || texture->last_used_frame < victim->last_used_frame)
+            victim = texture;
+    }
+
+    if (!victim)
+        return false;
+
+    streamer_begin_level(streamer, victim, victim->tail_level);
+    streamer->stats.evictions++;
+
+    return true;
+}
+
+void streamer_init(
+        struct streamer* streamer,
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        uint32_t frame_count,
+        uint64_t budget_bytes)
+{
+    assert(frame_count <= STREAMER_MAX_FRAMES);
+    memset(streamer, 0, sizeof(*streamer));
+
+    streamer->physical_device = physical_device;
+    streamer->device = device;
+    streamer->queue = queue;
+    streamer->command_pool = command_pool;
+    streamer->frame_count = frame_count;
+    streamer->budget_bytes = budget_bytes;
+}
+
+uint32_t streamer_add_texture(
+        struct streamer* streamer,
+        struct texture_file* file)
+{
+    assert(streamer->texture_count < STREAMER_MAX_TEXTURES);
+
+    uint32_t handle = streamer->texture_count++;
+    struct streamer_texture* texture = &streamer->textures[handle];
+    memset(texture, 0, sizeof(*texture));
+
+    // The file's level data is read from again whenever a finer level
+    // streams in, so the streamer takes ownership of it
+    texture->file = *file;
+    memset(file, 0, sizeof(*file));
+
+    struct texture_file_header* header = &texture->file.header;
+    uint32_t level = 0;
+    while (level + 1 < header->mip_levels &&
+        MAX(header->width >> level, header->height >> level) >
+            STREAMER_RESIDENT_LEVEL_SIZE) {
+        level++;
+    }
+
+    texture->tail_level = level;
+    texture->requested_level = level;
+    texture->resident_level = level;
+
+    texture->image = renderer_load_compressed_texture(
+        &texture->file,
+        level,
+        streamer->physical_device,
+        streamer->device,
+        streamer->queue,
+        streamer->command_pool,
+        streamer->profiler,
+        streamer->memory
+    );
+
+    texture->resident_bytes = streamer_level_bytes(&texture->file, level);
+    streamer->stats.resident_bytes += texture->resident_bytes;
+
+    return handle;
+}
+
+struct renderer_image* streamer_get_image(
+        struct streamer* streamer,
+        uint32_t texture)
+{
+    assert(texture < streamer->texture_count);
+
+    return &streamer->textures[texture].image;
+}
+
+void streamer_set_descriptor_set(
+        struct streamer* streamer,
+        uint32_t texture,
+        uint32_t frame,
+        VkDescriptorSet descriptor_set)
+{
+    assert(texture < streamer->texture_count);
+    assert(frame < streamer->frame_count);
+
+    streamer->textures[texture].descriptor_sets[frame] = descriptor_set;
+}
+
+void streamer_request(
+        struct streamer* streamer,
+        uint32_t texture,
+        uint32_t level)
+{
+    assert(texture < streamer->texture_count);
+
+    struct streamer_texture* streamed = &streamer->textures[texture];
+    level = MIN(level, streamed->tail_level);
+
+    // Several requests in one frame keep the finest
+    if (streamed->last_used_frame != streamer->frame ||
+        level < streamed->requested_level) {
+        streamed->requested_level = level;
+    }
+    streamed->last_used_frame = streamer->frame;
+
+    // Sampled at a level that isn't resident yet
+    if (level < streamed->resident_level)
+        streamer->stats.misses++;
+}
+
+void streamer_update(
+        struct streamer* streamer,
+        uint32_t frame)
+{
+    assert(frame < streamer->frame_count);
+
+    uint32_t rebuilds = 0;
+    uint32_t i;
+
+    // Finished uploads are swapped in at the frame boundary, and this
+    // frame's sets, idle since its fence, move to the newest images
+    for (i=0; i<streamer->texture_count; i++) {
+        struct streamer_texture* texture = &streamer->textures[i];
+        if (texture->loading &&
+            renderer_texture_upload_done(streamer->device, &texture->upload)) {
+            streamer_swap_level(streamer, texture);
+        }
+
+        if (texture->stale_frames & (1u << frame)) {
+            streamer_write_descriptor_set(streamer, texture, frame);
+            texture->stale_frames &= ~(1u << frame);
+        }
+    }
+
+    // Images no frame's set points at any more
+    i = 0;
+    while (i < streamer->retired_count) {
+        struct streamer_retired* retired = &streamer->retired[i];
+        retired->frame_mask &= ~(1u << frame);
+        if (retired->frame_mask) {
+            i++;
+            continue;
+        }
+
+        streamer_destroy_image(streamer, &retired->image);
+        *retired = streamer->retired[--streamer->retired_count];
+    }
+
+    while (rebuilds < STREAMER_MAX_UPLOADS_PER_FRAME) {
+        // Serve the request furthest from being resident first
+        struct streamer_texture* texture = NULL;
+        uint32_t largest_gap = 0;
+        for (i=0; i<streamer->texture_count; i++) {
+            struct streamer_texture* candidate = &streamer->textures[i];
+            if (candidate->last_used_frame != streamer->frame ||
+                candidate->loading ||
+                candidate->requested_level >= candidate->resident_level) {
+                continue;
+            }
+
+            uint32_t gap =
+                candidate->resident_level - candidate->requested_level;
+            if (gap > largest_gap) {
+                largest_gap = gap;
+                texture = candidate;
+            }
+        }
+
+        if (!texture)
+            break;
+
+        // Make room, settling for a coarser level when the budget can't
+        // hold the requested one even after evicting everything idle
+        uint32_t level = texture->requested_level;
+        for (;;) {
+            uint64_t bytes = streamer_level_bytes(&texture->file, level);
+            uint64_t resident = streamer->stats.resident_bytes -
+                texture->resident_bytes + bytes;
+
+            if (resident <= streamer->budget_bytes)
+                break;
+            // Out of rebuilds for this frame, carry on making room next
+            if (rebuilds == STREAMER_MAX_UPLOADS_PER_FRAME) {
+                level = texture->resident_level;
+                break;
+            }
+            if (streamer_evict(streamer, texture)) {
+                rebuilds++;
+                continue;
+            }
+            if (level + 1 >= texture->resident_level) {
+                level = texture->resident_level;
+                break;
+            }
+            level++;
+        }
+
+        // Nothing fits yet, or evicting used up the frame's rebuilds, leave
+        // the request pending until it does
+        if (level >= texture->resident_level ||
+            rebuilds == STREAMER_MAX_UPLOADS_PER_FRAME) {
+            break;
+        }
+
+        streamer_begin_level(streamer, texture, level);
+        streamer->stats.uploads++;
+        rebuilds++;
+    }
+
+    streamer->stats.pending_requests = 0;
+    for (i=0; i<streamer->texture_count; i++) {
+        struct streamer_texture* texture = &streamer->textures[i];
+        if (texture->last_used_frame == streamer->frame &&
+            texture->requested_level < texture->resident_level) {
+            streamer->stats.pending_requests++;
+        }
+    }
+
+    streamer->frame++;
+}
+
+void streamer_destroy(struct streamer* streamer)
+{
+    uint32_t i;
+    for (i=0; i<streamer->texture_count; i++) {
+        struct streamer_texture* texture = &streamer->textures[i];
+        if (texture->loading) {
+            renderer_finish_texture_upload(
+                streamer->device,
+                streamer->command_pool,
+                streamer->memory,
+                &texture->upload
+            );
+            streamer_destroy_image(streamer, &texture->loading_image);
+        }
+        streamer_destroy_image(streamer, &texture->image);
+        texture_file_free(&texture->file);
+    }
+    streamer->texture_count = 0;
+
+    for (i=0; i<streamer->retired_count; i++)
+        streamer_destroy_image(streamer, &streamer->retired[i].image);
+    free(streamer->retired);
+    streamer->retired = NULL;
+    streamer->retired_count = 0;
+    streamer->retired_capacity = 0;
+    streamer->stats.resident_bytes = 0;
+}
@@ -0,0 +1,121 @@
+#ifndef STREAMER_H_
+#define STREAMER_H_
+
+#include "renderer.h"
+#include "texture.h"
+
+#define STREAMER_MAX_TEXTURES 64
+
+// Swapchain images with their own descriptor sets, tracked as mask bits
+#define STREAMER_MAX_FRAMES 8
+
+// Levels this size and smaller are uploaded with the texture and never
+// evicted, so there is always something to sample
+#define STREAMER_RESIDENT_LEVEL_SIZE 64
+
+// Image rebuilds started per frame, for finer levels and evictions alike.
+// Each uploads in the background and is swapped in once its fence signals
+#define STREAMER_MAX_UPLOADS_PER_FRAME 1
+
+struct streamer_texture
+{
+    struct texture_file file;
+    struct renderer_image image;
+    VkDescriptorSet descriptor_sets[STREAMER_MAX_FRAMES];
+    // Frames whose descriptor set still points at a replaced image
+    uint32_t stale_frames;
+    // Finest level in the image, the finest level asked for this frame and
+    // the coarsest level the texture may be evicted down to
+    uint32_t resident_level;
+    uint32_t requested_level;
+    uint32_t tail_level;
+    // Counts the level being loaded as soon as its upload starts
+    uint64_t resident_bytes;
+    uint64_t last_used_frame;
+    // Rebuild in flight, its image replaces the current one when ready
+    bool loading;
+    uint32_t loading_level;
+    struct renderer_image loading_image;
+    struct renderer_texture_upload upload;
+};
+
+// Replaced image, destroyed once every frame has moved its descriptor set
+// off it, each frame only doing so after its fence was waited on
+struct streamer_retired
+{
+    struct renderer_image image;
+    uint32_t frame_mask;
+};
+
+struct streamer_stats
+{
+    uint64_t resident_bytes;
+    uint32_t pending_requests;
+    uint64_t misses;
+    uint64_t uploads;
+    uint64_t evictions;
+};
+
+struct streamer
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+    // Optional, level uploads are timed as the "texture_upload" scope
+    struct renderer_gpu_profiler* profiler;
+    // Accounts resident levels as RENDERER_MEMORY_TEXTURE when set
+    struct renderer_memory* memory;
+    uint64_t budget_bytes;
+    uint64_t frame;
+    uint32_t frame_count;
+    struct streamer_texture textures[STREAMER_MAX_TEXTURES];
+    uint32_t texture_count;
+    struct streamer_retired* retired;
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    struct streamer_stats stats;
+};
+
+void streamer_init(
+    struct streamer* streamer,
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    uint32_t frame_count,
+    uint64_t budget_bytes
+);
+
+uint32_t streamer_add_texture(
+    struct streamer* streamer,
+    struct texture_file* file
+);
+
+struct renderer_image* streamer_get_image(
+    struct streamer* streamer,
+    uint32_t texture
+);
+
+void streamer_set_descriptor_set(
+    struct streamer* streamer,
+    uint32_t texture,
+    uint32_t frame,
+    VkDescriptorSet descriptor_set
+);
+
+void streamer_request(
+    struct streamer* streamer,
+    uint32_t texture,
+    uint32_t level
+);
+
+// Called once frame's fence was waited on, before its commands are recorded
+void streamer_update(
+    struct streamer* streamer,
+    uint32_t frame
+);
+
+void streamer_destroy(struct streamer* streamer);
+
+#endif
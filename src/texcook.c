@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "bcn.h"
+#include "texture.h"
+
+// Offline texture cooker, decodes an image, builds its mip chain and
+// writes it block compressed so the renderer can upload it directly
+//
+//     texcook <input image> <output .ctex> [rgba8|bc1|bc3|bc4|bc5]
+
+static const char* format_names[] = {
+    "rgba8",
+    "bc1",
+    "bc3",
+    "bc4",
+    "bc5"
+};
+
+static void encode_level(
+        enum texture_format format,
+        const uint8_t* rgba,
+        uint32_t width,
+        uint32_t height,
+        uint8_t* dst)
+{
+    if (format == TEXTURE_FORMAT_RGBA8) {
+        memcpy(dst, rgba, (size_t)width * height * 4);
+        return;
+    }
+
+    uint32_t block_size = texture_block_size(format);
+    uint8_t texels[16 * 4];
+
+    uint32_t bx, by, x, y;
+    for (by=0; by<height; by+=4) {
+        for (bx=0; bx<width; bx+=4) {
+            // Partial blocks at the edges repeat the last row and column
+            for (y=0; y<4; y++) {
+                uint32_t sy = by + y < height ? by + y : height - 1;
+                for (x=0; x<4; x++) {
+                    uint32_t sx = bx + x < width ? bx + x : width - 1;
+                    memcpy(
+                        &texels[(y*4 + x) * 4],
+                        &rgba[(sy * width + sx) * 4],
+                        4
+                    );
+                }
+            }
+
+            switch (format) {
+            case TEXTURE_FORMAT_BC1:
+                bcn_encode_bc1(texels, dst);
+                break;
+            case TEXTURE_FORMAT_BC3:
+                bcn_encode_bc3(texels, dst);
+                break;
+            case TEXTURE_FORMAT_BC4:
+                bcn_encode_bc4(texels, dst);
+                break;
+            case TEXTURE_FORMAT_BC5:
+                bcn_encode_bc5(texels, dst);
+                break;
+            default:
+                assert(0);
+            }
+            dst += block_size;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr,
+            "usage: %s <input image> <output .ctex> [rgba8|bc1|bc3|bc4|bc5]\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(argv[1], &width, &height, &channels, 4);
+    if (!pixels) {
+        fprintf(stderr, "%s: %s\n", argv[1], stbi_failure_reason());
+        return 1;
+    }
+
+    // Without an explicit format, keep alpha only when it is actually used
+    enum texture_format format = TEXTURE_FORMAT_BC1;
+    int i;
+    for (i=0; i<width * height; i++) {
+        if (pixels[i*4 + 3] != 255) {
+            format = TEXTURE_FORMAT_BC3;
+            break;
+        }
+    }
+
+    if (argc == 4) {
+        int found = 0;
+        for (i=0; i<(int)(sizeof(format_names)/sizeof(format_names[0])); i++) {
+            if (strcmp(argv[3], format_names[i]) == 0) {
+                format = i;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown format %s\n", argv[3]);
+            stbi_image_free(pixels);
+            return 1;
+        }
+    }
+
+    uint32_t mip_levels = texture_mip_count(width, height);
+    if (mip_levels > TEXTURE_MAX_MIP_LEVELS)
+        mip_levels = TEXTURE_MAX_MIP_LEVELS;
+
+    uint8_t* level_data[TEXTURE_MAX_MIP_LEVELS];
+    uint8_t* level_rgba = pixels;
+    uint32_t level_width = width;
+    uint32_t level_height = height;
+    uint64_t cooked_size = 0;
+
+    uint32_t level;
+    for (level=0; level<mip_levels; level++) {
+        uint64_t size = texture_level_size(format, level_width, level_height);
+        level_data[level] = malloc(size);
+        assert(level_data[level]);
+        encode_level(format, level_rgba, level_width, level_height, level_data[level]);
+        cooked_size += size;
+
+        if (level + 1 == mip_levels)
+            break;
+
+        uint32_t next_width = level_width > 1 ? level_width / 2 : 1;
+        uint32_t next_height = level_height > 1 ? level_height / 2 : 1;
+        uint8_t* next_rgba = malloc((size_t)next_width * next_height * 4);
+        assert(next_rgba);
+        texture_downsample(level_rgba, level_width, level_height, next_rgba);
+
+        if (level_rgba != pixels)
+            free(level_rgba);
+        level_rgba = next_rgba;
+        level_width = next_width;
+        level_height = next_height;
+    }
+    if (level_rgba != pixels)
+        free(level_rgba);
+
+    bool written = texture_file_write(
+        argv[2],
+        format,
+        width,
+        height,
+        mip_levels,
+        level_data
+    );
+
+    for (level=0; level<mip_levels; level++)
+        free(level_data[level]);
+    stbi_image_free(pixels);
+
+    if (!written) {
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %dx%d, %u mips, %s, %llu bytes (%llu as RGBA8 base level)\n",
+        argv[2],
+        width,
+        height,
+        mip_levels,
+        format_names[format],
+        (unsigned long long)cooked_size,
+        (unsigned long long)width * height * 4
+    );
+
+    return 0;
+}
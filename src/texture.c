@@ -0,0 +1,386 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stb_image.h"
+
+#include "texture.h"
+#include "util.h"
+
+uint32_t texture_block_size(enum texture_format format)
+{
+    switch (format) {
+    case TEXTURE_FORMAT_BC1:
+    case TEXTURE_FORMAT_BC4:
+        return 8;
+    case TEXTURE_FORMAT_BC3:
+    case TEXTURE_FORMAT_BC5:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+uint64_t texture_level_size(
+        enum texture_format format,
+        uint32_t width,
+        uint32_t height)
+{
+    if (format == TEXTURE_FORMAT_RGBA8)
+        return (uint64_t)width * height * 4;
+
+    // Block formats round partial blocks up to a whole 4x4 block
+    uint64_t blocks_x = (width + 3) / 4;
+    uint64_t blocks_y = (height + 3) / 4;
+    return blocks_x * blocks_y * texture_block_size(format);
+}
+
+uint32_t texture_mip_count(uint32_t width, uint32_t height)
+{
+    uint32_t mip_levels = 1;
+    uint32_t size = width > height ? width : height;
+    while (size > 1) {
+        size /= 2;
+        mip_levels++;
+    }
+
+    return mip_levels;
+}
+
+void texture_downsample(
+        const uint8_t* src,
+        uint32_t src_width,
+        uint32_t src_height,
+        uint8_t* dst)
+{
+    uint32_t dst_width = src_width > 1 ? src_width / 2 : 1;
+    uint32_t dst_height = src_height > 1 ? src_height / 2 : 1;
+
+    // 2x2 box filter, odd edges reuse their last row or column
+    uint32_t x, y, c;
+    for (y=0; y<dst_height; y++) {
+        uint32_t y0 = y * 2;
+        uint32_t y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+        for (x=0; x<dst_width; x++) {
+            uint32_t x0 = x * 2;
+            uint32_t x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+            for (c=0; c<4; c++) {
+                uint32_t sum =
+                    src[(y0 * src_width + x0) * 4 + c] +
+                    src[(y0 * src_width + x1) * 4 + c] +
+                    src[(y1 * src_width + x0) * 4 + c] +
+                    src[(y1 * src_width + x1) * 4 + c];
+                dst[(y * dst_width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+bool texture_file_write(
+        const char* path,
+        enum texture_format format,
+        uint32_t width,
+        uint32_t height,
+        uint32_t mip_levels,
+        uint8_t** level_data)
+{
+    assert(mip_levels <= TEXTURE_MAX_MIP_LEVELS);
+
+    struct texture_file_header header = {
+        .magic = TEXTURE_FILE_MAGIC,
+        .version = TEXTURE_FILE_VERSION,
+        .format = format,
+        .width = width,
+        .height = height,
+        .mip_levels = mip_levels
+    };
+
+    struct texture_file_level levels[TEXTURE_MAX_MIP_LEVELS];
+    uint64_t offset = sizeof(header) + mip_levels * sizeof(levels[0]);
+
+    uint32_t i;
+    for (i=0; i<mip_levels; i++) {
+        uint32_t level_width = width >> i ? width >> i : 1;
+        uint32_t level_height = height >> i ? height >> i : 1;
+        levels[i].offset = offset;
+        levels[i].size = texture_level_size(format, level_width, level_height);
+        offset += levels[i].size;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(levels, sizeof(levels[0]), mip_levels, file) == mip_levels;
+
+    for (i=0; i<mip_levels && written; i++)
+        written = fwrite(level_data[i], 1, levels[i].size, file) == levels[i].size;
+
+    return fclose(file) == 0 && written;
+}
+
+bool texture_file_load(
+        const char* path,
+        struct texture_file* file)
+{
+    struct archive_data source;
+    if (!archive_read_asset(NULL, path, &source)) {
+        memset(file, 0, sizeof(*file));
+        return false;
+    }
+
+    return texture_file_parse(&source, file);
+}
+
+bool texture_file_parse(
+        struct archive_data* source,
+        struct texture_file* file)
+{
+    memset(file, 0, sizeof(*file));
+    file->source = *source;
+    file->data = source->data;
+    file->data_size = source->size;
+    memset(source, 0, sizeof(*source));
+
+    if (file->data_size < sizeof(file->header)) {
+        texture_file_free(file);
+        return false;
+    }
+
+    memcpy(&file->header, file->data, sizeof(file->header));
+
+    struct texture_file_header* header = &file->header;
+    uint64_t table_end = sizeof(*header) +
+        (uint64_t)header->mip_levels * sizeof(file->levels[0]);
+
+    if (header->magic != TEXTURE_FILE_MAGIC ||
+        header->version != TEXTURE_FILE_VERSION ||
+        header->format > TEXTURE_FORMAT_BC5 ||
+        header->width == 0 ||
+        header->height == 0 ||
+        header->mip_levels == 0 ||
+        header->mip_levels > TEXTURE_MAX_MIP_LEVELS ||
+        header->mip_levels > texture_mip_count(header->width, header->height) ||
+        table_end > file->data_size) {
+        texture_file_free(file);
+        return false;
+    }
+
+    memcpy(
+        file->levels,
+        file->data + sizeof(*header),
+        header->mip_levels * sizeof(file->levels[0])
+    );
+
+    // Levels must hold exactly the data the format needs at their size,
+    // the upload builds its copy regions from the dimensions alone
+    uint32_t i;
+    for (i=0; i<header->mip_levels; i++) {
+        uint32_t level_width = header->width >> i ? header->width >> i : 1;
+        uint32_t level_height = header->height >> i ? header->height >> i : 1;
+        uint64_t expected_size = texture_level_size(
+            header->format,
+            level_width,
+            level_height
+        );
+        if (file->levels[i].size != expected_size ||
+            file->levels[i].offset > file->data_size ||
+            file->levels[i].size > file->data_size - file->levels[i].offset) {
+            texture_file_free(file);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void texture_file_free(struct texture_file* file)
+{
+    archive_data_free(&file->source);
+    file->data = NULL;
+    file->data_size = 0;
+}
+
+// Loads cached pixels if the cache entry describes the same source
+static bool texture_cache_read(
+        const char* cache_path,
+        struct texture_cache_header* expected,
+        bool match_hash,
+        struct texture_decode* decode)
+{
+    FILE* fp = fopen(cache_path, "rb");
+    if (!fp)
+        return false;
+
+    struct texture_cache_header header;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1 &&
+        header.magic == TEXTURE_CACHE_MAGIC &&
+        header.version == TEXTURE_CACHE_VERSION &&
+        header.source_size == expected->source_size &&
+        (match_hash ?
+            header.source_hash == expected->source_hash :
+            header.source_mtime == expected->source_mtime);
+
+    if (valid) {
+        size_t size = (size_t)header.width * header.height * 4;
+        decode->pixels = malloc(size);
+        assert(decode->pixels);
+
+        valid = fread(decode->pixels, 1, size, fp) == size;
+        if (valid) {
+            decode->width = header.width;
+            decode->height = header.height;
+        } else {
+            free(decode->pixels);
+            decode->pixels = NULL;
+        }
+    }
+
+    fclose(fp);
+    return valid;
+}
+
+// Written to a temporary file of its own first so a concurrent or
+// interrupted write never leaves a truncated entry behind
+static void texture_cache_write(
+        const char* cache_dir,
+        const char* cache_path,
+        struct texture_cache_header* header,
+        const uint8_t* pixels)
+{
+    if (!util_make_dirs(cache_dir))
+        return;
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", cache_path);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0)
+        return;
+    // mkstemp makes files only the owner can read
+    fchmod(fd, 0644);
+
+    FILE* fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        remove(temp_path);
+        return;
+    }
+
+    size_t size = (size_t)header->width * header->height * 4;
+    bool written = fwrite(header, sizeof(*header), 1, fp) == 1 &&
+        fwrite(pixels, 1, size, fp) == size;
+
+    if (fclose(fp) == 0 && written)
+        rename(temp_path, cache_path);
+    else
+        remove(temp_path);
+}
+
+void texture_decode(void* data)
+{
+    struct texture_decode* decode = data;
+    decode->pixels = NULL;
+    decode->cache_hit = false;
+
+    struct texture_cache_header header = {
+        .magic = TEXTURE_CACHE_MAGIC,
+        .version = TEXTURE_CACHE_VERSION
+    };
+
+    // In-memory sources have no mtime and are always checked by hash
+    if (!decode->source) {
+        struct stat source_stat;
+        if (stat(decode->path, &source_stat) != 0)
+            return;
+
+        header.source_mtime = source_stat.st_mtime;
+        header.source_size = source_stat.st_size;
+    }
+
+    char cache_path[1024];
+    if (decode->cache_dir) {
+        snprintf(
+            cache_path,
+            sizeof(cache_path),
+            "%s/%016llx.rgba",
+            decode->cache_dir,
+            (unsigned long long)util_hash(
+                decode->path,
+                strlen(decode->path),
+                UTIL_FNV1A_SEED
+            )
+        );
+
+        // Unchanged mtime and size, the source doesn't need to be read
+        if (!decode->source &&
+            texture_cache_read(cache_path, &header, false, decode)) {
+            decode->cache_hit = true;
+            return;
+        }
+    }
+
+    uint64_t source_size = decode->source_size;
+    const uint8_t* source = decode->source;
+    struct archive_data source_data = {0};
+    if (!source) {
+        if (!archive_read_asset(NULL, decode->path, &source_data))
+            return;
+        source = source_data.data;
+        source_size = source_data.size;
+    }
+
+    header.source_size = source_size;
+    header.source_hash = util_hash(source, source_size, UTIL_FNV1A_SEED);
+
+    // Touched but identical sources still hit on their content hash
+    if (decode->cache_dir &&
+        texture_cache_read(cache_path, &header, true, decode)) {
+        decode->cache_hit = true;
+        archive_data_free(&source_data);
+
+        // Refresh the entry's mtime so the next load takes the fast path
+        if (!decode->source) {
+            header.width = decode->width;
+            header.height = decode->height;
+            texture_cache_write(decode->cache_dir, cache_path, &header, decode->pixels);
+        }
+        return;
+    }
+
+    int width, height, channels;
+    decode->pixels = stbi_load_from_memory(
+        source,
+        (int)source_size,
+        &width,
+        &height,
+        &channels,
+        STBI_rgb_alpha
+    );
+    archive_data_free(&source_data);
+
+    if (!decode->pixels)
+        return;
+
+    decode->width = width;
+    decode->height = height;
+    header.width = width;
+    header.height = height;
+
+    if (decode->cache_dir)
+        texture_cache_write(decode->cache_dir, cache_path, &header, decode->pixels);
+}
+
+void texture_decode_free(struct texture_decode* decode)
+{
+    // stb_image allocates with malloc, so both paths release with free
+    free(decode->pixels);
+    decode->pixels = NULL;
+}
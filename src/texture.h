@@ -0,0 +1,126 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "archive.h"
+
+// "CTEX" little endian, followed by the header, one level entry per mip
+// and then the level data, largest level first
+#define TEXTURE_FILE_MAGIC 0x58455443
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_MAX_MIP_LEVELS 16
+
+enum texture_format
+{
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC4,
+    TEXTURE_FORMAT_BC5
+};
+
+struct texture_file_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_levels;
+};
+
+// Offsets are from the start of the file
+struct texture_file_level
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Decoded RGBA8 images are cached on disk as this header followed by the
+// pixels, in a file named after the source path's hash
+#define TEXTURE_CACHE_MAGIC 0x48434554
+#define TEXTURE_CACHE_VERSION 1
+
+struct texture_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_mtime;
+    uint64_t source_size;
+    uint64_t source_hash;
+    uint32_t width;
+    uint32_t height;
+};
+
+// One image to decode to RGBA8, cache_dir may be NULL to skip the cache.
+// Source bytes already in memory, e.g. an archive entry, are decoded from
+// source instead of reading path, which then only names the cache entry
+struct texture_decode
+{
+    const char* path;
+    const char* cache_dir;
+    const uint8_t* source;
+    uint64_t source_size;
+    uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    bool cache_hit;
+};
+
+// Level data is read in place from source, which may be a mapping
+struct texture_file
+{
+    struct texture_file_header header;
+    struct texture_file_level levels[TEXTURE_MAX_MIP_LEVELS];
+    const uint8_t* data;
+    uint64_t data_size;
+    struct archive_data source;
+};
+
+uint32_t texture_block_size(enum texture_format format);
+
+uint64_t texture_level_size(
+    enum texture_format format,
+    uint32_t width,
+    uint32_t height
+);
+
+uint32_t texture_mip_count(uint32_t width, uint32_t height);
+
+void texture_downsample(
+    const uint8_t* src,
+    uint32_t src_width,
+    uint32_t src_height,
+    uint8_t* dst
+);
+
+bool texture_file_write(
+    const char* path,
+    enum texture_format format,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mip_levels,
+    uint8_t** level_data
+);
+
+bool texture_file_load(
+    const char* path,
+    struct texture_file* file
+);
+
+// Takes ownership of source, even when it fails to parse
+bool texture_file_parse(
+    struct archive_data* source,
+    struct texture_file* file
+);
+
+void texture_file_free(struct texture_file* file);
+
+// Job function, takes a struct texture_decode
+void texture_decode(void* data);
+
+void texture_decode_free(struct texture_decode* decode);
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "util.h"
+
+bool trace_enabled = false;
+
+static double trace_origin = -1.0;
+
+// Rings are only registered under the mutex, never removed until shutdown
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring* trace_rings[TRACE_MAX_THREADS];
+static uint32_t trace_ring_count;
+
+static __thread struct trace_ring* trace_thread_ring;
+static __thread bool trace_thread_full;
+static __thread const char* trace_thread_name;
+
+// Registers the calling thread's ring on its first event, NULL once every
+// ring is taken
+static struct trace_ring* trace_get_ring(void)
+{
+    if (trace_thread_ring || trace_thread_full)
+        return trace_thread_ring;
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_ring_count < TRACE_MAX_THREADS) {
+        struct trace_ring* ring = calloc(1, sizeof(*ring));
+        assert(ring);
+        ring->thread_id = trace_ring_count;
+        ring->thread_name = trace_thread_name;
+        trace_rings[trace_ring_count++] = ring;
+        trace_thread_ring = ring;
+    } else {
+        trace_thread_full = true;
+    }
+    pthread_mutex_unlock(&trace_mutex);
+
+    return trace_thread_ring;
+}
+
+void trace_enable(bool enabled)
+{
+    if (enabled && trace_origin < 0.0)
+        trace_origin = util_time();
+
+    trace_enabled = enabled;
+}
+
+// Threads that never record don't get a ring, the name is applied when
+// one is registered
+void trace_set_thread_name(const char* name)
+{
+    trace_thread_name = name;
+    if (trace_thread_ring)
+        trace_thread_ring->thread_name = name;
+}
+
+void trace_record(const char* name, double start, double end)
+{
+    struct trace_ring* ring = trace_get_ring();
+    if (!ring)
+        return;
+
+    uint64_t head = ring->head;
+    struct trace_event* event = &ring->events[head % TRACE_RING_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Copies the ring's events out, dropping any the owning thread may have
+// overwritten while they were copied. Returns the number copied
+static uint32_t trace_copy_ring(
+        struct trace_ring* ring,
+        struct trace_event* events,
+        uint64_t* first)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+
+    uint64_t i;
+    for (i=start; i<head; i++)
+        events[i - start] = ring->events[i % TRACE_RING_EVENTS];
+
+    // An event being written now lands on the slot of head + 1 - size
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t valid = end + 1 > TRACE_RING_EVENTS ?
+        end + 1 - TRACE_RING_EVENTS : 0;
+
+    *first = valid > start ? valid - start : 0;
+    return head - start;
+}
+
+bool trace_write(const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    pthread_mutex_lock(&trace_mutex);
+    uint32_t ring_count = trace_ring_count;
+    pthread_mutex_unlock(&trace_mutex);
+
+    struct trace_event* events = malloc(TRACE_RING_EVENTS * sizeof(*events));
+    assert(events);
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    bool first_event = true;
+    uint32_t i;
+    for (i=0; i<ring_count; i++) {
+        struct trace_ring* ring = trace_rings[i];
+
+        if (ring->thread_name) {
+            fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+                "\"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+                first_event ? "" : ",\n",
+                ring->thread_id
+            );
+            util_write_json_string(fp, ring->thread_name);
+            fprintf(fp, "}}");
+            first_event = false;
+        }
+
+        uint64_t first;
+        uint32_t count = trace_copy_ring(ring, events, &first);
+
+        // Complete events, times in microseconds
+        uint32_t j;
+        for (j=first; j<count; j++) {
+            fprintf(fp, "%s{\"name\": ", first_event ? "" : ",\n");
+            util_write_json_string(fp, events[j].name);
+            fprintf(fp, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                "\"ts\": %.3f, \"dur\": %.3f}",
+                ring->thread_id,
+                (events[j].start - trace_origin) * 1e6,
+                (events[j].end - events[j].start) * 1e6
+            );
+            first_event = false;
+        }
+    }
+
+    fprintf(fp, "\n]}\n");
+    free(events);
+
+    return fclose(fp) == 0;
+}
+
+void trace_shutdown(void)
+{
+    trace_enabled = false;
+
+    pthread_mutex_lock(&trace_mutex);
+    uint32_t i;
+    for (i=0; i<trace_ring_count; i++)
+        free(trace_rings[i]);
+    trace_ring_count = 0;
+    pthread_mutex_unlock(&trace_mutex);
+
+    trace_thread_ring = NULL;
+}
@@ -0,0 +1,63 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util.h"
+
+#define TRACE_MAX_THREADS 64
+
+// Per thread, once full the oldest events are overwritten
+#define TRACE_RING_EVENTS 8192
+
+struct trace_event
+{
+    const char* name;
+    double start;
+    double end;
+};
+
+// Written only by its own thread, head is published with release stores
+// so a dump from another thread sees complete events
+struct trace_ring
+{
+    struct trace_event events[TRACE_RING_EVENTS];
+    uint64_t head;
+    uint32_t thread_id;
+    const char* thread_name;
+};
+
+struct trace_scope
+{
+    const char* name;
+    double start;
+};
+
+// Checked by every scope, while false a scope costs a branch
+extern bool trace_enabled;
+
+// Scopes nest but can't span threads, names are kept, not copied
+#define TRACE_BEGIN(scope, name) \
+    struct trace_scope scope = {(name), trace_enabled ? util_time() : -1.0}
+
+#define TRACE_END(scope) \
+    do { \
+        if ((scope).start >= 0.0) \
+            trace_record((scope).name, (scope).start, util_time()); \
+    } while (0)
+
+// Timestamps in the trace are relative to the first call
+void trace_enable(bool enabled);
+
+void trace_set_thread_name(const char* name);
+
+void trace_record(const char* name, double start, double end);
+
+// Chrome trace_event JSON, can be written while other threads record
+bool trace_write(const char* path);
+
+// Frees every ring, no thread may be recording
+void trace_shutdown(void);
+
+#endif
@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "util.h"
+
+uint64_t util_hash(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = data;
+    uint64_t hash = seed;
+
+    size_t i;
+    for (i=0; i<size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+double util_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool util_make_dirs(const char* path)
+{
+    char partial[1024];
+    size_t length = strlen(path);
+    if (length >= sizeof(partial))
+        return false;
+
+    memcpy(partial, path, length + 1);
+
+    size_t i;
+    for (i=1; i<=length; i++) {
+        if (partial[i] != '/' && partial[i] != '\0')
+            continue;
+
+        char separator = partial[i];
+        partial[i] = '\0';
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST)
+            return false;
+        partial[i] = separator;
+    }
+
+    return true;
+}
+
+void util_write_json_string(FILE* fp, const char* string)
+{
+    fputc('"', fp);
+    for (; *string; string++) {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*string >= 0x20)
+            fputc(*string, fp);
+    }
+    fputc('"', fp);
+}
@@ -0,0 +1,24 @@
+#ifndef UTIL_H_
+#define UTIL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UTIL_FNV1A_SEED 0xcbf29ce484222325ULL
+
+// 64-bit FNV-1a, pass UTIL_FNV1A_SEED or a previous result to chain
+uint64_t util_hash(const void* data, size_t size, uint64_t seed);
+
+// Monotonic clock in seconds
+double util_time(void);
+
+// Creates every missing directory along path, like mkdir -p
+bool util_make_dirs(const char* path);
+
+// Quoted JSON string, quotes and backslashes escaped and control
+// characters dropped
+void util_write_json_string(FILE* fp, const char* string);
+
+#endif
@@ -0,0 +1,906 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "voxel.h"
+
+#define VOXEL_WORLD_INITIAL_CAPACITY 64
+
+// Strata are this many voxels thick before being bent by noise
+#define VOXEL_STRATA_HEIGHT 16.0f
+#define VOXEL_STRATA_WARP 6.0f
+#define VOXEL_STRATA_FREQUENCY 0.02f
+
+static uint32_t voxel_hash(int32_t x, int32_t y, int32_t z)
+{
+    uint32_t h = (uint32_t)x * 0x8da6b343u ^
+        (uint32_t)y * 0xd8163841u ^
+        (uint32_t)z * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+static bool voxel_chunk_at(
+        const struct voxel_chunk* chunk,
+        int32_t x,
+        int32_t y,
+        int32_t z)
+{
+    return chunk->coord[0] == x &&
+        chunk->coord[1] == y &&
+        chunk->coord[2] == z;
+}
+
+static void voxel_chunk_free_storage(struct voxel_chunk* chunk)
+{
+    free(chunk->palette);
+    free(chunk->data);
+    free(chunk->runs);
+    chunk->palette = NULL;
+    chunk->data = NULL;
+    chunk->runs = NULL;
+    chunk->palette_count = 0;
+    chunk->bits = 0;
+    chunk->run_count = 0;
+}
+
+static uint32_t voxel_packed_read(
+        const uint64_t* data,
+        uint32_t bits,
+        uint32_t index)
+{
+    uint32_t bits_log2 = __builtin_ctz(bits);
+    uint64_t word = data[index >> (6 - bits_log2)];
+    uint32_t shift = (index & ((64u >> bits_log2) - 1)) << bits_log2;
+    return (word >> shift) & ((1u << bits) - 1);
+}
+
+static void voxel_packed_write(
+        uint64_t* data,
+        uint32_t bits,
+        uint32_t index,
+        uint32_t value)
+{
+    uint32_t bits_log2 = __builtin_ctz(bits);
+    uint64_t* word = &data[index >> (6 - bits_log2)];
+    uint32_t shift = (index & ((64u >> bits_log2) - 1)) << bits_log2;
+    uint64_t mask = (uint64_t)((1u << bits) - 1) << shift;
+    *word = (*word & ~mask) | ((uint64_t)value << shift);
+}
+
+// Smallest index width with room for the palette
+static uint32_t voxel_bits_for(uint32_t palette_count)
+{
+    uint32_t bits = 1;
+    while ((1u << bits) < palette_count)
+        bits *= 2;
+    return bits;
+}
+
+static void voxel_chunk_alloc_packed(struct voxel_chunk* chunk, uint32_t bits)
+{
+    chunk->encoding = VOXEL_ENCODING_PACKED;
+    chunk->bits = bits;
+    chunk->palette = malloc((1u << bits) * sizeof(*chunk->palette));
+    chunk->data = calloc(VOXEL_CHUNK_VOLUME / 64 * bits, sizeof(uint64_t));
+    assert(chunk->palette && chunk->data);
+}
+
+// Consecutive voxels are usually the same material, so the last match is
+// checked before searching
+static uint32_t voxel_palette_find(
+        const uint16_t* palette,
+        uint32_t palette_count,
+        uint32_t* last,
+        uint16_t material)
+{
+    if (*last < palette_count && palette[*last] == material)
+        return *last;
+
+    uint32_t i;
+    for (i=0; i<palette_count; i++) {
+        if (palette[i] == material) {
+            *last = i;
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static void voxel_chunk_grow_palette(struct voxel_chunk* chunk)
+{
+    uint32_t bits = chunk->bits * 2;
+    assert(bits <= 16);
+
+    uint64_t* data = calloc(VOXEL_CHUNK_VOLUME / 64 * bits, sizeof(uint64_t));
+    uint16_t* palette = realloc(
+        chunk->palette,
+        (1u << bits) * sizeof(*palette)
+    );
+    assert(data && palette);
+
+    uint32_t i;
+    for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+        voxel_packed_write(
+            data,
+            bits,
+            i,
+            voxel_packed_read(chunk->data, chunk->bits, i)
+        );
+    }
+
+    free(chunk->data);
+    chunk->data = data;
+    chunk->palette = palette;
+    chunk->bits = bits;
+}
+
+// Writes go to packed chunks only, uniform and RLE ones are converted
+static void voxel_chunk_make_packed(struct voxel_chunk* chunk)
+{
+    if (chunk->encoding == VOXEL_ENCODING_PACKED)
+        return;
+
+    if (chunk->encoding == VOXEL_ENCODING_UNIFORM) {
+        voxel_chunk_alloc_packed(chunk, 1);
+        chunk->palette[0] = chunk->uniform;
+        chunk->palette_count = 1;
+        return;
+    }
+
+    uint16_t* materials = malloc(VOXEL_CHUNK_VOLUME * sizeof(*materials));
+    assert(materials);
+    voxel_chunk_unpack(chunk, materials);
+
+    // Every run's material is in the palette, in order of first use
+    uint16_t* palette = malloc(VOXEL_CHUNK_VOLUME * sizeof(*palette));
+    assert(palette);
+    uint32_t palette_count = 0;
+    uint32_t last = 0;
+    uint32_t i;
+    for (i=0; i<chunk->run_count; i++) {
+        uint16_t material = chunk->runs[i].material;
+        if (voxel_palette_find(palette, palette_count, &last, material) ==
+                UINT32_MAX)
+            palette[palette_count++] = material;
+    }
+
+    voxel_chunk_free_storage(chunk);
+    voxel_chunk_alloc_packed(chunk, voxel_bits_for(palette_count));
+    memcpy(chunk->palette, palette, palette_count * sizeof(*palette));
+    chunk->palette_count = palette_count;
+
+    for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+        uint32_t index = voxel_palette_find(
+            chunk->palette,
+            chunk->palette_count,
+            &last,
+            materials[i]
+        );
+        voxel_packed_write(chunk->data, chunk->bits, i, index);
+    }
+
+    free(palette);
+    free(materials);
+}
+
+// First run ending past the index
+static uint32_t voxel_chunk_find_run(
+        const struct voxel_chunk* chunk,
+        uint32_t index)
+{
+    uint32_t low = 0;
+    uint32_t high = chunk->run_count - 1;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        if (chunk->runs[middle].end <= index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+uint16_t voxel_chunk_get(
+        const struct voxel_chunk* chunk,
+        uint32_t x,
+        uint32_t y,
+        uint32_t z)
+{
+    uint32_t index = VOXEL_INDEX(x, y, z);
+
+    switch (chunk->encoding) {
+    case VOXEL_ENCODING_PACKED:
+        return chunk->palette[
+            voxel_packed_read(chunk->data, chunk->bits, index)];
+    case VOXEL_ENCODING_RLE:
+        return chunk->runs[voxel_chunk_find_run(chunk, index)].material;
+    default:
+        return chunk->uniform;
+    }
+}
+
+// Consecutive indices, so RLE only searches for the first run
+static void voxel_chunk_read_row(
+        const struct voxel_chunk* chunk,
+        uint32_t index,
+        uint32_t count,
+        uint16_t* out)
+{
+    uint32_t i;
+    switch (chunk->encoding) {
+    case VOXEL_ENCODING_PACKED:
+        for (i=0; i<count; i++) {
+            out[i] = chunk->palette[
+                voxel_packed_read(chunk->data, chunk->bits, index + i)];
+        }
+        break;
+    case VOXEL_ENCODING_RLE: {
+        uint32_t run = voxel_chunk_find_run(chunk, index);
+        for (i=0; i<count; i++) {
+            if (chunk->runs[run].end <= index + i)
+                run++;
+            out[i] = chunk->runs[run].material;
+        }
+        break;
+    }
+    default:
+        for (i=0; i<count; i++)
+            out[i] = chunk->uniform;
+        break;
+    }
+}
+
+void voxel_chunk_set(
+        struct voxel_chunk* chunk,
+        uint32_t x,
+        uint32_t y,
+        uint32_t z,
+        uint16_t material)
+{
+    if (voxel_chunk_get(chunk, x, y, z) == material)
+        return;
+
+    voxel_chunk_make_packed(chunk);
+
+    uint32_t last = 0;
+    uint32_t index = voxel_palette_find(
+        chunk->palette,
+        chunk->palette_count,
+        &last,
+        material
+    );
+    if (index == UINT32_MAX) {
+        if (chunk->palette_count == 1u << chunk->bits)
+            voxel_chunk_grow_palette(chunk);
+        index = chunk->palette_count++;
+        chunk->palette[index] = material;
+    }
+
+    voxel_packed_write(chunk->data, chunk->bits, VOXEL_INDEX(x, y, z), index);
+}
+
+void voxel_chunk_unpack(const struct voxel_chunk* chunk, uint16_t* out)
+{
+    uint32_t i, j;
+    switch (chunk->encoding) {
+    case VOXEL_ENCODING_PACKED:
+        for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+            out[i] = chunk->palette[
+                voxel_packed_read(chunk->data, chunk->bits, i)];
+        }
+        break;
+    case VOXEL_ENCODING_RLE:
+        i = 0;
+        for (j=0; j<chunk->run_count; j++) {
+            for (; i<chunk->runs[j].end; i++)
+                out[i] = chunk->runs[j].material;
+        }
+        break;
+    default:
+        for (i=0; i<VOXEL_CHUNK_VOLUME; i++)
+            out[i] = chunk->uniform;
+        break;
+    }
+}
+
+void voxel_chunk_pack(struct voxel_chunk* chunk, const uint16_t* materials)
+{
+    voxel_chunk_free_storage(chunk);
+
+    // Sized for a different material in every voxel
+    uint16_t* palette = malloc(VOXEL_CHUNK_VOLUME * sizeof(*palette));
+    assert(palette);
+    uint32_t palette_count = 0;
+    uint32_t run_count = 0;
+    uint32_t last = 0;
+
+    uint32_t i;
+    for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+        if (i == 0 || materials[i] != materials[i - 1]) {
+            run_count++;
+            if (voxel_palette_find(palette, palette_count, &last,
+                    materials[i]) == UINT32_MAX)
+                palette[palette_count++] = materials[i];
+        }
+    }
+
+    if (palette_count == 1) {
+        chunk->encoding = VOXEL_ENCODING_UNIFORM;
+        chunk->uniform = materials[0];
+        free(palette);
+        return;
+    }
+
+    uint32_t bits = voxel_bits_for(palette_count);
+    size_t packed_bytes = (1u << bits) * sizeof(*palette) +
+        VOXEL_CHUNK_VOLUME / 8 * bits;
+    size_t rle_bytes = run_count * sizeof(struct voxel_run);
+
+    if (rle_bytes < packed_bytes) {
+        chunk->encoding = VOXEL_ENCODING_RLE;
+        chunk->runs = malloc(run_count * sizeof(*chunk->runs));
+        assert(chunk->runs);
+        chunk->run_count = 0;
+        for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+            if (i == 0 || materials[i] != materials[i - 1]) {
+                chunk->runs[chunk->run_count].material = materials[i];
+                chunk->run_count++;
+            }
+            chunk->runs[chunk->run_count - 1].end = i + 1;
+        }
+        free(palette);
+        return;
+    }
+
+    voxel_chunk_alloc_packed(chunk, bits);
+    memcpy(chunk->palette, palette, palette_count * sizeof(*palette));
+    chunk->palette_count = palette_count;
+    free(palette);
+
+    for (i=0; i<VOXEL_CHUNK_VOLUME; i++) {
+        uint32_t index = voxel_palette_find(
+            chunk->palette,
+            chunk->palette_count,
+            &last,
+            materials[i]
+        );
+        voxel_packed_write(chunk->data, chunk->bits, i, index);
+    }
+}
+
+void voxel_chunk_compact(struct voxel_chunk* chunk)
+{
+    if (chunk->encoding == VOXEL_ENCODING_UNIFORM)
+        return;
+
+    uint16_t* materials = malloc(VOXEL_CHUNK_VOLUME * sizeof(*materials));
+    assert(materials);
+
+    voxel_chunk_unpack(chunk, materials);
+    voxel_chunk_pack(chunk, materials);
+
+    free(materials);
+}
+
+size_t voxel_chunk_bytes(const struct voxel_chunk* chunk)
+{
+    size_t bytes = sizeof(*chunk);
+
+    if (chunk->encoding == VOXEL_ENCODING_PACKED) {
+        bytes += (1u << chunk->bits) * sizeof(*chunk->palette);
+        bytes += VOXEL_CHUNK_VOLUME / 8 * chunk->bits;
+    } else if (chunk->encoding == VOXEL_ENCODING_RLE) {
+        bytes += chunk->run_count * sizeof(*chunk->runs);
+    }
+
+    return bytes;
+}
+
+void voxel_chunk_generate(struct voxel_chunk* chunk, const struct cave* cave)
+{
+    float* x = malloc(VOXEL_CHUNK_VOLUME * sizeof(float));
+    float* y = malloc(VOXEL_CHUNK_VOLUME * sizeof(float));
+    float* z = malloc(VOXEL_CHUNK_VOLUME * sizeof(float));
+    float* density = malloc(VOXEL_CHUNK_VOLUME * sizeof(float));
+    uint16_t* materials = malloc(VOXEL_CHUNK_VOLUME * sizeof(*materials));
+    assert(x && y && z && density && materials);
+
+    float origin[3];
+    uint32_t i, j, k;
+    for (j=0; j<3; j++)
+        origin[j] = (float)(chunk->coord[j] * VOXEL_CHUNK_SIZE);
+
+    for (j=0; j<VOXEL_CHUNK_SIZE; j++) {
+        for (k=0; k<VOXEL_CHUNK_SIZE; k++) {
+            for (i=0; i<VOXEL_CHUNK_SIZE; i++) {
+                uint32_t index = VOXEL_INDEX(i, j, k);
+                x[index] = origin[0] + i;
+                y[index] = origin[1] + j;
+                z[index] = origin[2] + k;
+            }
+        }
+    }
+
+    // The whole chunk in one batch, so worms are only generated once
+    cave_density_batch(cave, x, y, z, density, VOXEL_CHUNK_VOLUME);
+
+    // Strata bend with the same low frequency noise that warps the caves
+    float strata_offset[VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE];
+    for (k=0; k<VOXEL_CHUNK_SIZE; k++) {
+        for (i=0; i<VOXEL_CHUNK_SIZE; i++) {
+            strata_offset[k * VOXEL_CHUNK_SIZE + i] = VOXEL_STRATA_WARP *
+                noise_simplex(
+                    &cave->warp_noise[0],
+                    (origin[0] + i) * VOXEL_STRATA_FREQUENCY,
+                    0.0f,
+                    (origin[2] + k) * VOXEL_STRATA_FREQUENCY
+                );
+        }
+    }
+
+    static const uint16_t strata[] = {
+        VOXEL_MATERIAL_ROCK,
+        VOXEL_MATERIAL_SHALE,
+        VOXEL_MATERIAL_ROCK,
+        VOXEL_MATERIAL_LIMESTONE
+    };
+
+    for (j=0; j<VOXEL_CHUNK_SIZE; j++) {
+        for (k=0; k<VOXEL_CHUNK_SIZE; k++) {
+            for (i=0; i<VOXEL_CHUNK_SIZE; i++) {
+                uint32_t index = VOXEL_INDEX(i, j, k);
+                if (density[index] <= 0.0f) {
+                    materials[index] = VOXEL_MATERIAL_AIR;
+                    continue;
+                }
+
+                float height = y[index] +
+                    strata_offset[k * VOXEL_CHUNK_SIZE + i];
+                int32_t layer = (int32_t)floorf(height / VOXEL_STRATA_HEIGHT);
+                materials[index] = strata[layer & 3];
+            }
+        }
+    }
+
+    voxel_chunk_pack(chunk, materials);
+
+    free(materials);
+    free(density);
+    free(z);
+    free(y);
+    free(x);
+}
+
+void voxel_world_init(struct voxel_world* world)
+{
+    world->capacity = VOXEL_WORLD_INITIAL_CAPACITY;
+    world->chunk_count = 0;
+    world->slots = calloc(world->capacity, sizeof(*world->slots));
+    assert(world->slots);
+}
+
+void voxel_world_destroy(struct voxel_world* world)
+{
+    uint32_t i;
+    for (i=0; i<world->capacity; i++) {
+        if (world->slots[i]) {
+            voxel_chunk_free_storage(world->slots[i]);
+            free(world->slots[i]);
+        }
+    }
+
+    free(world->slots);
+    world->slots = NULL;
+    world->capacity = 0;
+    world->chunk_count = 0;
+}
+
+// Slot holding the chunk, or the empty slot it would go in
+static uint32_t voxel_world_slot(
+        const struct voxel_world* world,
+        int32_t chunk_x,
+        int32_t chunk_y,
+        int32_t chunk_z)
+{
+    uint32_t mask = world->capacity - 1;
+    uint32_t slot = voxel_hash(chunk_x, chunk_y, chunk_z) & mask;
+    while (world->slots[slot] &&
+            !voxel_chunk_at(world->slots[slot], chunk_x, chunk_y, chunk_z))
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+struct voxel_chunk* voxel_world_find(
+        const struct voxel_world* world,
+        int32_t chunk_x,
+        int32_t chunk_y,
+        int32_t chunk_z)
+{
+    return world->slots[voxel_world_slot(world, chunk_x, chunk_y, chunk_z)];
+}
+
+// Kept at most half full so probes stay short
+static void voxel_world_grow(struct voxel_world* world)
+{
+    struct voxel_chunk** slots = world->slots;
+    uint32_t capacity = world->capacity;
+
+    world->capacity *= 2;
+    world->slots = calloc(world->capacity, sizeof(*world->slots));
+    assert(world->slots);
+
+    uint32_t i;
+    for (i=0; i<capacity; i++) {
+        struct voxel_chunk* chunk = slots[i];
+        if (!chunk)
+            continue;
+
+        uint32_t slot = voxel_world_slot(
+            world,
+            chunk->coord[0],
+            chunk->coord[1],
+            chunk->coord[2]
+        );
+        world->slots[slot] = chunk;
+    }
+
+    free(slots);
+}
+
+struct voxel_chunk* voxel_world_add(
+        struct voxel_world* world,
+        int32_t chunk_x,
+        int32_t chunk_y,
+        int32_t chunk_z,
+        uint16_t material)
+{
+    struct voxel_chunk* chunk = voxel_world_find(
+        world,
+        chunk_x,
+        chunk_y,
+        chunk_z
+    );
+    if (chunk)
+        return chunk;
+
+    if ((world->chunk_count + 1) * 2 > world->capacity)
+        voxel_world_grow(world);
+
+    chunk = calloc(1, sizeof(*chunk));
+    assert(chunk);
+    chunk->coord[0] = chunk_x;
+    chunk->coord[1] = chunk_y;
+    chunk->coord[2] = chunk_z;
+    chunk->encoding = VOXEL_ENCODING_UNIFORM;
+    chunk->uniform = material;
+
+    uint32_t slot = voxel_world_slot(world, chunk_x, chunk_y, chunk_z);
+    world->slots[slot] = chunk;
+    world->chunk_count++;
+
+    return chunk;
+}
+
+void voxel_world_remove(
+        struct voxel_world* world,
+        int32_t chunk_x,
+        int32_t chunk_y,
+        int32_t chunk_z)
+{
+    uint32_t mask = world->capacity - 1;
+    uint32_t slot = voxel_world_slot(world, chunk_x, chunk_y, chunk_z);
+    struct voxel_chunk* chunk = world->slots[slot];
+    if (!chunk)
+        return;
+
+    voxel_chunk_free_storage(chunk);
+    free(chunk);
+    world->slots[slot] = NULL;
+    world->chunk_count--;
+
+    // Shifts back every following chunk whose probe passed the emptied
+    // slot, rather than leaving tombstones
+    uint32_t next = slot;
+    for (;;) {
+        next = (next + 1) & mask;
+        struct voxel_chunk* moved = world->slots[next];
+        if (!moved)
+            break;
+
+        uint32_t home = voxel_hash(
+            moved->coord[0],
+            moved->coord[1],
+            moved->coord[2]
+        ) & mask;
+
+        // Stays if its home lies cyclically in (slot, next]
+        bool stays = slot <= next ?
+            (home > slot && home <= next) :
+            (home > slot || home <= next);
+        if (stays)
+            continue;
+
+        world->slots[slot] = moved;
+        world->slots[next] = NULL;
+        slot = next;
+    }
+}
+
+uint16_t voxel_world_get(
+        const struct voxel_world* world,
+        int32_t x,
+        int32_t y,
+        int32_t z)
+{
+    const struct voxel_chunk* chunk = voxel_world_find(
+        world,
+        x >> VOXEL_CHUNK_SHIFT,
+        y >> VOXEL_CHUNK_SHIFT,
+        z >> VOXEL_CHUNK_SHIFT
+    );
+    if (!chunk)
+        return VOXEL_MATERIAL_AIR;
+
+    return voxel_chunk_get(
+        chunk,
+        x & VOXEL_CHUNK_MASK,
+        y & VOXEL_CHUNK_MASK,
+        z & VOXEL_CHUNK_MASK
+    );
+}
+
+void voxel_world_set(
+        struct voxel_world* world,
+        int32_t x,
+        int32_t y,
+        int32_t z,
+        uint16_t material)
+{
+    struct voxel_chunk* chunk = voxel_world_add(
+        world,
+        x >> VOXEL_CHUNK_SHIFT,
+        y >> VOXEL_CHUNK_SHIFT,
+        z >> VOXEL_CHUNK_SHIFT,
+        VOXEL_MATERIAL_AIR
+    );
+
+    voxel_chunk_set(
+        chunk,
+        x & VOXEL_CHUNK_MASK,
+        y & VOXEL_CHUNK_MASK,
+        z & VOXEL_CHUNK_MASK,
+        material
+    );
+}
+
+void voxel_world_read(
+        const struct voxel_world* world,
+        const int32_t* min,
+        const uint32_t* size,
+        uint16_t* out)
+{
+    int32_t max[3];
+    int32_t chunk_min[3], chunk_max[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        max[j] = min[j] + (int32_t)size[j] - 1;
+        chunk_min[j] = min[j] >> VOXEL_CHUNK_SHIFT;
+        chunk_max[j] = max[j] >> VOXEL_CHUNK_SHIFT;
+    }
+
+    int32_t cx, cy, cz;
+    for (cy=chunk_min[1]; cy<=chunk_max[1]; cy++) {
+        for (cz=chunk_min[2]; cz<=chunk_max[2]; cz++) {
+            for (cx=chunk_min[0]; cx<=chunk_max[0]; cx++) {
+                const struct voxel_chunk* chunk = voxel_world_find(
+                    world,
+                    cx,
+                    cy,
+                    cz
+                );
+
+                // Overlap of the box with this chunk, in world voxels
+                int32_t lo[3], hi[3];
+                int32_t chunk_coord[3] = {cx, cy, cz};
+                for (j=0; j<3; j++) {
+                    int32_t base = chunk_coord[j] * VOXEL_CHUNK_SIZE;
+                    lo[j] = min[j] > base ? min[j] : base;
+                    hi[j] = max[j] < base + VOXEL_CHUNK_MASK ?
+                        max[j] : base + VOXEL_CHUNK_MASK;
+                }
+
+                // Rows along x are consecutive voxels of the chunk
+                uint32_t count = hi[0] - lo[0] + 1;
+                int32_t x, y, z;
+                for (y=lo[1]; y<=hi[1]; y++) {
+                    for (z=lo[2]; z<=hi[2]; z++) {
+                        uint16_t* row = &out[
+                            ((size_t)(y - min[1]) * size[2] + (z - min[2])) *
+                                size[0] + (lo[0] - min[0])];
+
+                        if (!chunk) {
+                            for (x=0; x<(int32_t)count; x++)
+                                row[x] = VOXEL_MATERIAL_AIR;
+                            continue;
+                        }
+
+                        voxel_chunk_read_row(
+                            chunk,
+                            VOXEL_INDEX(
+                                lo[0] & VOXEL_CHUNK_MASK,
+                                y & VOXEL_CHUNK_MASK,
+                                z & VOXEL_CHUNK_MASK
+                            ),
+                            count,
+                            row
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
+
+uint16_t voxel_stand_in(const uint16_t* materials)
+{
+    // Most blocks are all one material, inside rock or open space
+    uint32_t i, j;
+    for (i=1; i<8 && materials[i] == materials[0]; i++)
+        ;
+    if (i == 8)
+        return materials[0];
+
+    uint16_t best = VOXEL_MATERIAL_AIR;
+    uint32_t best_count = 0;
+    for (i=0; i<8; i++) {
+        uint32_t count = 0;
+        for (j=0; j<8; j++)
+            count += materials[j] == materials[i];
+
+        if (count > best_count ||
+            (count == best_count && best == VOXEL_MATERIAL_AIR)) {
+            best = materials[i];
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+// Grows the box to hold the voxel
+static void voxel_box_add(int32_t* min, int32_t* max, const int32_t* voxel)
+{
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        min[j] = voxel[j] < min[j] ? voxel[j] : min[j];
+        max[j] = voxel[j] > max[j] ? voxel[j] : max[j];
+    }
+}
+
+bool voxel_world_edit(
+        struct voxel_world* world,
+        const struct voxel_edit* edit,
+        int32_t* changed_min,
+        int32_t* changed_max)
+{
+    // Voxels whose centres, half a voxel in from their corner, are in the
+    // shape's bounds
+    int32_t min[3], max[3];
+    int32_t chunk_min[3], chunk_max[3];
+    float inverse_extent[3];
+    uint32_t j;
+    for (j=0; j<3; j++) {
+        changed_min[j] = INT32_MAX;
+        changed_max[j] = INT32_MIN;
+    }
+    for (j=0; j<3; j++) {
+        assert(edit->extent[j] > 0.0f);
+        min[j] = (int32_t)ceilf(edit->center[j] - edit->extent[j] - 0.5f);
+        max[j] = (int32_t)floorf(edit->center[j] + edit->extent[j] - 0.5f);
+        if (max[j] < min[j])
+            return false;
+
+        chunk_min[j] = min[j] >> VOXEL_CHUNK_SHIFT;
+        chunk_max[j] = max[j] >> VOXEL_CHUNK_SHIFT;
+        inverse_extent[j] = 1.0f / edit->extent[j];
+    }
+
+    // Each chunk is unpacked, edited and packed again, so a big edit costs
+    // the same per voxel as a small one and leaves the best encoding
+    uint16_t* materials = NULL;
+    int32_t cx, cy, cz;
+    for (cy=chunk_min[1]; cy<=chunk_max[1]; cy++) {
+        for (cz=chunk_min[2]; cz<=chunk_max[2]; cz++) {
+            for (cx=chunk_min[0]; cx<=chunk_max[0]; cx++) {
+                struct voxel_chunk* chunk = voxel_world_find(
+                    world,
+                    cx,
+                    cy,
+                    cz
+                );
+                if (!chunk || (chunk->encoding == VOXEL_ENCODING_UNIFORM &&
+                        chunk->uniform == edit->material))
+                    continue;
+
+                int32_t lo[3], hi[3];
+                int32_t chunk_coord[3] = {cx, cy, cz};
+                for (j=0; j<3; j++) {
+                    int32_t base = chunk_coord[j] * VOXEL_CHUNK_SIZE;
+                    lo[j] = min[j] > base ? min[j] : base;
+                    hi[j] = max[j] < base + VOXEL_CHUNK_MASK ?
+                        max[j] : base + VOXEL_CHUNK_MASK;
+                }
+
+                if (!materials) {
+                    materials = malloc(
+                        VOXEL_CHUNK_VOLUME * sizeof(*materials)
+                    );
+                    assert(materials);
+                }
+                voxel_chunk_unpack(chunk, materials);
+
+                bool changed = false;
+                int32_t voxel[3];
+                for (voxel[1]=lo[1]; voxel[1]<=hi[1]; voxel[1]++) {
+                    float dy = (voxel[1] + 0.5f - edit->center[1]) *
+                        inverse_extent[1];
+                    for (voxel[2]=lo[2]; voxel[2]<=hi[2]; voxel[2]++) {
+                        float dz = (voxel[2] + 0.5f - edit->center[2]) *
+                            inverse_extent[2];
+                        for (voxel[0]=lo[0]; voxel[0]<=hi[0]; voxel[0]++) {
+                            float dx = (voxel[0] + 0.5f - edit->center[0]) *
+                                inverse_extent[0];
+                            if (edit->shape == VOXEL_SHAPE_SPHERE &&
+                                    dx * dx + dy * dy + dz * dz > 1.0f)
+                                continue;
+
+                            uint16_t* material = &materials[VOXEL_INDEX(
+                                voxel[0] & VOXEL_CHUNK_MASK,
+                                voxel[1] & VOXEL_CHUNK_MASK,
+                                voxel[2] & VOXEL_CHUNK_MASK
+                            )];
+                            if (*material == edit->material)
+                                continue;
+
+                            *material = edit->material;
+                            voxel_box_add(changed_min, changed_max, voxel);
+                            changed = true;
+                        }
+                    }
+                }
+
+                if (changed)
+                    voxel_chunk_pack(chunk, materials);
+            }
+        }
+    }
+
+    free(materials);
+    return changed_min[0] <= changed_max[0];
+}
+
+void voxel_world_get_stats(
+        const struct voxel_world* world,
+        struct voxel_world_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->bytes = world->capacity * sizeof(*world->slots);
+
+    uint32_t i;
+    for (i=0; i<world->capacity; i++) {
+        const struct voxel_chunk* chunk = world->slots[i];
+        if (!chunk)
+            continue;
+
+        stats->chunk_count++;
+        stats->encoding_counts[chunk->encoding]++;
+        stats->bytes += voxel_chunk_bytes(chunk);
+    }
+}
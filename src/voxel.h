@@ -0,0 +1,195 @@
+#ifndef VOXEL_H_
+#define VOXEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "cave.h"
+
+#define VOXEL_CHUNK_SHIFT 5
+#define VOXEL_CHUNK_SIZE (1 << VOXEL_CHUNK_SHIFT)
+#define VOXEL_CHUNK_MASK (VOXEL_CHUNK_SIZE - 1)
+#define VOXEL_CHUNK_VOLUME \
+    (VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE)
+
+// Materials index a palette per chunk, 0 is always open space
+#define VOXEL_MATERIAL_AIR 0
+#define VOXEL_MATERIAL_ROCK 1
+#define VOXEL_MATERIAL_SHALE 2
+#define VOXEL_MATERIAL_LIMESTONE 3
+
+// Voxels within a chunk are ordered x, then z, then y, so the horizontal
+// layers caves tend to have are contiguous runs
+#define VOXEL_INDEX(x, y, z) \
+    ((((y) << VOXEL_CHUNK_SHIFT | (z)) << VOXEL_CHUNK_SHIFT) | (x))
+
+enum voxel_encoding
+{
+    // One material, no storage beyond the chunk itself
+    VOXEL_ENCODING_UNIFORM,
+    // Palette indices of 1, 2, 4, 8 or 16 bits, never straddling words
+    VOXEL_ENCODING_PACKED,
+    // Runs in index order, read with a binary search and unpacked on the
+    // first write
+    VOXEL_ENCODING_RLE
+};
+
+struct voxel_run
+{
+    // Index one past the run's last voxel
+    uint16_t end;
+    uint16_t material;
+};
+
+struct voxel_chunk
+{
+    int32_t coord[3];
+    enum voxel_encoding encoding;
+    uint16_t uniform;
+    // Packed, palette has room for 1 << bits materials
+    uint16_t* palette;
+    uint32_t palette_count;
+    uint32_t bits;
+    uint64_t* data;
+    // RLE
+    struct voxel_run* runs;
+    uint32_t run_count;
+};
+
+// Open addressed on the chunk coordinate, with linear probing. Lookups
+// may run on several threads at once, any change needs them stopped
+struct voxel_world
+{
+    struct voxel_chunk** slots;
+    uint32_t capacity;
+    uint32_t chunk_count;
+};
+
+enum voxel_shape
+{
+    // Ellipsoid, a sphere when the extents are equal
+    VOXEL_SHAPE_SPHERE,
+    VOXEL_SHAPE_BOX
+};
+
+// Voxels whose centres fall inside the shape are set to the material,
+// carving is filling with air. Extents are half sizes in voxels
+struct voxel_edit
+{
+    enum voxel_shape shape;
+    float center[3];
+    float extent[3];
+    uint16_t material;
+};
+
+struct voxel_world_stats
+{
+    uint32_t chunk_count;
+    uint32_t encoding_counts[3];
+    uint64_t bytes;
+};
+
+void voxel_world_init(struct voxel_world* world);
+
+void voxel_world_destroy(struct voxel_world* world);
+
+struct voxel_chunk* voxel_world_find(
+    const struct voxel_world* world,
+    int32_t chunk_x,
+    int32_t chunk_y,
+    int32_t chunk_z
+);
+
+// Returns the existing chunk if there is one, otherwise adds one filled
+// with the material
+struct voxel_chunk* voxel_world_add(
+    struct voxel_world* world,
+    int32_t chunk_x,
+    int32_t chunk_y,
+    int32_t chunk_z,
+    uint16_t material
+);
+
+void voxel_world_remove(
+    struct voxel_world* world,
+    int32_t chunk_x,
+    int32_t chunk_y,
+    int32_t chunk_z
+);
+
+// World voxel coordinates, missing chunks read as air
+uint16_t voxel_world_get(
+    const struct voxel_world* world,
+    int32_t x,
+    int32_t y,
+    int32_t z
+);
+
+// Adds an air filled chunk when the voxel's chunk is missing
+void voxel_world_set(
+    struct voxel_world* world,
+    int32_t x,
+    int32_t y,
+    int32_t z,
+    uint16_t material
+);
+
+// Copies a box of materials out in the same x, z, y order, a chunk at a
+// time. Meshers read their chunk plus its borders this way
+void voxel_world_read(
+    const struct voxel_world* world,
+    const int32_t* min,
+    const uint32_t* size,
+    uint16_t* out
+);
+
+// Material for a block of eight sampled as one: the most common, rock
+// winning ties against air so thin walls stay
+uint16_t voxel_stand_in(const uint16_t* materials);
+
+// Only chunks already in the world are changed, the rest of the shape is
+// dropped. Returns false when no voxel changed, otherwise the box of those
+// that did in world voxels, min and max inclusive
+bool voxel_world_edit(
+    struct voxel_world* world,
+    const struct voxel_edit* edit,
+    int32_t* changed_min,
+    int32_t* changed_max
+);
+
+void voxel_world_get_stats(
+    const struct voxel_world* world,
+    struct voxel_world_stats* stats
+);
+
+uint16_t voxel_chunk_get(
+    const struct voxel_chunk* chunk,
+    uint32_t x,
+    uint32_t y,
+    uint32_t z
+);
+
+void voxel_chunk_set(
+    struct voxel_chunk* chunk,
+    uint32_t x,
+    uint32_t y,
+    uint32_t z,
+    uint16_t material
+);
+
+// Decodes all VOXEL_CHUNK_VOLUME materials
+void voxel_chunk_unpack(const struct voxel_chunk* chunk, uint16_t* out);
+
+// Replaces the contents with the smallest encoding of the materials
+void voxel_chunk_pack(struct voxel_chunk* chunk, const uint16_t* materials);
+
+// Drops unused palette entries and re-picks the encoding, for after edits
+void voxel_chunk_compact(struct voxel_chunk* chunk);
+
+size_t voxel_chunk_bytes(const struct voxel_chunk* chunk);
+
+// Rock wherever the cave's density is positive, in strata by height
+void voxel_chunk_generate(struct voxel_chunk* chunk, const struct cave* cave);
+
+#endif
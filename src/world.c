@@ -0,0 +1,1093 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "world.h"
+#include "util.h"
+#include "trace.h"
+
+// Chunks on each side of the camera's chunk that are ever looked at
+#define WORLD_WINDOW ((int32_t)WORLD_VOXEL_RADIUS + 1)
+#define WORLD_WINDOW_SIZE (2 * WORLD_WINDOW + 1)
+
+static struct world_chunk* world_slot(
+        struct world* world,
+        int32_t x,
+        int32_t y,
+        int32_t z)
+{
+    uint32_t mask = WORLD_GRID - 1;
+    uint32_t index = (((uint32_t)y & mask) << WORLD_GRID_SHIFT |
+        ((uint32_t)z & mask)) << WORLD_GRID_SHIFT | ((uint32_t)x & mask);
+    return &world->chunks[index];
+}
+
+// NULL unless the chunk itself holds the slot
+static struct world_chunk* world_find(
+        struct world* world,
+        int32_t x,
+        int32_t y,
+        int32_t z)
+{
+    struct world_chunk* chunk = world_slot(world, x, y, z);
+    if (chunk->state == WORLD_CHUNK_UNLOADED ||
+        chunk->coord[0] != x ||
+        chunk->coord[1] != y ||
+        chunk->coord[2] != z) {
+        return NULL;
+    }
+
+    return chunk;
+}
+
+// Eye to the chunk's centre in chunks, scaled down for chunks in view
+static float world_priority(
+        const float* eye,
+        const float* forward,
+        const int32_t* coord,
+        float* distance)
+{
+    float offset[3];
+    uint32_t j;
+    for (j=0; j<3; j++)
+        offset[j] = coord[j] + 0.5f - eye[j];
+
+    *distance = sqrtf(
+        offset[0] * offset[0] +
+        offset[1] * offset[1] +
+        offset[2] * offset[2]
+    );
+    if (*distance <= 0.0f)
+        return 0.0f;
+
+    float facing = (offset[0] * forward[0] +
+        offset[1] * forward[1] +
+        offset[2] * forward[2]) / *distance;
+    facing = facing > 0.0f ? facing : 0.0f;
+
+    return *distance * (1.0f - WORLD_VIEW_WEIGHT * facing);
+}
+
+static uint32_t world_lod(float distance)
+{
+    uint32_t lod = 0;
+    float limit = WORLD_LOD_DISTANCE;
+    while (lod < MESHER_MAX_LOD && distance >= limit) {
+        lod++;
+        limit *= 2.0f;
+    }
+
+    return lod;
+}
+
+// Faces whose neighbour is at another level of detail
+static uint32_t world_skirts(
+        struct world* world,
+        const struct world_chunk* chunk)
+{
+    uint32_t skirts = 0;
+    uint32_t axis, high;
+    for (axis=0; axis<3; axis++) {
+        for (high=0; high<2; high++) {
+            int32_t coord[3] = {
+                chunk->coord[0],
+                chunk->coord[1],
+                chunk->coord[2]
+            };
+            coord[axis] += high ? 1 : -1;
+            struct world_chunk* neighbour = world_find(
+                world,
+                coord[0],
+                coord[1],
+                coord[2]
+            );
+            if (neighbour && neighbour->lod != chunk->lod)
+                skirts |= MESHER_SKIRT(axis, high);
+        }
+    }
+
+    return skirts;
+}
+
+// First fit over the free ranges, which are kept in block order
+static bool world_pool_alloc(
+        struct world* world,
+        uint32_t block_count,
+        struct world_range* range)
+{
+    uint32_t i;
+    for (i=0; i<world->free_range_count; i++) {
+        struct world_range* free_range = &world->free_ranges[i];
+        if (free_range->block_count < block_count)
+            continue;
+
+        range->first_block = free_range->first_block;
+        range->block_count = block_count;
+
+        free_range->first_block += block_count;
+        free_range->block_count -= block_count;
+        if (free_range->block_count == 0) {
+            memmove(
+                free_range,
+                free_range + 1,
+                (world->free_range_count - i - 1) * sizeof(*free_range)
+            );
+            world->free_range_count--;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// Merges with the ranges on either side
+static void world_pool_free(struct world* world, struct world_range range)
+{
+    uint32_t i = 0;
+    while (i < world->free_range_count &&
+            world->free_ranges[i].first_block < range.first_block)
+        i++;
+
+    struct world_range* ranges = world->free_ranges;
+    bool joins_previous = i > 0 &&
+        ranges[i - 1].first_block + ranges[i - 1].block_count ==
+            range.first_block;
+    bool joins_next = i < world->free_range_count &&
+        range.first_block + range.block_count == ranges[i].first_block;
+
+    if (joins_previous && joins_next) {
+        ranges[i - 1].block_count += range.block_count + ranges[i].block_count;
+        memmove(
+            &ranges[i],
+            &ranges[i + 1],
+            (world->free_range_count - i - 1) * sizeof(*ranges)
+        );
+        world->free_range_count--;
+    } else if (joins_previous) {
+        ranges[i - 1].block_count += range.block_count;
+    } else if (joins_next) {
+        ranges[i].first_block = range.first_block;
+        ranges[i].block_count += range.block_count;
+    } else {
+        if (world->free_range_count == world->free_range_capacity) {
+            world->free_range_capacity *= 2;
+            world->free_ranges = realloc(
+                world->free_ranges,
+                world->free_range_capacity * sizeof(*world->free_ranges)
+            );
+            assert(world->free_ranges);
+            ranges = world->free_ranges;
+        }
+
+        memmove(
+            &ranges[i + 1],
+            &ranges[i],
+            (world->free_range_count - i) * sizeof(*ranges)
+        );
+        ranges[i] = range;
+        world->free_range_count++;
+    }
+}
+
+// Frames already in flight may still draw the range, it goes back to the
+// pool once this frame's fence is waited on again
+static void world_retire(
+        struct world* world,
+        uint32_t frame,
+        struct world_chunk* chunk)
+{
+    struct world_frame* retiring = &world->frames[frame];
+    if (retiring->retired_count == retiring->retired_capacity) {
+        retiring->retired_capacity = retiring->retired_capacity ?
+            retiring->retired_capacity * 2 : 64;
+        retiring->retired = realloc(
+            retiring->retired,
+            retiring->retired_capacity * sizeof(*retiring->retired)
+        );
+        assert(retiring->retired);
+    }
+
+    retiring->retired[retiring->retired_count++] = chunk->range;
+    chunk->resident = false;
+}
+
+static void world_drop_mesh(
+        struct world* world,
+        uint32_t frame,
+        struct world_chunk* chunk)
+{
+    if (chunk->resident)
+        world_retire(world, frame, chunk);
+    if (chunk->staged)
+        world->arenas[chunk->arena].staged_count--;
+
+    chunk->staged = false;
+    chunk->meshed = false;
+    chunk->edited = false;
+}
+
+static void world_run_job(void* data)
+{
+    struct world_job* job = data;
+    if (job->generate)
+        voxel_chunk_generate(job->chunk->voxels, &job->world->cave);
+    else
+        mesher_run_job(&job->mesh);
+}
+
+void world_init(
+        struct world* world,
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        VkCommandPool command_pool,
+        struct renderer_memory* memory,
+        struct job_pool* jobs,
+        uint32_t frame_count,
+        enum mesher_method method,
+        uint64_t seed)
+{
+    memset(world, 0, sizeof(*world));
+
+    // A kept chunk and one a grid away must never share a slot
+    assert(2 * (WORLD_VOXEL_RADIUS + WORLD_UNLOAD_MARGIN + 1.0f) < WORLD_GRID);
+    assert(frame_count <= WORLD_MAX_FRAMES);
+
+    world->physical_device = physical_device;
+    world->device = device;
+    world->queue = queue;
+    world->command_pool = command_pool;
+    world->memory = memory;
+    world->jobs = jobs;
+    world->method = method;
+    world->frame_count = frame_count;
+    world->arena_count = frame_count + 1;
+
+    struct cave_params params;
+    cave_default_params(&params, seed);
+    cave_init(&world->cave, &params);
+    voxel_world_init(&world->voxels);
+
+    uint32_t grid_volume = WORLD_GRID * WORLD_GRID * WORLD_GRID;
+    world->chunks = calloc(grid_volume, sizeof(*world->chunks));
+    world->candidates = malloc(
+        WORLD_WINDOW_SIZE * WORLD_WINDOW_SIZE * WORLD_WINDOW_SIZE *
+            sizeof(*world->candidates)
+    );
+    world->uploads = malloc(grid_volume * sizeof(*world->uploads));
+    world->draws = malloc(grid_volume * sizeof(*world->draws));
+    assert(world->chunks && world->candidates);
+    assert(world->uploads && world->draws);
+
+    // Staging stays mapped, meshing jobs write straight into it
+    uint32_t i;
+    for (i=0; i<world->arena_count; i++) {
+        struct world_arena* arena = &world->arenas[i];
+        arena->buffer = renderer_get_buffer(
+            physical_device,
+            device,
+            WORLD_ARENA_BYTES,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            memory,
+            RENDERER_MEMORY_STAGING
+        );
+
+        VkResult result;
+        result = vkMapMemory(
+            device,
+            arena->buffer.memory,
+            0,
+            WORLD_ARENA_BYTES,
+            0,
+            &arena->buffer.mapped
+        );
+        assert(result == VK_SUCCESS);
+
+        arena->arena.data = arena->buffer.mapped;
+        arena->arena.capacity = WORLD_ARENA_BYTES;
+    }
+
+    world->pool = renderer_get_buffer(
+        physical_device,
+        device,
+        WORLD_POOL_BYTES,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        memory,
+        RENDERER_MEMORY_MESH
+    );
+
+    world->free_range_capacity = 64;
+    world->free_ranges = malloc(
+        world->free_range_capacity * sizeof(*world->free_ranges)
+    );
+    assert(world->free_ranges);
+    world->free_ranges[0].first_block = 0;
+    world->free_ranges[0].block_count = WORLD_POOL_BYTES / WORLD_POOL_BLOCK;
+    world->free_range_count = 1;
+
+    VkCommandBufferAllocateInfo cmd_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    for (i=0; i<frame_count; i++) {
+        VkResult result;
+        result = vkAllocateCommandBuffers(
+            device,
+            &cmd_alloc_info,
+            &world->frames[i].cmd
+        );
+        assert(result == VK_SUCCESS);
+    }
+}
+
+static void world_finish_batch(struct world* world, uint32_t frame)
+{
+    uint32_t i;
+    for (i=0; i<world->batch_count; i++) {
+        struct world_job* job = &world->batch[i];
+        struct world_chunk* chunk = job->chunk;
+
+        if (job->generate) {
+            chunk->state = WORLD_CHUNK_GENERATED;
+            world->stats.generated++;
+            continue;
+        }
+
+        // Left unmeshed to go again in a later batch
+        chunk->meshing = false;
+        if (chunk->mesh.overflowed)
+            continue;
+
+        chunk->meshed = true;
+        world->stats.meshed++;
+
+        // Nothing to upload, an old mesh stops being drawn right away
+        // unless it goes with the rest of an edit
+        if (chunk->mesh.index_count == 0 && !chunk->edited) {
+            if (chunk->resident)
+                world_retire(world, frame, chunk);
+            continue;
+        }
+
+        chunk->staged = true;
+        world->arenas[chunk->arena].staged_count++;
+    }
+
+    world->batch_count = 0;
+    world->batch_running = false;
+}
+
+// Chunks reading a changed voxel drop any mesh not yet uploaded, the one
+// being drawn stays until the new one replaces it
+static void world_apply_edits(struct world* world)
+{
+    if (world->edit_count == 0)
+        return;
+
+    uint32_t marked = 0;
+    uint32_t i;
+    for (i=0; i<world->edit_count; i++) {
+        int32_t changed_min[3], changed_max[3];
+        if (!voxel_world_edit(
+                &world->voxels,
+                &world->edits[i],
+                changed_min,
+                changed_max))
+            continue;
+
+        // Coarser meshes read further around their chunks
+        uint32_t lod;
+        for (lod=0; lod<=MESHER_MAX_LOD; lod++) {
+            int32_t chunk_min[3], chunk_max[3];
+            mesher_get_dependent_chunks(
+                changed_min,
+                changed_max,
+                lod,
+                chunk_min,
+                chunk_max
+            );
+
+            int32_t x, y, z;
+            for (y=chunk_min[1]; y<=chunk_max[1]; y++) {
+                for (z=chunk_min[2]; z<=chunk_max[2]; z++) {
+                    for (x=chunk_min[0]; x<=chunk_max[0]; x++) {
+                        struct world_chunk* chunk = world_find(world, x, y, z);
+                        if (!chunk || !chunk->meshed || chunk->mesh.lod != lod)
+                            continue;
+
+                        if (chunk->staged)
+                            world->arenas[chunk->arena].staged_count--;
+                        chunk->staged = false;
+                        chunk->meshed = false;
+                        chunk->edited = true;
+                        marked++;
+                    }
+                }
+            }
+        }
+    }
+
+    world->edit_count = 0;
+
+    if (marked > 0)
+        world->applied_clock = world->queued_clock;
+    world->queued_clock.running = false;
+}
+
+// Drops meshes past the margin, and voxels past theirs while no jobs
+// read the store. Collects what waits to be uploaded on the way
+static void world_unload(
+        struct world* world,
+        const float* eye,
+        const float* forward,
+        uint32_t frame)
+{
+    struct world_stats* stats = &world->stats;
+    stats->resident_chunks = 0;
+    stats->resident_bytes = 0;
+    world->upload_count = 0;
+    world->edit_waiting = 0;
+    world->edit_staged = 0;
+
+    uint32_t grid_volume = WORLD_GRID * WORLD_GRID * WORLD_GRID;
+    uint32_t i;
+    for (i=0; i<grid_volume; i++) {
+        struct world_chunk* chunk = &world->chunks[i];
+        if (chunk->state == WORLD_CHUNK_UNLOADED)
+            continue;
+
+        float distance;
+        chunk->priority = world_priority(eye, forward, chunk->coord, &distance);
+
+        uint32_t nearer = world_lod(distance - WORLD_LOD_MARGIN);
+        uint32_t further = world_lod(distance + WORLD_LOD_MARGIN);
+        if (chunk->lod < nearer || chunk->lod > further)
+            chunk->lod = world_lod(distance);
+
+        if (distance > WORLD_LOAD_RADIUS + WORLD_UNLOAD_MARGIN &&
+            !chunk->meshing) {
+            world_drop_mesh(world, frame, chunk);
+        }
+
+        if (distance > WORLD_VOXEL_RADIUS + WORLD_UNLOAD_MARGIN &&
+            !world->batch_running &&
+            chunk->state == WORLD_CHUNK_GENERATED) {
+            voxel_world_remove(
+                &world->voxels,
+                chunk->coord[0],
+                chunk->coord[1],
+                chunk->coord[2]
+            );
+            memset(chunk, 0, sizeof(*chunk));
+            stats->unloads++;
+            continue;
+        }
+
+        if (chunk->staged)
+            world->uploads[world->upload_count++] = chunk;
+        if (chunk->edited && chunk->staged)
+            world->edit_staged++;
+        else if (chunk->edited)
+            world->edit_waiting++;
+        if (chunk->resident) {
+            stats->resident_chunks++;
+            stats->resident_bytes +=
+                (uint64_t)chunk->range.block_count * WORLD_POOL_BLOCK;
+        }
+    }
+
+    stats->staged_chunks = world->upload_count;
+}
+
+static bool world_neighbours_generated(
+        struct world* world,
+        const int32_t* coord)
+{
+    int32_t x, y, z;
+    for (y=-1; y<=1; y++) {
+        for (z=-1; z<=1; z++) {
+            for (x=-1; x<=1; x++) {
+                struct world_chunk* neighbour = world_find(
+                    world,
+                    coord[0] + x,
+                    coord[1] + y,
+                    coord[2] + z
+                );
+                if (!neighbour || neighbour->state != WORLD_CHUNK_GENERATED)
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Edited chunks first, since they're already on screen
+static int world_compare_candidates(const void* a, const void* b)
+{
+    const struct world_candidate* first = a;
+    const struct world_candidate* second = b;
+    if (first->edited != second->edited)
+        return second->edited - first->edited;
+
+    return (first->priority > second->priority) -
+        (first->priority < second->priority);
+}
+
+static int world_compare_chunks(const void* a, const void* b)
+{
+    const struct world_chunk* first = *(struct world_chunk* const*)a;
+    const struct world_chunk* second = *(struct world_chunk* const*)b;
+    if (first->edited != second->edited)
+        return second->edited - first->edited;
+
+    return (first->priority > second->priority) -
+        (first->priority < second->priority);
+}
+
+// Queues the most urgent generating and meshing the window needs, as many
+// as keep every worker busy for about one batch
+static void world_start_batch(
+        struct world* world,
+        const float* eye,
+        const float* forward)
+{
+    int32_t center[3] = {
+        (int32_t)floorf(eye[0]),
+        (int32_t)floorf(eye[1]),
+        (int32_t)floorf(eye[2])
+    };
+
+    uint32_t candidate_count = 0;
+    int32_t x, y, z;
+    for (y=-WORLD_WINDOW; y<=WORLD_WINDOW; y++) {
+        for (z=-WORLD_WINDOW; z<=WORLD_WINDOW; z++) {
+            for (x=-WORLD_WINDOW; x<=WORLD_WINDOW; x++) {
+                struct world_candidate* candidate =
+                    &world->candidates[candidate_count];
+                candidate->coord[0] = center[0] + x;
+                candidate->coord[1] = center[1] + y;
+                candidate->coord[2] = center[2] + z;
+
+                float distance;
+                candidate->priority = world_priority(
+                    eye,
+                    forward,
+                    candidate->coord,
+                    &distance
+                );
+                if (distance > WORLD_VOXEL_RADIUS)
+                    continue;
+
+                // A slot still held by a chunk that left waits for it to
+                // be unloaded
+                struct world_chunk* chunk = world_slot(
+                    world,
+                    candidate->coord[0],
+                    candidate->coord[1],
+                    candidate->coord[2]
+                );
+                candidate->edited = false;
+                if (chunk->state == WORLD_CHUNK_UNLOADED) {
+                    candidate->generate = true;
+                    candidate_count++;
+                    continue;
+                }
+
+                if (chunk != world_find(
+                        world,
+                        candidate->coord[0],
+                        candidate->coord[1],
+                        candidate->coord[2]) ||
+                    chunk->state != WORLD_CHUNK_GENERATED ||
+                    chunk->meshing ||
+                    (distance > WORLD_LOAD_RADIUS && !chunk->edited) ||
+                    (chunk->meshed &&
+                        chunk->mesh.lod == chunk->lod &&
+                        chunk->mesh.skirts == world_skirts(world, chunk)) ||
+                    !world_neighbours_generated(world, chunk->coord)) {
+                    continue;
+                }
+
+                candidate->generate = false;
+                candidate->edited = chunk->edited;
+                candidate_count++;
+            }
+        }
+    }
+
+    if (candidate_count == 0)
+        return;
+
+    qsort(
+        world->candidates,
+        candidate_count,
+        sizeof(*world->candidates),
+        world_compare_candidates
+    );
+
+    // Meshes need an arena that nothing still reads from
+    uint32_t arena = world->arena_count;
+    uint32_t i;
+    for (i=0; i<world->arena_count; i++) {
+        if (world->arenas[i].staged_count == 0 &&
+            world->arenas[i].frame_mask == 0) {
+            arena = i;
+            world->arenas[i].arena.used = 0;
+            break;
+        }
+    }
+
+    // An edit's chunks get a batch to themselves, so they finish together
+    // and nothing else holds them up
+    bool edited = world->candidates[0].edited;
+    uint32_t batch_size = edited ? WORLD_MAX_BATCH : MIN(
+        WORLD_MAX_BATCH,
+        2 * (world->jobs->thread_count + 1)
+    );
+    for (i=0; i<candidate_count && world->batch_count<batch_size; i++) {
+        struct world_candidate* candidate = &world->candidates[i];
+        if (edited && !candidate->edited)
+            break;
+
+        struct world_job* job = &world->batch[world->batch_count];
+        job->world = world;
+        job->generate = candidate->generate;
+
+        if (candidate->generate) {
+            struct world_chunk* chunk = world_slot(
+                world,
+                candidate->coord[0],
+                candidate->coord[1],
+                candidate->coord[2]
+            );
+            memset(chunk, 0, sizeof(*chunk));
+            memcpy(chunk->coord, candidate->coord, sizeof(chunk->coord));
+            chunk->state = WORLD_CHUNK_GENERATING;
+            chunk->voxels = voxel_world_add(
+                &world->voxels,
+                candidate->coord[0],
+                candidate->coord[1],
+                candidate->coord[2],
+                VOXEL_MATERIAL_AIR
+            );
+            job->chunk = chunk;
+        } else {
+            if (arena == world->arena_count)
+                continue;
+
+            struct world_chunk* chunk = world_find(
+                world,
+                candidate->coord[0],
+                candidate->coord[1],
+                candidate->coord[2]
+            );
+
+            // A mesh at the old level of detail is drawn until the new
+            // one replaces it, any still staged is dropped
+            if (chunk->meshed) {
+                if (chunk->staged)
+                    world->arenas[chunk->arena].staged_count--;
+                chunk->staged = false;
+                chunk->meshed = false;
+                world->stats.lod_changes++;
+            }
+
+            chunk->meshing = true;
+            chunk->arena = arena;
+            job->chunk = chunk;
+            job->mesh.world = &world->voxels;
+            job->mesh.method = world->method;
+            job->mesh.coord = chunk->coord;
+            job->mesh.lod = chunk->lod;
+            job->mesh.skirts = world_skirts(world, chunk);
+            job->mesh.arena = &world->arenas[arena].arena;
+            job->mesh.mesh = &chunk->mesh;
+        }
+
+        world->batch_count++;
+    }
+
+    for (i=0; i<world->batch_count; i++) {
+        jobs_submit(
+            world->jobs,
+            &world->batch_group,
+            world_run_job,
+            &world->batch[i]
+        );
+    }
+    world->batch_running = world->batch_count > 0;
+}
+
+// An arena with nothing staged, free once its frames retire
+static bool world_arena_available(struct world* world)
+{
+    uint32_t i;
+    for (i=0; i<world->arena_count; i++) {
+        if (world->arenas[i].staged_count == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Copies staged meshes into the pool nearest first, up to the frame's
+// byte cap, after every edited one whatever its size. A chunk's new mesh
+// replaces its old one in the same frame. Edited meshes wait until the
+// whole edit is staged, so none is drawn beside its neighbours' old ones,
+// unless they fill every arena and the rest could never be meshed
+static void world_upload(struct world* world, uint32_t frame)
+{
+    bool hold_edits = world->edit_waiting > 0;
+    if (hold_edits && world->edit_staged > 0 &&
+        !world_arena_available(world)) {
+        hold_edits = false;
+        world->stats.edit_splits++;
+    }
+
+    qsort(
+        world->uploads,
+        world->upload_count,
+        sizeof(*world->uploads),
+        world_compare_chunks
+    );
+
+    VkCommandBuffer cmd = world->frames[frame].cmd;
+    uint64_t bytes = 0;
+    uint32_t uploads = 0;
+
+    VkResult result;
+    uint32_t i;
+    for (i=0; i<world->upload_count; i++) {
+        struct world_chunk* chunk = world->uploads[i];
+        struct mesher_mesh* mesh = &chunk->mesh;
+        struct world_arena* arena = &world->arenas[chunk->arena];
+
+        if (chunk->edited && hold_edits)
+            continue;
+
+        // Edited away entirely, the old mesh goes with the others
+        if (mesh->index_count == 0) {
+            if (chunk->resident)
+                world_retire(world, frame, chunk);
+            chunk->staged = false;
+            chunk->edited = false;
+            arena->staged_count--;
+            continue;
+        }
+
+        VkDeviceSize vertex_bytes =
+            mesh->vertex_count * sizeof(struct renderer_vertex);
+        VkDeviceSize size = vertex_bytes +
+            mesh->index_count * sizeof(uint32_t);
+        if (!chunk->edited && uploads > 0 &&
+            bytes + size > WORLD_UPLOAD_BYTES_PER_FRAME)
+            break;
+
+        struct world_range range;
+        uint32_t block_count = (size + WORLD_POOL_BLOCK - 1) / WORLD_POOL_BLOCK;
+        if (!world_pool_alloc(world, block_count, &range)) {
+            world->stats.pool_full++;
+            break;
+        }
+
+        if (uploads == 0) {
+            VkCommandBufferBeginInfo cmd_begin_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = NULL,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = NULL
+            };
+            result = vkBeginCommandBuffer(cmd, &cmd_begin_info);
+            assert(result == VK_SUCCESS);
+        }
+
+        // Vertices and indices are contiguous in the arena and the pool
+        VkDeviceSize offset = (VkDeviceSize)range.first_block *
+            WORLD_POOL_BLOCK;
+        VkBufferCopy region = {
+            .srcOffset = mesh->vertex_offset,
+            .dstOffset = offset,
+            .size = size
+        };
+        vkCmdCopyBuffer(
+            cmd,
+            arena->buffer.buffer,
+            world->pool.buffer,
+            1,
+            &region
+        );
+
+        if (chunk->resident)
+            world_retire(world, frame, chunk);
+        chunk->resident = true;
+        chunk->range = range;
+        chunk->vertex_offset = offset / sizeof(struct renderer_vertex);
+        chunk->first_index = (offset + vertex_bytes) / sizeof(uint32_t);
+        chunk->index_count = mesh->index_count;
+        memcpy(chunk->bounds, mesh->bounds, sizeof(chunk->bounds));
+
+        chunk->staged = false;
+        chunk->edited = false;
+        arena->staged_count--;
+        arena->frame_mask |= 1u << frame;
+
+        bytes += size;
+        uploads++;
+    }
+
+    world->stats.uploads += uploads;
+    world->stats.upload_bytes += bytes;
+    world->stats.peak_frame_upload_bytes = MAX(
+        world->stats.peak_frame_upload_bytes,
+        bytes
+    );
+    if (uploads == 0)
+        return;
+
+    // Submitted ahead of the frame's commands, the barrier makes the
+    // copies visible to their vertex input
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+            VK_ACCESS_INDEX_READ_BIT
+    };
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        NULL,
+        0,
+        NULL
+    );
+
+    result = vkEndCommandBuffer(cmd);
+    assert(result == VK_SUCCESS);
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmd,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+    result = vkQueueSubmit(world->queue, 1, &submit_info, VK_NULL_HANDLE);
+    assert(result == VK_SUCCESS);
+}
+
+// Resident chunks in the load radius not entirely behind the camera
+static void world_select_draws(
+        struct world* world,
+        const float* eye,
+        const float* forward)
+{
+    struct world_stats* stats = &world->stats;
+    stats->draw_count = 0;
+    stats->triangle_count = 0;
+
+    int32_t center[3] = {
+        (int32_t)floorf(eye[0]),
+        (int32_t)floorf(eye[1]),
+        (int32_t)floorf(eye[2])
+    };
+    int32_t x, y, z;
+    for (y=-WORLD_WINDOW; y<=WORLD_WINDOW; y++) {
+        for (z=-WORLD_WINDOW; z<=WORLD_WINDOW; z++) {
+            for (x=-WORLD_WINDOW; x<=WORLD_WINDOW; x++) {
+                struct world_chunk* chunk = world_find(
+                    world,
+                    center[0] + x,
+                    center[1] + y,
+                    center[2] + z
+                );
+                if (!chunk || !chunk->resident)
+                    continue;
+
+                float ahead = 0.0f;
+                uint32_t j;
+                for (j=0; j<3; j++) {
+                    ahead += (chunk->bounds[j] / VOXEL_CHUNK_SIZE - eye[j]) *
+                        forward[j];
+                }
+                if (ahead < -chunk->bounds[3] / VOXEL_CHUNK_SIZE)
+                    continue;
+
+                world->draws[stats->draw_count++] = chunk;
+                stats->triangle_count += chunk->index_count / 3;
+            }
+        }
+    }
+}
+
+void world_update(
+        struct world* world,
+        const struct renderer_camera* camera,
+        uint32_t frame)
+{
+    assert(frame < world->frame_count);
+    world->update_count++;
+
+    // The frame's fence was waited on, whatever it freed is unused now
+    struct world_frame* current = &world->frames[frame];
+    uint32_t i;
+    for (i=0; i<current->retired_count; i++)
+        world_pool_free(world, current->retired[i]);
+    current->retired_count = 0;
+    for (i=0; i<world->arena_count; i++)
+        world->arenas[i].frame_mask &= ~(1u << frame);
+
+    // A running batch is left to the workers, edits and all wait for it
+    // to finish rather than hold up the frame
+    if (world->batch_running && jobs_done(world->jobs, &world->batch_group)) {
+        jobs_wait(world->jobs, &world->batch_group);
+        world_finish_batch(world, frame);
+    }
+
+    // Everything from here is measured in chunks
+    float eye[3], forward[3];
+    float length = 0.0f;
+    for (i=0; i<3; i++) {
+        eye[i] = camera->eye[i] / VOXEL_CHUNK_SIZE;
+        forward[i] = camera->center[i] - camera->eye[i];
+        length += forward[i] * forward[i];
+    }
+    length = length > 0.0f ? 1.0f / sqrtf(length) : 0.0f;
+    for (i=0; i<3; i++)
+        forward[i] *= length;
+
+    world_unload(world, eye, forward, frame);
+    world_upload(world, frame);
+
+    // Nothing of the edits left to mesh, so what was staged went up this
+    // frame, unless they all fell out of range first
+    struct world_edit_clock* clock = &world->applied_clock;
+    if (clock->running && world->edit_waiting == 0) {
+        if (world->edit_staged > 0) {
+            struct world_stats* stats = &world->stats;
+            uint32_t frames = world->update_count - clock->update;
+            double ms = (util_time() - clock->time) * 1000.0;
+            stats->edit_swaps++;
+            stats->edit_latency_frames += frames;
+            stats->max_edit_latency_frames = MAX(
+                stats->max_edit_latency_frames,
+                frames
+            );
+            stats->edit_latency_ms += ms;
+            stats->max_edit_latency_ms = MAX(stats->max_edit_latency_ms, ms);
+        }
+        clock->running = false;
+    }
+
+    // Edits made meanwhile go in the next set, so one that keeps growing
+    // doesn't hold back what was already meshed
+    if (!world->batch_running) {
+        if (!clock->running)
+            world_apply_edits(world);
+        world_start_batch(world, eye, forward);
+    }
+    world_select_draws(world, eye, forward);
+}
+
+void world_edit(struct world* world, const struct voxel_edit* edit)
+{
+    if (!world->queued_clock.running) {
+        world->queued_clock.running = true;
+        world->queued_clock.update = world->update_count;
+        world->queued_clock.time = util_time();
+    }
+
+    if (world->edit_count == world->edit_capacity) {
+        world->edit_capacity = world->edit_capacity ?
+            world->edit_capacity * 2 : 16;
+        world->edits = realloc(
+            world->edits,
+            world->edit_capacity * sizeof(*world->edits)
+        );
+        assert(world->edits);
+    }
+
+    world->edits[world->edit_count++] = *edit;
+}
+
+void world_record_draws(struct world* world, VkCommandBuffer cmd)
+{
+    if (world->stats.draw_count == 0)
+        return;
+
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd, 0, 1, &world->pool.buffer, offsets);
+    vkCmdBindIndexBuffer(cmd, world->pool.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    uint32_t i;
+    for (i=0; i<world->stats.draw_count; i++) {
+        struct world_chunk* chunk = world->draws[i];
+        vkCmdDrawIndexed(
+            cmd,
+            chunk->index_count,
+            1,
+            chunk->first_index,
+            chunk->vertex_offset,
+            0
+        );
+    }
+}
+
+void world_destroy(struct world* world)
+{
+    if (world->batch_running)
+        jobs_wait(world->jobs, &world->batch_group);
+
+    uint32_t i;
+    for (i=0; i<world->frame_count; i++) {
+        vkFreeCommandBuffers(
+            world->device,
+            world->command_pool,
+            1,
+            &world->frames[i].cmd
+        );
+        free(world->frames[i].retired);
+    }
+
+    for (i=0; i<world->arena_count; i++) {
+        struct world_arena* arena = &world->arenas[i];
+        vkUnmapMemory(world->device, arena->buffer.memory);
+        vkDestroyBuffer(world->device, arena->buffer.buffer, NULL);
+        renderer_free_memory(
+            world->device,
+            world->memory,
+            arena->buffer.memory
+        );
+    }
+
+    vkDestroyBuffer(world->device, world->pool.buffer, NULL);
+    renderer_free_memory(world->device, world->memory, world->pool.memory);
+
+    free(world->edits);
+    free(world->free_ranges);
+    free(world->draws);
+    free(world->uploads);
+    free(world->candidates);
+    free(world->chunks);
+    voxel_world_destroy(&world->voxels);
+}
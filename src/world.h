@@ -0,0 +1,263 @@
+#ifndef WORLD_H_
+#define WORLD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "renderer.h"
+#include "jobs.h"
+#include "cave.h"
+#include "voxel.h"
+#include "mesher.h"
+
+// Chunks within the load radius of the camera, in chunks, are meshed and
+// drawn. Meshes are dropped only past the radius plus the margin, so
+// walking back and forth over the edge doesn't reload them
+#define WORLD_LOAD_RADIUS 10.0f
+#define WORLD_UNLOAD_MARGIN 1.0f
+
+// Chunks nearer than this, in chunks, are meshed at full detail, and each
+// doubling of the distance past it halves the detail again. Rings are
+// wider than a chunk's diagonal, so neighbours are at most a level apart
+// and their skirts cover the gap. A chunk only changes level once it's
+// the margin past a boundary
+#define WORLD_LOD_DISTANCE 2.0f
+#define WORLD_LOD_MARGIN 0.25f
+
+// Voxels reach one chunk and a bit further, far enough to cover every
+// neighbour meshing reads from, and are kept to that plus the margin
+#define WORLD_VOXEL_RADIUS (WORLD_LOAD_RADIUS + 2.0f)
+
+// Records sit in a ring the size of the grid on each axis, indexed by
+// chunk coordinate, which must be wider than the kept region
+#define WORLD_GRID_SHIFT 5
+#define WORLD_GRID (1 << WORLD_GRID_SHIFT)
+
+// Chunks straight ahead count as this share nearer than they are
+#define WORLD_VIEW_WEIGHT 0.5f
+
+// Mesh bytes copied to the GPU per frame, at least one mesh always goes
+#define WORLD_UPLOAD_BYTES_PER_FRAME (2 * 1024 * 1024)
+
+// Meshing jobs write into staging arenas a batch at a time, the arena
+// is reused once its meshes are all copied out and those frames retired.
+// There's one more than frames in flight, so a batch can start each frame
+#define WORLD_ARENA_BYTES (16 * 1024 * 1024)
+#define WORLD_MAX_BATCH 64
+
+// Every resident mesh shares one buffer, vertices then indices, handed
+// out in blocks that keep vertices and indices aligned to their size
+#define WORLD_POOL_BYTES (256 * 1024 * 1024)
+#define WORLD_POOL_BLOCK (16 * sizeof(struct renderer_vertex))
+
+#define WORLD_MAX_FRAMES 8
+
+enum world_chunk_state
+{
+    WORLD_CHUNK_UNLOADED,
+    // A job is filling in the voxels
+    WORLD_CHUNK_GENERATING,
+    // Voxels are in the store, meshed once the neighbours are too
+    WORLD_CHUNK_GENERATED
+};
+
+struct world_range
+{
+    uint32_t first_block;
+    uint32_t block_count;
+};
+
+struct world_chunk
+{
+    int32_t coord[3];
+    enum world_chunk_state state;
+    struct voxel_chunk* voxels;
+    float priority;
+
+    // Level of detail by distance, the mesh is made again once it or a
+    // neighbour's changes and its skirts with them
+    uint32_t lod;
+
+    // The mesh matches the voxels, whether resident, staged or empty
+    bool meshed;
+    bool meshing;
+    // Meshed again for an edit, ahead of everything else. Every edited
+    // chunk's mesh is held until all of them are staged, then they're
+    // uploaded in one frame regardless of the frame's cap
+    bool edited;
+    // Written by the job, waiting in the arena for an upload
+    bool staged;
+    uint32_t arena;
+    struct mesher_mesh mesh;
+
+    // Drawn from the pool until a newer mesh replaces it
+    bool resident;
+    struct world_range range;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t index_count;
+    float bounds[4];
+};
+
+struct world_arena
+{
+    struct renderer_buffer buffer;
+    struct mesher_arena arena;
+    // Meshes not yet copied out, and frames whose copies may still read it
+    uint32_t staged_count;
+    uint32_t frame_mask;
+};
+
+// Pool ranges freed by a frame, returned once the frame's fence says
+// nothing in flight still draws from them
+struct world_frame
+{
+    VkCommandBuffer cmd;
+    struct world_range* retired;
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+};
+
+// Either fills in a chunk's voxels or meshes it
+struct world_job
+{
+    struct world* world;
+    struct world_chunk* chunk;
+    bool generate;
+    struct mesher_job mesh;
+};
+
+// Chunk missing voxels or a mesh, the lowest priority goes first
+struct world_candidate
+{
+    int32_t coord[3];
+    float priority;
+    bool generate;
+    bool edited;
+};
+
+struct world_stats
+{
+    uint32_t resident_chunks;
+    uint64_t resident_bytes;
+    uint32_t staged_chunks;
+    uint32_t draw_count;
+    uint32_t triangle_count;
+    uint64_t generated;
+    uint64_t meshed;
+    uint64_t lod_changes;
+    uint64_t uploads;
+    uint64_t upload_bytes;
+    uint64_t peak_frame_upload_bytes;
+    uint64_t unloads;
+    uint64_t pool_full;
+    // Edits drawn, from world_edit to the update that uploads them, and
+    // edits uploaded in parts because they filled every staging arena
+    uint64_t edit_swaps;
+    uint64_t edit_latency_frames;
+    uint32_t max_edit_latency_frames;
+    double edit_latency_ms;
+    double max_edit_latency_ms;
+    uint64_t edit_splits;
+};
+
+// When the oldest edit not yet drawn was made
+struct world_edit_clock
+{
+    bool running;
+    uint64_t update;
+    double time;
+};
+
+struct world
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+    struct renderer_memory* memory;
+    struct job_pool* jobs;
+    enum mesher_method method;
+
+    struct cave cave;
+    struct voxel_world voxels;
+    struct world_chunk* chunks;
+
+    // Jobs run a batch at a time, the voxel store only changes between
+    // batches since meshing reads it from the workers
+    struct job_group batch_group;
+    bool batch_running;
+    struct world_job batch[WORLD_MAX_BATCH];
+    uint32_t batch_count;
+    struct world_candidate* candidates;
+
+    // Applied before the next batch starts
+    struct voxel_edit* edits;
+    uint32_t edit_count;
+    uint32_t edit_capacity;
+
+    // Edited chunks still to be meshed and those staged, counted each
+    // update, and clocks for edits queued and applied but not drawn
+    uint32_t edit_waiting;
+    uint32_t edit_staged;
+    struct world_edit_clock queued_clock;
+    struct world_edit_clock applied_clock;
+    uint64_t update_count;
+
+    struct world_arena arenas[WORLD_MAX_FRAMES + 1];
+    uint32_t arena_count;
+
+    struct renderer_buffer pool;
+    struct world_range* free_ranges;
+    uint32_t free_range_count;
+    uint32_t free_range_capacity;
+
+    struct world_frame frames[WORLD_MAX_FRAMES];
+    uint32_t frame_count;
+
+    // Staged chunks by priority, then resident chunks in front of the
+    // camera this frame
+    struct world_chunk** uploads;
+    uint32_t upload_count;
+    struct world_chunk** draws;
+
+    struct world_stats stats;
+};
+
+// frame_count is how many frames can be in flight, each one is passed to
+// world_update by index after its fence is waited on
+void world_init(
+    struct world* world,
+    VkPhysicalDevice physical_device,
+    VkDevice device,
+    VkQueue queue,
+    VkCommandPool command_pool,
+    struct renderer_memory* memory,
+    struct job_pool* jobs,
+    uint32_t frame_count,
+    enum mesher_method method,
+    uint64_t seed
+);
+
+// Unloads what fell behind, starts jobs for what's missing nearest and
+// most in view first, and submits this frame's capped share of uploads
+// ahead of the frame's own commands
+void world_update(
+    struct world* world,
+    const struct renderer_camera* camera,
+    uint32_t frame
+);
+
+// Queued until no batch is running and the last edit is drawn, then the
+// changed chunks are meshed again. Their old meshes are drawn until the
+// first update that has every new one staged, which draws them all at
+// once. Only loaded voxels change, and only until their chunk unloads
+void world_edit(struct world* world, const struct voxel_edit* edit);
+
+// Inside a render pass with the pipeline and descriptor sets bound
+void world_record_draws(struct world* world, VkCommandBuffer cmd);
+
+// The device must be idle
+void world_destroy(struct world* world);
+
+#endif